@@ -16,7 +16,7 @@ set Win32FileOutputs=/Fe%BuildFolder%\StickCNote /Fo%BuildFolder%\StickCNote /Fd
 
 set AppFileOutputs=/Fe%BuildFolder%\ /Fo%BuildFolder%\ /Fd%BuildFolder%\
 
-set Libs=user32.lib kernel32.lib gdi32.lib Shell32.lib
+set Libs=user32.lib kernel32.lib gdi32.lib Shell32.lib Ole32.lib windowscodecs.lib
 
 set Resources="./resources/win32_resources.res"
 
@@ -26,7 +26,7 @@ set CommonCompilerFlags=/MTd /nologo /GL /GR- /EHsc /Od /Oi /W4 /wd4200 /wd4201
 
 set CommonLinkerFlags=/Fm%BuildFolder%\ /link %Libs%
 
-cl %CommonCompilerFlags% %AppFileOutputs% src/scn.cpp /LD %CommonLinkerFlags% /PDB:%BuildFolder%\app_%random%.pdb /EXPORT:UpdateBackBuffer /EXPORT:RespondToMouse /EXPORT:RespondToKeyboard /EXPORT:SeedRandPcg
+cl %CommonCompilerFlags% %AppFileOutputs% src/scn.cpp /LD %CommonLinkerFlags% /PDB:%BuildFolder%\app_%random%.pdb /EXPORT:UpdateBackBuffer /EXPORT:SeedRandPcg /EXPORT:SaveBoard /EXPORT:LoadBoard
 
 cl %CommonCompilerFlags% %Win32FileOutputs% src/win32/win32_main.cpp %Resources% %CommonLinkerFlags%
 
@@ -11,11 +11,24 @@
 #define APP_DLL_TEMP_NAME_CHAR "scn_temp.dll"
 #define APP_DLL_TEMP_NAME_TEXT TEXT(APP_DLL_TEMP_NAME_CHAR)
 
+// NOTE(ingar): Saved boards, relative to the directory of the executable
+#define SCN_IMAGE_NAME_TEXT      TEXT("scn_board.img")
+#define SCN_IMAGE_TEMP_NAME_TEXT TEXT("scn_board.img.tmp")
+#define SCN_BOARD_NAME_TEXT      TEXT("scn_board.scnb")
+
+#define SCN_FONT_PATH_CHAR "c:/windows/fonts/arialbd.ttf"
+#define SCN_FONT_PATH_TEXT TEXT(SCN_FONT_PATH_CHAR)
+
+// NOTE(ingar): Relative to the directory of the executable
+#define SCN_PALETTE_NAME_CHAR "..\\resources\\palette.png"
+#define SCN_PALETTE_NAME_TEXT TEXT(SCN_PALETTE_NAME_CHAR)
+
 #define MADDER_RED     0x9B0E2C
 #define SNOW_WHITE     0xFBF5F6
 #define MOONSTONE_CYAN 0x319DAE
 #define PRUSSIAN_BLUE  0x143651
 #define SCN_BG_COLOR   (PRUSSIAN_BLUE)
 #define FRENCH_ROSE    0xEB5B95
+#define SHADOW_BLACK   0x000000
 
 #endif // CONSTS_H_
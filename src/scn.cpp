@@ -5,6 +5,7 @@
 #include "isa.h"
 #include <cstdint>
 #include <cstring>
+#include <cstdio>
 
 ISA_LOG_REGISTER(Scn);
 
@@ -19,51 +20,1505 @@ ISA_LOG_REGISTER(Scn);
 #include "scn_math.h"
 #include "scn_intrinsics.h"
 #include "scn.h"
+#include "scn_font.h"
+#include "scn_text.h"
+#include "scn_note_text.h"
+#include "scn_undo.h"
+#include "scn_search.h"
+#include "scn_grid.h"
+#include "scn_zorder.h"
+#include "scn_pixels.h"
+#include "scn_background.h"
+#include "scn_upscale.h"
+#include "scn_shape.h"
+#include "scn_spans.h"
+#include "scn_surface.h"
+#include "scn_images.h"
+#include "scn_migrate.h"
+#include "scn_board.h"
+
+isa_internal void
+AddDamage(scn_state *State, rect Rect)
+{
+    damage_region *Damage = &State->Damage;
+    if(Damage->Full || !RectHasArea(Rect))
+    {
+        return;
+    }
+
+    /* Snap outwards so that rounding when drawing never leaves stale pixels at the edges */
+    Rect.Min = V2(floorf(Rect.Min.x), floorf(Rect.Min.y));
+    Rect.Max = V2(ceilf(Rect.Max.x), ceilf(Rect.Max.y));
+
+    if(Damage->Count < SCN_MAX_DAMAGE_RECTS)
+    {
+        Damage->Rects[Damage->Count++] = Rect;
+    }
+    else
+    {
+        rect *Last = Damage->Rects + (SCN_MAX_DAMAGE_RECTS - 1);
+        *Last      = RectUnion(*Last, Rect);
+    }
+}
+
+// NOTE(ingar): A note changes the pixels around it too, where its shadow falls
+isa_internal void
+AddNoteDamage(scn_state *State, rect NoteRect)
+{
+    AddDamage(State, GrowRect(NoteRect, SCN_SHADOW_MARGIN));
+}
+
+isa_internal void
+AddFullDamage(scn_state *State)
+{
+    State->Damage.Full  = true;
+    State->Damage.Count = 0;
+}
 
 isa_internal scn_state *
 InitScnState(scn_mem *Mem)
 {
-    scn_state *State = (scn_state *)Mem->Permanent;
-    if(!Mem->Initialized)
+    scn_state *State = (scn_state *)Mem->Permanent;
+    if(Mem->SessionInitialized && Mem->SessionSchemaHash != ScnSessionSchemaHash)
+    {
+        /* The code was reloaded with a different layout of the session fields, so they can not be read and are set up
+         * again. The font file they pointed to can not be found to free it, which only happens while developing. */
+        Mem->SessionInitialized = false;
+    }
+
+    if(Mem->Initialized && Mem->StateSchemaHash != ScnSchemaHash)
+    {
+        /* The code was reloaded with a different layout of the permanent state. What is in session memory is derived
+         * from it, so it is set up again for the new layout. The font file is the only thing in it that is not in
+         * the session arena. */
+        if(Mem->SessionInitialized && State->Font && State->Font->File)
+        {
+            free(State->Font->File);
+        }
+        Mem->SessionInitialized = false;
+        if(!MigrateScnState(Mem))
+        {
+            /* The board is not lost, the platform loads the portable board into the new state */
+            IsaLogError("Could not migrate the state, starting over from the portable board");
+            Mem->Initialized = false;
+            Mem->BoardLost   = true;
+        }
+    }
+
+    if(!Mem->Initialized)
+    {
+        memset(State, 0, sizeof(scn_state));
+
+        State->PermArena = IsaArenaCreate((u8 *)Mem->Permanent + SCN_STATE_RESERVED_SIZE,
+                                          Mem->PermanentMemSize - SCN_STATE_RESERVED_SIZE);
+
+        // TODO(ingar): The board can not hold more than MaxCount notes, and what is kept per note in session memory,
+        // like the layouts and the search index, is sized by it too
+        note_collection *NoteCollection = IsaPushStructZero(&State->PermArena, note_collection);
+        NoteCollection->MaxCount        = 1024;
+        NoteCollection->N               = IsaPushArray(&State->PermArena, note, NoteCollection->MaxCount);
+        NoteCollection->Selection       = IsaPushArrayZero(&State->PermArena, u64, SelectionWords(NoteCollection));
+        State->Notes                    = NoteCollection;
+
+        State->MouseHistory = IsaPushStructZero(&State->PermArena, mouse_history);
+        State->Undo         = CreateUndoLog(&State->PermArena);
+        State->Images       = CreateImageTable(&State->PermArena);
+
+        Mem->StateVersion    = SCN_STATE_VERSION;
+        Mem->StateSchemaHash = ScnSchemaHash;
+        Mem->Initialized     = true;
+    }
+
+    // NOTE(ingar): Everything in scn_state that points into session memory has to be reset here, since a state that
+    // was restored from an image still points into the session memory of the run that saved it
+    if(!Mem->SessionInitialized)
+    {
+        State->SessionArena = IsaArenaCreate((u8 *)Mem->Session, Mem->SessionMemSize);
+        State->Stbtt        = nullptr;
+
+        State->Font = IsaPushStructZero(&State->SessionArena, scn_font);
+        LoadFont(State->Font, &State->SessionArena, SCN_FONT_PATH_CHAR);
+        State->Layouts = CreateLayoutCache(&State->SessionArena, State->Notes->MaxCount + 1);
+        State->Search  = CreateSearchIndex(&State->SessionArena, State->Notes->MaxCount);
+        RebuildSearchIndex(State->Search, State->Notes);
+        State->Grid = CreateSpatialGrid(&State->SessionArena, State->Notes->MaxCount);
+        RebuildGrid(State->Grid, State->Notes);
+        State->Background   = CreateBackground(&State->SessionArena, U32Argb(SCN_BG_COLOR));
+        State->Shapes       = CreateShapeMaskCache(&State->SessionArena);
+        State->Spans        = CreateSpanBuffer(&State->SessionArena, State->Notes->MaxCount);
+        State->TextSurfaces = CreateTextSurfaceCache(&State->SessionArena, State->Notes->MaxCount);
+        State->ImageCache   = CreateImageCache(&State->SessionArena, Mem);
+
+        State->Band      = {};
+        State->Band.Bits = IsaPushArray(&State->SessionArena, u64, SelectionWords(State->Notes));
+        State->Drag      = {};
+        State->NoteMap   = IsaPushArray(&State->SessionArena, u32, State->Notes->MaxCount);
+        State->DrawBits  = IsaPushArray(&State->SessionArena, u64, SelectionWords(State->Notes));
+
+        ResetZOrder(&State->ZOrder, State->Notes);
+        State->ZOrder.Entries = IsaPushArray(&State->SessionArena, z_entry, State->Notes->MaxCount);
+
+        State->BufferW       = 0;
+        State->BufferH       = 0;
+        State->RenderDivisor = 1;
+        AddFullDamage(State);
+
+        Mem->SessionSchemaHash  = ScnSessionSchemaHash;
+        Mem->SessionInitialized = true;
+    }
+
+    return State;
+}
+
+isa_internal void
+FillNote(note *Note, rect Rect, u64 z, u32_argb Color)
+{
+    Note->Rect  = Rect;
+    Note->z     = z;
+    Note->Color = Color;
+    Note->Image = 0;
+    Note->Text  = {};
+}
+
+/* Note text */
+
+struct note_text_frame
+{
+    rect  Inner;    // The text is clipped to this
+    float Scale;    // From the reference height of the font to pixels
+    float MaxWidth; // Of a line, at the reference height
+};
+
+isa_internal note_text_frame
+NoteTextFrame(note *Note)
+{
+    note_text_frame Frame;
+    Frame.Inner.Min = V2(Note->Rect.Min.x + SCN_NOTE_TEXT_PADDING, Note->Rect.Min.y + SCN_NOTE_TEXT_PADDING);
+    Frame.Inner.Max = V2(Note->Rect.Max.x - SCN_NOTE_TEXT_PADDING, Note->Rect.Max.y - SCN_NOTE_TEXT_PADDING);
+    Frame.Scale     = SCN_NOTE_TEXT_HEIGHT / SCN_SDF_REF_HEIGHT;
+
+    float Width    = Frame.Inner.Max.x - Frame.Inner.Min.x;
+    Frame.MaxWidth = ((Width > 0.0f) ? Width : 0.0f) / Frame.Scale;
+
+    return Frame;
+}
+
+isa_internal note *
+EditedNote(scn_state *ScnState)
+{
+    note_collection *Notes = ScnState->Notes;
+    return (ScnState->Editing && Notes->SelectedNote) ? Notes->SelectedNote : nullptr;
+}
+
+// NOTE(ingar): Notes show their number until they have been given text
+inline bool
+NoteShowsText(scn_state *ScnState, note *Note)
+{
+    return NoteTextLen(&Note->Text) || (EditedNote(ScnState) == Note);
+}
+
+isa_internal text_layout *
+GetNoteTextLayout(scn_state *ScnState, note *Note)
+{
+    u64             Index = (u64)(Note - ScnState->Notes->N);
+    note_text_frame Frame = NoteTextFrame(Note);
+    return GetCachedLayout(ScnState->Layouts, ScnState->Font, Index, NoteTextView(&Note->Text), Note->Text.Stamp,
+                           Frame.MaxWidth);
+}
+
+// NOTE(ingar): The rows of lines [FirstLine, EndLine) across the whole text area
+isa_internal rect
+NoteTextLinesRect(note *Note, text_layout *Layout, u32 FirstLine, u32 EndLine)
+{
+    note_text_frame Frame = NoteTextFrame(Note);
+    float           LineH = Layout->LineAdvance * Frame.Scale;
+
+    /* Padded a little since glyphs may reach slightly outside their line */
+    rect Result = { V2(Frame.Inner.Min.x, Frame.Inner.Min.y + ((float)FirstLine * LineH) - 2.0f),
+                    V2(Frame.Inner.Max.x, Frame.Inner.Min.y + ((float)EndLine * LineH) + 2.0f) };
+    return RectIntersection(Result, Frame.Inner);
+}
+
+isa_internal rect
+NoteCaretRect(scn_state *ScnState, note *Note)
+{
+    rect         Result = {};
+    text_layout *Layout = GetNoteTextLayout(ScnState, Note);
+    if(!Layout)
+    {
+        return Result;
+    }
+
+    scn_font       *Font  = ScnState->Font;
+    note_text_frame Frame = NoteTextFrame(Note);
+    u32             Line  = FindTextLine(Layout, Note->Text.GapStart);
+    float           x     = Frame.Inner.Min.x + (TextCaretX(Layout, Font, Line, Note->Text.GapStart) * Frame.Scale);
+    float           Top   = Frame.Inner.Min.y + ((float)Line * Layout->LineAdvance * Frame.Scale);
+
+    Result.Min = V2(x - 1.0f, Top);
+    Result.Max = V2(x + 1.0f, Top + ((Font->Ascent - Font->Descent) * Frame.Scale));
+    return RectIntersection(Result, Note->Rect);
+}
+
+isa_internal void
+StartEditing(scn_state *ScnState)
+{
+    note *Note = ScnState->Notes->SelectedNote;
+    if(Note && !ScnState->Editing)
+    {
+        ScnState->Editing = true;
+        AddNoteDamage(ScnState, Note->Rect);
+    }
+}
+
+isa_internal void
+StopEditing(scn_state *ScnState)
+{
+    note *Note = EditedNote(ScnState);
+    if(Note)
+    {
+        AddNoteDamage(ScnState, Note->Rect);
+    }
+
+    ScnState->Editing = false;
+}
+
+isa_internal void
+PlaceCaret(scn_state *ScnState, note *Note, float x, float y)
+{
+    text_layout *Layout = GetNoteTextLayout(ScnState, Note);
+    if(!Layout)
+    {
+        return;
+    }
+
+    note_text_frame Frame = NoteTextFrame(Note);
+    float           Line  = (y - Frame.Inner.Min.y) / (Layout->LineAdvance * Frame.Scale);
+    Line                  = Clamp(Line, 0.0f, (float)(Layout->LineCount - 1));
+
+    AddDamage(ScnState, NoteCaretRect(ScnState, Note));
+    u64 Pos = TextHitTestLine(Layout, ScnState->Font, (u32)Line, (x - Frame.Inner.Min.x) / Frame.Scale);
+    MoveNoteCaret(&Note->Text, (u32)Pos);
+    AddDamage(ScnState, NoteCaretRect(ScnState, Note));
+}
+
+// NOTE(ingar): Lays out only the lines that the edit can have changed, and redraws only those, unless the lines below
+// them moved
+isa_internal void
+RelayoutEditedNote(scn_state *ScnState, note *Note, u64 OldStamp, u64 EditStart, u64 Removed, u64 Inserted)
+{
+    if(Note->Text.Stamp == OldStamp)
+    {
+        return;
+    }
+
+    u64             Index    = (u64)(Note - ScnState->Notes->N);
+    note_text_frame Frame    = NoteTextFrame(Note);
+    text_relayout   Relayout = RelayoutAfterEdit(ScnState->Layouts, ScnState->Font, Index, NoteTextView(&Note->Text),
+                                                 OldStamp, Note->Text.Stamp, Frame.MaxWidth, EditStart, Removed,
+                                                 Inserted);
+    if(Relayout.Full)
+    {
+        AddNoteDamage(ScnState, Note->Rect);
+        return;
+    }
+
+    text_layout *Layout = ScnState->Layouts->Layouts + Index;
+    rect         Lines  = NoteTextLinesRect(Note, Layout, Relayout.FirstLine, Relayout.NewEnd);
+    if(Relayout.OldEnd != Relayout.NewEnd)
+    {
+        Lines.Max.y = Frame.Inner.Max.y;
+    }
+
+    AddDamage(ScnState, Lines);
+}
+
+/* Selection
+ *
+ * The selection is a bitset with a bit per place in the note array, so changes to it and passes over it cost a word per
+ * 64 notes. The selected note that Enter edits is kept apart from it. */
+
+// NOTE(ingar): Without redrawing, for when the selected notes were taken off the board
+isa_internal void
+ResetSelection(note_collection *Notes)
+{
+    memset(Notes->Selection, 0, SelectionWords(Notes) * sizeof(u64));
+    Notes->SelectionCount = 0;
+    Notes->SelectedNote   = nullptr;
+}
+
+isa_internal void
+ClearSelection(scn_state *ScnState)
+{
+    note_collection *Notes = ScnState->Notes;
+    StopEditing(ScnState);
+
+    u64 Words = SelectionWords(Notes);
+    for(u64 Word = 0; Word < Words; ++Word)
+    {
+        for(u64 Bits = Notes->Selection[Word]; Bits; Bits &= Bits - 1)
+        {
+            AddNoteDamage(ScnState, Notes->N[(Word * 64) + CountTrailingZerosu64(Bits)].Rect);
+        }
+    }
+
+    ResetSelection(Notes);
+}
+
+// NOTE(ingar): Adds the note to the selection and makes it the one that Enter edits
+isa_internal void
+SelectNote(scn_state *ScnState, u64 Index)
+{
+    note_collection *Notes = ScnState->Notes;
+    if(!IsNoteSelected(Notes, Index))
+    {
+        Notes->Selection[Index / 64] |= 1ULL << (Index % 64);
+        Notes->SelectionCount++;
+    }
+
+    Notes->SelectedNote = Notes->N + Index;
+    AddNoteDamage(ScnState, Notes->SelectedNote->Rect);
+}
+
+// NOTE(ingar): Replaces the selection with the notes in Bits
+isa_internal void
+SetSelection(scn_state *ScnState, u64 *Bits)
+{
+    note_collection *Notes = ScnState->Notes;
+    ClearSelection(ScnState);
+
+    u64 Words = SelectionWords(Notes);
+    for(u64 Word = 0; Word < Words; ++Word)
+    {
+        Notes->Selection[Word] = Bits[Word];
+        Notes->SelectionCount += PopCountu64(Bits[Word]);
+        for(u64 Set = Bits[Word]; Set; Set &= Set - 1)
+        {
+            AddNoteDamage(ScnState, Notes->N[(Word * 64) + CountTrailingZerosu64(Set)].Rect);
+        }
+    }
+}
+
+isa_internal void
+SelectAll(scn_state *ScnState)
+{
+    note_collection *Notes = ScnState->Notes;
+    StopEditing(ScnState);
+
+    memset(Notes->Selection, 0, SelectionWords(Notes) * sizeof(u64));
+    for(u64 i = 0; i < Notes->Count; ++i)
+    {
+        Notes->Selection[i / 64] |= 1ULL << (i % 64);
+    }
+    Notes->SelectionCount = Notes->Count;
+
+    AddFullDamage(ScnState);
+}
+
+// NOTE(ingar): Index of the topmost note under the point, or -1
+inline i64
+TopNoteAt(scn_state *ScnState, float x, float y)
+{
+    return PickGridNote(ScnState->Grid, ScnState->Notes, x, y);
+}
+
+/* Rubber band */
+
+inline rect
+BandRect(rubber_band *Band)
+{
+    rect Start = { Band->Start, Band->Start };
+    rect End   = { Band->End, Band->End };
+    return RectUnion(Start, End);
+}
+
+// NOTE(ingar): Only the edges, so that dragging a large band does not redraw what is inside it
+isa_internal void
+AddOutlineDamage(scn_state *ScnState, rect Rect, float Width)
+{
+    v2 Min = Rect.Min;
+    v2 Max = Rect.Max;
+
+    AddDamage(ScnState, { Min, V2(Max.x, Min.y + Width) });
+    AddDamage(ScnState, { V2(Min.x, Max.y - Width), Max });
+    AddDamage(ScnState, { Min, V2(Min.x + Width, Max.y) });
+    AddDamage(ScnState, { V2(Max.x - Width, Min.y), Max });
+}
+
+isa_internal void
+StartBand(scn_state *ScnState, v2 Pos)
+{
+    ClearSelection(ScnState);
+
+    rubber_band *Band = &ScnState->Band;
+    Band->Active      = true;
+    Band->Start       = Pos;
+    Band->End         = Pos;
+}
+
+// NOTE(ingar): The selection becomes the notes that overlap the band, found with a query against the grid. Only the
+// notes that were selected or deselected by the move are redrawn.
+isa_internal void
+UpdateBand(scn_state *ScnState, v2 Pos)
+{
+    rubber_band     *Band  = &ScnState->Band;
+    note_collection *Notes = ScnState->Notes;
+    u64              Words = SelectionWords(Notes);
+
+    AddOutlineDamage(ScnState, BandRect(Band), SCN_BAND_OUTLINE);
+    Band->End = Pos;
+    AddOutlineDamage(ScnState, BandRect(Band), SCN_BAND_OUTLINE);
+
+    memset(Band->Bits, 0, Words * sizeof(u64));
+    QueryGrid(ScnState->Grid, Notes, BandRect(Band), Band->Bits);
+
+    Notes->SelectionCount = 0;
+    for(u64 Word = 0; Word < Words; ++Word)
+    {
+        for(u64 Changed = Notes->Selection[Word] ^ Band->Bits[Word]; Changed; Changed &= Changed - 1)
+        {
+            AddNoteDamage(ScnState, Notes->N[(Word * 64) + CountTrailingZerosu64(Changed)].Rect);
+        }
+
+        Notes->Selection[Word] = Band->Bits[Word];
+        Notes->SelectionCount += PopCountu64(Band->Bits[Word]);
+    }
+}
+
+isa_internal void
+StopBand(scn_state *ScnState)
+{
+    rubber_band *Band = &ScnState->Band;
+    AddOutlineDamage(ScnState, BandRect(Band), SCN_BAND_OUTLINE);
+    Band->Active = false;
+}
+
+/* Search */
+
+// NOTE(ingar): The query is laid out in the slot after the notes
+isa_internal text_layout *
+GetSearchBarLayout(scn_state *ScnState)
+{
+    search_index *Search = ScnState->Search;
+    return GetCachedLayout(ScnState->Layouts, ScnState->Font, ScnState->Notes->MaxCount,
+                           TextView(Search->Query, Search->QueryLen), HashText(Search->Query, Search->QueryLen),
+                           SCN_TEXT_NO_WRAP);
+}
+
+isa_internal rect
+SearchBarRect(scn_state *ScnState)
+{
+    rect Result = {};
+    if(!ScnState->Search->Active)
+    {
+        return Result;
+    }
+
+    text_layout *Layout = GetSearchBarLayout(ScnState);
+    float        Scale  = SCN_NOTE_TEXT_HEIGHT / SCN_SDF_REF_HEIGHT;
+    float        TextW  = Layout ? Layout->Width * Scale : 0.0f;
+    float        Width  = TextW + (3.0f * SCN_NOTE_TEXT_PADDING);
+
+    Result.Min = V2(SCN_NOTE_TEXT_PADDING, SCN_NOTE_TEXT_PADDING);
+    Result.Max = V2(Result.Min.x + ((Width > SCN_SEARCH_BAR_MIN_WIDTH) ? Width : SCN_SEARCH_BAR_MIN_WIDTH),
+                    Result.Min.y + SCN_NOTE_TEXT_HEIGHT + (2.0f * SCN_NOTE_TEXT_PADDING));
+    return Result;
+}
+
+// NOTE(ingar): Runs the query again and redraws the notes that started or stopped matching
+isa_internal void
+RefreshSearch(scn_state *ScnState)
+{
+    search_index    *Search = ScnState->Search;
+    note_collection *Notes  = ScnState->Notes;
+
+    RunSearch(Search, Notes);
+    for(u64 i = 0; i < Notes->Count; ++i)
+    {
+        if(((Search->Matches[i / 64] ^ Search->PrevMatches[i / 64]) >> (i % 64)) & 1)
+        {
+            AddNoteDamage(ScnState, Notes->N[i].Rect);
+        }
+    }
+}
+
+isa_internal void
+StartSearch(scn_state *ScnState)
+{
+    search_index *Search = ScnState->Search;
+    Search->Active       = true;
+    Search->QueryLen     = 0;
+
+    AddDamage(ScnState, SearchBarRect(ScnState));
+    RefreshSearch(ScnState);
+}
+
+isa_internal void
+StopSearch(scn_state *ScnState)
+{
+    AddDamage(ScnState, SearchBarRect(ScnState));
+    ScnState->Search->Active = false;
+    RefreshSearch(ScnState);
+}
+
+isa_internal void
+ChangeSearchQuery(scn_state *ScnState, const u8 *Append, u32 AppendSize, u32 RemoveSize)
+{
+    search_index *Search = ScnState->Search;
+    if((Search->QueryLen - RemoveSize + AppendSize) > SCN_SEARCH_MAX_QUERY)
+    {
+        return;
+    }
+
+    AddDamage(ScnState, SearchBarRect(ScnState));
+    Search->QueryLen -= RemoveSize;
+    memcpy(Search->Query + Search->QueryLen, Append, AppendSize);
+    Search->QueryLen += AppendSize;
+    AddDamage(ScnState, SearchBarRect(ScnState));
+
+    RefreshSearch(ScnState);
+}
+
+// NOTE(ingar): Returns false for keys that searching does not use
+isa_internal bool
+RespondToSearchKey(scn_state *ScnState, scn_keyboard_event Event)
+{
+    search_index    *Search = ScnState->Search;
+    note_collection *Notes  = ScnState->Notes;
+
+    /* Keys that type characters are handled by the char events they produce */
+    if((Event.Type >= ScnKeyboardEvent_A && Event.Type <= ScnKeyboardEvent_Z)
+       || (Event.Type >= ScnKeyboardEvent_0 && Event.Type <= ScnKeyboardEvent_9)
+       || Event.Type == ScnKeyboardEvent_Spacebar || Event.Type == ScnKeyboardEvent_Unhandled)
+    {
+        return true;
+    }
+
+    switch(Event.Type)
+    {
+        case ScnKeyboardEvent_Back:
+            {
+                u32 Size = 0;
+                while(Size < Search->QueryLen)
+                {
+                    ++Size;
+                    if(!IsUtf8Continuation(Search->Query[Search->QueryLen - Size]))
+                    {
+                        break;
+                    }
+                }
+                ChangeSearchQuery(ScnState, nullptr, 0, Size);
+            }
+            break;
+        case ScnKeyboardEvent_Enter:
+            {
+                /* Selects the topmost match */
+                i64 Top = -1;
+                for(u64 i = 0; i < Notes->Count; ++i)
+                {
+                    if(NoteMatchesSearch(Search, i) && (Top < 0 || Notes->N[i].z > Notes->N[Top].z))
+                    {
+                        Top = (i64)i;
+                    }
+                }
+                if(Top >= 0)
+                {
+                    ClearSelection(ScnState);
+                    SelectNote(ScnState, (u64)Top);
+                }
+                StopSearch(ScnState);
+            }
+            break;
+        case ScnKeyboardEvent_Escape:
+            {
+                StopSearch(ScnState);
+            }
+            break;
+        default:
+            {
+                return false;
+            }
+            break;
+    }
+
+    return true;
+}
+
+// NOTE(ingar): Called after every change to the text of a note. RemovedBytes are the Removed bytes that were taken out.
+isa_internal void
+NoteTextChanged(scn_state *ScnState, note *Note, u64 OldStamp, u64 EditStart, const u8 *RemovedBytes, u64 Removed,
+                u64 Inserted)
+{
+    RelayoutEditedNote(ScnState, Note, OldStamp, EditStart, Removed, Inserted);
+
+    IndexNoteEdit(ScnState->Search, (u64)(Note - ScnState->Notes->N), &Note->Text, OldStamp, EditStart, RemovedBytes,
+                  Removed, Inserted);
+    if(ScnState->Search->Active)
+    {
+        RefreshSearch(ScnState);
+    }
+}
+
+isa_internal void
+InsertIntoEditedNote(scn_state *ScnState, const u8 *Bytes, u32 Size)
+{
+    note *Note = EditedNote(ScnState);
+    if(!Note)
+    {
+        return;
+    }
+
+    u64 OldStamp  = Note->Text.Stamp;
+    u32 EditStart = Note->Text.GapStart;
+    if(InsertNoteText(&ScnState->TextAllocator, &ScnState->PermArena, &Note->Text, Bytes, Size))
+    {
+        RecordInsertText(ScnState, (u64)(Note - ScnState->Notes->N), EditStart, Bytes, Size);
+        NoteTextChanged(ScnState, Note, OldStamp, EditStart, nullptr, 0, Size);
+    }
+}
+
+// NOTE(ingar): Returns false for keys that editing does not use, so that they can be handled as commands
+isa_internal bool
+RespondToEditingKey(scn_state *ScnState, scn_keyboard_event Event)
+{
+    note *Note = EditedNote(ScnState);
+    if(!Note)
+    {
+        return false;
+    }
+
+    /* Keys that type characters are handled by the char events they produce, and must not run commands */
+    if((Event.Type >= ScnKeyboardEvent_A && Event.Type <= ScnKeyboardEvent_Z)
+       || (Event.Type >= ScnKeyboardEvent_0 && Event.Type <= ScnKeyboardEvent_9)
+       || Event.Type == ScnKeyboardEvent_Spacebar || Event.Type == ScnKeyboardEvent_Unhandled)
+    {
+        return true;
+    }
+
+    /* Control characters are not sent as char events */
+    u8 Char = (Event.Type == ScnKeyboardEvent_Enter) ? '\n' : 0;
+
+    note_text *Text     = &Note->Text;
+    u64        Index    = (u64)(Note - ScnState->Notes->N);
+    rect       OldCaret = NoteCaretRect(ScnState, Note);
+    u64        OldStamp = Text->Stamp;
+    if(Char)
+    {
+        InsertIntoEditedNote(ScnState, &Char, 1);
+    }
+    else
+    {
+        switch(Event.Type)
+        {
+            case ScnKeyboardEvent_Back:
+                {
+                    /* The deleted bytes are left where they were, at the start of the gap */
+                    u32 Removed = DeleteNoteTextBackward(&ScnState->TextAllocator, Text);
+                    if(Removed)
+                    {
+                        RecordDeleteText(ScnState, Index, Text->GapStart, Text->Data + Text->GapStart, Removed);
+                    }
+                    NoteTextChanged(ScnState, Note, OldStamp, Text->GapStart, Text->Data + Text->GapStart, Removed, 0);
+                }
+                break;
+            case ScnKeyboardEvent_Delete:
+                {
+                    /* Or at the end of it */
+                    u32 Removed = DeleteNoteTextForward(&ScnState->TextAllocator, Text);
+                    if(Removed)
+                    {
+                        RecordDeleteText(ScnState, Index, Text->GapStart, Text->Data + Text->GapEnd - Removed, Removed);
+                    }
+                    NoteTextChanged(ScnState, Note, OldStamp, Text->GapStart, Text->Data + Text->GapEnd - Removed,
+                                    Removed, 0);
+                }
+                break;
+            case ScnKeyboardEvent_Left:
+                {
+                    MoveNoteCaret(Text, Text->GapStart - PrevCodepointSize(Text));
+                }
+                break;
+            case ScnKeyboardEvent_Right:
+                {
+                    MoveNoteCaret(Text, Text->GapStart + NextCodepointSize(Text));
+                }
+                break;
+            case ScnKeyboardEvent_Up:
+            case ScnKeyboardEvent_Down:
+            case ScnKeyboardEvent_Home:
+            case ScnKeyboardEvent_End:
+                {
+                    text_layout *Layout = GetNoteTextLayout(ScnState, Note);
+                    if(!Layout)
+                    {
+                        break;
+                    }
+
+                    u32 Line = FindTextLine(Layout, Text->GapStart);
+                    if(Event.Type == ScnKeyboardEvent_Home)
+                    {
+                        MoveNoteCaret(Text, Layout->Lines[Line].ByteStart);
+                    }
+                    else if(Event.Type == ScnKeyboardEvent_End)
+                    {
+                        MoveNoteCaret(Text, (u32)TextHitTestLine(Layout, ScnState->Font, Line, FLT_MAX));
+                    }
+                    else
+                    {
+                        bool Up     = (Event.Type == ScnKeyboardEvent_Up);
+                        u32  Target = Up ? Line - 1 : Line + 1;
+                        if((Up && Line == 0) || (!Up && Target >= Layout->LineCount))
+                        {
+                            break;
+                        }
+
+                        float x = TextCaretX(Layout, ScnState->Font, Line, Text->GapStart);
+                        MoveNoteCaret(Text, (u32)TextHitTestLine(Layout, ScnState->Font, Target, x));
+                    }
+                }
+                break;
+            case ScnKeyboardEvent_Escape:
+                {
+                    StopEditing(ScnState);
+                }
+                break;
+            default:
+                {
+                    return false;
+                }
+                break;
+        }
+    }
+
+    /* The caret may have moved to lines that were not laid out again */
+    AddDamage(ScnState, OldCaret);
+    if(EditedNote(ScnState))
+    {
+        AddDamage(ScnState, NoteCaretRect(ScnState, Note));
+    }
+
+    return true;
+}
+
+isa_internal void
+RespondToChar(scn_state *ScnState, scn_char_event Event)
+{
+    u8  Bytes[4];
+    u32 Size = EncodeUtf8(Event.Codepoint, Bytes);
+
+    note *Note = EditedNote(ScnState);
+    if(!Note)
+    {
+        if(ScnState->Search->Active)
+        {
+            ChangeSearchQuery(ScnState, Bytes, Size, 0);
+        }
+        return;
+    }
+
+    rect OldCaret = NoteCaretRect(ScnState, Note);
+    InsertIntoEditedNote(ScnState, Bytes, Size);
+
+    AddDamage(ScnState, OldCaret);
+    AddDamage(ScnState, NoteCaretRect(ScnState, Note));
+}
+
+/* Changes to many notes
+ *
+ * These take the notes to change as selection bits, so that they can be given both the selection and the copy of it in
+ * an undo record, and make one pass over the bits or the notes. */
+
+inline u64
+CountBits(u64 *Bits, u64 Words)
+{
+    u64 Result = 0;
+    for(u64 Word = 0; Word < Words; ++Word)
+    {
+        Result += PopCountu64(Bits[Word]);
+    }
+
+    return Result;
+}
+
+// NOTE(ingar): Stacks the notes in Bits right above Base, keeping their order among themselves. No other note changes.
+isa_internal void
+RestackNotes(scn_state *ScnState, u64 *Bits, u64 Base)
+{
+    note_collection *Notes   = ScnState->Notes;
+    z_entry         *Entries = ScnState->ZOrder.Entries;
+    u64              Count   = SortNotesByZ(Notes, Bits, Entries);
+    for(u64 j = 0; j < Count; ++j)
+    {
+        note *Note = Notes->N + Entries[j].Note;
+        Note->z    = Base + ((j + 1) * SCN_Z_GAP);
+        AddNoteDamage(ScnState, Note->Rect);
+    }
+}
+
+// NOTE(ingar): Zs has a z for each note, in the order of the bits
+isa_internal void
+SetNotesZ(scn_state *ScnState, u64 *Bits, u64 *Zs)
+{
+    note_collection *Notes = ScnState->Notes;
+    u64              Words = SelectionWords(Notes);
+    for(u64 Word = 0; Word < Words; ++Word)
+    {
+        for(u64 Set = Bits[Word]; Set; Set &= Set - 1)
+        {
+            note *Note = Notes->N + (Word * 64) + CountTrailingZerosu64(Set);
+            Note->z    = *Zs++;
+            AddNoteDamage(ScnState, Note->Rect);
+        }
+    }
+}
+
+// NOTE(ingar): Takes the notes in Bits off the board and into Other, in order, and returns how many there were. The
+// notes that are left close up in one pass.
+isa_internal u64
+TakeNotes(scn_state *ScnState, u64 *Bits, note *Other)
+{
+    note_collection *Notes = ScnState->Notes;
+    u32             *Map   = ScnState->NoteMap;
+
+    u64 Kept  = 0;
+    u64 Taken = 0;
+    for(u64 i = 0; i < Notes->Count; ++i)
+    {
+        if((Bits[i / 64] >> (i % 64)) & 1)
+        {
+            AddNoteDamage(ScnState, Notes->N[i].Rect);
+            Other[Taken++] = Notes->N[i];
+            Map[i]         = UINT32_MAX;
+        }
+        else
+        {
+            Notes->N[Kept] = Notes->N[i];
+            Map[i]         = (u32)Kept++;
+        }
+    }
+
+    RenumberSearchNotes(ScnState->Search, Map, Notes->Count);
+    RenumberGrid(ScnState->Grid, Map, Notes->Count);
+    Notes->Count = Kept;
+    if(ScnState->Search->Active)
+    {
+        RefreshSearch(ScnState);
+    }
+
+    return Taken;
+}
+
+// NOTE(ingar): The inverse of TakeNotes. Puts the notes in Other back at the places that Bits gives, moving the others
+// up in one pass from the end.
+isa_internal void
+PutBackNotes(scn_state *ScnState, u64 *Bits, note *Other, u64 OtherCount)
+{
+    note_collection *Notes = ScnState->Notes;
+    u32             *Map   = ScnState->NoteMap;
+
+    u64 Board = Notes->Count;
+    u64 Taken = OtherCount;
+    for(u64 i = Notes->Count + OtherCount; i-- > 0;)
+    {
+        if((Bits[i / 64] >> (i % 64)) & 1)
+        {
+            Notes->N[i] = Other[--Taken];
+        }
+        else
+        {
+            Map[--Board] = (u32)i;
+            Notes->N[i]  = Notes->N[Board];
+        }
+    }
+
+    RenumberSearchNotes(ScnState->Search, Map, Notes->Count);
+    RenumberGrid(ScnState->Grid, Map, Notes->Count);
+    Notes->Count += OtherCount;
+
+    u64 Words = SelectionWords(Notes);
+    for(u64 Word = 0; Word < Words; ++Word)
+    {
+        for(u64 Put = Bits[Word]; Put; Put &= Put - 1)
+        {
+            u64 i = (Word * 64) + CountTrailingZerosu64(Put);
+            IndexNoteText(ScnState->Search, i, &Notes->N[i].Text);
+            AddNoteToGrid(ScnState->Grid, i, Notes->N[i].Rect);
+            AddNoteDamage(ScnState, Notes->N[i].Rect);
+        }
+    }
+
+    if(ScnState->Search->Active)
+    {
+        RefreshSearch(ScnState);
+    }
+}
+
+isa_internal void
+MoveNotes(scn_state *ScnState, u64 *Bits, v2 Delta)
+{
+    note_collection *Notes = ScnState->Notes;
+    u64              Words = SelectionWords(Notes);
+    for(u64 Word = 0; Word < Words; ++Word)
+    {
+        for(u64 Moved = Bits[Word]; Moved; Moved &= Moved - 1)
+        {
+            u64   i    = (Word * 64) + CountTrailingZerosu64(Moved);
+            note *Note = Notes->N + i;
+            rect  From = Note->Rect;
+
+            Note->Rect = OffsetRect(From, Delta);
+            MoveNoteInGrid(ScnState->Grid, i, From, Note->Rect);
+
+            AddNoteDamage(ScnState, From);
+            AddNoteDamage(ScnState, Note->Rect);
+        }
+    }
+}
+
+// NOTE(ingar): Colors has a color for each note, in the order of the bits. If it is null they all get Color.
+isa_internal void
+RecolorNotes(scn_state *ScnState, u64 *Bits, u32_argb *Colors, u32_argb Color)
+{
+    note_collection *Notes = ScnState->Notes;
+    u64              Words = SelectionWords(Notes);
+    for(u64 Word = 0; Word < Words; ++Word)
+    {
+        for(u64 Recolored = Bits[Word]; Recolored; Recolored &= Recolored - 1)
+        {
+            note *Note  = Notes->N + (Word * 64) + CountTrailingZerosu64(Recolored);
+            Note->Color = Colors ? *Colors++ : Color;
+            AddNoteDamage(ScnState, Note->Rect);
+        }
+    }
+}
+
+/* Undo */
+
+// NOTE(ingar): The note at Index moves to the end. The board takes over the text of the note.
+isa_internal void
+InsertNoteAt(scn_state *ScnState, u64 Index, note *Note)
+{
+    note_collection *Notes = ScnState->Notes;
+    ClearSelection(ScnState);
+
+    InsertNoteIntoSearch(ScnState->Search, Index, Notes->Count, &Note->Text);
+    if(Index != Notes->Count)
+    {
+        RenameGridNote(ScnState->Grid, Index, Notes->Count, Notes->N[Index].Rect);
+        Notes->N[Notes->Count] = Notes->N[Index];
+    }
+    Notes->N[Index] = *Note;
+    AddNoteToGrid(ScnState->Grid, Index, Note->Rect);
+    Notes->Count++;
+
+    AddNoteDamage(ScnState, Note->Rect);
+    if(ScnState->Search->Active)
+    {
+        RefreshSearch(ScnState);
+    }
+}
+
+// NOTE(ingar): The last note moves into the place of the one that is removed, which is the inverse of InsertNoteAt.
+// The caller takes over the text of the note.
+isa_internal note
+RemoveNoteAt(scn_state *ScnState, u64 Index)
+{
+    note_collection *Notes = ScnState->Notes;
+    note             Note  = Notes->N[Index];
+    u64              Last  = Notes->Count - 1;
+    ClearSelection(ScnState);
+
+    RemoveNoteFromSearch(ScnState->Search, Index, Notes->Count);
+    RemoveNoteFromGrid(ScnState->Grid, Index, Note.Rect);
+    if(Index != Last)
+    {
+        RenameGridNote(ScnState->Grid, Last, Index, Notes->N[Last].Rect);
+        Notes->N[Index] = Notes->N[Last];
+    }
+    Notes->Count--;
+
+    AddNoteDamage(ScnState, Note.Rect);
+    if(ScnState->Search->Active)
+    {
+        RefreshSearch(ScnState);
+    }
+
+    return Note;
+}
+
+isa_internal void
+MoveNoteTo(scn_state *ScnState, u64 Index, rect Rect)
+{
+    note *Note = ScnState->Notes->N + Index;
+    AddNoteDamage(ScnState, Note->Rect);
+    MoveNoteInGrid(ScnState->Grid, Index, Note->Rect, Rect);
+    Note->Rect = Rect;
+    AddNoteDamage(ScnState, Note->Rect);
+}
+
+isa_internal void
+AttachImage(scn_state *ScnState, u64 Index, u32 Image)
+{
+    note *Note  = ScnState->Notes->N + Index;
+    Note->Image = Image;
+    AddNoteDamage(ScnState, Note->Rect);
+}
+
+// NOTE(ingar): Both directions of a clear swap the note array on the board with the one in the record
+isa_internal void
+SwapClearedNotes(scn_state *ScnState, undo_record *Record)
+{
+    note_collection *Notes = ScnState->Notes;
+    ClearSelection(ScnState);
+
+    note *Board      = Notes->N;
+    u64   BoardCount = Notes->Count;
+    Notes->N         = Record->Batch.Other;
+    Notes->Count     = Record->Batch.OtherCount;
+
+    Record->Batch.Other      = Board;
+    Record->Batch.OtherCount = BoardCount;
+    Record->Batch.TextBytes  = 0;
+    for(u64 i = 0; i < BoardCount; ++i)
+    {
+        Record->Batch.TextBytes += Board[i].Text.Capacity;
+    }
+
+    /* Costs as much as indexing the notes that came back, which is the size of the change */
+    RebuildSearchIndex(ScnState->Search, Notes);
+    RebuildGrid(ScnState->Grid, Notes);
+    if(ScnState->Search->Active)
+    {
+        RunSearch(ScnState->Search, Notes);
+    }
+
+    AddFullDamage(ScnState);
+}
+
+// NOTE(ingar): Puts the bytes of a text record back into the note, or takes them out again
+isa_internal void
+ApplyTextRecord(scn_state *ScnState, undo_record *Record, bool Insert)
+{
+    note      *Note     = ScnState->Notes->N + Record->NoteIndex;
+    note_text *Text     = &Note->Text;
+    u64        OldStamp = Text->Stamp;
+    bool       Edited   = (EditedNote(ScnState) == Note);
+    if(Edited)
+    {
+        AddDamage(ScnState, NoteCaretRect(ScnState, Note));
+    }
+
+    if(Insert)
+    {
+        MoveNoteCaret(Text, Record->Text.Pos);
+        if(!InsertNoteText(&ScnState->TextAllocator, &ScnState->PermArena, Text, UndoRecordBytes(Record),
+                           Record->Text.Len))
+        {
+            return;
+        }
+        NoteTextChanged(ScnState, Note, OldStamp, Record->Text.Pos, nullptr, 0, Record->Text.Len);
+    }
+    else
+    {
+        DeleteNoteTextRange(&ScnState->TextAllocator, Text, Record->Text.Pos, Record->Text.Len);
+        NoteTextChanged(ScnState, Note, OldStamp, Record->Text.Pos, UndoRecordBytes(Record), Record->Text.Len, 0);
+    }
+
+    if(Edited)
+    {
+        AddDamage(ScnState, NoteCaretRect(ScnState, Note));
+    }
+}
+
+isa_internal void
+Undo(scn_state *ScnState)
+{
+    undo_log    *Log    = ScnState->Undo;
+    undo_record *Record = LastUndoRecord(Log);
+    if(!Record)
     {
-        State->PermArena
-            = IsaArenaCreate((u8 *)Mem->Permanent + sizeof(scn_state), Mem->PermanentMemSize - sizeof(scn_state));
-        State->SessionArena = IsaArenaCreate((u8 *)Mem->Session, Mem->SessionMemSize);
+        return;
+    }
 
-        note_collection *NoteCollection = IsaPushStructZero(&State->PermArena, note_collection);
-        NoteCollection->MaxCount        = 1024;
-        NoteCollection->N               = IsaPushArray(&State->PermArena, note, NoteCollection->MaxCount);
-        State->Notes                    = NoteCollection;
+    Log->Retained -= UndoRecordRetained(ScnState, Record, true);
+    switch(Record->Type)
+    {
+        case UndoRecord_CreateNote:
+            {
+                note Note = RemoveNoteAt(ScnState, Record->NoteIndex);
+                FreeNoteText(&ScnState->TextAllocator, &Note.Text);
+            }
+            break;
+        case UndoRecord_DeleteNote:
+            {
+                InsertNoteAt(ScnState, Record->NoteIndex, &Record->Note);
+            }
+            break;
+        case UndoRecord_ClearNotes:
+            {
+                SwapClearedNotes(ScnState, Record);
+            }
+            break;
+        case UndoRecord_InsertText:
+            {
+                ApplyTextRecord(ScnState, Record, false);
+            }
+            break;
+        case UndoRecord_DeleteText:
+            {
+                ApplyTextRecord(ScnState, Record, true);
+            }
+            break;
+        case UndoRecord_MoveNote:
+            {
+                MoveNoteTo(ScnState, Record->NoteIndex, Record->Move.From);
+            }
+            break;
+        case UndoRecord_DeleteNotes:
+            {
+                u64 *Bits = UndoRecordSelection(Record);
+                ClearSelection(ScnState);
+                PutBackNotes(ScnState, Bits, Record->Batch.Other, Record->Batch.OtherCount);
+                Record->Batch.OtherCount = 0;
+                SetSelection(ScnState, Bits);
+            }
+            break;
+        case UndoRecord_MoveNotes:
+            {
+                u64 *Bits = UndoRecordSelection(Record);
+                MoveNotes(ScnState, Bits, -Record->Nudge.Delta);
+                SetSelection(ScnState, Bits);
+            }
+            break;
+        case UndoRecord_RecolorNotes:
+            {
+                u64      *Bits      = UndoRecordSelection(Record);
+                u32_argb *OldColors = (u32_argb *)(Bits + SelectionWords(ScnState->Notes));
+                RecolorNotes(ScnState, Bits, OldColors, Record->Recolor.Color);
+                SetSelection(ScnState, Bits);
+            }
+            break;
+        case UndoRecord_RestackNotes:
+            {
+                u64 *Bits = UndoRecordSelection(Record);
+                SetNotesZ(ScnState, Bits, Bits + SelectionWords(ScnState->Notes));
+                SetSelection(ScnState, Bits);
+            }
+            break;
+        case UndoRecord_AttachImage:
+            {
+                AttachImage(ScnState, Record->NoteIndex, Record->Attach.From);
+            }
+            break;
+        default:
+            {
+                IsaAssert(0, "Invalid undo record");
+            }
+            break;
+    }
+    Log->Retained += UndoRecordRetained(ScnState, Record, false);
 
-        State->MouseHistory = IsaPushStructZero(&State->PermArena, mouse_history);
+    Log->Head = Log->Last;
+    Log->Last = Record->Prev;
+    Log->Open = false;
+}
+
+isa_internal void
+Redo(scn_state *ScnState)
+{
+    undo_log *Log = ScnState->Undo;
+    while(Log->Head < Log->End && UndoRecordAt(Log, Log->Head)->Type == UndoRecord_Pad)
+    {
+        Log->Head += UndoRecordAt(Log, Log->Head)->Size;
+    }
+    if(Log->Head == Log->End)
+    {
+        return;
+    }
+
+    undo_record *Record = UndoRecordAt(Log, Log->Head);
+    Log->Retained -= UndoRecordRetained(ScnState, Record, false);
+    switch(Record->Type)
+    {
+        case UndoRecord_CreateNote:
+            {
+                note Note = Record->Note;
+                InsertNoteAt(ScnState, Record->NoteIndex, &Note);
+            }
+            break;
+        case UndoRecord_DeleteNote:
+            {
+                Record->Note = RemoveNoteAt(ScnState, Record->NoteIndex);
+            }
+            break;
+        case UndoRecord_ClearNotes:
+            {
+                SwapClearedNotes(ScnState, Record);
+            }
+            break;
+        case UndoRecord_InsertText:
+            {
+                ApplyTextRecord(ScnState, Record, true);
+            }
+            break;
+        case UndoRecord_DeleteText:
+            {
+                ApplyTextRecord(ScnState, Record, false);
+            }
+            break;
+        case UndoRecord_MoveNote:
+            {
+                MoveNoteTo(ScnState, Record->NoteIndex, Record->Move.To);
+            }
+            break;
+        case UndoRecord_DeleteNotes:
+            {
+                ClearSelection(ScnState);
+                Record->Batch.OtherCount = TakeNotes(ScnState, UndoRecordSelection(Record), Record->Batch.Other);
+                Record->Batch.TextBytes  = 0;
+                for(u64 i = 0; i < Record->Batch.OtherCount; ++i)
+                {
+                    Record->Batch.TextBytes += Record->Batch.Other[i].Text.Capacity;
+                }
+            }
+            break;
+        case UndoRecord_MoveNotes:
+            {
+                u64 *Bits = UndoRecordSelection(Record);
+                MoveNotes(ScnState, Bits, Record->Nudge.Delta);
+                SetSelection(ScnState, Bits);
+            }
+            break;
+        case UndoRecord_RecolorNotes:
+            {
+                u64 *Bits = UndoRecordSelection(Record);
+                RecolorNotes(ScnState, Bits, nullptr, Record->Recolor.Color);
+                SetSelection(ScnState, Bits);
+            }
+            break;
+        case UndoRecord_RestackNotes:
+            {
+                u64 *Bits = UndoRecordSelection(Record);
+                RestackNotes(ScnState, Bits, Record->Restack.Base);
+                SetSelection(ScnState, Bits);
+            }
+            break;
+        case UndoRecord_AttachImage:
+            {
+                AttachImage(ScnState, Record->NoteIndex, Record->Attach.To);
+            }
+            break;
+        default:
+            {
+                IsaAssert(0, "Invalid undo record");
+            }
+            break;
+    }
+    Log->Retained += UndoRecordRetained(ScnState, Record, true);
+
+    Log->Last = Log->Head;
+    Log->Head += Record->Size;
+    Log->Open = false;
+    TrimUndoLog(ScnState);
+}
+
+/* Commands on the selection */
+
+isa_internal void
+DeleteSelection(scn_state *ScnState)
+{
+    note_collection *Notes = ScnState->Notes;
+    if(!Notes->SelectionCount)
+    {
+        return;
+    }
+
+    /* One note keeps the smaller record, that does not hold on to a note array */
+    if(Notes->SelectionCount == 1)
+    {
+        u64 Word = 0;
+        while(!Notes->Selection[Word])
+        {
+            ++Word;
+        }
 
-        Mem->Initialized = true;
+        u64  Index = (Word * 64) + CountTrailingZerosu64(Notes->Selection[Word]);
+        note Note  = RemoveNoteAt(ScnState, Index);
+        RecordDeleteNote(ScnState, Index, &Note);
+        return;
     }
 
-    return State;
+    StopEditing(ScnState);
+    note *Other = TakeNoteArray(ScnState);
+    u64   Taken = TakeNotes(ScnState, Notes->Selection, Other);
+    RecordDeleteNotes(ScnState, Other, Taken);
+    ResetSelection(Notes);
 }
 
 isa_internal void
-FillNote(note *Note, rect Rect, u64 z, u32_argb Color)
+NudgeSelection(scn_state *ScnState, v2 Delta)
 {
-    Note->Rect  = Rect;
-    Note->z     = z;
-    Note->Color = Color;
+    note_collection *Notes = ScnState->Notes;
+    if(Notes->SelectionCount)
+    {
+        RecordMoveNotes(ScnState, Delta);
+        MoveNotes(ScnState, Notes->Selection, Delta);
+    }
+}
+
+isa_internal void
+RecolorSelection(scn_state *ScnState)
+{
+    note_collection *Notes = ScnState->Notes;
+    if(Notes->SelectionCount)
+    {
+        u32_argb Color = U32Argb(GetRandu32());
+        RecordRecolorNotes(ScnState, Color);
+        RecolorNotes(ScnState, Notes->Selection, nullptr, Color);
+    }
+}
+
+// NOTE(ingar): Puts the selection on top of the other notes, or under them
+isa_internal void
+RestackSelection(scn_state *ScnState, bool Under)
+{
+    note_collection *Notes = ScnState->Notes;
+    if(Notes->SelectionCount)
+    {
+        StopEditing(ScnState);
+        u64 Base = ReserveZ(ScnState, Notes->SelectionCount, Under);
+        RecordRestackNotes(ScnState, Base);
+        RestackNotes(ScnState, Notes->Selection, Base);
+    }
+}
+
+/* Dragging */
+
+isa_internal void
+StartDrag(scn_state *ScnState, u64 Note, v2 Pos)
+{
+    note_collection *Notes = ScnState->Notes;
+    note_drag       *Drag  = &ScnState->Drag;
+    Drag->Active           = true;
+    Drag->Note             = Note;
+    Drag->Start            = Pos;
+    Drag->Offset           = V2(0.0f, 0.0f);
+    Drag->Bounds           = Notes->N[Note].Rect;
+
+    u64 Words = SelectionWords(Notes);
+    for(u64 Word = 0; Word < Words; ++Word)
+    {
+        for(u64 Bits = Notes->Selection[Word]; Bits; Bits &= Bits - 1)
+        {
+            Drag->Bounds = RectUnion(Drag->Bounds, Notes->N[(Word * 64) + CountTrailingZerosu64(Bits)].Rect);
+        }
+    }
+}
+
+// NOTE(ingar): Only the preview moves, so only where it was and where it is now are redrawn, whatever the size of the
+// board
+isa_internal void
+UpdateDrag(scn_state *ScnState, v2 Pos)
+{
+    note_drag *Drag   = &ScnState->Drag;
+    v2         Offset = Pos - Drag->Start;
+    if(Offset.x == Drag->Offset.x && Offset.y == Drag->Offset.y)
+    {
+        return;
+    }
+
+    AddDamage(ScnState, OffsetRect(Drag->Bounds, Drag->Offset));
+    Drag->Offset = Offset;
+    AddDamage(ScnState, OffsetRect(Drag->Bounds, Drag->Offset));
+}
+
+isa_internal void
+CancelDrag(scn_state *ScnState)
+{
+    note_drag *Drag = &ScnState->Drag;
+    AddDamage(ScnState, OffsetRect(Drag->Bounds, Drag->Offset));
+    Drag->Active = false;
+}
+
+// NOTE(ingar): Moves the selection to the preview as one change. A drag that went nowhere is a click, which selects
+// only the note that was clicked.
+isa_internal void
+FinishDrag(scn_state *ScnState)
+{
+    note_drag       *Drag  = &ScnState->Drag;
+    note_collection *Notes = ScnState->Notes;
+    CancelDrag(ScnState);
+
+    if(Drag->Offset.x == 0.0f && Drag->Offset.y == 0.0f)
+    {
+        ClearSelection(ScnState);
+        SelectNote(ScnState, Drag->Note);
+        return;
+    }
+
+    RecordMoveNotes(ScnState, Drag->Offset);
+    MoveNotes(ScnState, Notes->Selection, Drag->Offset);
+}
+
+// NOTE(ingar): Puts a new note on top of the others, unless the board is full
+isa_internal void
+CreateNote(scn_state *ScnState, rect Rect, u32 Image)
+{
+    note_collection *Notes = ScnState->Notes;
+    if(Notes->Count < Notes->MaxCount)
+    {
+        u64 z     = ReserveZ(ScnState, 1, false) + SCN_Z_GAP;
+        u64 Index = Notes->Count++;
+        FillNote(Notes->N + Index, Rect, z, U32Argb(GetRandu32()));
+        Notes->N[Index].Image = Image;
+        AddNoteToGrid(ScnState->Grid, Index, Rect);
+        RecordCreateNote(ScnState, Index);
+        AddNoteDamage(ScnState, Rect);
+    }
 }
 
 // NOTE(ingar): Casey says that your code should not be split up in this way the code that updates state and then
 // renders should be executed simultaneously so we might want to do that
 // NOTE(ingar): This was also in the context of games. Sinuce we're a traditional app we might have different needs to
 // handle events asynchronously
-extern "C" RESPOND_TO_MOUSE(RespondToMouse)
+isa_internal void
+RespondToMouse(scn_state *ScnState, scn_mouse_event Event)
 {
-    scn_state       *ScnState     = InitScnState(Mem);
     mouse_history   *MouseHistory = ScnState->MouseHistory;
     note_collection *Notes        = ScnState->Notes;
 
     if(Event.Type == ScnMouseEvent_LDown)
     {
         MouseHistory->PrevLClickPos = V2(Truncatei64ToFloat(Event.x), Truncatei64ToFloat(Event.y));
+
+        i64 Index = TopNoteAt(ScnState, (float)Event.x, (float)Event.y);
+        if(Index < 0)
+        {
+            StartBand(ScnState, MouseHistory->PrevLClickPos);
+        }
+        /* Pressing on a note that is not in the selection selects it alone, and either way the selection is dragged */
+        else if(EditedNote(ScnState) != Notes->N + Index)
+        {
+            if(!IsNoteSelected(Notes, Index))
+            {
+                ClearSelection(ScnState);
+            }
+            SelectNote(ScnState, Index);
+            StartDrag(ScnState, Index, MouseHistory->PrevLClickPos);
+        }
+    }
+    else if(Event.Type == ScnMouseEvent_Move)
+    {
+        /* Moves are coalesced in ProcessInput, so this runs at most once per frame */
+        v2 Pos = V2(Truncatei64ToFloat(Event.x), Truncatei64ToFloat(Event.y));
+        if(ScnState->Band.Active)
+        {
+            UpdateBand(ScnState, Pos);
+        }
+        else if(ScnState->Drag.Active)
+        {
+            UpdateDrag(ScnState, Pos);
+        }
     }
     else if(Event.Type == ScnMouseEvent_RDown)
     {
@@ -71,21 +1526,20 @@ extern "C" RESPOND_TO_MOUSE(RespondToMouse)
     }
     else if(Event.Type == ScnMouseEvent_LUp)
     {
-        /* Select note */
-        if(MouseHistory->Prev.Type == ScnMouseEvent_LDown)
+        if(ScnState->Band.Active)
+        {
+            StopBand(ScnState);
+        }
+        else if(ScnState->Drag.Active)
+        {
+            FinishDrag(ScnState);
+        }
+        else if(MouseHistory->Prev.Type == ScnMouseEvent_LDown)
         {
-            bool ClickedOnRect = false;
-            /* Reverse iteration because we want the top-most note within the coordinates */
-            for(i64 i = Notes->Count - 1; i >= 0; --i)
+            note *Note = EditedNote(ScnState);
+            if(Note && InRect(Note->Rect, (float)Event.x, (float)Event.y))
             {
-                note *Note    = Notes->N + i;
-                ClickedOnRect = InRect(Note->Rect, (float)Event.x, (float)Event.y);
-                if(ClickedOnRect)
-                {
-                    Notes->NoteIsSelected = (Notes->SelectedNote == Note);
-                    Notes->SelectedNote   = Note;
-                    break;
-                }
+                PlaceCaret(ScnState, Note, (float)Event.x, (float)Event.y);
             }
         }
 
@@ -125,12 +1579,7 @@ extern "C" RESPOND_TO_MOUSE(RespondToMouse)
             // TODO(ingar): Since the functions are ran on timers, this
             // probably means that we need synchronization mechanisms so that
             // new elements are not pushed simultaneously with the drawing
-            if(Notes->Count < Notes->MaxCount)
-            {
-                // TODO(ingar): Bake the note number as text into the note and scale it to the note's size
-                u64 z = Notes->Count++;
-                FillNote(Notes->N + z, NewRect, z, U32Argb(GetRandu32()));
-            }
+            CreateNote(ScnState, NewRect, 0);
         }
 
         MouseHistory->RClicked = true;
@@ -140,12 +1589,109 @@ extern "C" RESPOND_TO_MOUSE(RespondToMouse)
     MouseHistory->Prev = Event;
 }
 
-extern "C" RESPOND_TO_KEYBOARD(RespondToKeyboard)
+isa_internal void
+RespondToFileDrop(scn_state *ScnState, scn_drop_event Event, scn_dropped_file *File)
+{
+    u32 Image = AddImage(ScnState->Images, File->Path, (u32)strnlen(File->Path, SCN_PATH_MAX));
+    if(!Image)
+    {
+        IsaLogError("Could not attach the dropped file, the path is too long or there are too many images");
+        return;
+    }
+
+    /* A file dropped on a note replaces the image it had, and one dropped next to the notes gets a note of its own */
+    i64 Index = TopNoteAt(ScnState, (float)Event.x, (float)Event.y);
+    if(Index >= 0)
+    {
+        note *Note = ScnState->Notes->N + Index;
+        if(Note->Image != Image)
+        {
+            RecordAttachImage(ScnState, (u64)Index, Note->Image, Image);
+            AttachImage(ScnState, (u64)Index, Image);
+        }
+    }
+    else
+    {
+        v2   Min  = V2((float)Event.x, (float)Event.y);
+        rect Rect = { Min, V2(Min.x + SCN_IMAGE_NOTE_WIDTH, Min.y + SCN_IMAGE_NOTE_HEIGHT) };
+        CreateNote(ScnState, Rect, Image);
+    }
+}
+
+// NOTE(ingar): The notes that show the image are drawn again. If an image could not be requested because the ring
+// was full, there is room now, so every note with an image is.
+isa_internal void
+RespondToImageDecoded(scn_state *ScnState, scn_image_event Event)
+{
+    image_cache *Cache    = ScnState->ImageCache;
+    u32          Image    = FinishImageJob(Cache, Event);
+    bool         Deferred = Cache->Deferred;
+    Cache->Deferred       = false;
+
+    note_collection *Notes = ScnState->Notes;
+    for(u64 i = 0; i < Notes->Count; ++i)
+    {
+        note *Note = Notes->N + i;
+        if(Note->Image && (Note->Image == Image || Deferred))
+        {
+            AddNoteDamage(ScnState, Note->Rect);
+        }
+    }
+}
+
+isa_internal void
+RespondToKeyboard(scn_state *ScnState, scn_keyboard_event Event)
 {
-    scn_state       *ScnState = InitScnState(Mem);
-    note_collection *Notes    = ScnState->Notes;
+    note_collection *Notes = ScnState->Notes;
 
     IsaLogInfo("Key %lu was pressed", Event.Type);
+    if(ScnState->Drag.Active)
+    {
+        /* Escape cancels the drag. The other keys could change the selection that is being dragged, so they wait until
+         * the drag is over. */
+        if(Event.Type == ScnKeyboardEvent_Escape)
+        {
+            CancelDrag(ScnState);
+        }
+        return;
+    }
+
+    if(Event.Control)
+    {
+        if(Event.Type == ScnKeyboardEvent_Z && !Event.Shift)
+        {
+            Undo(ScnState);
+            return;
+        }
+        if(Event.Type == ScnKeyboardEvent_Y || Event.Type == ScnKeyboardEvent_Z)
+        {
+            Redo(ScnState);
+            return;
+        }
+        if(Event.Type == ScnKeyboardEvent_A && !EditedNote(ScnState))
+        {
+            SelectAll(ScnState);
+            return;
+        }
+
+        /* The letters are commands of their own without control, and a shortcut from another program, like Ctrl+C,
+         * must not clear the board */
+        if(Event.Type >= ScnKeyboardEvent_A && Event.Type <= ScnKeyboardEvent_Z)
+        {
+            return;
+        }
+    }
+
+    if(ScnState->Editing && RespondToEditingKey(ScnState, Event))
+    {
+        return;
+    }
+    if(ScnState->Search->Active && RespondToSearchKey(ScnState, Event))
+    {
+        return;
+    }
+
+    float Nudge = Event.Shift ? SCN_NUDGE_LARGE : SCN_NUDGE_SMALL;
     switch(Event.Type)
     {
         case ScnKeyboardEvent_A:
@@ -156,34 +1702,40 @@ extern "C" RESPOND_TO_KEYBOARD(RespondToKeyboard)
             {
                 IsaLogInfo("C was pressed");
 
-                Notes->Count          = 0;
-                Notes->NoteIsSelected = false;
-                Notes->SelectedNote   = nullptr;
-            }
-            break;
-        case ScnKeyboardEvent_D:
-            {
-                IsaLogInfo("D was pressed");
-
-                if(Notes->NoteIsSelected)
+                if(Notes->Count)
                 {
-                    u64 Index = Notes->SelectedNote->z;
-                    IsaArrayDeleteAndShift(Notes->N, Index, Notes->Count, sizeof(note));
+                    /* The notes are handed to the undo log as they are, and the board gets an empty array */
+                    ClearSelection(ScnState);
+                    note *Cleared      = Notes->N;
+                    u64   ClearedCount = Notes->Count;
 
-                    Notes->Count--;
-                    Notes->NoteIsSelected = false;
-                    Notes->SelectedNote   = nullptr;
+                    Notes->N     = TakeNoteArray(ScnState);
+                    Notes->Count = 0;
 
-                    for(u64 i = Index; i < Notes->Count; ++i)
+                    ClearSearchIndex(ScnState->Search);
+                    ClearGrid(ScnState->Grid);
+                    if(ScnState->Search->Active)
                     {
-                        Notes->N[i].z--;
+                        RunSearch(ScnState->Search, Notes);
                     }
+
+                    RecordClearNotes(ScnState, Cleared, ClearedCount);
+                    AddFullDamage(ScnState);
                 }
             }
             break;
+        case ScnKeyboardEvent_D:
+            {
+                IsaLogInfo("D was pressed");
+                DeleteSelection(ScnState);
+            }
+            break;
         case ScnKeyboardEvent_E:
             break;
         case ScnKeyboardEvent_F:
+            {
+                StartSearch(ScnState);
+            }
             break;
         case ScnKeyboardEvent_G:
             break;
@@ -208,10 +1760,16 @@ extern "C" RESPOND_TO_KEYBOARD(RespondToKeyboard)
         case ScnKeyboardEvent_Q:
             break;
         case ScnKeyboardEvent_R:
+            {
+                RecolorSelection(ScnState);
+            }
             break;
         case ScnKeyboardEvent_S:
             break;
         case ScnKeyboardEvent_T:
+            {
+                RestackSelection(ScnState, Event.Shift);
+            }
             break;
         case ScnKeyboardEvent_U:
             break;
@@ -260,6 +1818,41 @@ extern "C" RESPOND_TO_KEYBOARD(RespondToKeyboard)
         case ScnKeyboardEvent_Tab:
             break;
         case ScnKeyboardEvent_Enter:
+            {
+                StartEditing(ScnState);
+            }
+            break;
+        case ScnKeyboardEvent_Escape:
+            {
+                ClearSelection(ScnState);
+            }
+            break;
+        case ScnKeyboardEvent_Delete:
+            break;
+
+        case ScnKeyboardEvent_Left:
+            {
+                NudgeSelection(ScnState, V2(-Nudge, 0.0f));
+            }
+            break;
+        case ScnKeyboardEvent_Right:
+            {
+                NudgeSelection(ScnState, V2(Nudge, 0.0f));
+            }
+            break;
+        case ScnKeyboardEvent_Up:
+            {
+                NudgeSelection(ScnState, V2(0.0f, -Nudge));
+            }
+            break;
+        case ScnKeyboardEvent_Down:
+            {
+                NudgeSelection(ScnState, V2(0.0f, Nudge));
+            }
+            break;
+        case ScnKeyboardEvent_Home:
+            break;
+        case ScnKeyboardEvent_End:
             break;
 
         case ScnKeyboardEvent_Unhandled:
@@ -275,165 +1868,758 @@ extern "C" RESPOND_TO_KEYBOARD(RespondToKeyboard)
     }
 }
 
+isa_internal void
+RespondToAssetChange(scn_state *ScnState, scn_asset_event Event)
+{
+    IsaLogInfo("Asset %d changed on disk", (int)Event.Asset);
+
+    if(Event.Asset == ScnAsset_Font)
+    {
+        LoadFont(ScnState->Font, &ScnState->SessionArena, SCN_FONT_PATH_CHAR);
+    }
+
+    // NOTE(ingar): Everything on screen may depend on the font or the palette
+    AddFullDamage(ScnState);
+}
+
+// NOTE(ingar): Drains everything the platform has pushed since the last frame. Runs of mouse moves are coalesced
+// into the last one since only the final position matters for the handlers
+isa_internal void
+ProcessInput(scn_state *ScnState, scn_mem *Mem)
+{
+    scn_input_ring *Input = &Mem->Input;
+    u64 Count = ScnInputRingAvailable(Input);
+    for(u64 i = 0; i < Count; ++i)
+    {
+        scn_input_event *Event = ScnInputRingPeek(Input, i);
+        ScnState->Undo->NowUs  = Event->TimeUs;
+        switch(Event->Type)
+        {
+            case ScnInputEvent_Mouse:
+                {
+                    if(Event->Mouse.Type == ScnMouseEvent_Move && (i + 1) < Count)
+                    {
+                        scn_input_event *Next = ScnInputRingPeek(Input, i + 1);
+                        if(Next->Type == ScnInputEvent_Mouse && Next->Mouse.Type == ScnMouseEvent_Move)
+                        {
+                            break;
+                        }
+                    }
+                    RespondToMouse(ScnState, Event->Mouse);
+                }
+                break;
+            case ScnInputEvent_Keyboard:
+                {
+                    RespondToKeyboard(ScnState, Event->Keyboard);
+                }
+                break;
+            case ScnInputEvent_Char:
+                {
+                    RespondToChar(ScnState, Event->Char);
+                }
+                break;
+            case ScnInputEvent_AssetChanged:
+                {
+                    RespondToAssetChange(ScnState, Event->AssetChanged);
+                }
+                break;
+            case ScnInputEvent_FileDropped:
+                {
+                    /* The platform puts the path in the drop ring before it pushes the event */
+                    if(ScnRingAvailable(&Mem->Drops))
+                    {
+                        RespondToFileDrop(ScnState, Event->FileDropped, ScnRingPeek(&Mem->Drops, 0));
+                        ScnRingRelease(&Mem->Drops, 1);
+                    }
+                }
+                break;
+            case ScnInputEvent_ImageDecoded:
+                {
+                    RespondToImageDecoded(ScnState, Event->ImageDecoded);
+                }
+                break;
+            default:
+                {
+                    IsaAssert(0, "Invalid input event type");
+                }
+                break;
+        }
+    }
+
+    ScnInputRingRelease(Input, Count);
+}
+
+isa_internal void
+UpdatePermanentUsed(scn_mem *Mem, scn_state *State)
+{
+    /* Pushing nothing gives the current top of the arena */
+    u8 *Top            = (u8 *)IsaArenaPush(&State->PermArena, 0);
+    Mem->PermanentUsed = (size_t)(Top - (u8 *)Mem->Permanent);
+}
+
+extern "C" SAVE_BOARD(SaveBoard)
+{
+    scn_state *ScnState = InitScnState(Mem);
+    return WriteBoard(ScnState, (u8 *)Out, OutSize);
+}
+
+extern "C" LOAD_BOARD(LoadBoard)
+{
+    scn_state *ScnState = InitScnState(Mem);
+
+    bool Loaded = ReadBoard(ScnState, (u8 *)Data, Size);
+    RebuildSearchIndex(ScnState->Search, ScnState->Notes);
+    RebuildGrid(ScnState->Grid, ScnState->Notes);
+    AddFullDamage(ScnState);
+    UpdatePermanentUsed(Mem, ScnState);
+
+    return Loaded;
+}
+
 // NOTE(ingar): Man, this is overkill for this. Hoowee
 extern "C" SEED_RAND_PCG(SeedRandPcg)
 {
     SeedRandPcg_(Seed);
 }
 
+// NOTE(ingar): Clip is in whole pixels and must lie within the buffer
+inline void
+DrawRect(scn_offscreen_buffer Buffer, rect Clip, v2 Min, v2 Max, u32_argb Color)
+{
+    FillRectPixels(Buffer, Clip, Min, Max, Color, 256, BlendMode_Copy);
+}
+
+// NOTE(ingar): Blends Color over the pixels with Alpha out of 256
+inline void
+DrawTranslucentRect(scn_offscreen_buffer Buffer, rect Clip, v2 Min, v2 Max, u32_argb Color, u32 Alpha)
+{
+    FillRectPixels(Buffer, Clip, Min, Max, Color, Alpha, BlendMode_Over);
+}
+
+inline float
+SampleSdf(u8 *Atlas, sdf_glyph *Glyph, float u, float v)
+{
+    float MaxU = (float)(Glyph->w - 1);
+    float MaxV = (float)(Glyph->h - 1);
+    u          = Clamp(u, 0.0f, MaxU);
+    v          = Clamp(v, 0.0f, MaxV);
+
+    i32   u0 = TruncateFloatToi32(u);
+    i32   v0 = TruncateFloatToi32(v);
+    i32   u1 = (u0 < Glyph->w - 1) ? u0 + 1 : u0;
+    i32   v1 = (v0 < Glyph->h - 1) ? v0 + 1 : v0;
+    float fu = u - (float)u0;
+    float fv = v - (float)v0;
+
+    u8 *Row0 = Atlas + ((Glyph->AtlasY + v0) * SCN_SDF_ATLAS_DIM) + Glyph->AtlasX;
+    u8 *Row1 = Atlas + ((Glyph->AtlasY + v1) * SCN_SDF_ATLAS_DIM) + Glyph->AtlasX;
+
+    float Top    = (float)Row0[u0] + (((float)Row0[u1] - (float)Row0[u0]) * fu);
+    float Bottom = (float)Row1[u0] + (((float)Row1[u1] - (float)Row1[u0]) * fu);
+    return Top + ((Bottom - Top) * fv);
+}
+
+// NOTE(ingar): Coverage is the field value thresholded at the edge with a one pixel wide linear ramp, which is then
+// used to blend Color over the buffer. Four pixels are handled at a time.
+template <typename format>
 isa_internal void
-DrawRect(scn_offscreen_buffer Buffer, v2 Min, v2 Max, u32_argb Color)
+DrawSdfGlyph(scn_offscreen_buffer Buffer, rect Clip, scn_font *Font, sdf_glyph *Glyph, float PenX, float BaselineY,
+             float Scale, u32_argb Color)
 {
-    i64 StartX = RoundFloatToi64(Min.x);
-    i64 StartY = RoundFloatToi64(Min.y);
-    i64 EndX   = RoundFloatToi64(Max.x);
-    i64 EndY   = RoundFloatToi64(Max.y);
+    typedef typename format::type pixel;
+
+    if(!Glyph->w || !Glyph->h)
+    {
+        return;
+    }
 
-    Clamp(StartX, 0LL, StartX);
-    Clamp(StartY, 0LL, StartY);
-    Clamp(EndX, EndX, Buffer.w);
-    Clamp(EndY, EndY, Buffer.h);
+    float X0 = PenX + ((float)Glyph->XOff * Scale);
+    float Y0 = BaselineY + ((float)Glyph->YOff * Scale);
+    float X1 = X0 + ((float)Glyph->w * Scale);
+    float Y1 = Y0 + ((float)Glyph->h * Scale);
 
-    i64 Pitch = Buffer.w * Buffer.BytesPerPixel;
-    u8 *Row   = ((u8 *)Buffer.Mem) + (StartY * Pitch) + (StartX * Buffer.BytesPerPixel);
+    i64 StartX = Clamp(FloorFloatToi64(X0), (i64)Clip.Min.x, (i64)Clip.Max.x);
+    i64 StartY = Clamp(FloorFloatToi64(Y0), (i64)Clip.Min.y, (i64)Clip.Max.y);
+    i64 EndX   = Clamp(CeilFloatToi64(X1), (i64)Clip.Min.x, (i64)Clip.Max.x);
+    i64 EndY   = Clamp(CeilFloatToi64(Y1), (i64)Clip.Min.y, (i64)Clip.Max.y);
+
+    float InvScale = 1.0f / Scale;
+
+    __m128 Edge  = _mm_set1_ps((float)SCN_SDF_ON_EDGE);
+    __m128 Sharp = _mm_set1_ps(Scale / SCN_SDF_PIXEL_DIST);
+    __m128 Half  = _mm_set1_ps(0.5f);
+    __m128 Zero  = _mm_setzero_ps();
+    __m128 One   = _mm_set1_ps(1.0f);
 
     for(i64 y = StartY; y < EndY; ++y)
     {
-        u32 *Pixel = (u32 *)Row;
-        for(i64 x = StartX; x < EndX; ++x)
+        float  v   = (((float)y + 0.5f - Y0) * InvScale) - 0.5f;
+        pixel *Row = (pixel *)PixelAt(Buffer, 0, y);
+
+        for(i64 x = StartX; x < EndX; x += 4)
+        {
+            i64 Count = ((EndX - x) < 4) ? (EndX - x) : 4;
+
+            float Field[4];
+            pixel Pixels[4] = {};
+            for(i64 i = 0; i < Count; ++i)
+            {
+                float u   = (((float)(x + i) + 0.5f - X0) * InvScale) - 0.5f;
+                Field[i]  = SampleSdf(Font->Atlas, Glyph, u, v);
+                Pixels[i] = Row[x + i];
+            }
+            for(i64 i = Count; i < 4; ++i)
+            {
+                Field[i] = 0.0f;
+            }
+
+            __m128 Coverage = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(Field), Edge), Sharp), Half);
+            Coverage        = _mm_min_ps(_mm_max_ps(Coverage, Zero), One);
+            BlendCoverage4<format>(Pixels, Coverage, Color);
+
+            for(i64 i = 0; i < Count; ++i)
+            {
+                Row[x + i] = Pixels[i];
+            }
+        }
+    }
+}
+
+template <typename format>
+isa_internal void
+DrawTextLayoutIn(scn_offscreen_buffer Buffer, rect Clip, scn_font *Font, text_layout *Layout, float Left, float Top,
+                 float Scale, u32_argb Color)
+{
+    float LineH = (Font->Ascent - Font->Descent) * Scale;
+    for(u32 i = 0; i < Layout->LineCount; ++i)
+    {
+        text_line *Line    = Layout->Lines + i;
+        float      LineTop = Top + ((float)i * Layout->LineAdvance * Scale);
+        if(LineTop >= Clip.Max.y)
         {
-            *Pixel++ = Color.U32;
+            break;
+        }
+        if(LineTop + LineH <= Clip.Min.y)
+        {
+            continue;
+        }
+
+        float BaselineY = LineTop + (Font->Ascent * Scale);
+        for(u32 j = 0; j < Line->GlyphCount; ++j)
+        {
+            text_glyph *Glyph    = Layout->Glyphs + Line->FirstGlyph + j;
+            sdf_glyph  *SdfGlyph = GetSdfGlyph(Font, Glyph->Glyph);
+            if(SdfGlyph)
+            {
+                DrawSdfGlyph<format>(Buffer, Clip, Font, SdfGlyph, Left + (Glyph->x * Scale), BaselineY, Scale, Color);
+            }
         }
+    }
+}
+
+// NOTE(ingar): Top is the top of the first line. Lines that are entirely outside the clip are skipped. The layout is
+// placed in window pixels and scaled to the pixels of the buffer here, so glyphs are drawn at the buffer's resolution.
+isa_internal void
+DrawTextLayout(scn_offscreen_buffer Buffer, rect Clip, scn_font *Font, text_layout *Layout, float Left, float Top,
+               float Scale, u32_argb Color)
+{
+    rect Pixels = BufferClip(Buffer, Clip);
+    Left       /= Buffer.PixelSize;
+    Top        /= Buffer.PixelSize;
+    Scale      /= Buffer.PixelSize;
 
-        Row += Pitch;
+    switch(Buffer.Format)
+    {
+        case ScnPixelFormat_Bgra8:
+            {
+                DrawTextLayoutIn<pixel_bgra8>(Buffer, Pixels, Font, Layout, Left, Top, Scale, Color);
+            }
+            break;
+        case ScnPixelFormat_Rgb565:
+            {
+                DrawTextLayoutIn<pixel_rgb565>(Buffer, Pixels, Font, Layout, Left, Top, Scale, Color);
+            }
+            break;
+        case ScnPixelFormat_A8:
+            {
+                DrawTextLayoutIn<pixel_a8>(Buffer, Pixels, Font, Layout, Left, Top, Scale, Color);
+            }
+            break;
     }
 }
 
+// NOTE(ingar): Draws the layout of note Index through its text surface, see scn_surface.h. Area is what the text is
+// clipped to, and Key identifies the text the same way it does for the layout. The glyphs are drawn directly when the
+// buffer has no level to blend from or the surface can't be made.
 isa_internal void
-DrawText(isa_arena *Arena, scn_offscreen_buffer Buffer)
+DrawSurfaceText(scn_offscreen_buffer Buffer, rect Clip, scn_state *ScnState, u64 Index, text_layout *Layout, u64 Key,
+                rect Area, float Left, float Top, float Scale, u32_argb Color)
 {
-    IsaArenaF5(Arena);
+    scn_font *Font     = ScnState->Font;
+    rect      TextClip = RectIntersection(Clip, Area);
+    if(!RectHasArea(TextClip))
+    {
+        return;
+    }
+
+    i32 Level = SurfaceLevelFor(Buffer);
+    if(Level < 0)
+    {
+        DrawTextLayout(Buffer, TextClip, Font, Layout, Left, Top, Scale, Color);
+        return;
+    }
+
+    i64 BlockX = FloorFloatToi64(Area.Min.x / (float)SCN_SURFACE_ALIGN) * SCN_SURFACE_ALIGN;
+    i64 BlockY = FloorFloatToi64(Area.Min.y / (float)SCN_SURFACE_ALIGN) * SCN_SURFACE_ALIGN;
+
+    text_surface_key SurfaceKey;
+    SurfaceKey.Text           = Key;
+    SurfaceKey.FontGeneration = Font->Generation;
+    SurfaceKey.Width          = Area.Max.x - Area.Min.x;
+    SurfaceKey.Height         = Area.Max.y - Area.Min.y;
+    SurfaceKey.BlockX         = Area.Min.x - (float)BlockX;
+    SurfaceKey.BlockY         = Area.Min.y - (float)BlockY;
+    SurfaceKey.Left           = Left - Area.Min.x;
+    SurfaceKey.Top            = Top - Area.Min.y;
+    SurfaceKey.Scale          = Scale;
+
+    text_surface *Surface = FindTextSurface(ScnState->TextSurfaces, Index, SurfaceKey);
+    if(!Surface)
+    {
+        /* Only the part of the area the lines can reach is kept, with a quarter of a line to spare for glyphs that
+         * reach past their advance. Everything is taken from the key, so the same key gives the same surface. */
+        float LineH  = (Font->Ascent - Font->Descent) * Scale;
+        float Spare  = 0.25f * LineH;
+        float TextW  = (Layout->Width * Scale) + Spare;
+        float TextH  = ((float)(Layout->LineCount ? Layout->LineCount - 1 : 0) * Layout->LineAdvance * Scale) + LineH
+                       + Spare;
+        float Right  = SurfaceKey.Left + TextW;
+        float Bottom = SurfaceKey.Top + TextH;
+        Right        = (Right < SurfaceKey.Width) ? Right : SurfaceKey.Width;
+        Bottom       = (Bottom < SurfaceKey.Height) ? Bottom : SurfaceKey.Height;
+        if(Right <= 0.0f || Bottom <= 0.0f)
+        {
+            return;
+        }
 
-    isa_file_data *FontFile = IsaLoadFileIntoMemory("c:/windows/fonts/arialbd.ttf");
+        i64 Align = SCN_SURFACE_ALIGN;
+        i64 w     = ((CeilFloatToi64(SurfaceKey.BlockX + Right) + Align - 1) / Align) * Align;
+        i64 h     = ((CeilFloatToi64(SurfaceKey.BlockY + Bottom) + Align - 1) / Align) * Align;
 
-    stbtt_fontinfo Font;
-    stbtt_InitFont(&Font, FontFile->Data, 0);
+        Surface = RenewTextSurface(ScnState->TextSurfaces, Index, SurfaceKey, w, h);
+        if(!Surface)
+        {
+            DrawTextLayout(Buffer, TextClip, Font, Layout, Left, Top, Scale, Color);
+            return;
+        }
+
+        rect Local = { V2(SurfaceKey.BlockX, SurfaceKey.BlockY),
+                       V2(SurfaceKey.BlockX + SurfaceKey.Width, SurfaceKey.BlockY + SurfaceKey.Height) };
+        DrawTextLayout(SurfaceLevelBuffer(Surface, 0), Local, Font, Layout, SurfaceKey.BlockX + SurfaceKey.Left,
+                       SurfaceKey.BlockY + SurfaceKey.Top, Scale, U32Argb(0xFFFFFFFF));
+    }
 
-    float Scalar = stbtt_ScaleForPixelHeight(&Font, 50.0f);
+    BlendTextSurface(Buffer, TextClip, Surface, (u32)Level, BlockX, BlockY, Color);
+}
 
-    int Ascent, Descent, LineGap;
-    stbtt_GetFontVMetrics(&Font, &Ascent, &Descent, &LineGap);
+// NOTE(ingar): The attached image, fitted to the area the text is in and drawn under the text. The decode is requested
+// the first time the note is drawn at a size, and the note is drawn without the image until it is done.
+isa_internal void
+DrawNoteImage(scn_offscreen_buffer Buffer, rect Clip, scn_state *ScnState, note *Note)
+{
+    image_table *Table = ScnState->Images;
+    if(!Note->Image || Note->Image >= Table->Count)
+    {
+        return;
+    }
 
-    float XPos     = 2;
-    int   Baseline = (int)(Ascent * Scalar);
+    rect Inner = NoteTextFrame(Note).Inner;
+    rect Area  = RectIntersection(Clip, Inner);
+    i64  Left  = CeilFloatToi64(Inner.Min.x);
+    i64  Top   = CeilFloatToi64(Inner.Min.y);
+    i64  BoxW  = FloorFloatToi64(Inner.Max.x) - Left;
+    i64  BoxH  = FloorFloatToi64(Inner.Max.y) - Top;
+    if(!RectHasArea(Area) || BoxW <= 0 || BoxH <= 0)
+    {
+        return;
+    }
 
-    isa_string    Text = IsaNewString("Heljo World!");
-    const u64     BufY = 60;
-    const u64     BufX = 240;
-    unsigned char TTBuf[BufY][BufX];
+    u32          MaxW  = (u32)((BoxW < SCN_IMAGE_MAX_SIDE) ? BoxW : SCN_IMAGE_MAX_SIDE);
+    u32          MaxH  = (u32)((BoxH < SCN_IMAGE_MAX_SIDE) ? BoxH : SCN_IMAGE_MAX_SIDE);
+    image_cache *Cache = ScnState->ImageCache;
+    image_entry *Entry = FindImageEntry(Cache, Note->Image, MaxW, MaxH);
+    if(!Entry)
+    {
+        Entry = RequestImage(Cache, Table, Note->Image, MaxW, MaxH);
+    }
+    if(!Entry)
+    {
+        return;
+    }
 
-    for(u64 i = 0; i < Text.Len; ++i)
+    Entry->LastDrawn = Cache->Frame;
+    if(Entry->State == ImageEntry_Ready)
     {
-        int   Advance, Lsb, x0, y0, x1, y1;
-        float XShift = XPos - (float)FloorFloatToi64(XPos);
+        DrawImage(Buffer, Area, Cache, Entry, Left + ((BoxW - Entry->w) / 2), Top + ((BoxH - Entry->h) / 2));
+    }
+}
 
-        stbtt_GetCodepointHMetrics(&Font, (int)Text.String[i], &Advance, &Lsb);
+// NOTE(ingar): The note's number, scaled to fill the note
+isa_internal void
+DrawNoteLabel(scn_offscreen_buffer Buffer, rect Clip, scn_state *ScnState, u64 NoteIndex)
+{
+    scn_font *Font = ScnState->Font;
+    note     *Note = ScnState->Notes->N + NoteIndex;
+    if(!Font->Loaded)
+    {
+        return;
+    }
 
-        stbtt_GetCodepointBitmapBoxSubpixel(&Font, (int)Text.String[i], Scalar, Scalar, XShift, 0, &x0, &y0, &x1, &y1);
+    char Label[24];
+    int  Len = snprintf(Label, sizeof(Label), "%llu", (unsigned long long)(NoteIndex + 1));
 
-        stbtt_MakeCodepointBitmapSubpixel(&Font, &TTBuf[Baseline + y0][(int)XPos + x0], x1 - x0, y1 - y0, BufY, Scalar,
-                                          Scalar, XShift, 0, Text.String[i]);
-        XPos += (Advance * Scalar);
-        if(i < (Text.Len - 1))
-        {
-            XPos += Scalar * stbtt_GetCodepointKernAdvance(&Font, (int)Text.String[i], (int)Text.String[i + 1]);
-        }
+    float NoteW    = Note->Rect.Max.x - Note->Rect.Min.x;
+    float NoteH    = Note->Rect.Max.y - Note->Rect.Min.y;
+    if(NoteW < 4.0f || NoteH < 4.0f)
+    {
+        return;
     }
 
-    i64 StartY = 200;
-    i64 StartX = 200;
+    text_layout *Layout = GetCachedLayout(ScnState->Layouts, Font, NoteIndex, TextView((u8 *)Label, (u64)Len),
+                                          HashText((u8 *)Label, (u64)Len), SCN_TEXT_NO_WRAP);
+    float RefWidth = Layout ? Layout->Width : 0.0f;
+    if(RefWidth <= 0.0f)
+    {
+        return;
+    }
+
+    float FitWidth    = (0.8f * NoteW) * (SCN_SDF_REF_HEIGHT / RefWidth);
+    float PixelHeight = (0.6f * NoteH < FitWidth) ? 0.6f * NoteH : FitWidth;
+    float Scale       = PixelHeight / SCN_SDF_REF_HEIGHT;
+
+    float Left  = Note->Rect.Min.x + (0.5f * (NoteW - (RefWidth * Scale)));
+    float TextH = (Font->Ascent - Font->Descent) * Scale;
+    float Top   = Note->Rect.Min.y + (0.5f * (NoteH - TextH));
 
-    i64 Pitch = Buffer.w * Buffer.BytesPerPixel;
-    u8 *Row   = ((u8 *)Buffer.Mem) + (StartY * Pitch) + (StartX * Buffer.BytesPerPixel);
+    DrawSurfaceText(Buffer, Clip, ScnState, NoteIndex, Layout, HashText((u8 *)Label, (u64)Len), Note->Rect, Left, Top,
+                    Scale, U32Argb(SNOW_WHITE));
+}
+
+isa_internal void
+DrawNoteText(scn_offscreen_buffer Buffer, rect Clip, scn_state *ScnState, note *Note)
+{
+    if(!ScnState->Font->Loaded)
+    {
+        return;
+    }
 
-    for(u64 y = 0; y < BufY; ++y)
+    note_text_frame Frame    = NoteTextFrame(Note);
+    rect            TextClip = RectIntersection(Clip, Frame.Inner);
+    text_layout    *Layout   = GetNoteTextLayout(ScnState, Note);
+    bool            Edited   = (EditedNote(ScnState) == Note);
+    if(Layout && RectHasArea(TextClip))
     {
-        u32 *Pixel = (u32 *)Row;
-        for(u64 x = 0; x < BufX; ++x)
+        /* The note being edited changes with every key, and only the lines that changed are drawn again */
+        if(Edited)
+        {
+            DrawTextLayout(Buffer, TextClip, ScnState->Font, Layout, Frame.Inner.Min.x, Frame.Inner.Min.y,
+                           Frame.Scale, U32Argb(SNOW_WHITE));
+        }
+        else
         {
-            *Pixel++ = TTBuf[y][x];
+            DrawSurfaceText(Buffer, TextClip, ScnState, (u64)(Note - ScnState->Notes->N), Layout, Note->Text.Stamp,
+                            Frame.Inner, Frame.Inner.Min.x, Frame.Inner.Min.y, Frame.Scale, U32Argb(SNOW_WHITE));
         }
+    }
 
-        Row += Pitch;
+    if(Edited)
+    {
+        rect Caret = NoteCaretRect(ScnState, Note);
+        DrawRect(Buffer, Clip, Caret.Min, Caret.Max, U32Argb(SNOW_WHITE));
     }
+}
+
+// NOTE(ingar): Drawn inside the rect. Outlines of notes are drawn inside the note, so that redrawing the note redraws
+// the outline.
+isa_internal void
+DrawOutline(scn_offscreen_buffer Buffer, rect Clip, rect Rect, float Width, u32_argb Color)
+{
+    v2 Min = Rect.Min;
+    v2 Max = Rect.Max;
 
-    free(FontFile);
-    IsaArenaF9(Arena);
+    DrawRect(Buffer, Clip, Min, V2(Max.x, Min.y + Width), Color);
+    DrawRect(Buffer, Clip, V2(Min.x, Max.y - Width), Max, Color);
+    DrawRect(Buffer, Clip, V2(Min.x, Min.y + Width), V2(Min.x + Width, Max.y - Width), Color);
+    DrawRect(Buffer, Clip, V2(Max.x - Width, Min.y + Width), V2(Max.x, Max.y - Width), Color);
 }
 
 isa_internal void
-DrawChar(isa_arena *Arena, scn_offscreen_buffer Buffer)
+DrawSearchBar(scn_offscreen_buffer Buffer, rect Clip, scn_state *ScnState)
 {
-    IsaArenaF5(Arena);
+    rect Bar = SearchBarRect(ScnState);
+    DrawRect(Buffer, Clip, Bar.Min, Bar.Max, U32Argb(MOONSTONE_CYAN));
+
+    scn_font    *Font   = ScnState->Font;
+    text_layout *Layout = Font->Loaded ? GetSearchBarLayout(ScnState) : nullptr;
+    float        Scale  = SCN_NOTE_TEXT_HEIGHT / SCN_SDF_REF_HEIGHT;
+    float        Left   = Bar.Min.x + SCN_NOTE_TEXT_PADDING;
+    float        Top    = Bar.Min.y + SCN_NOTE_TEXT_PADDING;
+    float        TextW  = 0.0f;
+    if(Layout)
+    {
+        DrawTextLayout(Buffer, RectIntersection(Clip, Bar), Font, Layout, Left, Top, Scale, U32Argb(SNOW_WHITE));
+        TextW = Layout->Width * Scale;
+    }
 
-    isa_file_data *FontFile = IsaLoadFileIntoMemory("c:/windows/fonts/arialbd.ttf");
+    DrawRect(Buffer, Clip, V2(Left + TextW + 1.0f, Top), V2(Left + TextW + 3.0f, Top + SCN_NOTE_TEXT_HEIGHT),
+             U32Argb(SNOW_WHITE));
+}
 
-    stbtt_fontinfo Font;
-    stbtt_InitFont(&Font, FontFile->Data, 0);
+// NOTE(ingar): Draws the note with its shadow, outlines and text over what is under it
+isa_internal void
+DrawNote(scn_offscreen_buffer Buffer, rect Clip, scn_state *ScnState, u64 i)
+{
+    note_collection *Notes = ScnState->Notes;
+    note            *Note  = Notes->N + i;
+
+    /* The shadow is left out under the part of the note that is filled edge to edge */
+    DrawShadow(Buffer, Clip, ScnState->Shapes, Note->Rect, SCN_NOTE_RADIUS, SCN_SHADOW_BLUR,
+               V2(SCN_SHADOW_OFFSET_X, SCN_SHADOW_OFFSET_Y), U32Argb(SHADOW_BLACK), SCN_SHADOW_ALPHA,
+               GrowRect(Note->Rect, -SCN_NOTE_RADIUS));
+
+    /* The outlines are rings of the note from the outside in, so they stay inside it however small it is */
+    shape_ring Rings[2];
+    u32        RingCount = 0;
+    if(NoteMatchesSearch(ScnState->Search, i))
+    {
+        Rings[RingCount++] = { U32Argb(FRENCH_ROSE), SCN_SEARCH_OUTLINE };
+    }
+    else
+    {
+        Rings[RingCount++] = { ShadeColor(Note->Color, SCN_BORDER_SHADE), SCN_NOTE_BORDER };
+    }
+    if(IsNoteSelected(Notes, i))
+    {
+        Rings[RingCount++] = { U32Argb(SNOW_WHITE), SCN_SELECTION_OUTLINE };
+    }
+    DrawRoundedRect(Buffer, Clip, ScnState->Shapes, Note->Rect, SCN_NOTE_RADIUS, Note->Color, 256, Rings, RingCount);
 
-    isa_string Text = IsaNewString("Thank God it worked!");
+    DrawNoteImage(Buffer, Clip, ScnState, Note);
+    if(NoteShowsText(ScnState, Note))
+    {
+        DrawNoteText(Buffer, Clip, ScnState, Note);
+    }
+    else if(!Note->Image)
+    {
+        DrawNoteLabel(Buffer, Clip, ScnState, i);
+    }
+}
 
-    i64 StartY = 200;
-    i64 StartX = 200;
+// NOTE(ingar): The pixels of the buffer that drawing the note can change, with its shadow and a pixel for rounding
+inline pixel_span
+NoteExtentSpan(scn_offscreen_buffer Buffer, rect NoteRect)
+{
+    float      Size   = Buffer.PixelSize;
+    rect       Grown  = GrowRect(NoteRect, SCN_SHADOW_MARGIN + Size);
+    pixel_span Result = { FloorFloatToi64(Grown.Min.x / Size), FloorFloatToi64(Grown.Min.y / Size),
+                          CeilFloatToi64(Grown.Max.x / Size), CeilFloatToi64(Grown.Max.y / Size) };
+    return Result;
+}
 
-    for(u64 i = 0; i < Text.Len; ++i)
+isa_internal void
+DrawRegion(scn_state *ScnState, scn_offscreen_buffer Buffer, rect Clip)
+{
+    /* The notes under the region come from the grid, so a small region costs the same on any board, and only they
+     * are sorted into z order */
+    note_collection *Notes = ScnState->Notes;
+    u64              Words = SelectionWords(Notes);
+    memset(ScnState->DrawBits, 0, Words * sizeof(u64));
+    QueryGrid(ScnState->Grid, Notes, GrowRect(Clip, SCN_SHADOW_MARGIN), ScnState->DrawBits);
+
+    z_entry *Entries = ScnState->ZOrder.Entries;
+    u64      Count   = SortNotesByZ(Notes, ScnState->DrawBits, Entries);
+
+    /* Only the parts of the notes and the background that are not under an opaque part of a note above are drawn, see
+     * scn_spans.h */
+    span_buffer *Spans  = ScnState->Spans;
+    float        Size   = Buffer.PixelSize;
+    rect         Pixels = BufferClip(Buffer, Clip);
+    BeginSpanLayers(Spans, { (i64)Pixels.Min.x, (i64)Pixels.Min.y, (i64)Pixels.Max.x, (i64)Pixels.Max.y });
+    for(u64 j = 0; j < Count; ++j)
     {
-        int            w, h;
-        unsigned char *Bitmap
-            = stbtt_GetCodepointBitmap(&Font, 0, stbtt_ScaleForPixelHeight(&Font, 50.0f), Text.String[i], &w, &h, 0, 0);
+        rect       NoteRect = Notes->N[Entries[j].Note].Rect;
+        pixel_span Across, Down;
+        RoundedRectCore(Buffer, NoteRect, SCN_NOTE_RADIUS, &Across, &Down);
+        AddSpanLayer(Spans, Entries[j].Note, NoteExtentSpan(Buffer, NoteRect), Across, Down);
+    }
 
-        i64 Pitch = Buffer.w * Buffer.BytesPerPixel;
-        u8 *Row   = ((u8 *)Buffer.Mem) + (StartY * Pitch) + (StartX * Buffer.BytesPerPixel);
+    if(FindVisiblePieces(Spans))
+    {
+        for(u64 k = 0; k < Spans->PieceCount; ++k)
+        {
+            span_piece *Piece     = Spans->Pieces + k;
+            rect        PieceClip = { V2((float)Piece->Span.StartX * Size, (float)Piece->Span.StartY * Size),
+                                      V2((float)Piece->Span.EndX * Size, (float)Piece->Span.EndY * Size) };
+            if(Piece->Layer == 0)
+            {
+                RestoreBackground(ScnState->Background, Buffer, PieceClip);
+            }
+            else
+            {
+                DrawNote(Buffer, PieceClip, ScnState, Spans->Layers[Piece->Layer].Note);
+            }
+        }
+    }
+    else
+    {
+        RestoreBackground(ScnState->Background, Buffer, Clip);
+        for(u64 j = 0; j < Count; ++j)
+        {
+            DrawNote(Buffer, Clip, ScnState, Entries[j].Note);
+        }
+    }
 
-        for(u64 y = 0; y < h; ++y)
+    note_drag *Drag = &ScnState->Drag;
+    if(Drag->Active && RectsOverlap(OffsetRect(Drag->Bounds, Drag->Offset), Clip))
+    {
+        for(u64 Word = 0; Word < Words; ++Word)
         {
-            u32 *Pixel = (u32 *)Row;
-            for(u64 x = 0; x < w; ++x)
+            for(u64 Bits = Notes->Selection[Word]; Bits; Bits &= Bits - 1)
             {
-                *Pixel++ = Bitmap[(y * w) + x];
+                note *Note    = Notes->N + (Word * 64) + CountTrailingZerosu64(Bits);
+                rect  Preview = OffsetRect(Note->Rect, Drag->Offset);
+                if(RectsOverlap(Preview, Clip))
+                {
+                    DrawRoundedRect(Buffer, Clip, ScnState->Shapes, Preview, SCN_NOTE_RADIUS, Note->Color,
+                                    SCN_DRAG_PREVIEW_ALPHA, nullptr, 0);
+                }
             }
+        }
+    }
+
+    if(ScnState->Band.Active)
+    {
+        rect Band = BandRect(&ScnState->Band);
+        if(RectsOverlap(Band, Clip))
+        {
+            DrawOutline(Buffer, Clip, Band, SCN_BAND_OUTLINE, U32Argb(SNOW_WHITE));
+        }
+    }
+
+    if(ScnState->Search->Active && RectsOverlap(SearchBarRect(ScnState), Clip))
+    {
+        DrawSearchBar(Buffer, Clip, ScnState);
+    }
+}
 
-            Row += Pitch;
+// NOTE(ingar): Sharpness matters less than the frame rate while notes are being moved around, so they are drawn at a
+// lower resolution until they are let go. Falls back to full resolution when the platform has no room for it.
+isa_internal u32
+ChooseRenderDivisor(scn_state *ScnState, scn_mem *Mem, scn_offscreen_buffer Buffer)
+{
+    u32 Divisor = (ScnState->Drag.Active || ScnState->Band.Active) ? SCN_BUSY_RENDER_DIVISOR : 1;
+    if(Divisor > 1)
+    {
+        i64 w = (Buffer.w + Divisor - 1) / Divisor;
+        i64 h = (Buffer.h + Divisor - 1) / Divisor;
+        if(!Mem->Render || Buffer.Format != ScnPixelFormat_Bgra8 || w < 2 || h < 2
+           || (u64)(w * h) * Buffer.BytesPerPixel > Mem->RenderMemSize)
+        {
+            Divisor = 1;
         }
-        StartX += w + 5;
+    }
+
+    return Divisor;
+}
 
-        stbtt_FreeBitmap(Bitmap, NULL);
+isa_internal scn_offscreen_buffer
+RenderBuffer(scn_mem *Mem, scn_offscreen_buffer Buffer, u32 Divisor)
+{
+    scn_offscreen_buffer Result = Buffer;
+    if(Divisor > 1)
+    {
+        Result.w         = (Buffer.w + Divisor - 1) / Divisor;
+        Result.h         = (Buffer.h + Divisor - 1) / Divisor;
+        Result.PixelSize = Buffer.PixelSize * (float)Divisor;
+        Result.Mem       = Mem->Render;
+    }
+
+    return Result;
+}
+
+// NOTE(ingar): Clip is in window pixels. When Target is smaller than the back buffer the clip is widened to whole
+// pixels of Target, since DrawRegion only draws the notes that overlap it, and the part of the back buffer that the
+// redrawn pixels are spread over is scaled up from Target.
+isa_internal void
+DrawScaledRegion(scn_state *ScnState, scn_offscreen_buffer Target, scn_offscreen_buffer Buffer, u32 Divisor, rect Clip)
+{
+    if(Divisor == 1)
+    {
+        DrawRegion(ScnState, Buffer, Clip);
+        return;
     }
 
-    free(FontFile);
-    IsaArenaF9(Arena);
+    float Size    = Target.PixelSize;
+    rect  Pixels  = BufferClip(Target, Clip);
+    rect  Aligned = { Pixels.Min * Size, Pixels.Max * Size };
+    DrawRegion(ScnState, Target, Aligned);
+
+    rect Spread = { Aligned.Min - V2(Size, Size), Aligned.Max + V2(Size, Size) };
+    UpscaleBilinear(Target, Buffer, Divisor, Spread);
 }
 
+// NOTE(ingar): Only the damaged parts of the buffer are redrawn. If nothing changed since the last call the buffer is
+// left untouched and the platform is told that there is nothing new to present
 extern "C" UPDATE_BACK_BUFFER(UpdateBackBuffer)
 {
+    scn_update_result Result = { false, SCN_NO_DEADLINE };
+
     scn_state *ScnState = InitScnState(Mem);
+    ProcessInput(ScnState, Mem);
+    UpdatePermanentUsed(Mem, ScnState);
+
+    u32 Divisor = ChooseRenderDivisor(ScnState, Mem, Buffer);
+    if(Mem->RedrawRequested || Buffer.w != ScnState->BufferW || Buffer.h != ScnState->BufferH
+       || Divisor != ScnState->RenderDivisor)
+    {
+        AddFullDamage(ScnState);
+        Mem->RedrawRequested    = false;
+        ScnState->BufferW       = Buffer.w;
+        ScnState->BufferH       = Buffer.h;
+        ScnState->RenderDivisor = Divisor;
+    }
 
-    static bool Draw = true;
-    if(Draw)
+    damage_region *Damage = &ScnState->Damage;
+    if(!Damage->Full && Damage->Count == 0)
     {
-        /* Draw background */
-        // TODO(ingar): Check if background is already filled and skip drawing it?
-        DrawRect(Buffer, V2(0.0f, 0.0f), V2(Truncatei64ToFloat(Buffer.w), Truncatei64ToFloat(Buffer.h)),
-                 U32Argb(SCN_BG_COLOR));
+        return Result;
+    }
+
+    /* Images drawn in this frame are kept in the cache while it is drawn */
+    ScnState->ImageCache->Frame++;
 
-        // DrawText(&ScnState->SessionArena, Buffer);
-        DrawChar(&ScnState->SessionArena, Buffer);
-        for(u64 i = 0; i < ScnState->Notes->Count; ++i)
+    rect BufferRect = { V2(0.0f, 0.0f), V2(Truncatei64ToFloat(Buffer.w), Truncatei64ToFloat(Buffer.h)) };
+
+    scn_offscreen_buffer Target = RenderBuffer(Mem, Buffer, Divisor);
+    if(Damage->Full)
+    {
+        DrawScaledRegion(ScnState, Target, Buffer, Divisor, BufferRect);
+    }
+    else
+    {
+        for(u64 i = 0; i < Damage->Count; ++i)
         {
-            // note Note = ScnState->Notes->N[i];
-            //  TODO(ingar): Same check as with the background?
-            // DrawRect(Buffer, Note.Rect.Min, Note.Rect.Max, Note.Color);
+            rect Clip = RectIntersection(Damage->Rects[i], BufferRect);
+            if(RectHasArea(Clip))
+            {
+                DrawScaledRegion(ScnState, Target, Buffer, Divisor, Clip);
+            }
         }
-        Draw = false;
     }
+
+    Damage->Full  = false;
+    Damage->Count = 0;
+
+    Result.Redrawn = true;
+    return Result;
 }
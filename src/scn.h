@@ -8,26 +8,25 @@
 #include "consts.h"
 #include "isa.h"
 #include "scn_math.h"
+#include "scn_intrinsics.h"
 
 ISA_LOG_DECLARE_SAME_TU;
 
-struct scn_mem
+// TODO(ingar): Make the storage of this internal to scn instead of the
+// pointer being passed in from the platform layer?
+enum scn_pixel_format : u32
 {
-    bool Initialized;
-
-    size_t PermanentMemSize;
-    void  *Permanent;
-
-    size_t SessionMemSize;
-    void  *Session;
+    ScnPixelFormat_Bgra8, // The window, 0xAARRGGBB in a u32
+    ScnPixelFormat_Rgb565,
+    ScnPixelFormat_A8, // Masks, only the alpha of colors is kept
 };
 
-// TODO(ingar): Make the storage of this internal to scn instead of the
-// pointer being passed in from the platform layer?
 struct scn_offscreen_buffer
 {
-    i64 w, h;
-    u64 BytesPerPixel;
+    i64              w, h;
+    u64              BytesPerPixel; // Must match Format
+    scn_pixel_format Format;
+    float            PixelSize; // In window pixels, 1 for the window and more for buffers drawn at lower resolution
 
     void *Mem;
 };
@@ -84,6 +83,16 @@ enum scn_keyboard_event_type
     ScnKeyboardEvent_Back,
     ScnKeyboardEvent_Tab,
     ScnKeyboardEvent_Enter,
+    ScnKeyboardEvent_Escape,
+    ScnKeyboardEvent_Delete,
+
+    // Navigation keys
+    ScnKeyboardEvent_Left,
+    ScnKeyboardEvent_Right,
+    ScnKeyboardEvent_Up,
+    ScnKeyboardEvent_Down,
+    ScnKeyboardEvent_Home,
+    ScnKeyboardEvent_End,
 
     // Invalid key event
     ScnKeyboardEvent_Unhandled,
@@ -92,6 +101,8 @@ enum scn_keyboard_event_type
 struct scn_keyboard_event
 {
     scn_keyboard_event_type Type;
+    bool                    Shift;   // Held down when the key was pressed
+    bool                    Control; // Same
 };
 
 enum scn_mouse_event_type
@@ -112,6 +123,245 @@ struct scn_mouse_event
     i64                  x, y;
 };
 
+// NOTE(ingar): A character of text input, after the platform has applied the keyboard layout, dead keys and any IME.
+// Key events are still sent for the keys that produced it.
+struct scn_char_event
+{
+    u32 Codepoint; // UTF-32, never a surrogate or a control character
+};
+
+// NOTE(ingar): Files that the platform watches for changes on scn's behalf
+enum scn_asset
+{
+    ScnAsset_Font,
+    ScnAsset_Palette,
+
+    ScnAsset_Count,
+};
+
+struct scn_asset_event
+{
+    scn_asset Asset;
+};
+
+// NOTE(ingar): A file was dropped on the window at x, y. Its path is the next one in scn_mem::Drops.
+struct scn_drop_event
+{
+    i64 x, y;
+};
+
+// NOTE(ingar): The decode of an image request has finished. w and h are 0 if the file could not be decoded.
+struct scn_image_event
+{
+    u64 Job;
+    u32 w, h;
+};
+
+enum scn_input_event_type
+{
+    ScnInputEvent_Mouse,
+    ScnInputEvent_Keyboard,
+    ScnInputEvent_Char,
+    ScnInputEvent_AssetChanged,
+    ScnInputEvent_FileDropped,
+    ScnInputEvent_ImageDecoded,
+};
+
+struct scn_input_event
+{
+    scn_input_event_type Type;
+    u64                  TimeUs; // NOTE(ingar): Platform time at which the OS delivered the event
+
+    union
+    {
+        scn_mouse_event    Mouse;
+        scn_keyboard_event Keyboard;
+        scn_char_event     Char;
+        scn_asset_event    AssetChanged;
+        scn_drop_event     FileDropped;
+        scn_image_event    ImageDecoded;
+    };
+};
+
+// NOTE(ingar): Single-producer single-consumer ring. The platform layer is the only writer of WriteIndex and scn is
+// the only writer of ReadIndex, so no locks are needed. The indices only ever increase and are masked on access.
+#define SCN_INPUT_RING_SIZE 1024
+static_assert((SCN_INPUT_RING_SIZE & (SCN_INPUT_RING_SIZE - 1)) == 0, "The input ring size must be a power of two");
+
+struct scn_input_ring
+{
+    alignas(64) volatile u64 WriteIndex;
+    alignas(64) volatile u64 ReadIndex;
+
+    scn_input_event Events[SCN_INPUT_RING_SIZE];
+};
+
+inline bool
+ScnInputRingPush(scn_input_ring *Ring, scn_input_event *Event)
+{
+    u64 Write = Ring->WriteIndex;
+    u64 Read  = AtomicLoadAcquireu64(&Ring->ReadIndex);
+    if((Write - Read) >= SCN_INPUT_RING_SIZE)
+    {
+        return false;
+    }
+
+    Ring->Events[Write & (SCN_INPUT_RING_SIZE - 1)] = *Event;
+    AtomicStoreReleaseu64(&Ring->WriteIndex, Write + 1);
+
+    return true;
+}
+
+// NOTE(ingar): Returns the number of events that can be read starting at ReadIndex. The consumer calls
+// ScnInputRingRelease when it is done with them so the producer can reuse the slots.
+inline u64
+ScnInputRingAvailable(scn_input_ring *Ring)
+{
+    u64 Write  = AtomicLoadAcquireu64(&Ring->WriteIndex);
+    u64 Result = Write - Ring->ReadIndex;
+    return Result;
+}
+
+inline scn_input_event *
+ScnInputRingPeek(scn_input_ring *Ring, u64 Offset)
+{
+    scn_input_event *Result = Ring->Events + ((Ring->ReadIndex + Offset) & (SCN_INPUT_RING_SIZE - 1));
+    return Result;
+}
+
+inline void
+ScnInputRingRelease(scn_input_ring *Ring, u64 Count)
+{
+    AtomicStoreReleaseu64(&Ring->ReadIndex, Ring->ReadIndex + Count);
+}
+
+// NOTE(ingar): The same protocol as scn_input_ring, for the other rings between scn and the platform. Items are
+// written in place between ScnRingReserve and ScnRingCommit.
+template <typename type, u64 Size>
+struct scn_ring
+{
+    static_assert((Size & (Size - 1)) == 0, "The ring size must be a power of two");
+
+    alignas(64) volatile u64 WriteIndex;
+    alignas(64) volatile u64 ReadIndex;
+
+    type Items[Size];
+};
+
+// NOTE(ingar): Returns null if the ring is full
+template <typename type, u64 Size>
+inline type *
+ScnRingReserve(scn_ring<type, Size> *Ring)
+{
+    u64 Write = Ring->WriteIndex;
+    u64 Read  = AtomicLoadAcquireu64(&Ring->ReadIndex);
+    if((Write - Read) >= Size)
+    {
+        return nullptr;
+    }
+
+    return Ring->Items + (Write & (Size - 1));
+}
+
+template <typename type, u64 Size>
+inline void
+ScnRingCommit(scn_ring<type, Size> *Ring)
+{
+    AtomicStoreReleaseu64(&Ring->WriteIndex, Ring->WriteIndex + 1);
+}
+
+template <typename type, u64 Size>
+inline u64
+ScnRingAvailable(scn_ring<type, Size> *Ring)
+{
+    u64 Write = AtomicLoadAcquireu64(&Ring->WriteIndex);
+    return Write - Ring->ReadIndex;
+}
+
+template <typename type, u64 Size>
+inline type *
+ScnRingPeek(scn_ring<type, Size> *Ring, u64 Offset)
+{
+    return Ring->Items + ((Ring->ReadIndex + Offset) & (Size - 1));
+}
+
+template <typename type, u64 Size>
+inline void
+ScnRingRelease(scn_ring<type, Size> *Ring, u64 Count)
+{
+    AtomicStoreReleaseu64(&Ring->ReadIndex, Ring->ReadIndex + Count);
+}
+
+#define SCN_PATH_MAX 512 // Bytes of UTF-8, with the terminating zero
+
+struct scn_dropped_file
+{
+    char Path[SCN_PATH_MAX];
+};
+
+/* NOTE(ingar): Images
+ *
+ * Decoded images are kept in tiles of SCN_IMAGE_TILE by SCN_IMAGE_TILE pixels, 0xAARRGGBB with straight alpha, in
+ * memory that the platform allocates and scn hands out, see scn_images.h. scn asks for an image to be decoded to fit
+ * in MaxW by MaxH pixels, never larger than the file, into the tiles listed in the request, which are row by row
+ * across the MaxW by MaxH box. The platform decodes the requests one at a time, in order, and sends an
+ * ScnInputEvent_ImageDecoded for each.
+ */
+
+#define SCN_IMAGE_TILE       64
+#define SCN_IMAGE_TILE_BYTES (SCN_IMAGE_TILE * SCN_IMAGE_TILE * sizeof(u32))
+#define SCN_IMAGE_MAX_SIDE   1024 // Of what is decoded, in pixels
+#define SCN_IMAGE_MAX_TILES  ((SCN_IMAGE_MAX_SIDE / SCN_IMAGE_TILE) * (SCN_IMAGE_MAX_SIDE / SCN_IMAGE_TILE))
+
+struct scn_image_request
+{
+    u64  Job;
+    u32  MaxW, MaxH;
+    u32  Tiles[SCN_IMAGE_MAX_TILES];
+    char Path[SCN_PATH_MAX];
+};
+
+#define SCN_DROP_RING_SIZE  16
+#define SCN_IMAGE_RING_SIZE 32
+
+struct scn_mem
+{
+    bool Initialized;        // The permanent state is valid, either created by scn or restored from an image
+    bool SessionInitialized; // Session memory is not preserved across runs, so this is false at every startup
+
+    // NOTE(ingar): Layout of the permanent state as of the code that last wrote it, see scn_migrate.h
+    u32 StateVersion;
+    u64 StateSchemaHash;
+    u64 SessionSchemaHash; // Of the session fields, as of the code that last set them up
+
+    size_t PermanentMemSize;
+    size_t PermanentUsed; // Set by scn. Bytes from the start of Permanent that hold live state
+    void  *Permanent;
+
+    size_t SessionMemSize;
+    void  *Session;
+
+    // NOTE(ingar): Where scn draws when it draws below the resolution of the back buffer. At least as large as the
+    // back buffer, and reallocated by the platform along with it.
+    size_t RenderMemSize;
+    void  *Render;
+
+    bool RedrawRequested; // Set by the platform when the back buffer contents were lost, e.g. after a code reload
+
+    // NOTE(ingar): Set by scn when the permanent state could not be migrated and was created again. The platform then
+    // loads the portable board into it and clears this.
+    bool BoardLost;
+
+    // NOTE(ingar): The tiles of decoded images. Jobs are numbered here since pending jobs outlive session memory.
+    size_t ImageMemSize;
+    void  *ImageMem;
+    u64    LastImageJob;
+
+    scn_input_ring                                   Input;
+    scn_ring<scn_dropped_file, SCN_DROP_RING_SIZE>   Drops;         // Paths of ScnInputEvent_FileDropped, in order
+    scn_ring<scn_image_request, SCN_IMAGE_RING_SIZE> ImageRequests; // From scn to the platform's decode thread
+};
+
 struct mouse_history
 {
     bool LClicked;
@@ -125,7 +375,7 @@ struct mouse_history
     v2 PrevRClickPos;
 };
 
-// TODO(ingar): Add/convert float-based colors
+// NOTE(ingar): The channels are sRGB. Blending is done in linear light, see scn_srgb.h
 union u32_argb
 {
     struct
@@ -153,22 +403,75 @@ U32Argb(u32 U32)
     return Color;
 }
 
+// NOTE(ingar): Scales the color channels by Scale out of 256 and keeps the alpha
+inline u32_argb
+ShadeColor(u32_argb Color, u32 Scale)
+{
+    return U32Argb((u8)((Color.b * Scale) >> 8), (u8)((Color.g * Scale) >> 8), (u8)((Color.r * Scale) >> 8), Color.a);
+}
+
 struct gui_rect
 {
     rect     Dim;
     u32_argb Color;
 };
 
-// TODO(ingar): NOTE to self. When dragging, there should be a partially transparent rectangle that shows what the note
-// will look like. There should also be a simple color picker, and you could adjust the opacity (or something else) by
-// scrolling while choosing the color.
+// NOTE(ingar): UTF-8 gap buffer, see scn_note_text.h. Data is null for notes that have never had text.
+struct note_text
+{
+    u8 *Data;
+    u32 Capacity;
+    u32 GapStart; // Also the caret
+    u32 GapEnd;
+    u64 Stamp; // Changes whenever the text does, and is never the same for two texts
+};
+
+#define SCN_TEXT_MIN_BLOCK_SHIFT 6
+#define SCN_TEXT_BLOCK_CLASSES   20
+
+struct text_allocator
+{
+    u64 LastStamp;
+    u8 *FreeBlocks[SCN_TEXT_BLOCK_CLASSES]; // Indexed by log2 of the size, the next block is stored in the first bytes
+};
+
+// NOTE(ingar): In pixels, independent of the size of the note
+#define SCN_NOTE_TEXT_HEIGHT  20.0f
+#define SCN_NOTE_TEXT_PADDING 8.0f
+
+#define SCN_SEARCH_BAR_MIN_WIDTH 240.0f
+#define SCN_SEARCH_OUTLINE       3.0f // Width of the outline of notes that match the search
+#define SCN_SELECTION_OUTLINE    2.0f // Drawn inside the search outline, so both show on a note
+#define SCN_BAND_OUTLINE         1.0f // Of the rubber band
+#define SCN_NUDGE_SMALL          1.0f // Pixels the arrow keys move the selection, with and without shift
+#define SCN_NUDGE_LARGE          10.0f
+#define SCN_DRAG_PREVIEW_ALPHA   128 // Of the preview of where dragged notes will go, out of 256
+#define SCN_BUSY_RENDER_DIVISOR  2   // Notes are drawn at 1/this of the window resolution while they are moved around
+#define SCN_IMAGE_NOTE_WIDTH     240.0f // Of the note that is made for a file dropped next to the notes
+#define SCN_IMAGE_NOTE_HEIGHT    180.0f
+
+// NOTE(ingar): In pixels of the window. The shadow reaches half its blur past the note, moved by the offset.
+#define SCN_NOTE_RADIUS     8.0f
+#define SCN_NOTE_BORDER     1.0f
+#define SCN_BORDER_SHADE    192 // Of the color of the note, out of 256
+#define SCN_SHADOW_BLUR     8.0f
+#define SCN_SHADOW_OFFSET_X 2.0f
+#define SCN_SHADOW_OFFSET_Y 3.0f
+#define SCN_SHADOW_ALPHA    96 // Out of 256
+#define SCN_SHADOW_MARGIN   (SCN_SHADOW_BLUR / 2.0f + SCN_SHADOW_OFFSET_Y) // How far past a note it can change pixels
+
+// TODO(ingar): NOTE to self. There should be a simple color picker, and you could adjust the opacity (or something
+// else) by scrolling while choosing the color.
 struct note
 {
     rect Rect;
-    // TODO(ingar): Turn this into a u64?
-    u64      z;
-    u64      CollectionPos;
-    u32_argb Color;
+    // NOTE(ingar): Notes are drawn in the order of z, which is a label with gaps between notes and not the place in
+    // the array, so restacking a note does not move any other
+    u64       z;
+    u64       CollectionPos;
+    u32_argb  Color;
+    u32       Image; // Attached image in the image table, 0 for none
+    note_text Text;
 };
 
 struct note_collection
@@ -176,12 +479,134 @@ struct note_collection
     u64 MaxCount;
     u64 Count;
 
+    // NOTE(ingar): The selection is one bit per note, by index. SelectedNote is the note that Enter edits, and is in
+    // the selection when it is set.
     note *SelectedNote;
-    bool  NoteIsSelected;
+    u64  *Selection;
+    u64   SelectionCount;
 
     note *N;
 };
 
+inline u64
+SelectionWords(note_collection *Notes)
+{
+    return (Notes->MaxCount + 63) / 64;
+}
+
+inline bool
+IsNoteSelected(note_collection *Notes, u64 Index)
+{
+    return (Notes->Selection[Index / 64] >> (Index % 64)) & 1;
+}
+
+/* NOTE(ingar): Undo log
+ *
+ * Records of changes to the board, each with what is needed to undo and redo it, in a ring in permanent memory. See
+ * scn_undo.h.
+ */
+
+#define SCN_UNDO_RING_SIZE    IsaKiloByte(256) // Must be a power of two
+#define SCN_UNDO_MAX_RETAINED IsaMegaByte(8)   // Default cap on the notes and text that records keep alive
+#define SCN_UNDO_NO_RECORD    UINT64_MAX
+#define SCN_UNDO_COALESCE_US  1000000 // Changes to the same note closer together than this share a record
+#define SCN_UNDO_GROUP_US     5000000 // As long as the record is younger than this
+
+enum undo_record_type : u16
+{
+    UndoRecord_Pad, // Fills the end of the ring when the next record does not fit there
+
+    UndoRecord_CreateNote,
+    UndoRecord_DeleteNote,
+    UndoRecord_ClearNotes,
+    UndoRecord_InsertText,
+    UndoRecord_DeleteText,
+    UndoRecord_MoveNote,
+
+    // NOTE(ingar): Changes to the selection, with the bits of the selection after the header. The bits are by the
+    // indices the notes had before the change.
+    UndoRecord_DeleteNotes,
+    UndoRecord_MoveNotes,
+    UndoRecord_RecolorNotes, // Followed by the old colors, in the order of the bits
+    UndoRecord_RestackNotes, // Followed by the old z of the notes, in the order of the bits
+    UndoRecord_AttachImage,
+};
+
+// NOTE(ingar): Records are 8 byte aligned and never wrap around the end of the ring. Text records are followed by the
+// bytes that were inserted or deleted.
+struct undo_record
+{
+    undo_record_type Type;
+    u32              Size;    // Including this header and the bytes after it
+    u64              Prev;    // Position of the record before this one, SCN_UNDO_NO_RECORD if there is none
+    u64              StartUs; // Time of the first and the last change that were coalesced into the record
+    u64              EndUs;
+    u64              NoteIndex;
+
+    union
+    {
+        // NOTE(ingar): The record owns the text of the note while the note is not on the board
+        note Note;
+
+        // NOTE(ingar): For clears, the note array that is not on the board, with the notes that were cleared while
+        // the clear is done and without any while it is undone. Deleting the selection keeps the deleted notes in
+        // an array of its own the same way.
+        struct
+        {
+            note *Other;
+            u64   OtherCount;
+            u64   TextBytes; // Capacity of the text of the notes in Other
+        } Batch;
+
+        struct
+        {
+            u32 Pos; // Byte offset in the text
+            u32 Len;
+        } Text;
+
+        struct
+        {
+            rect From, To;
+        } Move;
+
+        struct
+        {
+            v2 Delta;
+        } Nudge;
+
+        struct
+        {
+            u32_argb Color;
+        } Recolor;
+
+        struct
+        {
+            u64 Base; // The notes were given the z after this, in the order they were stacked
+        } Restack;
+
+        struct
+        {
+            u32 From, To; // Images in the image table
+        } Attach;
+    };
+};
+
+struct undo_log
+{
+    u8  *Ring;  // SCN_UNDO_RING_SIZE
+    u64  Begin; // Position of the oldest record. Positions only increase and are masked on access
+    u64  Head;  // One past the newest record that is done, the records from here to End have been undone
+    u64  End;
+    u64  Last;  // Position of the newest record that is done, SCN_UNDO_NO_RECORD if there is none
+    bool Open;  // The newest record can take more changes
+
+    u64 Retained;    // Bytes of notes and text kept alive by records
+    u64 MaxRetained; // Oldest records are dropped to stay below this
+    u64 NowUs;       // Time of the input event being handled
+
+    note *SpareNotes; // Note arrays that are not in use, the next one is stored in the first bytes
+};
+
 // TODO(ingar): Figure out how much memory stbtt uses. In the example programs 2^20 to 2^25 bytes are used.
 struct stbtt_ctx
 {
@@ -189,6 +614,60 @@ struct stbtt_ctx
     size_t     MemSize;
 };
 
+// NOTE(ingar): Regions of the back buffer, in pixels, that no longer match the state and have to be redrawn. When
+// more rects are added than there is room for they are merged into the last one.
+#define SCN_MAX_DAMAGE_RECTS 16
+
+struct damage_region
+{
+    bool Full;
+    u64  Count;
+    rect Rects[SCN_MAX_DAMAGE_RECTS];
+};
+
+struct rubber_band
+{
+    bool Active;
+    v2   Start, End;
+    u64 *Bits; // Scratch for the query, one bit per note
+};
+
+// NOTE(ingar): The selection is dragged as a preview and only moved when the button is let go
+struct note_drag
+{
+    bool Active;
+    u64  Note;   // The one that was pressed on
+    v2   Start;  // Where it was pressed
+    v2   Offset; // From Start to the mouse
+    rect Bounds; // Of the selection when the drag started
+};
+
+struct z_entry
+{
+    u64 z;
+    u64 Note;
+};
+
+// NOTE(ingar): Every note has a z between Bottom and Top, so notes can be put above or below all of them without
+// looking at the others. Derived from the notes.
+struct z_order
+{
+    u64      Top;
+    u64      Bottom;
+    z_entry *Entries; // Scratch for sorting notes by z, one per note
+};
+
+struct scn_font;
+struct text_layout_cache;
+struct search_index;
+struct spatial_grid;
+struct scn_background;
+struct shape_mask_cache;
+struct span_buffer;
+struct text_surface_cache;
+struct image_table;
+struct image_cache;
+
 // NOTE(ingar): The items in the state that require a "substantial amount of memory will be pushed onto one of the
 // arenas instead of being part of the struct
 struct scn_state
@@ -196,35 +675,73 @@ struct scn_state
     isa_arena        PermArena;
     note_collection *Notes;
     mouse_history   *MouseHistory;
-
-    isa_arena  SessionArena;
-    stbtt_ctx *Stbtt; // TODO(ingar): Might need to be in permanent memory
+    text_allocator   TextAllocator;
+    bool             Editing; // The selected note's text is being edited
+    undo_log        *Undo;
+    image_table     *Images; // The files attached to notes
+
+    // NOTE(ingar): Session fields go after the permanent ones and are not part of the layout version, see
+    // scn_migrate.h
+    isa_arena           SessionArena;
+    stbtt_ctx          *Stbtt; // TODO(ingar): Might need to be in permanent memory
+    scn_font           *Font;
+    text_layout_cache  *Layouts; // One per note and one for the search bar after them
+    search_index       *Search;
+    spatial_grid       *Grid;
+    scn_background     *Background;
+    shape_mask_cache   *Shapes;       // The corner masks of rounded rects and shadows
+    span_buffer        *Spans;        // Scratch for the parts of the notes under the region being drawn that show
+    text_surface_cache *TextSurfaces; // The text of each note as coverage, to blend instead of drawing the glyphs
+    image_cache        *ImageCache;   // Decoded images at the size they are shown
+    rubber_band         Band;
+    note_drag           Drag;
+    z_order             ZOrder;
+    u32                *NoteMap;  // Scratch for reordering notes, one per note
+    u64                *DrawBits; // Scratch for the notes under the region being drawn, one bit per note
+
+    damage_region Damage;
+    i64           BufferW, BufferH; // Dimensions of the back buffer that was last drawn to
+    u32           RenderDivisor;    // The last frame was drawn at 1/this of the resolution of the back buffer
 };
 
 // TODO(ingar): Add (and figure out what it is) thread context
-#define UPDATE_BACK_BUFFER(name) void name(scn_mem *Mem, scn_offscreen_buffer Buffer)
+#define SCN_NO_DEADLINE UINT64_MAX
+
+struct scn_update_result
+{
+    bool Redrawn;      // The back buffer was written to and has to be presented
+    u64  NextWakeUpUs; // Time at which scn must be updated even if no input arrives, or SCN_NO_DEADLINE
+};
+
+// NOTE(ingar): TimeUs is on the same clock as the timestamps of the input events
+#define UPDATE_BACK_BUFFER(name) scn_update_result name(scn_mem *Mem, scn_offscreen_buffer Buffer, u64 TimeUs)
 typedef UPDATE_BACK_BUFFER(update_back_buffer);
 
 extern "C" UPDATE_BACK_BUFFER(UpdateBackBufferStub)
 {
     // DebugPrint("UpdateBackBufferStub was called!\n");
     IsaAssert(0 /*UpdateBackBufferStub was called!*/);
+    return { false, SCN_NO_DEADLINE };
 }
 
-#define RESPOND_TO_MOUSE(name) void name(scn_mem *Mem, scn_mouse_event Event)
-typedef RESPOND_TO_MOUSE(respond_to_mouse);
-extern "C" RESPOND_TO_MOUSE(RespondToMouseStub)
+// NOTE(ingar): Portable board format, used when a snapshot image of the permanent memory can't be restored. Returns
+// the size of the board, and only writes it if it fits in OutSize.
+#define SAVE_BOARD(name) u64 name(scn_mem *Mem, void *Out, u64 OutSize)
+typedef SAVE_BOARD(save_board);
+extern "C" SAVE_BOARD(SaveBoardStub)
 {
-    // DebugPrint("RespondToMouseStub was called!\n");
-    IsaAssert(0 /*RespondToMouseStub was called!*/);
+    IsaAssert(0 /*SaveBoardStub was called!*/);
+    return 0;
 }
 
-#define RESPOND_TO_KEYBOARD(name) void name(scn_mem *Mem, scn_keyboard_event Event)
-typedef RESPOND_TO_KEYBOARD(respond_to_keyboard);
-extern "C" RESPOND_TO_KEYBOARD(RespondToKeyboardStub)
+#define LOAD_BOARD(name) bool name(scn_mem *Mem, void *Data, u64 Size)
+typedef LOAD_BOARD(load_board);
+extern "C" LOAD_BOARD(LoadBoardStub)
 {
-    IsaAssert(0 /*RespondToKeyboardStub was called!*/);
+    IsaAssert(0 /*LoadBoardStub was called!*/);
+    return false;
 }
+
 // TODO(ingar): Is this way of doing this overkill?
 // NOTE(ingar): This really seems like overkill for this.
 // NOTE(ingar): This is overkill
@@ -0,0 +1,188 @@
+/*
+ * Copyright 2024 (c) by Ingar Solveigson Asheim. All Rights Reserved.
+ */
+
+#ifndef SCN_BACKGROUND_H_
+#define SCN_BACKGROUND_H_
+
+#include "isa.h"
+#include "scn.h"
+#include "scn_pixels.h"
+
+/* NOTE(ingar): Background layer
+ *
+ * The background is drawn once into a tile in the format of the back buffer, and a damaged region is restored by
+ * repeating the tile over it. The tile is only redrawn when the format of the buffer changes. A solid color is the
+ * only kind there is for now, and since every pixel of its tile is the same it is restored with a plain fill; grids
+ * and patterns only have to draw themselves into the tile.
+ *
+ * Restoring a large part of the buffer, like the whole window after a resize, uses streaming stores that go around
+ * the caches. Clearing megabytes with ordinary stores would evict the notes, the grid and the glyph atlas that are read
+ * right after. Small regions use ordinary stores, since the notes are drawn over them while they are still cached.
+ */
+
+#define SCN_BG_TILE_SIZE       64 // In pixels, each way
+#define SCN_STREAM_CLEAR_BYTES IsaKiloByte(256)
+
+enum scn_background_kind
+{
+    ScnBackground_Solid,
+};
+
+struct scn_background
+{
+    scn_background_kind Kind;
+    u32_argb            Color;
+
+    bool             TileValid;
+    scn_pixel_format TileFormat;
+    u8               Tile[SCN_BG_TILE_SIZE * SCN_BG_TILE_SIZE * sizeof(u32)];
+};
+
+inline u64
+PixelFormatBytes(scn_pixel_format Format)
+{
+    switch(Format)
+    {
+        case ScnPixelFormat_Bgra8:
+            return 4;
+        case ScnPixelFormat_Rgb565:
+            return 2;
+        case ScnPixelFormat_A8:
+            return 1;
+    }
+
+    return 4;
+}
+
+isa_internal scn_background *
+CreateBackground(isa_arena *Arena, u32_argb Color)
+{
+    scn_background *Background = IsaPushStructZero(Arena, scn_background);
+    Background->Kind           = ScnBackground_Solid;
+    Background->Color          = Color;
+    return Background;
+}
+
+isa_internal void
+DrawBackgroundTile(scn_background *Background, scn_pixel_format Format)
+{
+    scn_offscreen_buffer Tile;
+    Tile.w             = SCN_BG_TILE_SIZE;
+    Tile.h             = SCN_BG_TILE_SIZE;
+    Tile.BytesPerPixel = PixelFormatBytes(Format);
+    Tile.Format        = Format;
+    Tile.PixelSize     = 1.0f;
+    Tile.Mem           = Background->Tile;
+
+    rect Whole = { V2(0.0f, 0.0f), V2((float)SCN_BG_TILE_SIZE, (float)SCN_BG_TILE_SIZE) };
+    switch(Background->Kind)
+    {
+        case ScnBackground_Solid:
+            {
+                FillRectPixels(Tile, Whole, Whole.Min, Whole.Max, Background->Color, 256, BlendMode_Copy);
+            }
+            break;
+    }
+
+    Background->TileFormat = Format;
+    Background->TileValid  = true;
+}
+
+// NOTE(ingar): Pattern holds whole pixels and Dest is aligned to a pixel, so the pixels that are written one byte at a
+// time before and after the aligned middle line up with the pattern
+isa_internal void
+FillRowBytes(u8 *Dest, u64 Bytes, __m128i Pattern, bool Stream)
+{
+    alignas(16) u8 PatternBytes[16];
+    _mm_store_si128((__m128i *)PatternBytes, Pattern);
+
+    u64 Head = (16 - ((uintptr_t)Dest & 15)) & 15;
+    Head     = (Head < Bytes) ? Head : Bytes;
+    memcpy(Dest, PatternBytes, Head);
+    Dest  += Head;
+    Bytes -= Head;
+
+    u8 *End = Dest + (Bytes & ~(u64)15);
+    if(Stream)
+    {
+        for(; Dest < End; Dest += 16)
+        {
+            _mm_stream_si128((__m128i *)Dest, Pattern);
+        }
+    }
+    else
+    {
+        for(; Dest < End; Dest += 16)
+        {
+            _mm_store_si128((__m128i *)Dest, Pattern);
+        }
+    }
+
+    memcpy(Dest, PatternBytes, Bytes & 15);
+}
+
+// NOTE(ingar): Clip is in window pixels. The tile is anchored at the top left of the buffer, so that restoring two
+// regions next to each other leaves no seam.
+isa_internal void
+RestoreBackground(scn_background *Background, scn_offscreen_buffer Buffer, rect Clip)
+{
+    if(!Background->TileValid || Background->TileFormat != Buffer.Format)
+    {
+        DrawBackgroundTile(Background, Buffer.Format);
+    }
+
+    rect Pixels = BufferClip(Buffer, Clip);
+    i64  StartX = (i64)Pixels.Min.x;
+    i64  StartY = (i64)Pixels.Min.y;
+    i64  EndX   = (i64)Pixels.Max.x;
+    i64  EndY   = (i64)Pixels.Max.y;
+    if(EndX <= StartX || EndY <= StartY)
+    {
+        return;
+    }
+
+    u64 PixelBytes = Buffer.BytesPerPixel;
+    u64 RowBytes   = (u64)(EndX - StartX) * PixelBytes;
+    u64 TileRow    = SCN_BG_TILE_SIZE * PixelBytes;
+    switch(Background->Kind)
+    {
+        case ScnBackground_Solid:
+            {
+                bool    Stream  = (RowBytes * (u64)(EndY - StartY)) >= SCN_STREAM_CLEAR_BYTES;
+                __m128i Pattern = _mm_loadu_si128((__m128i *)Background->Tile);
+                for(i64 y = StartY; y < EndY; ++y)
+                {
+                    FillRowBytes(PixelAt(Buffer, StartX, y), RowBytes, Pattern, Stream);
+                }
+
+                if(Stream)
+                {
+                    /* Streaming stores are weakly ordered, so they are made visible before the buffer is presented */
+                    _mm_sfence();
+                }
+            }
+            break;
+        default:
+            {
+                for(i64 y = StartY; y < EndY; ++y)
+                {
+                    u8 *Dest    = PixelAt(Buffer, StartX, y);
+                    u8 *Row     = Background->Tile + ((u64)(y % SCN_BG_TILE_SIZE) * TileRow);
+                    u64 Offset  = (u64)(StartX % SCN_BG_TILE_SIZE) * PixelBytes;
+                    u64 Written = 0;
+                    while(Written < RowBytes)
+                    {
+                        u64 Chunk = TileRow - Offset;
+                        Chunk     = (Chunk < RowBytes - Written) ? Chunk : RowBytes - Written;
+                        memcpy(Dest + Written, Row + Offset, Chunk);
+                        Written += Chunk;
+                        Offset   = 0;
+                    }
+                }
+            }
+            break;
+    }
+}
+
+#endif // SCN_BACKGROUND_H_
@@ -0,0 +1,211 @@
+/*
+ * Copyright 2024 (c) by Ingar Solveigson Asheim. All Rights Reserved.
+ */
+
+#ifndef SCN_BOARD_H_
+#define SCN_BOARD_H_
+
+#include "isa.h"
+#include "scn.h"
+#include "scn_images.h"
+#include "scn_note_text.h"
+#include "scn_zorder.h"
+
+/* NOTE(ingar): Portable board format
+ *
+ * Used when a snapshot image of the permanent memory cannot be mapped back at its original address. It only holds
+ * what is needed to rebuild the board, in z order, and does not depend on the layout of the structs in memory. The z
+ * labels themselves are not stored, the notes are given new ones when they are read.
+ * All values are little-endian.
+ *
+ * Version 2 added note text. The UTF-8 text of every note follows the note records, in the same order and without
+ * separators, with the size of each in its record.
+ *
+ * Version 3 added image attachments. The path of the image of a note follows its text, with its size in the record,
+ * which is 0 for notes without an image. Only the path is stored, not the pixels.
+ */
+
+#define SCN_BOARD_MAGIC   0x44524f424e4353ULL // "SCNBORD"
+#define SCN_BOARD_VERSION 3
+
+struct board_file_header
+{
+    u64 Magic;
+    u32 Version;
+    u32 Reserved;
+    u64 NoteCount;
+};
+
+struct board_file_note_v1
+{
+    float MinX, MinY, MaxX, MaxY;
+    u32   Color;
+};
+
+struct board_file_note_v2
+{
+    float MinX, MinY, MaxX, MaxY;
+    u32   Color;
+    u32   TextSize;
+};
+
+struct board_file_note
+{
+    float MinX, MinY, MaxX, MaxY;
+    u32   Color;
+    u32   TextSize;
+    u32   ImageSize;
+};
+
+inline image_attachment *
+NoteImage(scn_state *State, note *Note)
+{
+    image_table *Table = State->Images;
+    return (Note->Image && Note->Image < Table->Count) ? Table->Images + Note->Image : nullptr;
+}
+
+// NOTE(ingar): Returns the number of bytes the board needs. Nothing is written if Out is too small, so the function
+// can be called with a null buffer to get the size.
+isa_internal u64
+WriteBoard(scn_state *State, u8 *Out, u64 OutSize)
+{
+    note_collection *Notes = State->Notes;
+
+    u64 Size = sizeof(board_file_header) + (Notes->Count * sizeof(board_file_note));
+    for(u64 i = 0; i < Notes->Count; ++i)
+    {
+        image_attachment *Image = NoteImage(State, Notes->N + i);
+        Size += NoteTextLen(&Notes->N[i].Text) + (Image ? Image->PathLen : 0);
+    }
+
+    if(!Out || OutSize < Size)
+    {
+        return Size;
+    }
+
+    board_file_header *Header = (board_file_header *)Out;
+    Header->Magic             = SCN_BOARD_MAGIC;
+    Header->Version           = SCN_BOARD_VERSION;
+    Header->Reserved          = 0;
+    Header->NoteCount         = Notes->Count;
+
+    board_file_note *FileNotes = (board_file_note *)(Header + 1);
+    u8              *FileText  = (u8 *)(FileNotes + Notes->Count);
+    z_entry         *Sorted    = State->ZOrder.Entries;
+    SortNotesByZ(Notes, nullptr, Sorted);
+    for(u64 i = 0; i < Notes->Count; ++i)
+    {
+        note            *Note     = Notes->N + Sorted[i].Note;
+        board_file_note *FileNote = FileNotes + i;
+
+        image_attachment *Image = NoteImage(State, Note);
+
+        FileNote->MinX      = Note->Rect.Min.x;
+        FileNote->MinY      = Note->Rect.Min.y;
+        FileNote->MaxX      = Note->Rect.Max.x;
+        FileNote->MaxY      = Note->Rect.Max.y;
+        FileNote->Color     = Note->Color.U32;
+        FileNote->TextSize  = NoteTextLen(&Note->Text);
+        FileNote->ImageSize = Image ? Image->PathLen : 0;
+
+        CopyNoteText(&Note->Text, FileText);
+        FileText += FileNote->TextSize;
+        if(Image)
+        {
+            memcpy(FileText, Image->Path, Image->PathLen);
+            FileText += Image->PathLen;
+        }
+    }
+
+    return Size;
+}
+
+// NOTE(ingar): Appends the notes in the file to the board, on top of the notes that are on it
+isa_internal bool
+ReadBoard(scn_state *State, u8 *Data, u64 Size)
+{
+    board_file_header *Header = (board_file_header *)Data;
+    if(Size < sizeof(board_file_header) || Header->Magic != SCN_BOARD_MAGIC)
+    {
+        IsaLogError("Not a board file");
+        return false;
+    }
+
+    if(Header->Version < 1 || Header->Version > SCN_BOARD_VERSION)
+    {
+        IsaLogError("Unsupported board file version %u", Header->Version);
+        return false;
+    }
+
+    u64 RecordSize = sizeof(board_file_note);
+    if(Header->Version == 1)
+    {
+        RecordSize = sizeof(board_file_note_v1);
+    }
+    else if(Header->Version == 2)
+    {
+        RecordSize = sizeof(board_file_note_v2);
+    }
+    if(Header->NoteCount > (Size - sizeof(board_file_header)) / RecordSize)
+    {
+        IsaLogError("Board file is truncated");
+        return false;
+    }
+
+    u8 *Records  = (u8 *)(Header + 1);
+    u8 *FileText = Records + (Header->NoteCount * RecordSize);
+    u8 *FileEnd  = Data + Size;
+
+    note_collection *Notes = State->Notes;
+    for(u64 i = 0; i < Header->NoteCount && Notes->Count < Notes->MaxCount; ++i)
+    {
+        /* The records of the older versions are prefixes of the current one */
+        board_file_note FileNote = {};
+        memcpy(&FileNote, Records + (i * RecordSize), RecordSize);
+
+        if((u64)FileNote.TextSize + FileNote.ImageSize > (u64)(FileEnd - FileText))
+        {
+            IsaLogError("Board file is truncated");
+            return false;
+        }
+
+        u64   z    = ReserveZ(State, 1, false) + SCN_Z_GAP;
+        note *Note = Notes->N + Notes->Count++;
+
+        memset(&Note->Text, 0, sizeof(Note->Text));
+        Note->Rect  = { V2(FileNote.MinX, FileNote.MinY), V2(FileNote.MaxX, FileNote.MaxY) };
+        Note->z     = z;
+        Note->Color = U32Argb(FileNote.Color);
+        Note->Image = 0;
+
+        if(FileNote.TextSize)
+        {
+            if(ValidateUtf8(FileText, FileNote.TextSize))
+            {
+                SetNoteText(&State->TextAllocator, &State->PermArena, &Note->Text, FileText, FileNote.TextSize);
+            }
+            else
+            {
+                IsaLogError("Text of note %llu is not valid UTF-8 and was left out", i);
+            }
+            FileText += FileNote.TextSize;
+        }
+
+        if(FileNote.ImageSize)
+        {
+            if(ValidateUtf8(FileText, FileNote.ImageSize))
+            {
+                Note->Image = AddImage(State->Images, (const char *)FileText, FileNote.ImageSize);
+            }
+            if(!Note->Image)
+            {
+                IsaLogError("Image of note %llu could not be attached and was left out", i);
+            }
+            FileText += FileNote.ImageSize;
+        }
+    }
+
+    return true;
+}
+
+#endif // SCN_BOARD_H_
@@ -0,0 +1,429 @@
+/*
+ * Copyright 2024 (c) by Ingar Solveigson Asheim. All Rights Reserved.
+ */
+
+#ifndef SCN_FONT_H_
+#define SCN_FONT_H_
+
+#include "isa.h"
+// NOTE(ingar): Expects stb_truetype.h to have been included, with the implementation, by the translation unit
+
+/* NOTE(ingar): Signed distance field glyphs
+ *
+ * Every glyph is rendered once, as a distance field at SCN_SDF_REF_HEIGHT, into a single atlas. Text of any size is
+ * drawn from the atlas by sampling the field and thresholding it at the edge value, so scaling notes never makes us
+ * rasterize outlines again.
+ *
+ * The cmap is flattened when the font loads: a direct array for the BMP and a sorted list of ranges for the
+ * supplementary planes. Everything after that works on glyph indices, so stbtt never has to search the cmap.
+ */
+
+#define SCN_SDF_REF_HEIGHT      48.0f // Pixel height of the font the fields are generated at
+#define SCN_SDF_PADDING         6     // Pixels of field around each glyph at the reference height
+#define SCN_SDF_ON_EDGE         128   // Field value on the outline
+#define SCN_SDF_PIXEL_DIST      ((float)SCN_SDF_ON_EDGE / (float)SCN_SDF_PADDING) // Field change per pixel
+#define SCN_SDF_ATLAS_DIM       1024
+#define SCN_FONT_GLYPH_SLOTS    1024 // Must be a power of two
+#define SCN_FONT_MAX_SDF_GLYPHS (SCN_FONT_GLYPH_SLOTS * 3 / 4) // The atlas starts over past this, to keep probes short
+#define SCN_FONT_EMPTY_SLOT     0xFFFFFFFF
+
+// NOTE(ingar): Kerning between the codepoints below this is flattened into a table when the font loads, so that
+// laying out text in them never touches the font tables. Other pairs are looked up through stbtt the first time they
+// are seen and cached.
+#define SCN_FONT_FLAT_CODEPOINTS 256
+#define SCN_FONT_KERN_SLOT_BITS  12
+#define SCN_FONT_KERN_SLOTS      (1 << SCN_FONT_KERN_SLOT_BITS)
+#define SCN_FONT_BMP_CODEPOINTS  0x10000
+#define SCN_FONT_MAX_GLYPHS      0x10000 // Glyph indices are 16 bits in TrueType
+#define SCN_FONT_MAX_RANGES      4096    // Supplementary plane ranges, the rest go through stbtt_FindGlyphIndex
+
+struct glyph_range
+{
+    u32 FirstCodepoint, LastCodepoint;
+    u32 FirstGlyph;
+};
+
+struct kern_pair
+{
+    u32 Pair; // Left glyph in the high 16 bits and right glyph in the low, SCN_FONT_EMPTY_SLOT if unused
+    i16 Kern; // In font units
+};
+
+struct sdf_glyph
+{
+    u32 Glyph; // Glyph index, SCN_FONT_EMPTY_SLOT if the slot is unused
+
+    // NOTE(ingar): Location of the field in the atlas. w or h is 0 for glyphs without an outline, e.g. space
+    u16  AtlasX, AtlasY;
+    u16  w, h;
+    bool Failed; // The field could not be made, w and h are 0
+
+    // NOTE(ingar): At the reference height. The offset is from the pen position on the baseline to the top-left
+    // corner of the field
+    i16   XOff, YOff;
+    float Advance;
+};
+
+struct scn_font
+{
+    isa_file_data *File;
+    stbtt_fontinfo Info;
+    bool           Loaded;
+
+    u32   Generation; // Bumped on every load and atlas reset, so text laid out or drawn before it is redone
+    float RefScale;   // Font units to pixels at the reference height
+    float Ascent, Descent, LineGap;
+
+    u16         *BmpGlyphs;  // SCN_FONT_BMP_CODEPOINTS, glyph index of every codepoint in the BMP
+    u64          RangeCount; // Sorted, non-overlapping
+    glyph_range *Ranges;     // SCN_FONT_MAX_RANGES
+
+    float     *Advances;  // SCN_FONT_MAX_GLYPHS, by glyph index, at the reference height
+    i16       *Kerning;   // SCN_FONT_FLAT_CODEPOINTS squared, by codepoint, in font units, [Left][Right]
+    kern_pair *KernPairs; // SCN_FONT_KERN_SLOTS, direct mapped on the glyph pair, a new pair replaces the old one
+
+    u8 *Atlas; // SCN_SDF_ATLAS_DIM squared, one byte per texel
+    u32 PackX, PackY, PackRowH;
+    u32 GlyphCount; // In the glyph table, including the ones that failed
+
+    sdf_glyph Glyphs[SCN_FONT_GLYPH_SLOTS]; // Open addressing on the glyph index
+};
+
+isa_internal void
+ResetFontGlyphs(scn_font *Font)
+{
+    for(u64 i = 0; i < SCN_FONT_GLYPH_SLOTS; ++i)
+    {
+        Font->Glyphs[i].Glyph = SCN_FONT_EMPTY_SLOT;
+    }
+
+    Font->PackX      = 0;
+    Font->PackY      = 0;
+    Font->PackRowH   = 0;
+    Font->GlyphCount = 0;
+}
+
+// NOTE(ingar): The slot of the glyph, or the empty slot it would go in. There is always one, since the table is
+// started over before it is full.
+isa_internal sdf_glyph *
+FindSdfGlyphSlot(scn_font *Font, u32 GlyphIndex)
+{
+    u32 Mask = SCN_FONT_GLYPH_SLOTS - 1;
+    u32 Slot = (GlyphIndex * 2654435761u) & Mask;
+    for(u32 Probe = 0; Probe < SCN_FONT_GLYPH_SLOTS; ++Probe)
+    {
+        sdf_glyph *Candidate = Font->Glyphs + ((Slot + Probe) & Mask);
+        if(Candidate->Glyph == GlyphIndex || Candidate->Glyph == SCN_FONT_EMPTY_SLOT)
+        {
+            return Candidate;
+        }
+    }
+
+    return nullptr;
+}
+
+// NOTE(ingar): Throws away every field once the atlas or the table is full, which text with many distinct glyphs
+// (e.g. CJK) reaches. The glyphs that are drawn from then on are generated again as they are needed.
+isa_internal void
+StartSdfAtlasOver(scn_font *Font)
+{
+    IsaLogInfo("The glyph atlas is full, starting it over");
+    ResetFontGlyphs(Font);
+    Font->Generation++;
+}
+
+// NOTE(ingar): Generates the field on first use. Returns null for glyphs whose field could not be made, which are kept
+// in the table so that they are not tried again on every draw.
+isa_internal sdf_glyph *
+GetSdfGlyph(scn_font *Font, u32 GlyphIndex)
+{
+    sdf_glyph *Glyph = FindSdfGlyphSlot(Font, GlyphIndex);
+    if(Glyph && Glyph->Glyph == GlyphIndex)
+    {
+        return Glyph->Failed ? nullptr : Glyph;
+    }
+    if(!Font->Loaded)
+    {
+        return nullptr;
+    }
+    if(!Glyph || Font->GlyphCount >= SCN_FONT_MAX_SDF_GLYPHS)
+    {
+        StartSdfAtlasOver(Font);
+        Glyph = FindSdfGlyphSlot(Font, GlyphIndex);
+    }
+
+    int  w = 0, h = 0, XOff = 0, YOff = 0;
+    bool Failed = false;
+    u8  *Field  = stbtt_GetGlyphSDF(&Font->Info, Font->RefScale, (int)GlyphIndex, SCN_SDF_PADDING, SCN_SDF_ON_EDGE,
+                                    SCN_SDF_PIXEL_DIST, &w, &h, &XOff, &YOff);
+    if(Field && (w > SCN_SDF_ATLAS_DIM || h > SCN_SDF_ATLAS_DIM))
+    {
+        IsaLogError("Glyph %u is too large for the atlas", GlyphIndex);
+        Failed = true;
+    }
+    else if(Field)
+    {
+        /* Shelf packing, one row at a time */
+        if(Font->PackX + w > SCN_SDF_ATLAS_DIM)
+        {
+            Font->PackX = 0;
+            Font->PackY += Font->PackRowH;
+            Font->PackRowH = 0;
+        }
+        if(Font->PackY + h > SCN_SDF_ATLAS_DIM)
+        {
+            /* The glyph fits in an empty atlas, since it is no larger than it */
+            StartSdfAtlasOver(Font);
+            Glyph = FindSdfGlyphSlot(Font, GlyphIndex);
+        }
+
+        for(int y = 0; y < h; ++y)
+        {
+            u8 *Dest = Font->Atlas + ((Font->PackY + y) * SCN_SDF_ATLAS_DIM) + Font->PackX;
+            memcpy(Dest, Field + (y * w), (size_t)w);
+        }
+
+        Glyph->AtlasX = (u16)Font->PackX;
+        Glyph->AtlasY = (u16)Font->PackY;
+        Font->PackX += w;
+        Font->PackRowH = ((u32)h > Font->PackRowH) ? (u32)h : Font->PackRowH;
+    }
+    if(Field)
+    {
+        stbtt_FreeSDF(Field, nullptr);
+    }
+    if(!Field || Failed)
+    {
+        w = h = 0;
+    }
+
+    Glyph->Glyph   = GlyphIndex;
+    Glyph->w       = (u16)w;
+    Glyph->h       = (u16)h;
+    Glyph->Failed  = Failed;
+    Glyph->XOff    = (i16)XOff;
+    Glyph->YOff    = (i16)YOff;
+    Glyph->Advance = Font->Advances[GlyphIndex];
+    Font->GlyphCount++;
+
+    return Failed ? nullptr : Glyph;
+}
+
+inline u32
+ReadBigEndianu16(const u8 *At)
+{
+    return ((u32)At[0] << 8) | (u32)At[1];
+}
+
+inline u32
+ReadBigEndianu32(const u8 *At)
+{
+    return ((u32)At[0] << 24) | ((u32)At[1] << 16) | ((u32)At[2] << 8) | (u32)At[3];
+}
+
+// NOTE(ingar): Only segmented coverage (format 12) cmaps can map codepoints outside the BMP. Their groups are sorted
+// by codepoint, so the ones past the BMP are copied as they are.
+isa_internal void
+FlattenSupplementaryRanges(scn_font *Font)
+{
+    Font->RangeCount = 0;
+
+    const u8 *Cmap = Font->Info.data + Font->Info.index_map;
+    if(ReadBigEndianu16(Cmap) != 12)
+    {
+        return;
+    }
+
+    u32 GroupCount = ReadBigEndianu32(Cmap + 12);
+    for(u32 i = 0; i < GroupCount; ++i)
+    {
+        const u8 *Group = Cmap + 16 + (i * 12);
+        u32       First = ReadBigEndianu32(Group);
+        u32       Last  = ReadBigEndianu32(Group + 4);
+        if(Last < SCN_FONT_BMP_CODEPOINTS)
+        {
+            continue;
+        }
+        if(Font->RangeCount >= SCN_FONT_MAX_RANGES)
+        {
+            IsaLogInfo("The font has more than %d supplementary ranges, the rest are looked up through stbtt",
+                       SCN_FONT_MAX_RANGES);
+            break;
+        }
+
+        /* A group that straddles the end of the BMP only needs its upper part */
+        u32          Skip  = (First < SCN_FONT_BMP_CODEPOINTS) ? (SCN_FONT_BMP_CODEPOINTS - First) : 0;
+        glyph_range *Range = Font->Ranges + Font->RangeCount++;
+
+        Range->FirstCodepoint = First + Skip;
+        Range->LastCodepoint  = Last;
+        Range->FirstGlyph     = ReadBigEndianu32(Group + 8) + Skip;
+    }
+}
+
+isa_internal void
+BuildFontTables(scn_font *Font)
+{
+    for(u32 Codepoint = 0; Codepoint < SCN_FONT_BMP_CODEPOINTS; ++Codepoint)
+    {
+        Font->BmpGlyphs[Codepoint] = (u16)stbtt_FindGlyphIndex(&Font->Info, (int)Codepoint);
+    }
+    FlattenSupplementaryRanges(Font);
+
+    u32 GlyphCount = (u32)Font->Info.numGlyphs;
+    for(u32 Glyph = 0; Glyph < SCN_FONT_MAX_GLYPHS; ++Glyph)
+    {
+        int Advance = 0, Lsb = 0;
+        if(Glyph < GlyphCount)
+        {
+            stbtt_GetGlyphHMetrics(&Font->Info, (int)Glyph, &Advance, &Lsb);
+        }
+        Font->Advances[Glyph] = (float)Advance * Font->RefScale;
+    }
+
+    memset(Font->Kerning, 0, SCN_FONT_FLAT_CODEPOINTS * SCN_FONT_FLAT_CODEPOINTS * sizeof(i16));
+    for(u32 i = 0; i < SCN_FONT_KERN_SLOTS; ++i)
+    {
+        Font->KernPairs[i].Pair = SCN_FONT_EMPTY_SLOT;
+    }
+    if(!Font->Info.kern && !Font->Info.gpos)
+    {
+        return;
+    }
+
+    for(u32 Left = 0; Left < SCN_FONT_FLAT_CODEPOINTS; ++Left)
+    {
+        int LeftGlyph = Font->BmpGlyphs[Left];
+        if(!LeftGlyph)
+        {
+            continue;
+        }
+
+        i16 *Row = Font->Kerning + (Left * SCN_FONT_FLAT_CODEPOINTS);
+        for(u32 Right = 0; Right < SCN_FONT_FLAT_CODEPOINTS; ++Right)
+        {
+            int RightGlyph = Font->BmpGlyphs[Right];
+            if(RightGlyph)
+            {
+                Row[Right] = (i16)stbtt_GetGlyphKernAdvance(&Font->Info, LeftGlyph, RightGlyph);
+            }
+        }
+    }
+}
+
+// NOTE(ingar): Glyph 0 is the font's missing glyph
+inline u32
+FindGlyph(scn_font *Font, u32 Codepoint)
+{
+    if(Codepoint < SCN_FONT_BMP_CODEPOINTS)
+    {
+        return Font->BmpGlyphs[Codepoint];
+    }
+
+    u64 Low  = 0;
+    u64 High = Font->RangeCount;
+    while(Low < High)
+    {
+        u64          Mid   = Low + ((High - Low) / 2);
+        glyph_range *Range = Font->Ranges + Mid;
+        if(Codepoint < Range->FirstCodepoint)
+        {
+            High = Mid;
+        }
+        else if(Codepoint > Range->LastCodepoint)
+        {
+            Low = Mid + 1;
+        }
+        else
+        {
+            u32 Glyph = Range->FirstGlyph + (Codepoint - Range->FirstCodepoint);
+            return (Glyph < (u32)Font->Info.numGlyphs) ? Glyph : 0;
+        }
+    }
+
+    if(Font->RangeCount == SCN_FONT_MAX_RANGES)
+    {
+        return (u32)stbtt_FindGlyphIndex(&Font->Info, (int)Codepoint);
+    }
+
+    return 0;
+}
+
+// NOTE(ingar): At the reference height
+inline float
+GlyphAdvance(scn_font *Font, u32 Glyph)
+{
+    return Font->Advances[Glyph];
+}
+
+inline float
+KernAdvance(scn_font *Font, u32 LeftCodepoint, u32 LeftGlyph, u32 RightCodepoint, u32 RightGlyph)
+{
+    if(LeftCodepoint < SCN_FONT_FLAT_CODEPOINTS && RightCodepoint < SCN_FONT_FLAT_CODEPOINTS)
+    {
+        return (float)Font->Kerning[(LeftCodepoint * SCN_FONT_FLAT_CODEPOINTS) + RightCodepoint] * Font->RefScale;
+    }
+
+    u32        Pair = (LeftGlyph << 16) | RightGlyph;
+    kern_pair *Slot = Font->KernPairs + ((Pair * 2654435761u) >> (32 - SCN_FONT_KERN_SLOT_BITS));
+    if(Slot->Pair != Pair)
+    {
+        Slot->Pair = Pair;
+        Slot->Kern = (i16)stbtt_GetGlyphKernAdvance(&Font->Info, (int)LeftGlyph, (int)RightGlyph);
+    }
+
+    return (float)Slot->Kern * Font->RefScale;
+}
+
+// NOTE(ingar): Loads (or reloads) the font into a scn_font that was pushed once onto the session arena. The atlas and
+// the tables are reused across reloads, so reloading does not grow the arena.
+isa_internal bool
+LoadFont(scn_font *Font, isa_arena *Arena, const char *Path)
+{
+    if(!Font->Atlas)
+    {
+        Font->Atlas     = IsaPushArray(Arena, u8, SCN_SDF_ATLAS_DIM * SCN_SDF_ATLAS_DIM);
+        Font->BmpGlyphs = IsaPushArray(Arena, u16, SCN_FONT_BMP_CODEPOINTS);
+        Font->Ranges    = IsaPushArray(Arena, glyph_range, SCN_FONT_MAX_RANGES);
+        Font->Advances  = IsaPushArray(Arena, float, SCN_FONT_MAX_GLYPHS);
+        Font->Kerning   = IsaPushArray(Arena, i16, SCN_FONT_FLAT_CODEPOINTS * SCN_FONT_FLAT_CODEPOINTS);
+        Font->KernPairs = IsaPushArray(Arena, kern_pair, SCN_FONT_KERN_SLOTS);
+    }
+    if(Font->File)
+    {
+        free(Font->File);
+        Font->File = nullptr;
+    }
+
+    Font->Loaded = false;
+    Font->Generation++;
+    ResetFontGlyphs(Font);
+
+    Font->File = IsaLoadFileIntoMemory(Path);
+    if(!Font->File || !stbtt_InitFont(&Font->Info, Font->File->Data, 0))
+    {
+        IsaLogError("Could not load font %s", Path);
+        return false;
+    }
+
+    int Ascent, Descent, LineGap;
+    stbtt_GetFontVMetrics(&Font->Info, &Ascent, &Descent, &LineGap);
+
+    Font->RefScale = stbtt_ScaleForPixelHeight(&Font->Info, SCN_SDF_REF_HEIGHT);
+    Font->Ascent   = (float)Ascent * Font->RefScale;
+    Font->Descent  = (float)Descent * Font->RefScale;
+    Font->LineGap  = (float)LineGap * Font->RefScale;
+    Font->Loaded   = true;
+
+    BuildFontTables(Font);
+
+    /* Printable ASCII up front so that typical text never generates fields while drawing */
+    for(u32 Codepoint = ' '; Codepoint <= '~'; ++Codepoint)
+    {
+        GetSdfGlyph(Font, FindGlyph(Font, Codepoint));
+    }
+
+    return true;
+}
+
+#endif // SCN_FONT_H_
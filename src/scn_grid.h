@@ -0,0 +1,380 @@
+/*
+ * Copyright 2024 (c) by Ingar Solveigson Asheim. All Rights Reserved.
+ */
+
+#ifndef SCN_GRID_H_
+#define SCN_GRID_H_
+
+#include "isa.h"
+#include "scn.h"
+#include "scn_intrinsics.h"
+#include "scn_note_text.h"
+
+/* NOTE(ingar): Spatial grid
+ *
+ * The board is cut into square cells and every note is listed in each of the cells it overlaps, so a rectangle query
+ * only looks at the notes in the cells it covers. The board has no bounds, so cells are hashed into a fixed number of
+ * buckets and a bucket can hold notes from cells that are far apart. Queries test every note they find against the
+ * rectangle and set a bit for each hit, so finding a note more than once does no harm. Notes that cover too many
+ * cells to list in each go on one list that every query looks at.
+ *
+ * The grid is derived from the notes, and is built when session memory is set up and lives there. Notes are indexed by
+ * their place in the note array, the same as in the search index. Bucket lists are power of two blocks with free
+ * lists, the same as note text.
+ *
+ * The grid also keeps the rect of every note in four arrays of its own, one per side, since it is told about every
+ * change to a rect and every note that changes place. Picking the note under a point tests those arrays eight notes at
+ * a time and only reads the notes that are hit, so it stays fast on a large board without looking at the buckets.
+ */
+
+#define SCN_GRID_CELL_SHIFT     7 // 128 pixel cells
+#define SCN_GRID_BUCKET_BITS    12
+#define SCN_GRID_BUCKETS        (1 << SCN_GRID_BUCKET_BITS)
+#define SCN_GRID_MAX_NOTE_CELLS 64
+#define SCN_GRID_PICK_BLOCK     8 // Notes tested per step of a pick
+
+struct grid_bucket
+{
+    u32  Count;
+    u32  Capacity; // In bytes
+    u32 *Notes;    // In no particular order, a note is in a bucket once for every one of its cells that hash to it
+};
+
+struct spatial_grid
+{
+    isa_arena     *Arena;
+    text_allocator Blocks;
+
+    grid_bucket *Buckets; // SCN_GRID_BUCKETS
+    grid_bucket  Large;   // Notes that cover more than SCN_GRID_MAX_NOTE_CELLS cells
+
+    // NOTE(ingar): By note index, 64 byte aligned and padded to a whole pick block. Only valid below the note count.
+    float *MinX, *MinY;
+    float *MaxX, *MaxY;
+};
+
+struct grid_cells
+{
+    i64 MinX, MinY;
+    i64 MaxX, MaxY; // Inclusive
+};
+
+inline grid_cells
+GridCells(rect Rect)
+{
+    float      Scale  = 1.0f / (float)(1 << SCN_GRID_CELL_SHIFT);
+    grid_cells Result = { FloorFloatToi64(Rect.Min.x * Scale), FloorFloatToi64(Rect.Min.y * Scale),
+                          FloorFloatToi64(Rect.Max.x * Scale), FloorFloatToi64(Rect.Max.y * Scale) };
+    return Result;
+}
+
+inline u64
+GridCellCount(grid_cells Cells)
+{
+    return (u64)(Cells.MaxX - Cells.MinX + 1) * (u64)(Cells.MaxY - Cells.MinY + 1);
+}
+
+inline grid_bucket *
+GridBucket(spatial_grid *Grid, i64 x, i64 y)
+{
+    u64 Hash = ((u64)x * 0x9E3779B97F4A7C15ULL) ^ ((u64)y * 0xC2B2AE3D27D4EB4FULL);
+    return Grid->Buckets + (Hash >> (64 - SCN_GRID_BUCKET_BITS));
+}
+
+isa_internal void
+AddToGridBucket(spatial_grid *Grid, grid_bucket *Bucket, u32 Note)
+{
+    u64 Size = ((u64)Bucket->Count + 1) * sizeof(u32);
+    if(Size > Bucket->Capacity)
+    {
+        u32 Capacity = 0;
+        u8 *Block    = AllocTextBlock(&Grid->Blocks, Grid->Arena, 2 * Size, &Capacity);
+        if(!Block)
+        {
+            return;
+        }
+
+        if(Bucket->Notes)
+        {
+            memcpy(Block, Bucket->Notes, Bucket->Count * sizeof(u32));
+        }
+        FreeTextBlock(&Grid->Blocks, (u8 *)Bucket->Notes, Bucket->Capacity);
+        Bucket->Notes    = (u32 *)Block;
+        Bucket->Capacity = Capacity;
+    }
+
+    Bucket->Notes[Bucket->Count++] = Note;
+}
+
+isa_internal void
+RemoveFromGridBucket(grid_bucket *Bucket, u32 Note)
+{
+    for(u32 i = 0; i < Bucket->Count; ++i)
+    {
+        if(Bucket->Notes[i] == Note)
+        {
+            Bucket->Notes[i] = Bucket->Notes[--Bucket->Count];
+            break;
+        }
+    }
+}
+
+inline void
+SetGridBounds(spatial_grid *Grid, u64 NoteIndex, rect Rect)
+{
+    Grid->MinX[NoteIndex] = Rect.Min.x;
+    Grid->MinY[NoteIndex] = Rect.Min.y;
+    Grid->MaxX[NoteIndex] = Rect.Max.x;
+    Grid->MaxY[NoteIndex] = Rect.Max.y;
+}
+
+isa_internal void
+AddNoteToGrid(spatial_grid *Grid, u64 NoteIndex, rect Rect)
+{
+    SetGridBounds(Grid, NoteIndex, Rect);
+
+    grid_cells Cells = GridCells(Rect);
+    if(GridCellCount(Cells) > SCN_GRID_MAX_NOTE_CELLS)
+    {
+        AddToGridBucket(Grid, &Grid->Large, (u32)NoteIndex);
+        return;
+    }
+
+    for(i64 y = Cells.MinY; y <= Cells.MaxY; ++y)
+    {
+        for(i64 x = Cells.MinX; x <= Cells.MaxX; ++x)
+        {
+            AddToGridBucket(Grid, GridBucket(Grid, x, y), (u32)NoteIndex);
+        }
+    }
+}
+
+// NOTE(ingar): Rect must be the one the note was added with
+isa_internal void
+RemoveNoteFromGrid(spatial_grid *Grid, u64 NoteIndex, rect Rect)
+{
+    grid_cells Cells = GridCells(Rect);
+    if(GridCellCount(Cells) > SCN_GRID_MAX_NOTE_CELLS)
+    {
+        RemoveFromGridBucket(&Grid->Large, (u32)NoteIndex);
+        return;
+    }
+
+    for(i64 y = Cells.MinY; y <= Cells.MaxY; ++y)
+    {
+        for(i64 x = Cells.MinX; x <= Cells.MaxX; ++x)
+        {
+            RemoveFromGridBucket(GridBucket(Grid, x, y), (u32)NoteIndex);
+        }
+    }
+}
+
+isa_internal void
+MoveNoteInGrid(spatial_grid *Grid, u64 NoteIndex, rect From, rect To)
+{
+    RemoveNoteFromGrid(Grid, NoteIndex, From);
+    AddNoteToGrid(Grid, NoteIndex, To);
+}
+
+// NOTE(ingar): Gives every note in the grid the index NewIndex[Old]. A note whose index maps to UINT32_MAX is left out.
+// The notes that are kept must stay in the same order, and NoteCount is the number of notes before the change.
+isa_internal void
+RenumberGrid(spatial_grid *Grid, u32 *NewIndex, u64 NoteCount)
+{
+    /* Bounds that move down are copied from the front and bounds that move up from the back, so that with the order
+     * kept no bounds are overwritten before they are copied */
+    for(u64 i = 0; i < NoteCount; ++i)
+    {
+        if(NewIndex[i] < i)
+        {
+            rect Rect = { V2(Grid->MinX[i], Grid->MinY[i]), V2(Grid->MaxX[i], Grid->MaxY[i]) };
+            SetGridBounds(Grid, NewIndex[i], Rect);
+        }
+    }
+    for(u64 i = NoteCount; i-- > 0;)
+    {
+        if(NewIndex[i] != UINT32_MAX && NewIndex[i] > i)
+        {
+            rect Rect = { V2(Grid->MinX[i], Grid->MinY[i]), V2(Grid->MaxX[i], Grid->MaxY[i]) };
+            SetGridBounds(Grid, NewIndex[i], Rect);
+        }
+    }
+
+    for(u64 i = 0; i <= SCN_GRID_BUCKETS; ++i)
+    {
+        grid_bucket *Bucket = (i < SCN_GRID_BUCKETS) ? Grid->Buckets + i : &Grid->Large;
+        for(u32 j = 0; j < Bucket->Count;)
+        {
+            u32 New = NewIndex[Bucket->Notes[j]];
+            if(New == UINT32_MAX)
+            {
+                Bucket->Notes[j] = Bucket->Notes[--Bucket->Count];
+            }
+            else
+            {
+                Bucket->Notes[j++] = New;
+            }
+        }
+    }
+}
+
+isa_internal void
+RenameInGridBucket(grid_bucket *Bucket, u32 From, u32 To)
+{
+    for(u32 i = 0; i < Bucket->Count; ++i)
+    {
+        if(Bucket->Notes[i] == From)
+        {
+            Bucket->Notes[i] = To;
+            break;
+        }
+    }
+}
+
+// NOTE(ingar): For when a note moves to another place in the array. Rect must be the one the note was added with.
+isa_internal void
+RenameGridNote(spatial_grid *Grid, u64 From, u64 To, rect Rect)
+{
+    SetGridBounds(Grid, To, Rect);
+
+    grid_cells Cells = GridCells(Rect);
+    if(GridCellCount(Cells) > SCN_GRID_MAX_NOTE_CELLS)
+    {
+        RenameInGridBucket(&Grid->Large, (u32)From, (u32)To);
+        return;
+    }
+
+    /* The note is in a bucket once for each of its cells that hash to it, so one rename per cell gets them all */
+    for(i64 y = Cells.MinY; y <= Cells.MaxY; ++y)
+    {
+        for(i64 x = Cells.MinX; x <= Cells.MaxX; ++x)
+        {
+            RenameInGridBucket(GridBucket(Grid, x, y), (u32)From, (u32)To);
+        }
+    }
+}
+
+isa_internal void
+ClearGrid(spatial_grid *Grid)
+{
+    for(u64 i = 0; i < SCN_GRID_BUCKETS; ++i)
+    {
+        Grid->Buckets[i].Count = 0;
+    }
+    Grid->Large.Count = 0;
+}
+
+isa_internal void
+RebuildGrid(spatial_grid *Grid, note_collection *Notes)
+{
+    ClearGrid(Grid);
+    for(u64 i = 0; i < Notes->Count; ++i)
+    {
+        AddNoteToGrid(Grid, i, Notes->N[i].Rect);
+    }
+}
+
+isa_internal void
+QueryGridBucket(grid_bucket *Bucket, note_collection *Notes, rect Rect, u64 *Bits)
+{
+    for(u32 i = 0; i < Bucket->Count; ++i)
+    {
+        u32 Note = Bucket->Notes[i];
+        if(RectsOverlap(Notes->N[Note].Rect, Rect))
+        {
+            Bits[Note / 64] |= 1ULL << (Note % 64);
+        }
+    }
+}
+
+// NOTE(ingar): Sets the bits of the notes that overlap Rect, and leaves the others as they are
+isa_internal void
+QueryGrid(spatial_grid *Grid, note_collection *Notes, rect Rect, u64 *Bits)
+{
+    /* A rect that covers more cells than there are buckets would visit buckets more than once, so every note is
+     * tested against it from the bounds instead */
+    grid_cells Cells = GridCells(Rect);
+    if(GridCellCount(Cells) >= SCN_GRID_BUCKETS)
+    {
+        CullRects(Grid->MinX, Grid->MinY, Grid->MaxX, Grid->MaxY, Notes->Count, Rect, Bits);
+        return;
+    }
+
+    QueryGridBucket(&Grid->Large, Notes, Rect, Bits);
+
+    for(i64 y = Cells.MinY; y <= Cells.MaxY; ++y)
+    {
+        for(i64 x = Cells.MinX; x <= Cells.MaxX; ++x)
+        {
+            QueryGridBucket(GridBucket(Grid, x, y), Notes, Rect, Bits);
+        }
+    }
+}
+
+// NOTE(ingar): Index of the note with the highest z that contains the point, or -1
+isa_internal i64
+PickGridNote(spatial_grid *Grid, note_collection *Notes, float x, float y)
+{
+    __m128 X = _mm_set1_ps(x);
+    __m128 Y = _mm_set1_ps(y);
+
+    i64 Result = -1;
+    u64 TopZ   = 0;
+    for(u64 Block = 0; Block < Notes->Count; Block += SCN_GRID_PICK_BLOCK)
+    {
+        u32 Hits = 0;
+        for(u64 Lane = 0; Lane < SCN_GRID_PICK_BLOCK; Lane += 4)
+        {
+            u64    i   = Block + Lane;
+            __m128 InX = _mm_and_ps(_mm_cmpge_ps(X, _mm_load_ps(Grid->MinX + i)),
+                                    _mm_cmple_ps(X, _mm_load_ps(Grid->MaxX + i)));
+            __m128 InY = _mm_and_ps(_mm_cmpge_ps(Y, _mm_load_ps(Grid->MinY + i)),
+                                    _mm_cmple_ps(Y, _mm_load_ps(Grid->MaxY + i)));
+            Hits |= (u32)_mm_movemask_ps(_mm_and_ps(InX, InY)) << Lane;
+        }
+
+        /* The lanes past the last note hold whatever was there before */
+        if(Notes->Count - Block < SCN_GRID_PICK_BLOCK)
+        {
+            Hits &= (1u << (Notes->Count - Block)) - 1;
+        }
+
+        for(; Hits; Hits &= Hits - 1)
+        {
+            u64 i = Block + CountTrailingZeros(Hits);
+            if(Result < 0 || Notes->N[i].z > TopZ)
+            {
+                Result = (i64)i;
+                TopZ   = Notes->N[i].z;
+            }
+        }
+    }
+
+    return Result;
+}
+
+inline float *
+PushGridBoundsArray(isa_arena *Arena, u64 Count)
+{
+    u8 *Mem = (u8 *)IsaArenaPush(Arena, (Count * sizeof(float)) + 64);
+    return (float *)(((uintptr_t)Mem + 63) & ~(uintptr_t)63);
+}
+
+isa_internal spatial_grid *
+CreateSpatialGrid(isa_arena *Arena, u64 MaxNotes)
+{
+    spatial_grid *Grid = IsaPushStructZero(Arena, spatial_grid);
+    Grid->Arena        = Arena;
+    Grid->Buckets      = IsaPushArray(Arena, grid_bucket, SCN_GRID_BUCKETS);
+    memset(Grid->Buckets, 0, SCN_GRID_BUCKETS * sizeof(grid_bucket));
+
+    u64 Padded = (MaxNotes + SCN_GRID_PICK_BLOCK - 1) & ~(u64)(SCN_GRID_PICK_BLOCK - 1);
+    Grid->MinX = PushGridBoundsArray(Arena, Padded);
+    Grid->MinY = PushGridBoundsArray(Arena, Padded);
+    Grid->MaxX = PushGridBoundsArray(Arena, Padded);
+    Grid->MaxY = PushGridBoundsArray(Arena, Padded);
+
+    return Grid;
+}
+
+#endif // SCN_GRID_H_
@@ -0,0 +1,380 @@
+/*
+ * Copyright 2024 (c) by Ingar Solveigson Asheim. All Rights Reserved.
+ */
+
+#ifndef SCN_IMAGES_H_
+#define SCN_IMAGES_H_
+
+#include "isa.h"
+#include "scn.h"
+#include "scn_pixels.h"
+
+/* NOTE(ingar): Image attachments
+ *
+ * Notes refer to the file attached to them by its place in the image table, which is in permanent memory. Entries are
+ * never removed, so notes that are kept in the undo log can go on referring to theirs, and attaching a file that is in
+ * the table already reuses its entry.
+ *
+ * The pixels are decoded by the platform on a thread of its own, and only at the size the image is shown at: the
+ * largest that fits in the note, at most SCN_IMAGE_MAX_SIDE each way and never larger than the file. Nothing is kept
+ * of a file at its full resolution; it is read again if it has to be shown at another size. Decoded images are kept
+ * in tiles from the image memory, and when there is no room for another one the images that were drawn the longest
+ * ago are dropped. Images that are being decoded or that were drawn in the current frame are never dropped.
+ *
+ * The platform decodes requests in order, on one thread. A job that was still pending when session memory was set up
+ * again has written its tiles before any later job writes the same tiles, so they can be handed out again right away,
+ * and job numbers are kept in scn_mem so the result of such a job is not mistaken for a new one.
+ */
+
+#define SCN_MAX_IMAGES       1024 // Files in the image table
+#define SCN_IMAGE_CACHE_SIZE 256  // Decoded images
+#define SCN_NO_TILE          UINT32_MAX
+
+struct image_attachment
+{
+    u32  PathLen;
+    char Path[SCN_PATH_MAX]; // UTF-8, zero terminated
+};
+
+struct image_table
+{
+    u32               MaxCount;
+    u32               Count; // Entry 0 is not used, so that 0 is no image
+    image_attachment *Images;
+};
+
+isa_internal image_table *
+CreateImageTable(isa_arena *Arena)
+{
+    image_table *Table = IsaPushStructZero(Arena, image_table);
+    Table->MaxCount    = SCN_MAX_IMAGES;
+    Table->Count       = 1;
+    Table->Images      = IsaPushArrayZero(Arena, image_attachment, Table->MaxCount);
+
+    return Table;
+}
+
+// NOTE(ingar): Returns the entry of the file, or 0 if the path is too long or the table is full
+isa_internal u32
+AddImage(image_table *Table, const char *Path, u32 PathLen)
+{
+    if(!PathLen || PathLen >= SCN_PATH_MAX)
+    {
+        return 0;
+    }
+
+    for(u32 i = 1; i < Table->Count; ++i)
+    {
+        image_attachment *Image = Table->Images + i;
+        if(Image->PathLen == PathLen && memcmp(Image->Path, Path, PathLen) == 0)
+        {
+            return i;
+        }
+    }
+
+    if(Table->Count == Table->MaxCount)
+    {
+        return 0;
+    }
+
+    image_attachment *Image = Table->Images + Table->Count;
+    Image->PathLen          = PathLen;
+    memcpy(Image->Path, Path, PathLen);
+    Image->Path[PathLen] = 0;
+
+    return Table->Count++;
+}
+
+/* Cache of decoded images */
+
+enum image_entry_state : u32
+{
+    ImageEntry_Free,
+    ImageEntry_Pending, // Being decoded, the platform writes its tiles
+    ImageEntry_Ready,
+    ImageEntry_Failed, // Kept so that the file is not read again every time the note is drawn
+};
+
+struct image_entry
+{
+    image_entry_state State;
+    u32               Image;
+    u32               MaxW, MaxH; // The box the image was fitted to, which the tiles are laid out across
+    u32               w, h;       // Of the decoded image
+    u64               Job;
+    u64               LastDrawn; // Frame
+    u32               Tiles[SCN_IMAGE_MAX_TILES];
+};
+
+struct image_cache
+{
+    scn_mem     *Mem;
+    image_entry *Entries; // SCN_IMAGE_CACHE_SIZE
+
+    u8  *TileMem;
+    u32  TileCount;
+    u32 *FreeTiles;
+    u32  FreeCount;
+
+    u64  Frame;    // Counts the frames that are drawn
+    bool Deferred; // An image could not be requested since the ring was full
+};
+
+inline u32
+ImageTilesAcross(u32 Pixels)
+{
+    return (Pixels + SCN_IMAGE_TILE - 1) / SCN_IMAGE_TILE;
+}
+
+isa_internal image_cache *
+CreateImageCache(isa_arena *Arena, scn_mem *Mem)
+{
+    image_cache *Cache = IsaPushStructZero(Arena, image_cache);
+    Cache->Mem         = Mem;
+    Cache->Entries     = IsaPushArrayZero(Arena, image_entry, SCN_IMAGE_CACHE_SIZE);
+    Cache->TileMem     = (u8 *)Mem->ImageMem;
+    Cache->TileCount   = Mem->ImageMem ? (u32)(Mem->ImageMemSize / SCN_IMAGE_TILE_BYTES) : 0;
+    Cache->FreeTiles   = IsaPushArray(Arena, u32, Cache->TileCount);
+    Cache->FreeCount   = Cache->TileCount;
+    for(u32 i = 0; i < Cache->TileCount; ++i)
+    {
+        Cache->FreeTiles[i] = Cache->TileCount - 1 - i;
+    }
+
+    return Cache;
+}
+
+isa_internal void
+FreeImageTiles(image_cache *Cache, image_entry *Entry)
+{
+    u32 Count = ImageTilesAcross(Entry->MaxW) * ImageTilesAcross(Entry->MaxH);
+    for(u32 i = 0; i < Count; ++i)
+    {
+        if(Entry->Tiles[i] != SCN_NO_TILE)
+        {
+            Cache->FreeTiles[Cache->FreeCount++] = Entry->Tiles[i];
+            Entry->Tiles[i]                      = SCN_NO_TILE;
+        }
+    }
+}
+
+inline image_entry *
+FindImageEntry(image_cache *Cache, u32 Image, u32 MaxW, u32 MaxH)
+{
+    for(u32 i = 0; i < SCN_IMAGE_CACHE_SIZE; ++i)
+    {
+        image_entry *Entry = Cache->Entries + i;
+        if(Entry->State != ImageEntry_Free && Entry->Image == Image && Entry->MaxW == MaxW && Entry->MaxH == MaxH)
+        {
+            return Entry;
+        }
+    }
+
+    return nullptr;
+}
+
+// NOTE(ingar): The entry that was drawn the longest ago and can be dropped, or null if there is none
+isa_internal image_entry *
+OldestImageEntry(image_cache *Cache)
+{
+    image_entry *Oldest = nullptr;
+    for(u32 i = 0; i < SCN_IMAGE_CACHE_SIZE; ++i)
+    {
+        image_entry *Entry = Cache->Entries + i;
+        bool         Done  = (Entry->State == ImageEntry_Ready || Entry->State == ImageEntry_Failed);
+        if(Done && Entry->LastDrawn < Cache->Frame && (!Oldest || Entry->LastDrawn < Oldest->LastDrawn))
+        {
+            Oldest = Entry;
+        }
+    }
+
+    return Oldest;
+}
+
+isa_internal void
+DropImageEntry(image_cache *Cache, image_entry *Entry)
+{
+    FreeImageTiles(Cache, Entry);
+    Entry->State = ImageEntry_Free;
+}
+
+// NOTE(ingar): Asks the platform to decode the image to fit in MaxW by MaxH, making room for it if needed. Returns the
+// pending entry, or null if there is no room or the request has to wait for the ring.
+isa_internal image_entry *
+RequestImage(image_cache *Cache, image_table *Table, u32 Image, u32 MaxW, u32 MaxH)
+{
+    IsaAssert(MaxW && MaxH && MaxW <= SCN_IMAGE_MAX_SIDE && MaxH <= SCN_IMAGE_MAX_SIDE, "Invalid image size");
+
+    u32 Needed = ImageTilesAcross(MaxW) * ImageTilesAcross(MaxH);
+    if(Needed > Cache->TileCount)
+    {
+        return nullptr;
+    }
+
+    scn_image_request *Request = ScnRingReserve(&Cache->Mem->ImageRequests);
+    if(!Request)
+    {
+        Cache->Deferred = true;
+        return nullptr;
+    }
+
+    image_entry *Entry = nullptr;
+    for(u32 i = 0; i < SCN_IMAGE_CACHE_SIZE && !Entry; ++i)
+    {
+        Entry = (Cache->Entries[i].State == ImageEntry_Free) ? Cache->Entries + i : nullptr;
+    }
+    while(!Entry || Cache->FreeCount < Needed)
+    {
+        image_entry *Oldest = OldestImageEntry(Cache);
+        if(!Oldest)
+        {
+            return nullptr;
+        }
+
+        DropImageEntry(Cache, Oldest);
+        Entry = Entry ? Entry : Oldest;
+    }
+
+    Entry->State     = ImageEntry_Pending;
+    Entry->Image     = Image;
+    Entry->MaxW      = MaxW;
+    Entry->MaxH      = MaxH;
+    Entry->w         = 0;
+    Entry->h         = 0;
+    Entry->Job       = ++Cache->Mem->LastImageJob;
+    Entry->LastDrawn = Cache->Frame;
+    for(u32 i = 0; i < Needed; ++i)
+    {
+        Entry->Tiles[i] = Cache->FreeTiles[--Cache->FreeCount];
+    }
+
+    image_attachment *File = Table->Images + Image;
+    Request->Job           = Entry->Job;
+    Request->MaxW          = MaxW;
+    Request->MaxH          = MaxH;
+    memcpy(Request->Tiles, Entry->Tiles, Needed * sizeof(u32));
+    memcpy(Request->Path, File->Path, File->PathLen + 1);
+    ScnRingCommit(&Cache->Mem->ImageRequests);
+
+    return Entry;
+}
+
+// NOTE(ingar): Takes in the result of a decode. Returns the image that was decoded, or 0 if the job is not one of
+// this session's.
+isa_internal u32
+FinishImageJob(image_cache *Cache, scn_image_event Event)
+{
+    image_entry *Entry = nullptr;
+    for(u32 i = 0; i < SCN_IMAGE_CACHE_SIZE && !Entry; ++i)
+    {
+        image_entry *Candidate = Cache->Entries + i;
+        Entry = (Candidate->State == ImageEntry_Pending && Candidate->Job == Event.Job) ? Candidate : nullptr;
+    }
+    if(!Entry)
+    {
+        return 0;
+    }
+
+    if(!Event.w || !Event.h || Event.w > Entry->MaxW || Event.h > Entry->MaxH)
+    {
+        Entry->State = ImageEntry_Failed;
+        FreeImageTiles(Cache, Entry);
+        return Entry->Image;
+    }
+
+    /* The image is usually narrower or shorter than the box, and the tiles it does not reach are given back */
+    Entry->State = ImageEntry_Ready;
+    Entry->w     = Event.w;
+    Entry->h     = Event.h;
+
+    u32 Across = ImageTilesAcross(Entry->MaxW);
+    u32 Down   = ImageTilesAcross(Entry->MaxH);
+    u32 UsedX  = ImageTilesAcross(Entry->w);
+    u32 UsedY  = ImageTilesAcross(Entry->h);
+    for(u32 y = 0; y < Down; ++y)
+    {
+        for(u32 x = (y < UsedY) ? UsedX : 0; x < Across; ++x)
+        {
+            u32 *Tile = Entry->Tiles + (y * Across) + x;
+            Cache->FreeTiles[Cache->FreeCount++] = *Tile;
+            *Tile                                = SCN_NO_TILE;
+        }
+    }
+
+    return Entry->Image;
+}
+
+/* Drawing */
+
+template <typename format>
+isa_internal void
+DrawImageIn(scn_offscreen_buffer Buffer, pixel_span Span, image_cache *Cache, image_entry *Entry, i64 Left, i64 Top)
+{
+    typedef typename format::type pixel;
+
+    /* Each pixel of the buffer takes the pixel of the image under its middle */
+    i64 Size   = (i64)Buffer.PixelSize;
+    i64 Half   = Size / 2;
+    u32 Across = ImageTilesAcross(Entry->MaxW);
+
+    i64 StartX = ((Left - Half) + Size - 1) / Size;
+    i64 EndX   = ((Left + Entry->w - Half) + Size - 1) / Size;
+    i64 StartY = ((Top - Half) + Size - 1) / Size;
+    i64 EndY   = ((Top + Entry->h - Half) + Size - 1) / Size;
+    StartX     = (StartX > Span.StartX) ? StartX : Span.StartX;
+    EndX       = (EndX < Span.EndX) ? EndX : Span.EndX;
+    StartY     = (StartY > Span.StartY) ? StartY : Span.StartY;
+    EndY       = (EndY < Span.EndY) ? EndY : Span.EndY;
+    for(i64 y = StartY; y < EndY; ++y)
+    {
+        i64    ImageY = (y * Size) + Half - Top;
+        u32   *Row    = Entry->Tiles + ((ImageY / SCN_IMAGE_TILE) * Across);
+        i64    TileY  = (ImageY % SCN_IMAGE_TILE) * SCN_IMAGE_TILE;
+        pixel *Pixels = (pixel *)PixelAt(Buffer, 0, y);
+        for(i64 x = StartX; x < EndX; ++x)
+        {
+            i64       ImageX = (x * Size) + Half - Left;
+            u32      *Tile   = (u32 *)(Cache->TileMem + ((u64)Row[ImageX / SCN_IMAGE_TILE] * SCN_IMAGE_TILE_BYTES));
+            u32_argb  Color  = U32Argb(Tile[TileY + (ImageX % SCN_IMAGE_TILE)]);
+            if(Color.a == 0xFF)
+            {
+                Pixels[x] = format::Pack(Color);
+            }
+            else if(Color.a)
+            {
+                Pixels[x] = BlendOver<format>(Pixels[x], Color, Color.a + (Color.a >> 7));
+            }
+        }
+    }
+}
+
+// NOTE(ingar): Draws a decoded image with its top left corner at Left, Top in whole pixels of the window. Clip is in
+// window pixels.
+isa_internal void
+DrawImage(scn_offscreen_buffer Buffer, rect Clip, image_cache *Cache, image_entry *Entry, i64 Left, i64 Top)
+{
+    IsaAssert(Entry->State == ImageEntry_Ready, "The image has not been decoded");
+
+    rect       Pixels = BufferClip(Buffer, Clip);
+    pixel_span Span   = { (i64)Pixels.Min.x, (i64)Pixels.Min.y, (i64)Pixels.Max.x, (i64)Pixels.Max.y };
+    switch(Buffer.Format)
+    {
+        case ScnPixelFormat_Bgra8:
+            {
+                DrawImageIn<pixel_bgra8>(Buffer, Span, Cache, Entry, Left, Top);
+            }
+            break;
+        case ScnPixelFormat_Rgb565:
+            {
+                DrawImageIn<pixel_rgb565>(Buffer, Span, Cache, Entry, Left, Top);
+            }
+            break;
+        case ScnPixelFormat_A8:
+            {
+                DrawImageIn<pixel_a8>(Buffer, Span, Cache, Entry, Left, Top);
+            }
+            break;
+    }
+}
+
+#endif // SCN_IMAGES_H_
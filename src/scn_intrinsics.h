@@ -3,6 +3,11 @@
 
 #include "isa.h"
 
+#include <immintrin.h>
+#if COMPILER_MSVC
+#include <intrin.h>
+#endif
+
 inline i32
 SignOfi32(i32 Value)
 {
@@ -127,4 +132,72 @@ Truncatei64ToFloat(i64 I64)
     return Result;
 }
 
+// NOTE(ingar): On x64 aligned 64-bit loads and stores are atomic and the hardware does not reorder a store with
+// earlier stores or a load with later loads, so acquire/release only needs to stop the compiler from reordering.
+inline u64
+AtomicLoadAcquireu64(volatile u64 *Value)
+{
+#if COMPILER_MSVC
+    u64 Result = *Value;
+    _ReadWriteBarrier();
+#else
+    u64 Result = __atomic_load_n(Value, __ATOMIC_ACQUIRE);
+#endif
+
+    return Result;
+}
+
+inline void
+AtomicStoreReleaseu64(volatile u64 *Value, u64 New)
+{
+#if COMPILER_MSVC
+    _ReadWriteBarrier();
+    *Value = New;
+#else
+    __atomic_store_n(Value, New, __ATOMIC_RELEASE);
+#endif
+}
+
+// NOTE(ingar): Value must not be 0
+inline u32
+CountTrailingZeros(u32 Value)
+{
+#if COMPILER_MSVC
+    unsigned long Index;
+    _BitScanForward(&Index, Value);
+    u32 Result = (u32)Index;
+#else
+    u32 Result = (u32)__builtin_ctz(Value);
+#endif
+
+    return Result;
+}
+
+// NOTE(ingar): Value must not be 0
+inline u32
+CountTrailingZerosu64(u64 Value)
+{
+#if COMPILER_MSVC
+    unsigned long Index;
+    _BitScanForward64(&Index, Value);
+    u32 Result = (u32)Index;
+#else
+    u32 Result = (u32)__builtin_ctzll(Value);
+#endif
+
+    return Result;
+}
+
+inline u32
+PopCountu64(u64 Value)
+{
+#if COMPILER_MSVC
+    u32 Result = (u32)__popcnt64(Value);
+#else
+    u32 Result = (u32)__builtin_popcountll(Value);
+#endif
+
+    return Result;
+}
+
 #endif // SCN_INTRINSICS_H_
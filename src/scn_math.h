@@ -3,6 +3,8 @@
 
 #include "isa.h"
 
+#include <immintrin.h>
+
 union v2
 {
     struct
@@ -19,10 +21,10 @@ struct rect
 
 typedef v2 p2;
 
-inline v2
+constexpr v2
 V2(float x, float y)
 {
-    v2 Result;
+    v2 Result = {};
 
     Result.x = x;
     Result.y = y;
@@ -30,33 +32,66 @@ V2(float x, float y)
     return Result;
 }
 
-inline v2
-operator+(v2 &a, v2 &b)
+constexpr v2
+operator+(v2 a, v2 b)
 {
-    v2 Result;
-    Result.x = a.x + b.x;
-    Result.y = a.y + b.y;
-    return Result;
+    return V2(a.x + b.x, a.y + b.y);
 }
 
-inline v2
-operator-(v2 &a, v2 &b)
+constexpr v2
+operator-(v2 a, v2 b)
 {
-    v2 Result;
-    Result.x = a.x - b.x;
-    Result.y = a.y - b.y;
-    return Result;
+    return V2(a.x - b.x, a.y - b.y);
+}
+
+constexpr v2
+operator-(v2 a)
+{
+    return V2(-a.x, -a.y);
+}
+
+constexpr v2
+operator*(v2 a, float s)
+{
+    return V2(a.x * s, a.y * s);
 }
 
-inline v2
-operator-(v2 &a)
+constexpr v2
+operator*(float s, v2 a)
 {
-    a.x = -a.x;
-    a.y = -a.y;
+    return V2(a.x * s, a.y * s);
+}
+
+constexpr v2 &
+operator+=(v2 &a, v2 b)
+{
+    a = a + b;
     return a;
 }
 
-inline bool
+constexpr v2 &
+operator-=(v2 &a, v2 b)
+{
+    a = a - b;
+    return a;
+}
+
+constexpr rect
+OffsetRect(rect r, v2 Offset)
+{
+    rect Result = { r.Min + Offset, r.Max + Offset };
+    return Result;
+}
+
+// NOTE(ingar): Shrinks the rect if Amount is negative
+constexpr rect
+GrowRect(rect r, float Amount)
+{
+    rect Result = { V2(r.Min.x - Amount, r.Min.y - Amount), V2(r.Max.x + Amount, r.Max.y + Amount) };
+    return Result;
+}
+
+constexpr bool
 InRect(rect r, float x, float y)
 {
     bool InX = (x >= r.Min.x) && (x <= r.Max.x);
@@ -65,6 +100,80 @@ InRect(rect r, float x, float y)
     return (InX && InY);
 }
 
+/* A rect is four floats, Min.x, Min.y, Max.x, Max.y, so it fits in one SSE register. With the signs of Min flipped
+ * the min of a union and the max of an intersection become a max and a min, and every lane takes the same op. */
+
+inline __m128
+LoadFlippedRect(rect r)
+{
+    return _mm_xor_ps(_mm_loadu_ps((const float *)&r), _mm_setr_ps(-0.0f, -0.0f, 0.0f, 0.0f));
+}
+
+inline rect
+StoreFlippedRect(__m128 Flipped)
+{
+    rect Result;
+    _mm_storeu_ps((float *)&Result, _mm_xor_ps(Flipped, _mm_setr_ps(-0.0f, -0.0f, 0.0f, 0.0f)));
+    return Result;
+}
+
+inline rect
+RectUnion(rect a, rect b)
+{
+    return StoreFlippedRect(_mm_max_ps(LoadFlippedRect(a), LoadFlippedRect(b)));
+}
+
+// NOTE(ingar): The result has Min > Max on some axis if the rects don't overlap, check with RectHasArea
+inline rect
+RectIntersection(rect a, rect b)
+{
+    return StoreFlippedRect(_mm_min_ps(LoadFlippedRect(a), LoadFlippedRect(b)));
+}
+
+inline bool
+RectHasArea(rect r)
+{
+    bool Result = (r.Min.x < r.Max.x) && (r.Min.y < r.Max.y);
+    return Result;
+}
+
+inline bool
+RectsOverlap(rect a, rect b)
+{
+    bool Result = RectHasArea(RectIntersection(a, b));
+    return Result;
+}
+
+/* Batches
+ *
+ * Rects kept as one array per side, like the bounds the spatial grid keeps, are handled four at a time. The arrays
+ * must be 16 byte aligned and readable up to Count rounded up to four. */
+
+// NOTE(ingar): Sets the bit of every rect that overlaps Clip, with the same test as RectsOverlap, and leaves the other
+// bits as they are
+inline void
+CullRects(const float *MinX, const float *MinY, const float *MaxX, const float *MaxY, u64 Count, rect Clip, u64 *Bits)
+{
+    __m128 ClipMinX = _mm_set1_ps(Clip.Min.x);
+    __m128 ClipMinY = _mm_set1_ps(Clip.Min.y);
+    __m128 ClipMaxX = _mm_set1_ps(Clip.Max.x);
+    __m128 ClipMaxY = _mm_set1_ps(Clip.Max.y);
+    for(u64 i = 0; i < Count; i += 4)
+    {
+        __m128 Left   = _mm_max_ps(_mm_load_ps(MinX + i), ClipMinX);
+        __m128 Right  = _mm_min_ps(_mm_load_ps(MaxX + i), ClipMaxX);
+        __m128 Top    = _mm_max_ps(_mm_load_ps(MinY + i), ClipMinY);
+        __m128 Bottom = _mm_min_ps(_mm_load_ps(MaxY + i), ClipMaxY);
+        __m128 Area   = _mm_and_ps(_mm_cmplt_ps(Left, Right), _mm_cmplt_ps(Top, Bottom));
+        u64    In     = (u64)_mm_movemask_ps(Area);
+        if(Count - i < 4)
+        {
+            In &= (1ULL << (Count - i)) - 1;
+        }
+        Bits[i / 64] |= In << (i % 64);
+    }
+}
+
 // NOTE(ingar): I'm sorry, Casey ;_;
 template <typename T>
 inline T
@@ -0,0 +1,1063 @@
+/*
+ * Copyright 2024 (c) by Ingar Solveigson Asheim. All Rights Reserved.
+ */
+
+#ifndef SCN_MIGRATE_H_
+#define SCN_MIGRATE_H_
+
+#include "isa.h"
+#include "scn.h"
+#include "scn_font.h"
+#include "scn_text.h"
+#include "scn_undo.h"
+#include "scn_search.h"
+#include "scn_grid.h"
+#include "scn_zorder.h"
+#include "scn_background.h"
+#include "scn_shape.h"
+#include "scn_spans.h"
+#include "scn_surface.h"
+#include "scn_images.h"
+
+#include <cstddef>
+
+/* NOTE(ingar): Layout versioning of the permanent state
+ *
+ * scn_state and everything it points to lives in permanent memory, which survives code reloads (and, with snapshot
+ * images, restarts). Every layout that is reachable from the permanent fields of scn_state is described in ScnSchema
+ * below, and the hash of the description is stamped into scn_mem together with SCN_STATE_VERSION when the state is
+ * created or migrated.
+ *
+ * The session fields of scn_state come after the permanent ones and are left out of ScnSchema, since session memory
+ * is set up again from the permanent state whenever its layout changes. They are described in ScnSessionSchema, whose
+ * hash is stamped when the session is set up, so adding or changing a cache never needs a new version.
+ *
+ * When the loaded code finds a different hash it looks for a migration from the stamped version and runs it. To
+ * change a layout:
+ *   1. Copy the current definitions of every struct that ScnSchema describes into this file with a _v<N> suffix,
+ *      unless a copy with the same layout is already here, and describe version N with them in ScnSchema_v<N>. The
+ *      old description must not use the structs in scn.h, or changing them later would change its hash.
+ *   2. Bump SCN_STATE_VERSION and change the structs in scn.h.
+ *   3. Add a migration from version N with the old hash (log it with ScnSchemaHash before the change) that rewrites
+ *      the old data into the new layout, using MigrateArray for arrays.
+ * If no migration matches, the state is thrown away and recreated instead of being read with the wrong layout.
+ */
+
+#define SCN_STATE_VERSION 6
+
+// NOTE(ingar): scn_state is placed at the start of permanent memory and the permanent arena starts after this many
+// bytes, so that scn_state can grow in place during a migration.
+#define SCN_STATE_RESERVED_SIZE IsaKiloByte(4)
+static_assert(sizeof(scn_state) <= SCN_STATE_RESERVED_SIZE, "scn_state has outgrown its reserved space");
+
+#define SCN_SCHEMA_TYPE(Type)         sizeof(Type), alignof(Type)
+#define SCN_SCHEMA_FIELD(Type, Field) offsetof(Type, Field), sizeof(((Type *)0)->Field)
+
+constexpr u64 ScnSchema[] = {
+    SCN_SCHEMA_TYPE(note),
+    SCN_SCHEMA_FIELD(note, Rect),
+    SCN_SCHEMA_FIELD(note, z),
+    SCN_SCHEMA_FIELD(note, CollectionPos),
+    SCN_SCHEMA_FIELD(note, Color),
+    SCN_SCHEMA_FIELD(note, Image),
+    SCN_SCHEMA_FIELD(note, Text),
+
+    SCN_SCHEMA_TYPE(note_text),
+    SCN_SCHEMA_FIELD(note_text, Data),
+    SCN_SCHEMA_FIELD(note_text, Capacity),
+    SCN_SCHEMA_FIELD(note_text, GapStart),
+    SCN_SCHEMA_FIELD(note_text, GapEnd),
+    SCN_SCHEMA_FIELD(note_text, Stamp),
+
+    SCN_SCHEMA_TYPE(note_collection),
+    SCN_SCHEMA_FIELD(note_collection, MaxCount),
+    SCN_SCHEMA_FIELD(note_collection, Count),
+    SCN_SCHEMA_FIELD(note_collection, SelectedNote),
+    SCN_SCHEMA_FIELD(note_collection, Selection),
+    SCN_SCHEMA_FIELD(note_collection, SelectionCount),
+    SCN_SCHEMA_FIELD(note_collection, N),
+
+    SCN_SCHEMA_TYPE(scn_mouse_event),
+    SCN_SCHEMA_FIELD(scn_mouse_event, Type),
+    SCN_SCHEMA_FIELD(scn_mouse_event, x),
+    SCN_SCHEMA_FIELD(scn_mouse_event, y),
+
+    SCN_SCHEMA_TYPE(mouse_history),
+    SCN_SCHEMA_FIELD(mouse_history, LClicked),
+    SCN_SCHEMA_FIELD(mouse_history, RClicked),
+    SCN_SCHEMA_FIELD(mouse_history, Prev),
+    SCN_SCHEMA_FIELD(mouse_history, PrevLClick),
+    SCN_SCHEMA_FIELD(mouse_history, PrevRClick),
+    SCN_SCHEMA_FIELD(mouse_history, PrevLClickPos),
+    SCN_SCHEMA_FIELD(mouse_history, PrevRClickPos),
+
+    SCN_SCHEMA_TYPE(text_allocator),
+    SCN_SCHEMA_FIELD(text_allocator, LastStamp),
+    SCN_SCHEMA_FIELD(text_allocator, FreeBlocks),
+    SCN_TEXT_MIN_BLOCK_SHIFT, // The free lists are by the size of the blocks relative to it
+
+    SCN_SCHEMA_TYPE(undo_record),
+    SCN_SCHEMA_FIELD(undo_record, Type),
+    SCN_SCHEMA_FIELD(undo_record, Size),
+    SCN_SCHEMA_FIELD(undo_record, Prev),
+    SCN_SCHEMA_FIELD(undo_record, StartUs),
+    SCN_SCHEMA_FIELD(undo_record, EndUs),
+    SCN_SCHEMA_FIELD(undo_record, NoteIndex),
+    SCN_SCHEMA_FIELD(undo_record, Note),
+    SCN_SCHEMA_FIELD(undo_record, Batch),
+    SCN_SCHEMA_FIELD(undo_record, Text),
+    SCN_SCHEMA_FIELD(undo_record, Move),
+    SCN_SCHEMA_FIELD(undo_record, Nudge),
+    SCN_SCHEMA_FIELD(undo_record, Recolor),
+    SCN_SCHEMA_FIELD(undo_record, Restack),
+    SCN_SCHEMA_FIELD(undo_record, Attach),
+    SCN_UNDO_RING_SIZE, // Positions in the ring are masked with it
+
+    SCN_SCHEMA_TYPE(undo_log),
+    SCN_SCHEMA_FIELD(undo_log, Ring),
+    SCN_SCHEMA_FIELD(undo_log, Begin),
+    SCN_SCHEMA_FIELD(undo_log, Head),
+    SCN_SCHEMA_FIELD(undo_log, End),
+    SCN_SCHEMA_FIELD(undo_log, Last),
+    SCN_SCHEMA_FIELD(undo_log, Open),
+    SCN_SCHEMA_FIELD(undo_log, Retained),
+    SCN_SCHEMA_FIELD(undo_log, MaxRetained),
+    SCN_SCHEMA_FIELD(undo_log, NowUs),
+    SCN_SCHEMA_FIELD(undo_log, SpareNotes),
+
+    SCN_SCHEMA_TYPE(image_attachment),
+    SCN_SCHEMA_FIELD(image_attachment, PathLen),
+    SCN_SCHEMA_FIELD(image_attachment, Path),
+
+    SCN_SCHEMA_TYPE(image_table),
+    SCN_SCHEMA_FIELD(image_table, MaxCount),
+    SCN_SCHEMA_FIELD(image_table, Count),
+    SCN_SCHEMA_FIELD(image_table, Images),
+
+    offsetof(scn_state, SessionArena), // Where the session fields start
+    SCN_SCHEMA_FIELD(scn_state, PermArena),
+    SCN_SCHEMA_FIELD(scn_state, Notes),
+    SCN_SCHEMA_FIELD(scn_state, MouseHistory),
+    SCN_SCHEMA_FIELD(scn_state, TextAllocator),
+    SCN_SCHEMA_FIELD(scn_state, Editing),
+    SCN_SCHEMA_FIELD(scn_state, Undo),
+    SCN_SCHEMA_FIELD(scn_state, Images),
+};
+
+constexpr u64
+ComputeSchemaHash(const u64 *Values, u64 Count)
+{
+    /* FNV-1a over the bytes of each value */
+    u64 Hash = 0xcbf29ce484222325ULL;
+    for(u64 i = 0; i < Count; ++i)
+    {
+        for(u64 Byte = 0; Byte < sizeof(u64); ++Byte)
+        {
+            Hash ^= (Values[i] >> (Byte * 8)) & 0xFF;
+            Hash *= 0x100000001b3ULL;
+        }
+    }
+
+    return Hash;
+}
+
+constexpr u64 ScnSchemaHash = ComputeSchemaHash(ScnSchema, sizeof(ScnSchema) / sizeof(ScnSchema[0]));
+
+// NOTE(ingar): The sizes of what the session fields point to are in it too, so that a cache that changes shape is
+// also set up again instead of being read with the wrong layout after a reload.
+constexpr u64 ScnSessionSchema[] = {
+    SCN_SCHEMA_TYPE(scn_state),
+    SCN_SCHEMA_FIELD(scn_state, SessionArena),
+    SCN_SCHEMA_FIELD(scn_state, Stbtt),
+    SCN_SCHEMA_FIELD(scn_state, Font),
+    SCN_SCHEMA_FIELD(scn_state, Layouts),
+    SCN_SCHEMA_FIELD(scn_state, Search),
+    SCN_SCHEMA_FIELD(scn_state, Grid),
+    SCN_SCHEMA_FIELD(scn_state, Background),
+    SCN_SCHEMA_FIELD(scn_state, Shapes),
+    SCN_SCHEMA_FIELD(scn_state, Spans),
+    SCN_SCHEMA_FIELD(scn_state, TextSurfaces),
+    SCN_SCHEMA_FIELD(scn_state, ImageCache),
+    SCN_SCHEMA_FIELD(scn_state, Band),
+    SCN_SCHEMA_FIELD(scn_state, Drag),
+    SCN_SCHEMA_FIELD(scn_state, ZOrder),
+    SCN_SCHEMA_FIELD(scn_state, NoteMap),
+    SCN_SCHEMA_FIELD(scn_state, DrawBits),
+    SCN_SCHEMA_FIELD(scn_state, Damage),
+    SCN_SCHEMA_FIELD(scn_state, BufferW),
+    SCN_SCHEMA_FIELD(scn_state, BufferH),
+    SCN_SCHEMA_FIELD(scn_state, RenderDivisor),
+
+    SCN_SCHEMA_TYPE(scn_font),
+    SCN_SCHEMA_TYPE(text_layout_cache),
+    SCN_SCHEMA_TYPE(search_index),
+    SCN_SCHEMA_TYPE(spatial_grid),
+    SCN_SCHEMA_TYPE(scn_background),
+    SCN_SCHEMA_TYPE(shape_mask_cache),
+    SCN_SCHEMA_TYPE(span_buffer),
+    SCN_SCHEMA_TYPE(text_surface_cache),
+    SCN_SCHEMA_TYPE(image_cache),
+};
+
+constexpr u64 ScnSessionSchemaHash
+    = ComputeSchemaHash(ScnSessionSchema, sizeof(ScnSessionSchema) / sizeof(ScnSessionSchema[0]));
+
+/* NOTE(ingar): Layouts of older versions
+ *
+ * Each struct here is a copy of one in scn.h as of the version in its suffix, and describes that version and the
+ * later ones until the struct changed. Pointers to notes stay note pointers, since a pointer has the same layout
+ * whatever it points to.
+ */
+
+/* Version 1: notes without text */
+
+struct note_v1
+{
+    rect     Rect;
+    u64      z;
+    u64      CollectionPos;
+    u32_argb Color;
+};
+
+struct note_collection_v1
+{
+    u64 MaxCount;
+    u64 Count;
+
+    note *SelectedNote;
+    bool  NoteIsSelected;
+
+    note *N;
+};
+
+struct scn_mouse_event_v1
+{
+    scn_mouse_event_type Type;
+    i64                  x, y;
+};
+
+struct mouse_history_v1
+{
+    bool LClicked;
+    bool RClicked;
+
+    scn_mouse_event_v1 Prev;
+    scn_mouse_event_v1 PrevLClick;
+    scn_mouse_event_v1 PrevRClick;
+
+    v2 PrevLClickPos;
+    v2 PrevRClickPos;
+};
+
+struct scn_state_v1
+{
+    isa_arena           PermArena;
+    note_collection_v1 *Notes;
+    mouse_history_v1   *MouseHistory;
+
+    isa_arena SessionArena;
+};
+
+constexpr u64 ScnSchema_v1[] = {
+    SCN_SCHEMA_TYPE(note_v1),
+    SCN_SCHEMA_FIELD(note_v1, Rect),
+    SCN_SCHEMA_FIELD(note_v1, z),
+    SCN_SCHEMA_FIELD(note_v1, CollectionPos),
+    SCN_SCHEMA_FIELD(note_v1, Color),
+
+    SCN_SCHEMA_TYPE(note_collection_v1),
+    SCN_SCHEMA_FIELD(note_collection_v1, MaxCount),
+    SCN_SCHEMA_FIELD(note_collection_v1, Count),
+    SCN_SCHEMA_FIELD(note_collection_v1, SelectedNote),
+    SCN_SCHEMA_FIELD(note_collection_v1, NoteIsSelected),
+    SCN_SCHEMA_FIELD(note_collection_v1, N),
+
+    SCN_SCHEMA_TYPE(scn_mouse_event_v1),
+    SCN_SCHEMA_FIELD(scn_mouse_event_v1, Type),
+    SCN_SCHEMA_FIELD(scn_mouse_event_v1, x),
+    SCN_SCHEMA_FIELD(scn_mouse_event_v1, y),
+
+    SCN_SCHEMA_TYPE(mouse_history_v1),
+    SCN_SCHEMA_FIELD(mouse_history_v1, LClicked),
+    SCN_SCHEMA_FIELD(mouse_history_v1, RClicked),
+    SCN_SCHEMA_FIELD(mouse_history_v1, Prev),
+    SCN_SCHEMA_FIELD(mouse_history_v1, PrevLClick),
+    SCN_SCHEMA_FIELD(mouse_history_v1, PrevRClick),
+    SCN_SCHEMA_FIELD(mouse_history_v1, PrevLClickPos),
+    SCN_SCHEMA_FIELD(mouse_history_v1, PrevRClickPos),
+
+    offsetof(scn_state_v1, SessionArena),
+    SCN_SCHEMA_FIELD(scn_state_v1, PermArena),
+    SCN_SCHEMA_FIELD(scn_state_v1, Notes),
+    SCN_SCHEMA_FIELD(scn_state_v1, MouseHistory),
+};
+
+constexpr u64 ScnSchemaHash_v1 = ComputeSchemaHash(ScnSchema_v1, sizeof(ScnSchema_v1) / sizeof(ScnSchema_v1[0]));
+
+/* Version 2: no undo log */
+
+struct note_text_v2
+{
+    u8 *Data;
+    u32 Capacity;
+    u32 GapStart;
+    u32 GapEnd;
+    u64 Stamp;
+};
+
+struct note_v2
+{
+    rect         Rect;
+    u64          z;
+    u64          CollectionPos;
+    u32_argb     Color;
+    note_text_v2 Text;
+};
+
+struct text_allocator_v2
+{
+    u64 LastStamp;
+    u8 *FreeBlocks[20]; // SCN_TEXT_BLOCK_CLASSES as of version 2
+};
+
+struct scn_state_v2
+{
+    isa_arena           PermArena;
+    note_collection_v1 *Notes;
+    mouse_history_v1   *MouseHistory;
+    text_allocator_v2   TextAllocator;
+    bool                Editing;
+
+    isa_arena SessionArena;
+};
+
+constexpr u64 ScnSchema_v2[] = {
+    SCN_SCHEMA_TYPE(note_v2),
+    SCN_SCHEMA_FIELD(note_v2, Rect),
+    SCN_SCHEMA_FIELD(note_v2, z),
+    SCN_SCHEMA_FIELD(note_v2, CollectionPos),
+    SCN_SCHEMA_FIELD(note_v2, Color),
+    SCN_SCHEMA_FIELD(note_v2, Text),
+
+    SCN_SCHEMA_TYPE(note_text_v2),
+    SCN_SCHEMA_FIELD(note_text_v2, Data),
+    SCN_SCHEMA_FIELD(note_text_v2, Capacity),
+    SCN_SCHEMA_FIELD(note_text_v2, GapStart),
+    SCN_SCHEMA_FIELD(note_text_v2, GapEnd),
+    SCN_SCHEMA_FIELD(note_text_v2, Stamp),
+
+    SCN_SCHEMA_TYPE(note_collection_v1),
+    SCN_SCHEMA_FIELD(note_collection_v1, MaxCount),
+    SCN_SCHEMA_FIELD(note_collection_v1, Count),
+    SCN_SCHEMA_FIELD(note_collection_v1, SelectedNote),
+    SCN_SCHEMA_FIELD(note_collection_v1, NoteIsSelected),
+    SCN_SCHEMA_FIELD(note_collection_v1, N),
+
+    SCN_SCHEMA_TYPE(scn_mouse_event_v1),
+    SCN_SCHEMA_FIELD(scn_mouse_event_v1, Type),
+    SCN_SCHEMA_FIELD(scn_mouse_event_v1, x),
+    SCN_SCHEMA_FIELD(scn_mouse_event_v1, y),
+
+    SCN_SCHEMA_TYPE(mouse_history_v1),
+    SCN_SCHEMA_FIELD(mouse_history_v1, LClicked),
+    SCN_SCHEMA_FIELD(mouse_history_v1, RClicked),
+    SCN_SCHEMA_FIELD(mouse_history_v1, Prev),
+    SCN_SCHEMA_FIELD(mouse_history_v1, PrevLClick),
+    SCN_SCHEMA_FIELD(mouse_history_v1, PrevRClick),
+    SCN_SCHEMA_FIELD(mouse_history_v1, PrevLClickPos),
+    SCN_SCHEMA_FIELD(mouse_history_v1, PrevRClickPos),
+
+    SCN_SCHEMA_TYPE(text_allocator_v2),
+    SCN_SCHEMA_FIELD(text_allocator_v2, LastStamp),
+    SCN_SCHEMA_FIELD(text_allocator_v2, FreeBlocks),
+    6, // SCN_TEXT_MIN_BLOCK_SHIFT as of version 2
+
+    offsetof(scn_state_v2, SessionArena),
+    SCN_SCHEMA_FIELD(scn_state_v2, PermArena),
+    SCN_SCHEMA_FIELD(scn_state_v2, Notes),
+    SCN_SCHEMA_FIELD(scn_state_v2, MouseHistory),
+    SCN_SCHEMA_FIELD(scn_state_v2, TextAllocator),
+    SCN_SCHEMA_FIELD(scn_state_v2, Editing),
+};
+
+constexpr u64 ScnSchemaHash_v2 = ComputeSchemaHash(ScnSchema_v2, sizeof(ScnSchema_v2) / sizeof(ScnSchema_v2[0]));
+
+/* Version 3: a single selected note */
+
+struct undo_record_v3
+{
+    undo_record_type Type;
+    u32              Size;
+    u64              Prev;
+    u64              StartUs;
+    u64              EndUs;
+    u64              NoteIndex;
+
+    union
+    {
+        note_v2 Note;
+
+        struct
+        {
+            note *Other;
+            u64   OtherCount;
+            u64   TextBytes;
+        } Clear;
+
+        struct
+        {
+            u32 Pos;
+            u32 Len;
+        } Text;
+
+        struct
+        {
+            rect From, To;
+        } Move;
+    };
+};
+
+struct undo_log_v3
+{
+    u8  *Ring;
+    u64  Begin;
+    u64  Head;
+    u64  End;
+    u64  Last;
+    bool Open;
+
+    u64 Retained;
+    u64 MaxRetained;
+    u64 NowUs;
+
+    note *SpareNotes;
+};
+
+struct scn_state_v3
+{
+    isa_arena           PermArena;
+    note_collection_v1 *Notes;
+    mouse_history_v1   *MouseHistory;
+    text_allocator_v2   TextAllocator;
+    bool                Editing;
+    undo_log_v3        *Undo;
+
+    isa_arena SessionArena;
+};
+
+constexpr u64 ScnSchema_v3[] = {
+    SCN_SCHEMA_TYPE(note_v2),
+    SCN_SCHEMA_FIELD(note_v2, Rect),
+    SCN_SCHEMA_FIELD(note_v2, z),
+    SCN_SCHEMA_FIELD(note_v2, CollectionPos),
+    SCN_SCHEMA_FIELD(note_v2, Color),
+    SCN_SCHEMA_FIELD(note_v2, Text),
+
+    SCN_SCHEMA_TYPE(note_text_v2),
+    SCN_SCHEMA_FIELD(note_text_v2, Data),
+    SCN_SCHEMA_FIELD(note_text_v2, Capacity),
+    SCN_SCHEMA_FIELD(note_text_v2, GapStart),
+    SCN_SCHEMA_FIELD(note_text_v2, GapEnd),
+    SCN_SCHEMA_FIELD(note_text_v2, Stamp),
+
+    SCN_SCHEMA_TYPE(note_collection_v1),
+    SCN_SCHEMA_FIELD(note_collection_v1, MaxCount),
+    SCN_SCHEMA_FIELD(note_collection_v1, Count),
+    SCN_SCHEMA_FIELD(note_collection_v1, SelectedNote),
+    SCN_SCHEMA_FIELD(note_collection_v1, NoteIsSelected),
+    SCN_SCHEMA_FIELD(note_collection_v1, N),
+
+    SCN_SCHEMA_TYPE(scn_mouse_event_v1),
+    SCN_SCHEMA_FIELD(scn_mouse_event_v1, Type),
+    SCN_SCHEMA_FIELD(scn_mouse_event_v1, x),
+    SCN_SCHEMA_FIELD(scn_mouse_event_v1, y),
+
+    SCN_SCHEMA_TYPE(mouse_history_v1),
+    SCN_SCHEMA_FIELD(mouse_history_v1, LClicked),
+    SCN_SCHEMA_FIELD(mouse_history_v1, RClicked),
+    SCN_SCHEMA_FIELD(mouse_history_v1, Prev),
+    SCN_SCHEMA_FIELD(mouse_history_v1, PrevLClick),
+    SCN_SCHEMA_FIELD(mouse_history_v1, PrevRClick),
+    SCN_SCHEMA_FIELD(mouse_history_v1, PrevLClickPos),
+    SCN_SCHEMA_FIELD(mouse_history_v1, PrevRClickPos),
+
+    SCN_SCHEMA_TYPE(text_allocator_v2),
+    SCN_SCHEMA_FIELD(text_allocator_v2, LastStamp),
+    SCN_SCHEMA_FIELD(text_allocator_v2, FreeBlocks),
+    6, // SCN_TEXT_MIN_BLOCK_SHIFT as of version 3
+
+    SCN_SCHEMA_TYPE(undo_record_v3),
+    SCN_SCHEMA_FIELD(undo_record_v3, Type),
+    SCN_SCHEMA_FIELD(undo_record_v3, Size),
+    SCN_SCHEMA_FIELD(undo_record_v3, Prev),
+    SCN_SCHEMA_FIELD(undo_record_v3, StartUs),
+    SCN_SCHEMA_FIELD(undo_record_v3, EndUs),
+    SCN_SCHEMA_FIELD(undo_record_v3, NoteIndex),
+    SCN_SCHEMA_FIELD(undo_record_v3, Note),
+    SCN_SCHEMA_FIELD(undo_record_v3, Clear),
+    SCN_SCHEMA_FIELD(undo_record_v3, Text),
+    SCN_SCHEMA_FIELD(undo_record_v3, Move),
+    IsaKiloByte(256), // SCN_UNDO_RING_SIZE as of version 3
+
+    SCN_SCHEMA_TYPE(undo_log_v3),
+    SCN_SCHEMA_FIELD(undo_log_v3, Ring),
+    SCN_SCHEMA_FIELD(undo_log_v3, Begin),
+    SCN_SCHEMA_FIELD(undo_log_v3, Head),
+    SCN_SCHEMA_FIELD(undo_log_v3, End),
+    SCN_SCHEMA_FIELD(undo_log_v3, Last),
+    SCN_SCHEMA_FIELD(undo_log_v3, Open),
+    SCN_SCHEMA_FIELD(undo_log_v3, Retained),
+    SCN_SCHEMA_FIELD(undo_log_v3, MaxRetained),
+    SCN_SCHEMA_FIELD(undo_log_v3, NowUs),
+    SCN_SCHEMA_FIELD(undo_log_v3, SpareNotes),
+
+    offsetof(scn_state_v3, SessionArena),
+    SCN_SCHEMA_FIELD(scn_state_v3, PermArena),
+    SCN_SCHEMA_FIELD(scn_state_v3, Notes),
+    SCN_SCHEMA_FIELD(scn_state_v3, MouseHistory),
+    SCN_SCHEMA_FIELD(scn_state_v3, TextAllocator),
+    SCN_SCHEMA_FIELD(scn_state_v3, Editing),
+    SCN_SCHEMA_FIELD(scn_state_v3, Undo),
+};
+
+constexpr u64 ScnSchemaHash_v3 = ComputeSchemaHash(ScnSchema_v3, sizeof(ScnSchema_v3) / sizeof(ScnSchema_v3[0]));
+
+/* Version 4: z is the place in the note array */
+
+struct note_collection_v4
+{
+    u64 MaxCount;
+    u64 Count;
+
+    note *SelectedNote;
+    u64  *Selection;
+    u64   SelectionCount;
+
+    note *N;
+};
+
+struct undo_record_v4
+{
+    undo_record_type Type;
+    u32              Size;
+    u64              Prev;
+    u64              StartUs;
+    u64              EndUs;
+    u64              NoteIndex;
+
+    union
+    {
+        note_v2 Note;
+
+        struct
+        {
+            note *Other;
+            u64   OtherCount;
+            u64   TextBytes;
+        } Batch;
+
+        struct
+        {
+            u32 Pos;
+            u32 Len;
+        } Text;
+
+        struct
+        {
+            rect From, To;
+        } Move;
+
+        struct
+        {
+            v2 Delta;
+        } Nudge;
+
+        struct
+        {
+            u32_argb Color;
+        } Recolor;
+    };
+};
+
+struct scn_state_v4
+{
+    isa_arena           PermArena;
+    note_collection_v4 *Notes;
+    mouse_history_v1   *MouseHistory;
+    text_allocator_v2   TextAllocator;
+    bool                Editing;
+    undo_log_v3        *Undo;
+
+    isa_arena SessionArena;
+};
+
+constexpr u64 ScnSchema_v4[] = {
+    SCN_SCHEMA_TYPE(note_v2),
+    SCN_SCHEMA_FIELD(note_v2, Rect),
+    SCN_SCHEMA_FIELD(note_v2, z),
+    SCN_SCHEMA_FIELD(note_v2, CollectionPos),
+    SCN_SCHEMA_FIELD(note_v2, Color),
+    SCN_SCHEMA_FIELD(note_v2, Text),
+
+    SCN_SCHEMA_TYPE(note_text_v2),
+    SCN_SCHEMA_FIELD(note_text_v2, Data),
+    SCN_SCHEMA_FIELD(note_text_v2, Capacity),
+    SCN_SCHEMA_FIELD(note_text_v2, GapStart),
+    SCN_SCHEMA_FIELD(note_text_v2, GapEnd),
+    SCN_SCHEMA_FIELD(note_text_v2, Stamp),
+
+    SCN_SCHEMA_TYPE(note_collection_v4),
+    SCN_SCHEMA_FIELD(note_collection_v4, MaxCount),
+    SCN_SCHEMA_FIELD(note_collection_v4, Count),
+    SCN_SCHEMA_FIELD(note_collection_v4, SelectedNote),
+    SCN_SCHEMA_FIELD(note_collection_v4, Selection),
+    SCN_SCHEMA_FIELD(note_collection_v4, SelectionCount),
+    SCN_SCHEMA_FIELD(note_collection_v4, N),
+
+    SCN_SCHEMA_TYPE(scn_mouse_event_v1),
+    SCN_SCHEMA_FIELD(scn_mouse_event_v1, Type),
+    SCN_SCHEMA_FIELD(scn_mouse_event_v1, x),
+    SCN_SCHEMA_FIELD(scn_mouse_event_v1, y),
+
+    SCN_SCHEMA_TYPE(mouse_history_v1),
+    SCN_SCHEMA_FIELD(mouse_history_v1, LClicked),
+    SCN_SCHEMA_FIELD(mouse_history_v1, RClicked),
+    SCN_SCHEMA_FIELD(mouse_history_v1, Prev),
+    SCN_SCHEMA_FIELD(mouse_history_v1, PrevLClick),
+    SCN_SCHEMA_FIELD(mouse_history_v1, PrevRClick),
+    SCN_SCHEMA_FIELD(mouse_history_v1, PrevLClickPos),
+    SCN_SCHEMA_FIELD(mouse_history_v1, PrevRClickPos),
+
+    SCN_SCHEMA_TYPE(text_allocator_v2),
+    SCN_SCHEMA_FIELD(text_allocator_v2, LastStamp),
+    SCN_SCHEMA_FIELD(text_allocator_v2, FreeBlocks),
+    6, // SCN_TEXT_MIN_BLOCK_SHIFT as of version 4
+
+    SCN_SCHEMA_TYPE(undo_record_v4),
+    SCN_SCHEMA_FIELD(undo_record_v4, Type),
+    SCN_SCHEMA_FIELD(undo_record_v4, Size),
+    SCN_SCHEMA_FIELD(undo_record_v4, Prev),
+    SCN_SCHEMA_FIELD(undo_record_v4, StartUs),
+    SCN_SCHEMA_FIELD(undo_record_v4, EndUs),
+    SCN_SCHEMA_FIELD(undo_record_v4, NoteIndex),
+    SCN_SCHEMA_FIELD(undo_record_v4, Note),
+    SCN_SCHEMA_FIELD(undo_record_v4, Batch),
+    SCN_SCHEMA_FIELD(undo_record_v4, Text),
+    SCN_SCHEMA_FIELD(undo_record_v4, Move),
+    SCN_SCHEMA_FIELD(undo_record_v4, Nudge),
+    SCN_SCHEMA_FIELD(undo_record_v4, Recolor),
+    IsaKiloByte(256), // SCN_UNDO_RING_SIZE as of version 4
+
+    SCN_SCHEMA_TYPE(undo_log_v3),
+    SCN_SCHEMA_FIELD(undo_log_v3, Ring),
+    SCN_SCHEMA_FIELD(undo_log_v3, Begin),
+    SCN_SCHEMA_FIELD(undo_log_v3, Head),
+    SCN_SCHEMA_FIELD(undo_log_v3, End),
+    SCN_SCHEMA_FIELD(undo_log_v3, Last),
+    SCN_SCHEMA_FIELD(undo_log_v3, Open),
+    SCN_SCHEMA_FIELD(undo_log_v3, Retained),
+    SCN_SCHEMA_FIELD(undo_log_v3, MaxRetained),
+    SCN_SCHEMA_FIELD(undo_log_v3, NowUs),
+    SCN_SCHEMA_FIELD(undo_log_v3, SpareNotes),
+
+    offsetof(scn_state_v4, SessionArena),
+    SCN_SCHEMA_FIELD(scn_state_v4, PermArena),
+    SCN_SCHEMA_FIELD(scn_state_v4, Notes),
+    SCN_SCHEMA_FIELD(scn_state_v4, MouseHistory),
+    SCN_SCHEMA_FIELD(scn_state_v4, TextAllocator),
+    SCN_SCHEMA_FIELD(scn_state_v4, Editing),
+    SCN_SCHEMA_FIELD(scn_state_v4, Undo),
+};
+
+constexpr u64 ScnSchemaHash_v4 = ComputeSchemaHash(ScnSchema_v4, sizeof(ScnSchema_v4) / sizeof(ScnSchema_v4[0]));
+
+/* Version 5: no image attachments */
+
+struct undo_record_v5
+{
+    undo_record_type Type;
+    u32              Size;
+    u64              Prev;
+    u64              StartUs;
+    u64              EndUs;
+    u64              NoteIndex;
+
+    union
+    {
+        note_v2 Note;
+
+        struct
+        {
+            note *Other;
+            u64   OtherCount;
+            u64   TextBytes;
+        } Batch;
+
+        struct
+        {
+            u32 Pos;
+            u32 Len;
+        } Text;
+
+        struct
+        {
+            rect From, To;
+        } Move;
+
+        struct
+        {
+            v2 Delta;
+        } Nudge;
+
+        struct
+        {
+            u32_argb Color;
+        } Recolor;
+
+        struct
+        {
+            u64 Base;
+        } Restack;
+    };
+};
+
+constexpr u64 ScnSchema_v5[] = {
+    SCN_SCHEMA_TYPE(note_v2),
+    SCN_SCHEMA_FIELD(note_v2, Rect),
+    SCN_SCHEMA_FIELD(note_v2, z),
+    SCN_SCHEMA_FIELD(note_v2, CollectionPos),
+    SCN_SCHEMA_FIELD(note_v2, Color),
+    SCN_SCHEMA_FIELD(note_v2, Text),
+
+    SCN_SCHEMA_TYPE(note_text_v2),
+    SCN_SCHEMA_FIELD(note_text_v2, Data),
+    SCN_SCHEMA_FIELD(note_text_v2, Capacity),
+    SCN_SCHEMA_FIELD(note_text_v2, GapStart),
+    SCN_SCHEMA_FIELD(note_text_v2, GapEnd),
+    SCN_SCHEMA_FIELD(note_text_v2, Stamp),
+
+    SCN_SCHEMA_TYPE(note_collection_v4),
+    SCN_SCHEMA_FIELD(note_collection_v4, MaxCount),
+    SCN_SCHEMA_FIELD(note_collection_v4, Count),
+    SCN_SCHEMA_FIELD(note_collection_v4, SelectedNote),
+    SCN_SCHEMA_FIELD(note_collection_v4, Selection),
+    SCN_SCHEMA_FIELD(note_collection_v4, SelectionCount),
+    SCN_SCHEMA_FIELD(note_collection_v4, N),
+
+    SCN_SCHEMA_TYPE(scn_mouse_event_v1),
+    SCN_SCHEMA_FIELD(scn_mouse_event_v1, Type),
+    SCN_SCHEMA_FIELD(scn_mouse_event_v1, x),
+    SCN_SCHEMA_FIELD(scn_mouse_event_v1, y),
+
+    SCN_SCHEMA_TYPE(mouse_history_v1),
+    SCN_SCHEMA_FIELD(mouse_history_v1, LClicked),
+    SCN_SCHEMA_FIELD(mouse_history_v1, RClicked),
+    SCN_SCHEMA_FIELD(mouse_history_v1, Prev),
+    SCN_SCHEMA_FIELD(mouse_history_v1, PrevLClick),
+    SCN_SCHEMA_FIELD(mouse_history_v1, PrevRClick),
+    SCN_SCHEMA_FIELD(mouse_history_v1, PrevLClickPos),
+    SCN_SCHEMA_FIELD(mouse_history_v1, PrevRClickPos),
+
+    SCN_SCHEMA_TYPE(text_allocator_v2),
+    SCN_SCHEMA_FIELD(text_allocator_v2, LastStamp),
+    SCN_SCHEMA_FIELD(text_allocator_v2, FreeBlocks),
+    6, // SCN_TEXT_MIN_BLOCK_SHIFT as of version 5
+
+    SCN_SCHEMA_TYPE(undo_record_v5),
+    SCN_SCHEMA_FIELD(undo_record_v5, Type),
+    SCN_SCHEMA_FIELD(undo_record_v5, Size),
+    SCN_SCHEMA_FIELD(undo_record_v5, Prev),
+    SCN_SCHEMA_FIELD(undo_record_v5, StartUs),
+    SCN_SCHEMA_FIELD(undo_record_v5, EndUs),
+    SCN_SCHEMA_FIELD(undo_record_v5, NoteIndex),
+    SCN_SCHEMA_FIELD(undo_record_v5, Note),
+    SCN_SCHEMA_FIELD(undo_record_v5, Batch),
+    SCN_SCHEMA_FIELD(undo_record_v5, Text),
+    SCN_SCHEMA_FIELD(undo_record_v5, Move),
+    SCN_SCHEMA_FIELD(undo_record_v5, Nudge),
+    SCN_SCHEMA_FIELD(undo_record_v5, Recolor),
+    SCN_SCHEMA_FIELD(undo_record_v5, Restack),
+    IsaKiloByte(256), // SCN_UNDO_RING_SIZE as of version 5
+
+    SCN_SCHEMA_TYPE(undo_log_v3),
+    SCN_SCHEMA_FIELD(undo_log_v3, Ring),
+    SCN_SCHEMA_FIELD(undo_log_v3, Begin),
+    SCN_SCHEMA_FIELD(undo_log_v3, Head),
+    SCN_SCHEMA_FIELD(undo_log_v3, End),
+    SCN_SCHEMA_FIELD(undo_log_v3, Last),
+    SCN_SCHEMA_FIELD(undo_log_v3, Open),
+    SCN_SCHEMA_FIELD(undo_log_v3, Retained),
+    SCN_SCHEMA_FIELD(undo_log_v3, MaxRetained),
+    SCN_SCHEMA_FIELD(undo_log_v3, NowUs),
+    SCN_SCHEMA_FIELD(undo_log_v3, SpareNotes),
+
+    offsetof(scn_state_v4, SessionArena),
+    SCN_SCHEMA_FIELD(scn_state_v4, PermArena),
+    SCN_SCHEMA_FIELD(scn_state_v4, Notes),
+    SCN_SCHEMA_FIELD(scn_state_v4, MouseHistory),
+    SCN_SCHEMA_FIELD(scn_state_v4, TextAllocator),
+    SCN_SCHEMA_FIELD(scn_state_v4, Editing),
+    SCN_SCHEMA_FIELD(scn_state_v4, Undo),
+};
+
+constexpr u64 ScnSchemaHash_v5 = ComputeSchemaHash(ScnSchema_v5, sizeof(ScnSchema_v5) / sizeof(ScnSchema_v5[0]));
+
+/* Migration helpers */
+
+typedef void migrate_element(void *Dest, void *Src);
+
+// NOTE(ingar): Converts Count elements of OldSize bytes into elements of NewSize bytes. Arrays that do not grow are
+// rewritten in place, others are moved to the top of the arena since whatever follows them would be overwritten.
+isa_internal void *
+MigrateArray(isa_arena *Arena, void *Array, u64 Count, u64 OldSize, u64 NewSize, migrate_element *Convert)
+{
+    u8 Element[256];
+    IsaAssert(OldSize <= sizeof(Element), "Element too large to migrate");
+
+    u8 *Dest = (u8 *)Array;
+    if(NewSize > OldSize)
+    {
+        Dest = (u8 *)IsaArenaPush(Arena, Count * NewSize);
+    }
+
+    for(u64 i = 0; i < Count; ++i)
+    {
+        /* The source is copied out first since the converted element may overlap it when rewriting in place */
+        memcpy(Element, (u8 *)Array + (i * OldSize), OldSize);
+        Convert(Dest + (i * NewSize), Element);
+    }
+
+    return Dest;
+}
+
+/* Migrations */
+
+typedef bool state_migration_fn(scn_state *State);
+
+// NOTE(ingar): ToHash is ScnSchemaHash for the migration to the current version, and the FromHash of the next
+// migration for older ones
+struct state_migration
+{
+    u32                 FromVersion;
+    u64                 FromHash;
+    u64                 ToHash;
+    state_migration_fn *Migrate;
+};
+
+isa_internal void
+MigrateNote_v1(void *Dest, void *Src)
+{
+    note_v1 *Old = (note_v1 *)Src;
+    note_v2 *New = (note_v2 *)Dest;
+
+    memset(New, 0, sizeof(*New));
+    New->Rect          = Old->Rect;
+    New->z             = Old->z;
+    New->CollectionPos = Old->CollectionPos;
+    New->Color         = Old->Color;
+}
+
+// NOTE(ingar): Notes get empty text. The note array grows, so it moves to the top of the permanent arena.
+isa_internal bool
+MigrateState_v1(scn_state *State)
+{
+    scn_state_v1 Old;
+    memcpy(&Old, State, sizeof(Old));
+
+    scn_state_v2 *New = (scn_state_v2 *)State;
+    memset(New, 0, sizeof(*New));
+    New->PermArena    = Old.PermArena;
+    New->Notes        = Old.Notes;
+    New->MouseHistory = Old.MouseHistory;
+
+    note_collection_v1 *Notes = New->Notes;
+
+    u64 Selected = 0;
+    if(Notes->SelectedNote)
+    {
+        Selected = (u64)((note_v1 *)Notes->SelectedNote - (note_v1 *)Notes->N);
+    }
+
+    note_v2 *N = (note_v2 *)MigrateArray(&New->PermArena, Notes->N, Notes->MaxCount, sizeof(note_v1), sizeof(note_v2),
+                                         MigrateNote_v1);
+    Notes->N   = (note *)N;
+    if(Notes->SelectedNote)
+    {
+        Notes->SelectedNote = (note *)(N + Selected);
+    }
+
+    return true;
+}
+
+// NOTE(ingar): The history starts out empty
+isa_internal bool
+MigrateState_v2(scn_state *State)
+{
+    scn_state_v2 Old;
+    memcpy(&Old, State, sizeof(Old));
+
+    scn_state_v3 *New = (scn_state_v3 *)State;
+    memset(New, 0, sizeof(*New));
+    New->PermArena     = Old.PermArena;
+    New->Notes         = Old.Notes;
+    New->MouseHistory  = Old.MouseHistory;
+    New->TextAllocator = Old.TextAllocator;
+    New->Editing       = Old.Editing;
+
+    New->Undo = (undo_log_v3 *)CreateUndoLog(&New->PermArena);
+
+    return true;
+}
+
+// NOTE(ingar): The selected note becomes the selection. The note collection grows, so a new one is pushed. Clear
+// records were renamed batch records without changing their layout, so the history is kept.
+isa_internal bool
+MigrateState_v3(scn_state *State)
+{
+    scn_state_v3 Old;
+    memcpy(&Old, State, sizeof(Old));
+
+    scn_state_v4 *New = (scn_state_v4 *)State;
+    memset(New, 0, sizeof(*New));
+    New->PermArena     = Old.PermArena;
+    New->MouseHistory  = Old.MouseHistory;
+    New->TextAllocator = Old.TextAllocator;
+    New->Editing       = Old.Editing;
+    New->Undo          = Old.Undo;
+
+    note_collection_v1 *OldNotes = Old.Notes;
+    note_collection_v4 *Notes    = IsaPushStructZero(&New->PermArena, note_collection_v4);
+    Notes->MaxCount              = OldNotes->MaxCount;
+    Notes->Count                 = OldNotes->Count;
+    Notes->N                     = OldNotes->N;
+    Notes->Selection             = IsaPushArrayZero(&New->PermArena, u64, (Notes->MaxCount + 63) / 64);
+
+    /* The old selected note only counts if NoteIsSelected was set */
+    if(OldNotes->NoteIsSelected && OldNotes->SelectedNote)
+    {
+        u64 Selected = (u64)(OldNotes->SelectedNote - OldNotes->N);
+        Notes->Selection[Selected / 64] |= 1ULL << (Selected % 64);
+        Notes->SelectionCount = 1;
+        Notes->SelectedNote   = Notes->N + Selected;
+    }
+    New->Notes = Notes;
+
+    return true;
+}
+
+// NOTE(ingar): The places in the note array become z labels, and scn_state keeps its layout. Undo records hold places,
+// so the history is dropped, which only reads the fields of the state, the log and the records that version 4 already
+// had.
+isa_internal bool
+MigrateState_v4(scn_state *State)
+{
+    scn_state_v4       *Old   = (scn_state_v4 *)State;
+    note_collection_v4 *Notes = Old->Notes;
+    note_v2            *N     = (note_v2 *)Notes->N;
+    for(u64 i = 0; i < Notes->Count; ++i)
+    {
+        N[i].z = SCN_Z_MIDDLE + (i * SCN_Z_GAP);
+    }
+    ResetUndoLog(State);
+
+    return true;
+}
+
+// NOTE(ingar): The image table is new. Notes had padding where the image goes, so the image is cleared in the notes on
+// the board and in the ones kept by the undo log.
+isa_internal bool
+MigrateState_v5(scn_state *State)
+{
+    scn_state_v4 Old;
+    memcpy(&Old, State, sizeof(Old));
+
+    memset(State, 0, sizeof(*State));
+    State->PermArena               = Old.PermArena;
+    State->Notes                   = (note_collection *)Old.Notes;
+    State->MouseHistory            = (mouse_history *)Old.MouseHistory;
+    State->TextAllocator.LastStamp = Old.TextAllocator.LastStamp;
+    State->Editing                 = Old.Editing;
+    State->Undo                    = (undo_log *)Old.Undo;
+    memcpy(State->TextAllocator.FreeBlocks, Old.TextAllocator.FreeBlocks, sizeof(Old.TextAllocator.FreeBlocks));
+
+    State->Images = CreateImageTable(&State->PermArena);
+
+    note_collection *Notes = State->Notes;
+    for(u64 i = 0; i < Notes->Count; ++i)
+    {
+        Notes->N[i].Image = 0;
+    }
+
+    undo_log *Log = State->Undo;
+    for(u64 Pos = Log->Begin; Pos < Log->End;)
+    {
+        undo_record *Record = UndoRecordAt(Log, Pos);
+        if(Record->Type == UndoRecord_CreateNote || Record->Type == UndoRecord_DeleteNote)
+        {
+            Record->Note.Image = 0;
+        }
+        else if(Record->Type == UndoRecord_ClearNotes || Record->Type == UndoRecord_DeleteNotes)
+        {
+            for(u64 i = 0; i < Record->Batch.OtherCount; ++i)
+            {
+                Record->Batch.Other[i].Image = 0;
+            }
+        }
+        Pos += Record->Size;
+    }
+
+    return true;
+}
+
+isa_global state_migration StateMigrations[] = {
+    { 1, ScnSchemaHash_v1, ScnSchemaHash_v2, MigrateState_v1 },
+    { 2, ScnSchemaHash_v2, ScnSchemaHash_v3, MigrateState_v2 },
+    { 3, ScnSchemaHash_v3, ScnSchemaHash_v4, MigrateState_v3 },
+    { 4, ScnSchemaHash_v4, ScnSchemaHash_v5, MigrateState_v4 },
+    { 5, ScnSchemaHash_v5, ScnSchemaHash, MigrateState_v5 },
+};
+
+// NOTE(ingar): Returns false if the stamped layout could not be brought up to date, in which case the caller has to
+// recreate the state
+isa_internal bool
+MigrateScnState(scn_mem *Mem)
+{
+    scn_state *State = (scn_state *)Mem->Permanent;
+
+    u64 MigrationCount = sizeof(StateMigrations) / sizeof(StateMigrations[0]);
+    for(u64 Step = 0; Mem->StateSchemaHash != ScnSchemaHash; ++Step)
+    {
+        state_migration *Migration = nullptr;
+        for(u64 i = 0; i < MigrationCount && Step < MigrationCount; ++i)
+        {
+            state_migration *Candidate = StateMigrations + i;
+            if(Candidate->Migrate && Candidate->FromVersion == Mem->StateVersion
+               && Candidate->FromHash == Mem->StateSchemaHash)
+            {
+                Migration = Candidate;
+                break;
+            }
+        }
+
+        if(!Migration)
+        {
+            IsaLogError("No migration from state version %u (schema %llx) to version %u (schema %llx)",
+                        Mem->StateVersion, Mem->StateSchemaHash, SCN_STATE_VERSION, ScnSchemaHash);
+            return false;
+        }
+
+        IsaLogInfo("Migrating state from version %u", Mem->StateVersion);
+        if(!Migration->Migrate(State))
+        {
+            IsaLogError("Migration from state version %u failed", Mem->StateVersion);
+            return false;
+        }
+
+        Mem->StateVersion    = Migration->FromVersion + 1;
+        Mem->StateSchemaHash = Migration->ToHash;
+    }
+
+    return true;
+}
+
+#endif // SCN_MIGRATE_H_
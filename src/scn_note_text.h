@@ -0,0 +1,269 @@
+/*
+ * Copyright 2024 (c) by Ingar Solveigson Asheim. All Rights Reserved.
+ */
+
+#ifndef SCN_NOTE_TEXT_H_
+#define SCN_NOTE_TEXT_H_
+
+#include "isa.h"
+#include "scn.h"
+#include "scn_text.h"
+
+/* NOTE(ingar): Note text
+ *
+ * The text of a note is UTF-8 in a gap buffer, with the gap at the caret, so typing and deleting at the caret only
+ * touch the bytes next to the gap. Moving the caret moves the bytes between the old and the new position across the
+ * gap, which is one codepoint for the arrow keys. The gap is always on a codepoint boundary.
+ *
+ * Buffers are power of two sized blocks from the permanent arena. Blocks that are let go of go on a free list per size
+ * and are reused before the arena grows.
+ */
+
+inline u32
+TextBlockClass(u64 Size)
+{
+    u32 Class = 0;
+    while(((u64)1 << (SCN_TEXT_MIN_BLOCK_SHIFT + Class)) < Size)
+    {
+        ++Class;
+    }
+
+    return Class;
+}
+
+// NOTE(ingar): Returns null if the size is larger than the largest block
+isa_internal u8 *
+AllocTextBlock(text_allocator *Allocator, isa_arena *Arena, u64 Size, u32 *Capacity)
+{
+    u32 Class = TextBlockClass(Size);
+    if(Class >= SCN_TEXT_BLOCK_CLASSES)
+    {
+        IsaLogError("Text block of %llu bytes is too large", Size);
+        return nullptr;
+    }
+
+    u8 *Block = Allocator->FreeBlocks[Class];
+    if(Block)
+    {
+        Allocator->FreeBlocks[Class] = *(u8 **)Block;
+    }
+    else
+    {
+        Block = IsaPushArray(Arena, u8, (u64)1 << (SCN_TEXT_MIN_BLOCK_SHIFT + Class));
+    }
+
+    *Capacity = (u32)1 << (SCN_TEXT_MIN_BLOCK_SHIFT + Class);
+    return Block;
+}
+
+// NOTE(ingar): Capacity is the one AllocTextBlock gave for the block
+isa_internal void
+FreeTextBlock(text_allocator *Allocator, u8 *Block, u32 Capacity)
+{
+    if(Block)
+    {
+        u32 Class                    = TextBlockClass(Capacity);
+        *(u8 **)Block                = Allocator->FreeBlocks[Class];
+        Allocator->FreeBlocks[Class] = Block;
+    }
+}
+
+isa_internal void
+FreeNoteText(text_allocator *Allocator, note_text *Text)
+{
+    FreeTextBlock(Allocator, Text->Data, Text->Capacity);
+    memset(Text, 0, sizeof(*Text));
+}
+
+inline u32
+NoteTextLen(note_text *Text)
+{
+    return Text->Capacity - (Text->GapEnd - Text->GapStart);
+}
+
+inline text_view
+NoteTextView(note_text *Text)
+{
+    text_view View = { Text->Data, Text->GapStart, Text->Data + Text->GapEnd, Text->Capacity - Text->GapEnd };
+    return View;
+}
+
+inline void
+StampNoteText(text_allocator *Allocator, note_text *Text)
+{
+    Text->Stamp = ++Allocator->LastStamp;
+}
+
+// NOTE(ingar): Makes room for at least Size more bytes in the gap
+isa_internal bool
+ReserveNoteText(text_allocator *Allocator, isa_arena *Arena, note_text *Text, u32 Size)
+{
+    if((Text->GapEnd - Text->GapStart) >= Size)
+    {
+        return true;
+    }
+
+    u32 Len      = NoteTextLen(Text);
+    u32 Capacity = 0;
+    u8 *Data     = AllocTextBlock(Allocator, Arena, 2 * ((u64)Len + Size), &Capacity);
+    if(!Data)
+    {
+        return false;
+    }
+
+    u32 After = Text->Capacity - Text->GapEnd;
+    if(Text->Data)
+    {
+        memcpy(Data, Text->Data, Text->GapStart);
+        memcpy(Data + (Capacity - After), Text->Data + Text->GapEnd, After);
+    }
+
+    u32 GapStart = Text->GapStart;
+    u64 Stamp    = Text->Stamp;
+    FreeNoteText(Allocator, Text);
+
+    Text->Data     = Data;
+    Text->Capacity = Capacity;
+    Text->GapStart = GapStart;
+    Text->GapEnd   = Capacity - After;
+    Text->Stamp    = Stamp;
+
+    return true;
+}
+
+isa_internal bool
+InsertNoteText(text_allocator *Allocator, isa_arena *Arena, note_text *Text, const u8 *Bytes, u32 Size)
+{
+    if(!ReserveNoteText(Allocator, Arena, Text, Size))
+    {
+        return false;
+    }
+
+    memcpy(Text->Data + Text->GapStart, Bytes, Size);
+    Text->GapStart += Size;
+    StampNoteText(Allocator, Text);
+
+    return true;
+}
+
+inline bool
+IsUtf8Continuation(u8 Byte)
+{
+    return (Byte & 0xC0) == 0x80;
+}
+
+// NOTE(ingar): Size in bytes of the codepoint before the caret
+inline u32
+PrevCodepointSize(note_text *Text)
+{
+    u32 Size = 0;
+    if(Text->GapStart)
+    {
+        Size = 1;
+        while(Size < 4 && Size < Text->GapStart && IsUtf8Continuation(Text->Data[Text->GapStart - Size]))
+        {
+            ++Size;
+        }
+    }
+
+    return Size;
+}
+
+// NOTE(ingar): Size in bytes of the codepoint after the caret
+inline u32
+NextCodepointSize(note_text *Text)
+{
+    u32 Size = 0;
+    if(Text->GapEnd < Text->Capacity)
+    {
+        Size = 1;
+        while(Size < 4 && (Text->GapEnd + Size) < Text->Capacity
+              && IsUtf8Continuation(Text->Data[Text->GapEnd + Size]))
+        {
+            ++Size;
+        }
+    }
+
+    return Size;
+}
+
+// NOTE(ingar): Both return the number of bytes removed
+isa_internal u32
+DeleteNoteTextBackward(text_allocator *Allocator, note_text *Text)
+{
+    u32 Size = PrevCodepointSize(Text);
+    if(Size)
+    {
+        Text->GapStart -= Size;
+        StampNoteText(Allocator, Text);
+    }
+
+    return Size;
+}
+
+isa_internal u32
+DeleteNoteTextForward(text_allocator *Allocator, note_text *Text)
+{
+    u32 Size = NextCodepointSize(Text);
+    if(Size)
+    {
+        Text->GapEnd += Size;
+        StampNoteText(Allocator, Text);
+    }
+
+    return Size;
+}
+
+// NOTE(ingar): Pos is a byte offset in the text and must be on a codepoint boundary. Moving the caret does not change
+// the text, so the stamp is left alone.
+isa_internal void
+MoveNoteCaret(note_text *Text, u32 Pos)
+{
+    u32 Len = NoteTextLen(Text);
+    Pos     = (Pos > Len) ? Len : Pos;
+
+    if(Pos < Text->GapStart)
+    {
+        u32 Count = Text->GapStart - Pos;
+        memmove(Text->Data + Text->GapEnd - Count, Text->Data + Pos, Count);
+        Text->GapStart -= Count;
+        Text->GapEnd -= Count;
+    }
+    else if(Pos > Text->GapStart)
+    {
+        u32 Count = Pos - Text->GapStart;
+        memmove(Text->Data + Text->GapStart, Text->Data + Text->GapEnd, Count);
+        Text->GapStart += Count;
+        Text->GapEnd += Count;
+    }
+}
+
+// NOTE(ingar): Deletes the Len bytes at Pos, which must start and end on codepoint boundaries, and leaves the caret
+// at Pos
+isa_internal void
+DeleteNoteTextRange(text_allocator *Allocator, note_text *Text, u32 Pos, u32 Len)
+{
+    MoveNoteCaret(Text, Pos);
+    Text->GapEnd += Len;
+    StampNoteText(Allocator, Text);
+}
+
+isa_internal bool
+SetNoteText(text_allocator *Allocator, isa_arena *Arena, note_text *Text, const u8 *Bytes, u32 Size)
+{
+    FreeNoteText(Allocator, Text);
+    return InsertNoteText(Allocator, Arena, Text, Bytes, Size);
+}
+
+// NOTE(ingar): Copies the text out without the gap. Out must hold NoteTextLen bytes.
+isa_internal void
+CopyNoteText(note_text *Text, u8 *Out)
+{
+    if(Text->Data)
+    {
+        memcpy(Out, Text->Data, Text->GapStart);
+        memcpy(Out + Text->GapStart, Text->Data + Text->GapEnd, Text->Capacity - Text->GapEnd);
+    }
+}
+
+#endif // SCN_NOTE_TEXT_H_
@@ -0,0 +1,400 @@
+/*
+ * Copyright 2024 (c) by Ingar Solveigson Asheim. All Rights Reserved.
+ */
+
+#ifndef SCN_PIXELS_H_
+#define SCN_PIXELS_H_
+
+#include "isa.h"
+#include "scn.h"
+#include "scn_intrinsics.h"
+#include "scn_srgb.h"
+
+/* NOTE(ingar): Pixel pipeline
+ *
+ * The kernels that write pixels are templates on the pixel format of the buffer and on how the color is combined with
+ * what is already there. A draw call picks the kernel for its buffer and blend mode once, so the loops over pixels
+ * have no branches on either, and each format can have fast paths of its own.
+ *
+ * A format has the type of one pixel and converts colors to and from it. A blend combines the packed color with a
+ * pixel, with Alpha out of 256. The blends are written once, channel by channel, for every format, and BGRA8 has
+ * its own versions of the ones that are used the most.
+ *
+ * Over and coverage blends mix the color channels in linear light through the tables in scn_srgb.h, so translucent
+ * notes and the edges of glyphs are as bright as they should be. Alpha is already linear and is mixed as it is.
+ */
+
+enum blend_mode
+{
+    BlendMode_Copy, // Alpha is ignored
+    BlendMode_Over,
+    BlendMode_Add,
+};
+
+struct pixel_bgra8
+{
+    typedef u32 type;
+
+    static inline type
+    Pack(u32_argb Color)
+    {
+        return Color.U32;
+    }
+
+    static inline u32_argb
+    Unpack(type Pixel)
+    {
+        return U32Argb(Pixel);
+    }
+};
+
+struct pixel_rgb565
+{
+    typedef u16 type;
+
+    static inline type
+    Pack(u32_argb Color)
+    {
+        return (type)(((Color.r >> 3) << 11) | ((Color.g >> 2) << 5) | (Color.b >> 3));
+    }
+
+    static inline u32_argb
+    Unpack(type Pixel)
+    {
+        /* The top bits are repeated into the bottom ones, so that 0x1F becomes 0xFF and not 0xF8 */
+        u32 r = (Pixel >> 11) & 0x1F;
+        u32 g = (Pixel >> 5) & 0x3F;
+        u32 b = Pixel & 0x1F;
+        return U32Argb((u8)((b << 3) | (b >> 2)), (u8)((g << 2) | (g >> 4)), (u8)((r << 3) | (r >> 2)), 0xFF);
+    }
+};
+
+struct pixel_a8
+{
+    typedef u8 type;
+
+    static inline type
+    Pack(u32_argb Color)
+    {
+        return Color.a;
+    }
+
+    static inline u32_argb
+    Unpack(type Pixel)
+    {
+        return U32Argb(0, 0, 0, Pixel);
+    }
+};
+
+/* Blends */
+
+template <typename format>
+inline typename format::type
+BlendOver(typename format::type Dest, u32_argb Src, u32 Alpha)
+{
+    u32_argb Under = format::Unpack(Dest);
+    Under.b        = BlendSrgb(Under.b, Src.b, Alpha);
+    Under.g        = BlendSrgb(Under.g, Src.g, Alpha);
+    Under.r        = BlendSrgb(Under.r, Src.r, Alpha);
+    Under.a        = (u8)(((Src.a * Alpha) + (Under.a * (256 - Alpha))) >> 8);
+
+    return format::Pack(Under);
+}
+
+// NOTE(ingar): The result is opaque
+template <>
+inline u32
+BlendOver<pixel_bgra8>(u32 Dest, u32_argb Src, u32 Alpha)
+{
+    u32_argb Under = U32Argb(Dest);
+    u32      b     = BlendSrgb(Under.b, Src.b, Alpha);
+    u32      g     = BlendSrgb(Under.g, Src.g, Alpha);
+    u32      r     = BlendSrgb(Under.r, Src.r, Alpha);
+    return 0xFF000000 | (r << 16) | (g << 8) | b;
+}
+
+template <typename format>
+inline typename format::type
+BlendAdd(typename format::type Dest, u32_argb Src, u32 Alpha)
+{
+    u32_argb Sum = format::Unpack(Dest);
+    for(u32 i = 0; i < 4; ++i)
+    {
+        u32 Channel = Sum.BGRA[i] + ((Src.BGRA[i] * Alpha) >> 8);
+        Sum.BGRA[i] = (u8)((Channel > 0xFF) ? 0xFF : Channel);
+    }
+
+    return format::Pack(Sum);
+}
+
+// NOTE(ingar): Blends Color over four pixels, each with its own coverage from 0 to 1
+template <typename format>
+inline void
+BlendCoverage4(typename format::type *Pixels, __m128 Coverage, u32_argb Color)
+{
+    alignas(16) float Alpha[4];
+    _mm_store_ps(Alpha, _mm_mul_ps(Coverage, _mm_set1_ps(256.0f)));
+    for(u32 i = 0; i < 4; ++i)
+    {
+        Pixels[i] = BlendOver<format>(Pixels[i], Color, (u32)Alpha[i]);
+    }
+}
+
+// NOTE(ingar): The channel at Shift of four pixels, in linear light
+inline __m128
+LoadLinear4(u32 *Pixels, u32 Shift)
+{
+    return _mm_setr_ps((float)SrgbTables.ToLinear[(Pixels[0] >> Shift) & 0xFF],
+                       (float)SrgbTables.ToLinear[(Pixels[1] >> Shift) & 0xFF],
+                       (float)SrgbTables.ToLinear[(Pixels[2] >> Shift) & 0xFF],
+                       (float)SrgbTables.ToLinear[(Pixels[3] >> Shift) & 0xFF]);
+}
+
+// NOTE(ingar): The tables are looked up one lane at a time, since SSE has no gather, and the mix is done four pixels at
+// a time. The result is opaque.
+template <>
+inline void
+BlendCoverage4<pixel_bgra8>(u32 *Pixels, __m128 Coverage, u32_argb Color)
+{
+    __m128 DestR = LoadLinear4(Pixels, 16);
+    __m128 DestG = LoadLinear4(Pixels, 8);
+    __m128 DestB = LoadLinear4(Pixels, 0);
+
+    __m128 SrcR = _mm_set1_ps((float)SrgbTables.ToLinear[Color.r]);
+    __m128 SrcG = _mm_set1_ps((float)SrgbTables.ToLinear[Color.g]);
+    __m128 SrcB = _mm_set1_ps((float)SrgbTables.ToLinear[Color.b]);
+
+    DestR = _mm_add_ps(DestR, _mm_mul_ps(_mm_sub_ps(SrcR, DestR), Coverage));
+    DestG = _mm_add_ps(DestG, _mm_mul_ps(_mm_sub_ps(SrcG, DestG), Coverage));
+    DestB = _mm_add_ps(DestB, _mm_mul_ps(_mm_sub_ps(SrcB, DestB), Coverage));
+
+    alignas(16) u32 LinearR[4];
+    alignas(16) u32 LinearG[4];
+    alignas(16) u32 LinearB[4];
+    _mm_store_si128((__m128i *)LinearR, _mm_cvtps_epi32(DestR));
+    _mm_store_si128((__m128i *)LinearG, _mm_cvtps_epi32(DestG));
+    _mm_store_si128((__m128i *)LinearB, _mm_cvtps_epi32(DestB));
+
+    for(u32 i = 0; i < 4; ++i)
+    {
+        Pixels[i] = 0xFF000000 | ((u32)SrgbTables.ToSrgb[LinearR[i]] << 16) | ((u32)SrgbTables.ToSrgb[LinearG[i]] << 8)
+                  | SrgbTables.ToSrgb[LinearB[i]];
+    }
+}
+
+// NOTE(ingar): Rounded to the nearest step rather than down, since coverage drawn into an A8 buffer is blended again
+// from there
+template <>
+inline void
+BlendCoverage4<pixel_a8>(u8 *Pixels, __m128 Coverage, u32_argb Color)
+{
+    __m128 Dest = _mm_setr_ps((float)Pixels[0], (float)Pixels[1], (float)Pixels[2], (float)Pixels[3]);
+    __m128 Src  = _mm_set1_ps((float)Color.a);
+    Dest        = _mm_add_ps(Dest, _mm_mul_ps(_mm_sub_ps(Src, Dest), Coverage));
+
+    alignas(16) u32 Alpha[4];
+    _mm_store_si128((__m128i *)Alpha, _mm_cvtps_epi32(Dest));
+    for(u32 i = 0; i < 4; ++i)
+    {
+        Pixels[i] = (u8)Alpha[i];
+    }
+}
+
+// NOTE(ingar): Blends Color over Count pixels, each with the coverage in Mask out of 255 scaled by Alpha out of 256.
+// Step is 1 to read the mask forwards and -1 to read it backwards, which mirrors it.
+template <typename format>
+isa_internal void
+BlendMaskSpan(typename format::type *Pixels, u8 *Mask, i64 Step, i64 Count, u32_argb Color, u32 Alpha)
+{
+    typedef typename format::type pixel;
+
+    float  Scale   = (float)Alpha / (255.0f * 256.0f);
+    __m128 Scale4  = _mm_set1_ps(Scale);
+    i64    Blocked = Count & ~(i64)3;
+    for(i64 i = 0; i < Blocked; i += 4)
+    {
+        __m128 Coverage = _mm_setr_ps((float)Mask[i * Step], (float)Mask[(i + 1) * Step], (float)Mask[(i + 2) * Step],
+                                      (float)Mask[(i + 3) * Step]);
+        BlendCoverage4<format>(Pixels + i, _mm_mul_ps(Coverage, Scale4), Color);
+    }
+
+    if(Blocked < Count)
+    {
+        float Field[4] = {};
+        pixel Tail[4]  = {};
+        for(i64 i = Blocked; i < Count; ++i)
+        {
+            Field[i - Blocked] = (float)Mask[i * Step] * Scale;
+            Tail[i - Blocked]  = Pixels[i];
+        }
+
+        BlendCoverage4<format>(Tail, _mm_loadu_ps(Field), Color);
+        for(i64 i = Blocked; i < Count; ++i)
+        {
+            Pixels[i] = Tail[i - Blocked];
+        }
+    }
+}
+
+struct blend_copy
+{
+    template <typename format>
+    static inline typename format::type
+    Apply(typename format::type Dest, typename format::type Packed, u32_argb Src, u32 Alpha)
+    {
+        return Packed;
+    }
+};
+
+struct blend_over
+{
+    template <typename format>
+    static inline typename format::type
+    Apply(typename format::type Dest, typename format::type Packed, u32_argb Src, u32 Alpha)
+    {
+        return BlendOver<format>(Dest, Src, Alpha);
+    }
+};
+
+struct blend_add
+{
+    template <typename format>
+    static inline typename format::type
+    Apply(typename format::type Dest, typename format::type Packed, u32_argb Src, u32 Alpha)
+    {
+        return BlendAdd<format>(Dest, Src, Alpha);
+    }
+};
+
+/* Kernels */
+
+struct pixel_span
+{
+    i64 StartX, StartY;
+    i64 EndX, EndY; // Exclusive
+};
+
+inline pixel_span
+IntersectSpans(pixel_span a, pixel_span b)
+{
+    pixel_span Result;
+    Result.StartX = (a.StartX > b.StartX) ? a.StartX : b.StartX;
+    Result.StartY = (a.StartY > b.StartY) ? a.StartY : b.StartY;
+    Result.EndX   = (a.EndX < b.EndX) ? a.EndX : b.EndX;
+    Result.EndY   = (a.EndY < b.EndY) ? a.EndY : b.EndY;
+    return Result;
+}
+
+inline bool
+SpanHasArea(pixel_span Span)
+{
+    return (Span.StartX < Span.EndX) && (Span.StartY < Span.EndY);
+}
+
+// NOTE(ingar): True if Inner has no area or lies within Outer
+inline bool
+SpanContains(pixel_span Outer, pixel_span Inner)
+{
+    return !SpanHasArea(Inner)
+           || ((Inner.StartX >= Outer.StartX) && (Inner.StartY >= Outer.StartY) && (Inner.EndX <= Outer.EndX)
+               && (Inner.EndY <= Outer.EndY));
+}
+
+inline u8 *
+PixelAt(scn_offscreen_buffer Buffer, i64 x, i64 y)
+{
+    return (u8 *)Buffer.Mem + (((y * Buffer.w) + x) * (i64)Buffer.BytesPerPixel);
+}
+
+// NOTE(ingar): Clip is in window pixels. Returns the whole pixels of the buffer that it touches.
+inline rect
+BufferClip(scn_offscreen_buffer Buffer, rect Clip)
+{
+    float W = (float)Buffer.w;
+    float H = (float)Buffer.h;
+
+    /* Divided rather than multiplied by the inverse, so a clip on whole pixels of the buffer maps to them exactly */
+    rect Result;
+    Result.Min.x = Clamp((float)FloorFloatToi64(Clip.Min.x / Buffer.PixelSize), 0.0f, W);
+    Result.Min.y = Clamp((float)FloorFloatToi64(Clip.Min.y / Buffer.PixelSize), 0.0f, H);
+    Result.Max.x = Clamp((float)CeilFloatToi64(Clip.Max.x / Buffer.PixelSize), 0.0f, W);
+    Result.Max.y = Clamp((float)CeilFloatToi64(Clip.Max.y / Buffer.PixelSize), 0.0f, H);
+    return Result;
+}
+
+template <typename format, typename blend>
+isa_internal void
+FillPixels(scn_offscreen_buffer Buffer, pixel_span Span, u32_argb Color, u32 Alpha)
+{
+    typedef typename format::type pixel;
+
+    pixel Packed = format::Pack(Color);
+    for(i64 y = Span.StartY; y < Span.EndY; ++y)
+    {
+        pixel *Pixel = (pixel *)PixelAt(Buffer, Span.StartX, y);
+        for(i64 x = Span.StartX; x < Span.EndX; ++x)
+        {
+            *Pixel = blend::template Apply<format>(*Pixel, Packed, Color, Alpha);
+            ++Pixel;
+        }
+    }
+}
+
+template <typename format>
+isa_internal void
+FillPixelsInFormat(scn_offscreen_buffer Buffer, pixel_span Span, u32_argb Color, u32 Alpha, blend_mode Mode)
+{
+    switch(Mode)
+    {
+        case BlendMode_Copy:
+            {
+                FillPixels<format, blend_copy>(Buffer, Span, Color, Alpha);
+            }
+            break;
+        case BlendMode_Over:
+            {
+                FillPixels<format, blend_over>(Buffer, Span, Color, Alpha);
+            }
+            break;
+        case BlendMode_Add:
+            {
+                FillPixels<format, blend_add>(Buffer, Span, Color, Alpha);
+            }
+            break;
+    }
+}
+
+// NOTE(ingar): Clip, Min and Max are in window pixels
+isa_internal void
+FillRectPixels(scn_offscreen_buffer Buffer, rect Clip, v2 Min, v2 Max, u32_argb Color, u32 Alpha, blend_mode Mode)
+{
+    rect  Pixels = BufferClip(Buffer, Clip);
+    float Size   = Buffer.PixelSize;
+
+    pixel_span Span;
+    Span.StartX = Clamp(RoundFloatToi64(Min.x / Size), (i64)Pixels.Min.x, (i64)Pixels.Max.x);
+    Span.StartY = Clamp(RoundFloatToi64(Min.y / Size), (i64)Pixels.Min.y, (i64)Pixels.Max.y);
+    Span.EndX   = Clamp(RoundFloatToi64(Max.x / Size), (i64)Pixels.Min.x, (i64)Pixels.Max.x);
+    Span.EndY   = Clamp(RoundFloatToi64(Max.y / Size), (i64)Pixels.Min.y, (i64)Pixels.Max.y);
+
+    switch(Buffer.Format)
+    {
+        case ScnPixelFormat_Bgra8:
+            {
+                FillPixelsInFormat<pixel_bgra8>(Buffer, Span, Color, Alpha, Mode);
+            }
+            break;
+        case ScnPixelFormat_Rgb565:
+            {
+                FillPixelsInFormat<pixel_rgb565>(Buffer, Span, Color, Alpha, Mode);
+            }
+            break;
+        case ScnPixelFormat_A8:
+            {
+                FillPixelsInFormat<pixel_a8>(Buffer, Span, Color, Alpha, Mode);
+            }
+            break;
+    }
+}
+
+#endif // SCN_PIXELS_H_
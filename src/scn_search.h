@@ -0,0 +1,995 @@
+/*
+ * Copyright 2024 (c) by Ingar Solveigson Asheim. All Rights Reserved.
+ */
+
+#ifndef SCN_SEARCH_H_
+#define SCN_SEARCH_H_
+
+#include "isa.h"
+#include "scn.h"
+#include "scn_intrinsics.h"
+#include "scn_text.h"
+#include "scn_note_text.h"
+
+#include <cstdlib>
+
+/* NOTE(ingar): Full-text search
+ *
+ * Every run of three codepoints in a note's text, after case folding, is a trigram, and the index maps each trigram
+ * to the notes that contain it. A query is answered by going through the notes of its rarest trigram, looking each
+ * of them up in the lists of its other trigrams, and checking the ones that are in all of them for the query, so the
+ * cost follows the length of the rarest list and not the number of notes. Queries shorter than a trigram take the
+ * union of the lists of the trigrams that contain them.
+ *
+ * Each note keeps the sorted set of its trigrams with the number of times each occurs, so that an edit only has to
+ * look at the trigrams within two codepoints of it, and a note only leaves a posting list when the last of a trigram
+ * is gone. Notes are indexed by their place in the note array. A single note is deleted by moving the last note into
+ * its place, so only the postings of the two notes change.
+ *
+ * The index is built from the notes when session memory is set up and lives there. Posting lists and the per-note sets
+ * are power of two blocks with free lists, the same as note text.
+ */
+
+#define SCN_SEARCH_BUCKET_BITS 18
+#define SCN_SEARCH_BUCKETS     (1 << SCN_SEARCH_BUCKET_BITS)
+#define SCN_SEARCH_MAX_QUERY   256 // Bytes of UTF-8
+#define SCN_TRIGRAM_USED       (1ULL << 63)
+
+struct trigram_postings
+{
+    u64  Trigram; // Three folded codepoints of 21 bits each and SCN_TRIGRAM_USED, 0 if the bucket is empty
+    u32  Count;
+    u32  Capacity; // In bytes
+    u32 *Notes;    // Indices of the notes that contain the trigram, sorted
+};
+
+struct note_trigram
+{
+    u64 Trigram;
+    u32 Count; // Times the note has it
+};
+
+struct note_trigrams
+{
+    u64           Stamp; // Of the text the trigrams were taken from
+    u32           Count;
+    u32           Capacity; // In bytes
+    note_trigram *Trigrams; // Sorted, without duplicates
+};
+
+struct search_index
+{
+    isa_arena     *Arena;
+    text_allocator Blocks;
+
+    u64               UsedBuckets; // Buckets of lists that are empty are emptied, so this is the number of trigrams
+    bool              Overflowed;  // Some trigrams did not fit, so queries have to check every note
+    trigram_postings *Buckets;     // SCN_SEARCH_BUCKETS, open addressing on the trigram
+
+    u64            MaxNotes;
+    note_trigrams *Notes; // MaxNotes, by note index
+
+    // NOTE(ingar): Scratch space for a note's folded codepoints, its new trigrams, and the old text around an edit
+    u32          *Codepoints;
+    u32           CodepointsCapacity; // In bytes
+    note_trigram *Trigrams;
+    u32           TrigramsCapacity;   // In bytes
+    u8           *Window;
+    u32           WindowCapacity;     // In bytes
+
+    // NOTE(ingar): The current query, and the notes that matched it when it was last run
+    bool Active;
+    u32  QueryLen;
+    u8   Query[SCN_SEARCH_MAX_QUERY];
+    u64  MatchCount;
+    u64 *Matches;     // One bit per note
+    u64 *PrevMatches; // The bits before the last run, to find the notes that have to be redrawn
+
+    u8 *Marks; // MaxNotes, for RenumberSearchNotes and zero outside it
+};
+
+/* Simple case folding for the scripts that have case, enough for searching */
+inline u32
+FoldCodepoint(u32 Codepoint)
+{
+    if(Codepoint < 0x80)
+    {
+        return (Codepoint >= 'A' && Codepoint <= 'Z') ? Codepoint + 32 : Codepoint;
+    }
+
+    if((Codepoint >= 0xC0 && Codepoint <= 0xDE && Codepoint != 0xD7)    // Latin-1
+       || (Codepoint >= 0x391 && Codepoint <= 0x3AB && Codepoint != 0x3A2) // Greek
+       || (Codepoint >= 0x410 && Codepoint <= 0x42F))                      // Cyrillic
+    {
+        return Codepoint + 32;
+    }
+
+    if(Codepoint >= 0x400 && Codepoint <= 0x40F)
+    {
+        return Codepoint + 80;
+    }
+
+    /* Latin Extended-A pairs upper and lower case, upper first */
+    if((Codepoint >= 0x100 && Codepoint <= 0x137) || (Codepoint >= 0x14A && Codepoint <= 0x177))
+    {
+        return Codepoint | 1;
+    }
+    if((Codepoint >= 0x139 && Codepoint <= 0x148) || (Codepoint >= 0x179 && Codepoint <= 0x17E))
+    {
+        return (Codepoint & 1) ? Codepoint + 1 : Codepoint;
+    }
+
+    return Codepoint;
+}
+
+inline u64
+MakeTrigram(u32 A, u32 B, u32 C)
+{
+    return SCN_TRIGRAM_USED | ((u64)A << 42) | ((u64)B << 21) | (u64)C;
+}
+
+// NOTE(ingar): Grows a scratch or list block to hold at least Size bytes, keeping the first Keep bytes
+isa_internal bool
+GrowSearchBlock(search_index *Index, void **Block, u32 *Capacity, u64 Size, u64 Keep)
+{
+    if(Size <= *Capacity)
+    {
+        return true;
+    }
+
+    u32 NewCapacity = 0;
+    u8 *NewBlock    = AllocTextBlock(&Index->Blocks, Index->Arena, Size, &NewCapacity);
+    if(!NewBlock)
+    {
+        return false;
+    }
+
+    if(*Block && Keep)
+    {
+        memcpy(NewBlock, *Block, Keep);
+    }
+
+    FreeTextBlock(&Index->Blocks, (u8 *)*Block, *Capacity);
+    *Block    = NewBlock;
+    *Capacity = NewCapacity;
+    return true;
+}
+
+// NOTE(ingar): Decodes and folds the text into Index->Codepoints. Returns the number of codepoints.
+isa_internal u32
+FoldText(search_index *Index, text_view View)
+{
+    u64 Len = TextViewLen(View);
+    if(!GrowSearchBlock(Index, (void **)&Index->Codepoints, &Index->CodepointsCapacity, Len * sizeof(u32), 0))
+    {
+        return 0;
+    }
+
+    u32      *Out          = Index->Codepoints;
+    const u8 *Pieces[2]    = { View.A, View.B };
+    u64       PieceLens[2] = { View.ALen, View.BLen };
+    for(u32 Piece = 0; Piece < 2; ++Piece)
+    {
+        const u8 *Text = Pieces[Piece];
+        for(u64 At = 0; At < PieceLens[Piece];)
+        {
+            u32 Codepoint = Text[At];
+            if(Codepoint < 0x80)
+            {
+                *Out++ = (Codepoint - 'A' < 26) ? Codepoint + 32 : Codepoint;
+                ++At;
+            }
+            else
+            {
+                At += DecodeUtf8(Text + At, &Codepoint);
+                *Out++ = FoldCodepoint(Codepoint);
+            }
+        }
+    }
+
+    return (u32)(Out - Index->Codepoints);
+}
+
+inline u64
+TrigramBucket(u64 Trigram)
+{
+    return (Trigram * 0x9E3779B97F4A7C15ULL) >> (64 - SCN_SEARCH_BUCKET_BITS);
+}
+
+isa_internal trigram_postings *
+FindPostings(search_index *Index, u64 Trigram, bool Create)
+{
+    u64 Mask = SCN_SEARCH_BUCKETS - 1;
+    for(u64 Slot = TrigramBucket(Trigram);; Slot = (Slot + 1) & Mask)
+    {
+        trigram_postings *Postings = Index->Buckets + Slot;
+        if(Postings->Trigram == Trigram)
+        {
+            return Postings;
+        }
+
+        if(!Postings->Trigram)
+        {
+            /* Kept at most three quarters full so that probe runs stay short */
+            if(!Create || (Index->UsedBuckets + 1) > (SCN_SEARCH_BUCKETS / 4) * 3)
+            {
+                Index->Overflowed |= Create;
+                return nullptr;
+            }
+
+            Postings->Trigram = Trigram;
+            Index->UsedBuckets++;
+            return Postings;
+        }
+    }
+}
+
+// NOTE(ingar): Frees the bucket of a list that has become empty. The buckets after it in the probe run are moved back
+// into the hole, unless their own bucket is between the hole and where they are, so that lookups never stop short of
+// them and no tombstones are needed.
+isa_internal void
+EmptyBucket(search_index *Index, u64 Slot)
+{
+    trigram_postings *Buckets = Index->Buckets;
+    FreeTextBlock(&Index->Blocks, (u8 *)Buckets[Slot].Notes, Buckets[Slot].Capacity);
+
+    u64 Mask = SCN_SEARCH_BUCKETS - 1;
+    u64 Hole = Slot;
+    for(u64 Next = (Hole + 1) & Mask; Buckets[Next].Trigram; Next = (Next + 1) & Mask)
+    {
+        u64 Home = TrigramBucket(Buckets[Next].Trigram);
+        if(((Next - Home) & Mask) >= ((Next - Hole) & Mask))
+        {
+            Buckets[Hole] = Buckets[Next];
+            Hole          = Next;
+        }
+    }
+
+    memset(Buckets + Hole, 0, sizeof(trigram_postings));
+    Index->UsedBuckets--;
+}
+
+// NOTE(ingar): Returns the first place in the sorted list from Start on that holds Note or a later note
+inline u32
+FindPostingFrom(trigram_postings *Postings, u32 Start, u32 Note)
+{
+    u32 Low  = Start;
+    u32 High = Postings->Count;
+    while(Low < High)
+    {
+        u32 Mid = (Low + High) / 2;
+        if(Postings->Notes[Mid] < Note)
+        {
+            Low = Mid + 1;
+        }
+        else
+        {
+            High = Mid;
+        }
+    }
+
+    return Low;
+}
+
+isa_internal void
+AddPosting(search_index *Index, u64 Trigram, u32 Note)
+{
+    trigram_postings *Postings = FindPostings(Index, Trigram, true);
+    if(!Postings)
+    {
+        return;
+    }
+
+    u64 Size = ((u64)Postings->Count + 1) * sizeof(u32);
+    if(Size > Postings->Capacity
+       && !GrowSearchBlock(Index, (void **)&Postings->Notes, &Postings->Capacity, 2 * Size, Size - sizeof(u32)))
+    {
+        Index->Overflowed = true;
+        return;
+    }
+
+    /* Notes are mostly added in order when the index is built, so this is usually the end of the list */
+    u32 At = FindPostingFrom(Postings, 0, Note);
+    memmove(Postings->Notes + At + 1, Postings->Notes + At, (Postings->Count - At) * sizeof(u32));
+    Postings->Notes[At] = Note;
+    Postings->Count++;
+}
+
+isa_internal void
+RemovePosting(search_index *Index, u64 Trigram, u32 Note)
+{
+    trigram_postings *Postings = FindPostings(Index, Trigram, false);
+    if(!Postings)
+    {
+        return;
+    }
+
+    u32 At = FindPostingFrom(Postings, 0, Note);
+    if(At < Postings->Count && Postings->Notes[At] == Note)
+    {
+        memmove(Postings->Notes + At, Postings->Notes + At + 1, (Postings->Count - At - 1) * sizeof(u32));
+        Postings->Count--;
+    }
+
+    if(!Postings->Count)
+    {
+        EmptyBucket(Index, (u64)(Postings - Index->Buckets));
+    }
+}
+
+isa_internal int
+CompareTrigrams(const void *A, const void *B)
+{
+    u64 a = ((const note_trigram *)A)->Trigram;
+    u64 b = ((const note_trigram *)B)->Trigram;
+    return (a < b) ? -1 : (a > b);
+}
+
+// NOTE(ingar): Indexes the whole text of a note anew. Does nothing if the text has the same stamp as when it was last
+// indexed. Edits go through IndexNoteEdit, which only looks at the text around them.
+isa_internal void
+IndexNoteText(search_index *Index, u64 NoteIndex, note_text *Text)
+{
+    note_trigrams *Old = Index->Notes + NoteIndex;
+    if(Old->Stamp == Text->Stamp)
+    {
+        return;
+    }
+
+    u32 CodepointCount = FoldText(Index, NoteTextView(Text));
+    u32 NewCount       = (CodepointCount >= 3) ? CodepointCount - 2 : 0;
+    if(!GrowSearchBlock(Index, (void **)&Index->Trigrams, &Index->TrigramsCapacity,
+                        (u64)NewCount * sizeof(note_trigram), 0))
+    {
+        Index->Overflowed = true;
+        return;
+    }
+
+    note_trigram *New = Index->Trigrams;
+    u32          *Cps = Index->Codepoints;
+    for(u32 i = 0; i < NewCount; ++i)
+    {
+        New[i].Trigram = MakeTrigram(Cps[i], Cps[i + 1], Cps[i + 2]);
+        New[i].Count   = 1;
+    }
+
+    qsort(New, NewCount, sizeof(note_trigram), CompareTrigrams);
+    u32 Unique = 0;
+    for(u32 i = 0; i < NewCount; ++i)
+    {
+        if(Unique && New[Unique - 1].Trigram == New[i].Trigram)
+        {
+            New[Unique - 1].Count++;
+        }
+        else
+        {
+            New[Unique++] = New[i];
+        }
+    }
+    NewCount = Unique;
+
+    /* Both sets are sorted, so one pass finds what came and what went */
+    u32 i = 0, j = 0;
+    while(i < Old->Count || j < NewCount)
+    {
+        if(j == NewCount || (i < Old->Count && Old->Trigrams[i].Trigram < New[j].Trigram))
+        {
+            RemovePosting(Index, Old->Trigrams[i++].Trigram, (u32)NoteIndex);
+        }
+        else if(i == Old->Count || New[j].Trigram < Old->Trigrams[i].Trigram)
+        {
+            AddPosting(Index, New[j++].Trigram, (u32)NoteIndex);
+        }
+        else
+        {
+            ++i, ++j;
+        }
+    }
+
+    if(!GrowSearchBlock(Index, (void **)&Old->Trigrams, &Old->Capacity, (u64)NewCount * sizeof(note_trigram), 0))
+    {
+        Index->Overflowed = true;
+        Old->Count        = 0;
+        return;
+    }
+
+    memcpy(Old->Trigrams, New, NewCount * sizeof(note_trigram));
+    Old->Count = NewCount;
+    Old->Stamp = Text->Stamp;
+}
+
+// NOTE(ingar): Counts one more or one less of the trigram in the note, and adds the note to its postings or removes
+// it when the count leaves or comes to zero. Returns false if the set could not grow.
+isa_internal bool
+CountNoteTrigram(search_index *Index, u64 NoteIndex, u64 Trigram, bool Add)
+{
+    note_trigrams *Note = Index->Notes + NoteIndex;
+    u32            Low  = 0;
+    u32            High = Note->Count;
+    while(Low < High)
+    {
+        u32 Mid = (Low + High) / 2;
+        if(Note->Trigrams[Mid].Trigram < Trigram)
+        {
+            Low = Mid + 1;
+        }
+        else
+        {
+            High = Mid;
+        }
+    }
+
+    note_trigram *At = Note->Trigrams + Low;
+    if(Low < Note->Count && At->Trigram == Trigram)
+    {
+        At->Count += Add ? 1 : -1;
+        if(!At->Count)
+        {
+            RemovePosting(Index, Trigram, (u32)NoteIndex);
+            memmove(At, At + 1, (Note->Count - Low - 1) * sizeof(note_trigram));
+            Note->Count--;
+        }
+        return true;
+    }
+
+    if(!Add)
+    {
+        return true;
+    }
+
+    u64 Size = ((u64)Note->Count + 1) * sizeof(note_trigram);
+    if(Size > Note->Capacity
+       && !GrowSearchBlock(Index, (void **)&Note->Trigrams, &Note->Capacity, 2 * Size, Size - sizeof(note_trigram)))
+    {
+        return false;
+    }
+
+    At = Note->Trigrams + Low;
+    memmove(At + 1, At, (Note->Count - Low) * sizeof(note_trigram));
+    At->Trigram = Trigram;
+    At->Count   = 1;
+    Note->Count++;
+    AddPosting(Index, Trigram, (u32)NoteIndex);
+    return true;
+}
+
+// NOTE(ingar): Counts the trigrams of the codepoints in Index->Codepoints
+isa_internal bool
+CountWindowTrigrams(search_index *Index, u64 NoteIndex, u32 CodepointCount, bool Add)
+{
+    u32 *Cps = Index->Codepoints;
+    for(u32 i = 0; i + 2 < CodepointCount; ++i)
+    {
+        if(!CountNoteTrigram(Index, NoteIndex, MakeTrigram(Cps[i], Cps[i + 1], Cps[i + 2]), Add))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// NOTE(ingar): Brings the trigrams of a note up to date after Removed bytes at EditStart were replaced by Inserted
+// bytes. The trigrams that changed are the ones with a codepoint in the edit or on both sides of it, so they are the
+// runs of the text from two codepoints before the edit to two codepoints after it, with the old bytes and with the new.
+// The text before and after is the same in both, and RemovedBytes are the old bytes. Falls back to indexing the whole
+// note if the index was not up to date with the text before the edit.
+isa_internal void
+IndexNoteEdit(search_index *Index, u64 NoteIndex, note_text *Text, u64 OldStamp, u64 EditStart,
+              const u8 *RemovedBytes, u64 Removed, u64 Inserted)
+{
+    note_trigrams *Note = Index->Notes + NoteIndex;
+    if(Note->Stamp != OldStamp)
+    {
+        IndexNoteText(Index, NoteIndex, Text);
+        return;
+    }
+
+    text_view View   = NoteTextView(Text);
+    u64       Len    = TextViewLen(View);
+    u64       Before = EditStart;
+    u64       After  = EditStart + Inserted;
+    for(u32 i = 0; i < 2 && Before; ++i)
+    {
+        while(--Before && IsUtf8Continuation(TextViewByte(View, Before)))
+        {
+        }
+    }
+    for(u32 i = 0; i < 2 && After < Len; ++i)
+    {
+        while(++After < Len && IsUtf8Continuation(TextViewByte(View, After)))
+        {
+        }
+    }
+
+    u64 Head   = EditStart - Before;
+    u64 OldLen = Head + Removed + (After - (EditStart + Inserted));
+    u64 NewLen = After - Before;
+    if(!GrowSearchBlock(Index, (void **)&Index->Window, &Index->WindowCapacity, OldLen + NewLen, 0))
+    {
+        Index->Overflowed = true;
+        return;
+    }
+
+    u8 *OldWindow = Index->Window;
+    u8 *NewWindow = Index->Window + OldLen;
+    CopyTextView(View, Before, EditStart, OldWindow);
+    if(Removed)
+    {
+        memcpy(OldWindow + Head, RemovedBytes, Removed);
+    }
+    CopyTextView(View, EditStart + Inserted, After, OldWindow + Head + Removed);
+    CopyTextView(View, Before, After, NewWindow);
+
+    /* The new trigrams are counted first, so that the ones the edit kept never leave their posting lists */
+    if(!CountWindowTrigrams(Index, NoteIndex, FoldText(Index, TextView(NewWindow, NewLen)), true)
+       || !CountWindowTrigrams(Index, NoteIndex, FoldText(Index, TextView(OldWindow, OldLen)), false))
+    {
+        /* The stamp is left behind, so the next change indexes the whole note again */
+        Index->Overflowed = true;
+        return;
+    }
+
+    Note->Stamp = Text->Stamp;
+}
+
+// NOTE(ingar): For when the note at From moves to the empty place To in the array. Its postings are moved to the
+// place of To in each list, which keeps the lists sorted.
+isa_internal void
+RenameSearchNote(search_index *Index, u64 From, u64 To)
+{
+    note_trigrams *Note = Index->Notes + From;
+    for(u32 i = 0; i < Note->Count; ++i)
+    {
+        trigram_postings *Postings = FindPostings(Index, Note->Trigrams[i].Trigram, false);
+        if(!Postings)
+        {
+            continue;
+        }
+
+        u32 At   = FindPostingFrom(Postings, 0, (u32)From);
+        u32 Dest = FindPostingFrom(Postings, 0, (u32)To);
+        if(At == Postings->Count || Postings->Notes[At] != From)
+        {
+            continue;
+        }
+
+        if(Dest > At)
+        {
+            memmove(Postings->Notes + At, Postings->Notes + At + 1, (Dest - At - 1) * sizeof(u32));
+            Postings->Notes[Dest - 1] = (u32)To;
+        }
+        else
+        {
+            memmove(Postings->Notes + Dest + 1, Postings->Notes + Dest, (At - Dest) * sizeof(u32));
+            Postings->Notes[Dest] = (u32)To;
+        }
+    }
+
+    Index->Notes[To] = *Note;
+    memset(Note, 0, sizeof(note_trigrams));
+}
+
+// NOTE(ingar): For when the note is deleted from the array and the last note is moved into its place
+isa_internal void
+RemoveNoteFromSearch(search_index *Index, u64 NoteIndex, u64 NoteCount)
+{
+    note_trigrams *Note = Index->Notes + NoteIndex;
+    for(u32 i = 0; i < Note->Count; ++i)
+    {
+        RemovePosting(Index, Note->Trigrams[i].Trigram, (u32)NoteIndex);
+    }
+    FreeTextBlock(&Index->Blocks, (u8 *)Note->Trigrams, Note->Capacity);
+    memset(Note, 0, sizeof(note_trigrams));
+
+    if(NoteIndex != NoteCount - 1)
+    {
+        RenameSearchNote(Index, NoteCount - 1, NoteIndex);
+    }
+}
+
+// NOTE(ingar): For when a note is put into the array at NoteIndex and the note that was there is moved to the end.
+// NoteCount is the number of notes before the insert.
+isa_internal void
+InsertNoteIntoSearch(search_index *Index, u64 NoteIndex, u64 NoteCount, note_text *Text)
+{
+    if(NoteIndex != NoteCount)
+    {
+        RenameSearchNote(Index, NoteIndex, NoteCount);
+    }
+
+    IndexNoteText(Index, NoteIndex, Text);
+}
+
+isa_internal int
+CompareNoteIndices(const void *A, const void *B)
+{
+    u32 a = *(const u32 *)A;
+    u32 b = *(const u32 *)B;
+    return (a < b) ? -1 : (a > b);
+}
+
+// NOTE(ingar): For when many notes change places at once. The note at Old moves to NewIndex[Old], or is taken out if
+// that is UINT32_MAX, and places that no note moves to are left empty for notes that are put in.
+isa_internal void
+RenumberSearchNotes(search_index *Index, u32 *NewIndex, u64 NoteCount)
+{
+    for(u64 i = 0; i < SCN_SEARCH_BUCKETS; ++i)
+    {
+        trigram_postings *Postings = Index->Buckets + i;
+        u32               Kept     = 0;
+        bool              Sorted   = true;
+        for(u32 j = 0; j < Postings->Count; ++j)
+        {
+            u32 New = NewIndex[Postings->Notes[j]];
+            if(New != UINT32_MAX)
+            {
+                Sorted &= (!Kept || Postings->Notes[Kept - 1] < New);
+                Postings->Notes[Kept++] = New;
+            }
+        }
+        Postings->Count = Kept;
+
+        if(!Sorted)
+        {
+            qsort(Postings->Notes, Kept, sizeof(u32), CompareNoteIndices);
+        }
+    }
+
+    /* Emptying a bucket can move a later one into it, so the same bucket is looked at again */
+    for(u64 i = 0; i < SCN_SEARCH_BUCKETS; ++i)
+    {
+        while(Index->Buckets[i].Trigram && !Index->Buckets[i].Count)
+        {
+            EmptyBucket(Index, i);
+        }
+    }
+
+    for(u64 i = 0; i < NoteCount; ++i)
+    {
+        if(NewIndex[i] == UINT32_MAX)
+        {
+            note_trigrams *Note = Index->Notes + i;
+            FreeTextBlock(&Index->Blocks, (u8 *)Note->Trigrams, Note->Capacity);
+            memset(Note, 0, sizeof(*Note));
+        }
+    }
+
+    /* The sets are moved along the chains of the renumbering, each move displacing the set that goes next. Marks
+     * are the places that have been filled (1) and the sets that have moved (2). */
+    u8 *Marks = Index->Marks;
+    for(u64 i = 0; i < NoteCount; ++i)
+    {
+        if((Marks[i] & 2) || NewIndex[i] == UINT32_MAX || NewIndex[i] == i)
+        {
+            continue;
+        }
+
+        note_trigrams Carry = Index->Notes[i];
+        memset(Index->Notes + i, 0, sizeof(note_trigrams));
+        for(u64 From = i;;)
+        {
+            u64           To        = NewIndex[From];
+            note_trigrams Displaced = Index->Notes[To];
+            bool          Next      = (To < NoteCount) && NewIndex[To] != UINT32_MAX && !(Marks[To] & 2);
+
+            Index->Notes[To] = Carry;
+            Marks[To] |= 1;
+            Marks[From] |= 2;
+            if(!Next)
+            {
+                break;
+            }
+
+            Carry = Displaced;
+            From  = To;
+        }
+    }
+
+    memset(Marks, 0, Index->MaxNotes);
+}
+
+isa_internal void
+ClearSearchIndex(search_index *Index)
+{
+    for(u64 i = 0; i < SCN_SEARCH_BUCKETS; ++i)
+    {
+        trigram_postings *Postings = Index->Buckets + i;
+        FreeTextBlock(&Index->Blocks, (u8 *)Postings->Notes, Postings->Capacity);
+        memset(Postings, 0, sizeof(*Postings));
+    }
+
+    for(u64 i = 0; i < Index->MaxNotes; ++i)
+    {
+        note_trigrams *Note = Index->Notes + i;
+        FreeTextBlock(&Index->Blocks, (u8 *)Note->Trigrams, Note->Capacity);
+        memset(Note, 0, sizeof(*Note));
+    }
+
+    Index->UsedBuckets = 0;
+    Index->Overflowed  = false;
+}
+
+isa_internal void
+RebuildSearchIndex(search_index *Index, note_collection *Notes)
+{
+    ClearSearchIndex(Index);
+    for(u64 i = 0; i < Notes->Count; ++i)
+    {
+        IndexNoteText(Index, i, &Notes->N[i].Text);
+    }
+}
+
+inline bool
+NoteMatchesSearch(search_index *Index, u64 NoteIndex)
+{
+    return (Index->Matches[NoteIndex / 64] >> (NoteIndex % 64)) & 1;
+}
+
+// NOTE(ingar): Query is folded ASCII. Text is compared 16 bytes at a time against the first character of the query in
+// both cases, and only the positions that have it are compared in full.
+isa_internal bool
+ContainsAsciiQuery(const u8 *Text, u64 Len, const u8 *Query, u32 QueryLen)
+{
+    if(Len < QueryLen)
+    {
+        return false;
+    }
+
+    u8      First = Query[0];
+    u8      Upper = ((u32)(First - 'a') < 26) ? (u8)(First - 32) : First;
+    __m128i Lower = _mm_set1_epi8((char)First);
+    __m128i Other = _mm_set1_epi8((char)Upper);
+
+    u64 Last = Len - QueryLen; // Last position the query can start at
+    for(u64 Block = 0; Block <= Last; Block += 16)
+    {
+        u32 Candidates = 0xFFFF;
+        if((Block + 16) <= Len)
+        {
+            __m128i Bytes = _mm_loadu_si128((const __m128i *)(Text + Block));
+            Candidates    = (u32)_mm_movemask_epi8(
+                _mm_or_si128(_mm_cmpeq_epi8(Bytes, Lower), _mm_cmpeq_epi8(Bytes, Other)));
+        }
+
+        for(; Candidates; Candidates &= Candidates - 1)
+        {
+            u64 Start = Block + CountTrailingZeros(Candidates);
+            if(Start > Last)
+            {
+                break;
+            }
+
+            u32 i = 0;
+            while(i < QueryLen)
+            {
+                u8 Byte = Text[Start + i];
+                if((((u32)(Byte - 'A') < 26) ? Byte + 32 : Byte) != Query[i])
+                {
+                    break;
+                }
+                ++i;
+            }
+
+            if(i == QueryLen)
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// NOTE(ingar): Query is folded codepoints. ASCII queries are matched against the bytes of the text directly, since no
+// other codepoint folds to ASCII and no byte of a longer sequence is ASCII.
+isa_internal bool
+NoteContainsQuery(search_index *Index, note_text *Text, u32 *Query, u32 QueryCount, bool AsciiQuery)
+{
+    if(AsciiQuery)
+    {
+        u8 Bytes[SCN_SEARCH_MAX_QUERY];
+        for(u32 i = 0; i < QueryCount; ++i)
+        {
+            Bytes[i] = (u8)Query[i];
+        }
+
+        text_view View = NoteTextView(Text);
+        if(ContainsAsciiQuery(View.A, View.ALen, Bytes, QueryCount)
+           || ContainsAsciiQuery(View.B, View.BLen, Bytes, QueryCount))
+        {
+            return true;
+        }
+
+        /* Matches that span the gap */
+        u8  Window[2 * SCN_SEARCH_MAX_QUERY];
+        u64 Left  = (View.ALen < QueryCount - 1) ? View.ALen : QueryCount - 1;
+        u64 Right = (View.BLen < QueryCount - 1) ? View.BLen : QueryCount - 1;
+        if(!Left || !Right)
+        {
+            return false;
+        }
+
+        memcpy(Window, View.A + (View.ALen - Left), Left);
+        memcpy(Window + Left, View.B, Right);
+        return ContainsAsciiQuery(Window, Left + Right, Bytes, QueryCount);
+    }
+
+    u32 Count = FoldText(Index, NoteTextView(Text));
+    u32 *Cps  = Index->Codepoints;
+    for(u32 Start = 0; Start + QueryCount <= Count; ++Start)
+    {
+        u32 i = 0;
+        while(i < QueryCount && Cps[Start + i] == Query[i])
+        {
+            ++i;
+        }
+
+        if(i == QueryCount)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+inline void
+SetSearchMatch(search_index *Index, u64 NoteIndex)
+{
+    u64 Bit = 1ULL << (NoteIndex % 64);
+    Index->MatchCount += !(Index->Matches[NoteIndex / 64] & Bit);
+    Index->Matches[NoteIndex / 64] |= Bit;
+}
+
+// NOTE(ingar): Queries of one or two codepoints are shorter than a trigram, but a note that contains one has a trigram
+// that contains it, unless the whole note is shorter than a trigram. So the candidates are the union of the lists of
+// those trigrams, which are found by going through the table, and the notes without trigrams. Going through the table
+// reads all SCN_SEARCH_BUCKETS buckets (6 MB) however few notes there are, but it is only done for the first two
+// characters typed into the search bar.
+isa_internal void
+RunShortSearch(search_index *Index, note_collection *Notes, u32 *Query, u32 QueryCount, bool AsciiQuery)
+{
+    u32 Mask = (1 << 21) - 1;
+    for(u64 i = 0; i < SCN_SEARCH_BUCKETS; ++i)
+    {
+        trigram_postings *Postings = Index->Buckets + i;
+        if(!Postings->Count)
+        {
+            continue;
+        }
+
+        u32  A     = (u32)(Postings->Trigram >> 42) & Mask;
+        u32  B     = (u32)(Postings->Trigram >> 21) & Mask;
+        u32  C     = (u32)Postings->Trigram & Mask;
+        bool Match = (QueryCount == 1) ? (A == Query[0] || B == Query[0] || C == Query[0])
+                                       : ((A == Query[0] && B == Query[1]) || (B == Query[0] && C == Query[1]));
+        for(u32 j = 0; Match && j < Postings->Count; ++j)
+        {
+            SetSearchMatch(Index, Postings->Notes[j]);
+        }
+    }
+
+    for(u64 Note = 0; Note < Notes->Count; ++Note)
+    {
+        if(!Index->Notes[Note].Count && NoteContainsQuery(Index, &Notes->N[Note].Text, Query, QueryCount, AsciiQuery))
+        {
+            SetSearchMatch(Index, Note);
+        }
+    }
+}
+
+// NOTE(ingar): Runs the current query over the notes. The previous matches are kept in PrevMatches.
+isa_internal void
+RunSearch(search_index *Index, note_collection *Notes)
+{
+    u64 Words = (Index->MaxNotes + 63) / 64;
+    memcpy(Index->PrevMatches, Index->Matches, Words * sizeof(u64));
+    memset(Index->Matches, 0, Words * sizeof(u64));
+    Index->MatchCount = 0;
+
+    if(!Index->Active || !Index->QueryLen)
+    {
+        return;
+    }
+
+    u32 Query[SCN_SEARCH_MAX_QUERY];
+    u32 QueryCount = FoldText(Index, TextView(Index->Query, Index->QueryLen));
+    memcpy(Query, Index->Codepoints, QueryCount * sizeof(u32));
+
+    bool AsciiQuery = true;
+    for(u32 i = 0; i < QueryCount; ++i)
+    {
+        AsciiQuery &= (Query[i] < 0x80);
+    }
+
+    if(QueryCount < 3 && !Index->Overflowed)
+    {
+        RunShortSearch(Index, Notes, Query, QueryCount, AsciiQuery);
+        return;
+    }
+
+    if(Index->Overflowed)
+    {
+        for(u64 Note = 0; Note < Notes->Count; ++Note)
+        {
+            if(NoteContainsQuery(Index, &Notes->N[Note].Text, Query, QueryCount, AsciiQuery))
+            {
+                SetSearchMatch(Index, Note);
+            }
+        }
+        return;
+    }
+
+    /* A note can only match if it has every trigram of the query */
+    trigram_postings *Lists[SCN_SEARCH_MAX_QUERY];
+    u32               ListCount = 0;
+    u32               Rarest    = 0;
+    for(u32 i = 0; i + 2 < QueryCount; ++i)
+    {
+        trigram_postings *Postings = FindPostings(Index, MakeTrigram(Query[i], Query[i + 1], Query[i + 2]), false);
+        if(!Postings || !Postings->Count)
+        {
+            return;
+        }
+
+        bool Seen = false;
+        for(u32 j = 0; j < ListCount && !Seen; ++j)
+        {
+            Seen = (Lists[j] == Postings);
+        }
+        if(!Seen)
+        {
+            Rarest             = (!ListCount || Postings->Count < Lists[Rarest]->Count) ? ListCount : Rarest;
+            Lists[ListCount++] = Postings;
+        }
+    }
+
+    trigram_postings *Candidates = Lists[Rarest];
+    Lists[Rarest]                = Lists[--ListCount];
+
+    /* The lists are sorted and the candidates come in order, so each lookup starts where the last one in that list
+     * ended. Having the trigram is the same as containing the query when the query is one trigram. */
+    u32  Starts[SCN_SEARCH_MAX_QUERY] = {};
+    bool Verify                       = (QueryCount > 3);
+    for(u32 i = 0; i < Candidates->Count; ++i)
+    {
+        u32  Note  = Candidates->Notes[i];
+        bool InAll = true;
+        for(u32 j = 0; j < ListCount && InAll; ++j)
+        {
+            Starts[j] = FindPostingFrom(Lists[j], Starts[j], Note);
+            InAll     = (Starts[j] < Lists[j]->Count) && (Lists[j]->Notes[Starts[j]] == Note);
+        }
+
+        if(InAll && (!Verify || NoteContainsQuery(Index, &Notes->N[Note].Text, Query, QueryCount, AsciiQuery)))
+        {
+            SetSearchMatch(Index, Note);
+        }
+    }
+}
+
+isa_internal search_index *
+CreateSearchIndex(isa_arena *Arena, u64 MaxNotes)
+{
+    u64 Words = (MaxNotes + 63) / 64;
+
+    search_index *Index = IsaPushStructZero(Arena, search_index);
+    Index->Arena        = Arena;
+    Index->MaxNotes     = MaxNotes;
+    Index->Buckets      = IsaPushArray(Arena, trigram_postings, SCN_SEARCH_BUCKETS);
+    Index->Notes        = IsaPushArray(Arena, note_trigrams, MaxNotes);
+    Index->Matches      = IsaPushArray(Arena, u64, Words);
+    Index->PrevMatches  = IsaPushArray(Arena, u64, Words);
+    Index->Marks        = IsaPushArray(Arena, u8, MaxNotes);
+
+    memset(Index->Buckets, 0, SCN_SEARCH_BUCKETS * sizeof(trigram_postings));
+    memset(Index->Notes, 0, MaxNotes * sizeof(note_trigrams));
+    memset(Index->Matches, 0, Words * sizeof(u64));
+    memset(Index->PrevMatches, 0, Words * sizeof(u64));
+    memset(Index->Marks, 0, MaxNotes);
+
+    return Index;
+}
+
+#endif // SCN_SEARCH_H_
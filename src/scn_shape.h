@@ -0,0 +1,389 @@
+/*
+ * Copyright 2024 (c) by Ingar Solveigson Asheim. All Rights Reserved.
+ */
+
+#ifndef SCN_SHAPE_H_
+#define SCN_SHAPE_H_
+
+#include "isa.h"
+#include "scn.h"
+#include "scn_intrinsics.h"
+#include "scn_pixels.h"
+
+#include <cmath>
+
+/* NOTE(ingar): Rounded rects and shadows
+ *
+ * A rounded rect with a soft edge is drawn from a mask of one corner and a profile of one edge, which depend only on
+ * the radius and the blur in pixels of the buffer and are cached by them. The four corners are the same mask read
+ * forwards or backwards, the straight edges repeat the profile along their length, and the rest is a plain fill. A
+ * sharp rect (a blur of 1) has no edge profile, so only its corners cost more than a fill.
+ *
+ * The coverage of a pixel is a ramp over the signed distance d from its center to the edge of the shape,
+ * 0.5 - d / Blur, clamped, and smoothed for shadows. The shape is grown by half the blur, which is how far the ramp
+ * reaches outside it.
+ *
+ * Parts of the fill that something opaque is drawn over right after, like the inside of a border or the shadow under
+ * a note, can be left out with a hidden rect.
+ */
+
+#define SCN_SHAPE_MAX_TILE   64 // Radius plus half the blur, in pixels of the buffer
+#define SCN_SHAPE_MASK_SLOTS 16
+
+struct shape_mask
+{
+    i32 Radius;
+    i32 Blur;
+    i32 Extent; // How far the shape is grown, half the blur
+    i32 Tile;   // The size of the corner mask each way, Radius + Extent but at least the width of the edge
+    u64 LastUse;
+
+    u8 Corner[SCN_SHAPE_MAX_TILE * SCN_SHAPE_MAX_TILE]; // The top left corner, Tile pixels each way
+    u8 Edge[SCN_SHAPE_MAX_TILE];                         // The left edge from the outside in, 2 * Extent pixels
+};
+
+struct shape_mask_cache
+{
+    u64        Clock;
+    u32        Count;
+    shape_mask Masks[SCN_SHAPE_MASK_SLOTS];
+};
+
+// NOTE(ingar): A band of a rounded rect in the window, from the outside in
+struct shape_ring
+{
+    u32_argb Color;
+    float    Width;
+};
+
+isa_internal shape_mask_cache *
+CreateShapeMaskCache(isa_arena *Arena)
+{
+    return IsaPushStructZero(Arena, shape_mask_cache);
+}
+
+inline u8
+ShapeCoverage(float Distance, i32 Blur)
+{
+    float Coverage = Clamp(0.5f - (Distance / (float)Blur), 0.0f, 1.0f);
+    if(Blur > 1)
+    {
+        Coverage = Coverage * Coverage * (3.0f - (2.0f * Coverage));
+    }
+
+    return (u8)((Coverage * 255.0f) + 0.5f);
+}
+
+isa_internal void
+MakeShapeMask(shape_mask *Mask, i32 Radius, i32 Blur)
+{
+    Mask->Radius = Radius;
+    Mask->Blur   = Blur;
+    Mask->Extent = Blur / 2;
+    Mask->Tile   = Radius + Mask->Extent;
+    Mask->Tile   = (Mask->Tile > 2 * Mask->Extent) ? Mask->Tile : 2 * Mask->Extent;
+
+    /* The distance to a rounded rect whose corner circle is centered at (Center, Center), which is the quarter circle
+     * inside that square and the straight edges past it */
+    float Center = (float)(Radius + Mask->Extent);
+    for(i32 y = 0; y < Mask->Tile; ++y)
+    {
+        for(i32 x = 0; x < Mask->Tile; ++x)
+        {
+            float qx       = Center - ((float)x + 0.5f);
+            float qy       = Center - ((float)y + 0.5f);
+            float ox       = (qx > 0.0f) ? qx : 0.0f;
+            float oy       = (qy > 0.0f) ? qy : 0.0f;
+            float Inside   = (qx > qy) ? qx : qy;
+            float Distance = sqrtf((ox * ox) + (oy * oy)) + ((Inside < 0.0f) ? Inside : 0.0f) - (float)Radius;
+
+            Mask->Corner[(y * Mask->Tile) + x] = ShapeCoverage(Distance, Blur);
+        }
+    }
+
+    for(i32 x = 0; x < 2 * Mask->Extent; ++x)
+    {
+        Mask->Edge[x] = ShapeCoverage((float)Mask->Extent - ((float)x + 0.5f), Blur);
+    }
+}
+
+// NOTE(ingar): The least recently used mask is made over when the cache is full
+isa_internal shape_mask *
+GetShapeMask(shape_mask_cache *Cache, i32 Radius, i32 Blur)
+{
+    ++Cache->Clock;
+
+    shape_mask *Oldest = Cache->Masks;
+    for(u32 i = 0; i < Cache->Count; ++i)
+    {
+        shape_mask *Mask = Cache->Masks + i;
+        if(Mask->Radius == Radius && Mask->Blur == Blur)
+        {
+            Mask->LastUse = Cache->Clock;
+            return Mask;
+        }
+        Oldest = (Mask->LastUse < Oldest->LastUse) ? Mask : Oldest;
+    }
+
+    shape_mask *Mask = (Cache->Count < SCN_SHAPE_MASK_SLOTS) ? Cache->Masks + Cache->Count++ : Oldest;
+    MakeShapeMask(Mask, Radius, Blur);
+    Mask->LastUse = Cache->Clock;
+    return Mask;
+}
+
+// NOTE(ingar): The pixels of the buffer that the rect in the window covers
+inline pixel_span
+RectToSpan(scn_offscreen_buffer Buffer, rect Rect)
+{
+    pixel_span Result;
+    Result.StartX = RoundFloatToi64(Rect.Min.x / Buffer.PixelSize);
+    Result.StartY = RoundFloatToi64(Rect.Min.y / Buffer.PixelSize);
+    Result.EndX   = RoundFloatToi64(Rect.Max.x / Buffer.PixelSize);
+    Result.EndY   = RoundFloatToi64(Rect.Max.y / Buffer.PixelSize);
+    return Result;
+}
+
+inline pixel_span
+GrowSpan(pixel_span Span, i64 Amount)
+{
+    pixel_span Result = { Span.StartX - Amount, Span.StartY - Amount, Span.EndX + Amount, Span.EndY + Amount };
+    return Result;
+}
+
+template <typename format>
+isa_internal void
+FillShapeSpan(scn_offscreen_buffer Buffer, pixel_span Clip, pixel_span Span, u32_argb Color, u32 Alpha)
+{
+    Span = IntersectSpans(Span, Clip);
+    if(!SpanHasArea(Span) || Alpha == 0)
+    {
+        return;
+    }
+
+    if(Alpha >= 256)
+    {
+        FillPixels<format, blend_copy>(Buffer, Span, Color, 256);
+    }
+    else
+    {
+        FillPixels<format, blend_over>(Buffer, Span, Color, Alpha);
+    }
+}
+
+// NOTE(ingar): Fills what is left of Span after taking out Hidden, which is at most four rects
+template <typename format>
+isa_internal void
+FillShapeSpanExcept(scn_offscreen_buffer Buffer, pixel_span Clip, pixel_span Span, pixel_span Hidden,
+                    u32_argb Color, u32 Alpha)
+{
+    pixel_span Cut = IntersectSpans(Span, Hidden);
+    if(!SpanHasArea(Cut))
+    {
+        FillShapeSpan<format>(Buffer, Clip, Span, Color, Alpha);
+        return;
+    }
+
+    FillShapeSpan<format>(Buffer, Clip, { Span.StartX, Span.StartY, Span.EndX, Cut.StartY }, Color, Alpha);
+    FillShapeSpan<format>(Buffer, Clip, { Span.StartX, Cut.EndY, Span.EndX, Span.EndY }, Color, Alpha);
+    FillShapeSpan<format>(Buffer, Clip, { Span.StartX, Cut.StartY, Cut.StartX, Cut.EndY }, Color, Alpha);
+    FillShapeSpan<format>(Buffer, Clip, { Cut.EndX, Cut.StartY, Span.EndX, Cut.EndY }, Color, Alpha);
+}
+
+// NOTE(ingar): Blends the mask over the rows of Span, with its first pixel at (MaskX, MaskY) and mirrored in each
+// direction whose step is -1
+template <typename format>
+isa_internal void
+BlendShapeMask(scn_offscreen_buffer Buffer, pixel_span Clip, pixel_span Span, u8 *Mask, i64 Pitch, i64 StepX,
+               i64 StepY, u32_argb Color, u32 Alpha)
+{
+    typedef typename format::type pixel;
+
+    pixel_span Drawn = IntersectSpans(Span, Clip);
+    if(!SpanHasArea(Drawn))
+    {
+        return;
+    }
+
+    for(i64 y = Drawn.StartY; y < Drawn.EndY; ++y)
+    {
+        u8    *Row    = Mask + ((y - Span.StartY) * StepY * Pitch) + ((Drawn.StartX - Span.StartX) * StepX);
+        pixel *Pixels = (pixel *)PixelAt(Buffer, Drawn.StartX, y);
+        BlendMaskSpan<format>(Pixels, Row, StepX, Drawn.EndX - Drawn.StartX, Color, Alpha);
+    }
+}
+
+// NOTE(ingar): Shape and Hidden are in pixels of the buffer. Shape is at least 2 * Radius each way.
+template <typename format>
+isa_internal void
+DrawShapeIn(scn_offscreen_buffer Buffer, pixel_span Clip, pixel_span Shape, shape_mask *Mask, u32_argb Color,
+            u32 Alpha, pixel_span Hidden)
+{
+    pixel_span Outer = GrowSpan(Shape, Mask->Extent);
+    i64        Tile  = Mask->Tile;
+    i64        Band  = 2 * (i64)Mask->Extent;
+    i64        Last  = Tile - 1;
+
+    /* Corners, with the mask mirrored for the right and bottom ones */
+    u8 *Corner = Mask->Corner;
+    BlendShapeMask<format>(Buffer, Clip, { Outer.StartX, Outer.StartY, Outer.StartX + Tile, Outer.StartY + Tile },
+                           Corner, Tile, 1, 1, Color, Alpha);
+    BlendShapeMask<format>(Buffer, Clip, { Outer.EndX - Tile, Outer.StartY, Outer.EndX, Outer.StartY + Tile },
+                           Corner + Last, Tile, -1, 1, Color, Alpha);
+    BlendShapeMask<format>(Buffer, Clip, { Outer.StartX, Outer.EndY - Tile, Outer.StartX + Tile, Outer.EndY },
+                           Corner + (Last * Tile), Tile, 1, -1, Color, Alpha);
+    BlendShapeMask<format>(Buffer, Clip, { Outer.EndX - Tile, Outer.EndY - Tile, Outer.EndX, Outer.EndY },
+                           Corner + (Last * Tile) + Last, Tile, -1, -1, Color, Alpha);
+
+    /* Top and bottom edges, where every row has one coverage along its length */
+    i64 InnerX0 = Outer.StartX + Tile;
+    i64 InnerX1 = Outer.EndX - Tile;
+    for(i64 i = 0; i < Band; ++i)
+    {
+        u32 RowAlpha = (Mask->Edge[i] * Alpha) / 255;
+        FillShapeSpan<format>(Buffer, Clip, { InnerX0, Outer.StartY + i, InnerX1, Outer.StartY + i + 1 }, Color,
+                              RowAlpha);
+        FillShapeSpan<format>(Buffer, Clip, { InnerX0, Outer.EndY - i - 1, InnerX1, Outer.EndY - i }, Color, RowAlpha);
+    }
+
+    /* Left and right edges, where every row is the edge profile */
+    i64 InnerY0 = Outer.StartY + Tile;
+    i64 InnerY1 = Outer.EndY - Tile;
+    BlendShapeMask<format>(Buffer, Clip, { Outer.StartX, InnerY0, Outer.StartX + Band, InnerY1 }, Mask->Edge, 0, 1, 1,
+                           Color, Alpha);
+    BlendShapeMask<format>(Buffer, Clip, { Outer.EndX - Band, InnerY0, Outer.EndX, InnerY1 }, Mask->Edge + Band - 1,
+                           0, -1, 1, Color, Alpha);
+
+    /* The inside, as the part between the corners and the part beside them */
+    FillShapeSpanExcept<format>(Buffer, Clip, { InnerX0, Outer.StartY + Band, InnerX1, Outer.EndY - Band }, Hidden,
+                                Color, Alpha);
+    FillShapeSpanExcept<format>(Buffer, Clip, { Outer.StartX + Band, InnerY0, InnerX0, InnerY1 }, Hidden, Color,
+                                Alpha);
+    FillShapeSpanExcept<format>(Buffer, Clip, { InnerX1, InnerY0, Outer.EndX - Band, InnerY1 }, Hidden, Color, Alpha);
+}
+
+isa_internal void
+DrawShape(scn_offscreen_buffer Buffer, pixel_span Clip, pixel_span Shape, shape_mask *Mask, u32_argb Color,
+          u32 Alpha, pixel_span Hidden)
+{
+    switch(Buffer.Format)
+    {
+        case ScnPixelFormat_Bgra8:
+            {
+                DrawShapeIn<pixel_bgra8>(Buffer, Clip, Shape, Mask, Color, Alpha, Hidden);
+            }
+            break;
+        case ScnPixelFormat_Rgb565:
+            {
+                DrawShapeIn<pixel_rgb565>(Buffer, Clip, Shape, Mask, Color, Alpha, Hidden);
+            }
+            break;
+        case ScnPixelFormat_A8:
+            {
+                DrawShapeIn<pixel_a8>(Buffer, Clip, Shape, Mask, Color, Alpha, Hidden);
+            }
+            break;
+    }
+}
+
+// NOTE(ingar): The radius in pixels of the buffer, no more than half of the shape and no more than the masks hold
+inline i32
+ShapeRadius(pixel_span Shape, float Radius, float PixelSize, i32 Extent)
+{
+    i64 w      = Shape.EndX - Shape.StartX;
+    i64 h      = Shape.EndY - Shape.StartY;
+    i64 Half   = ((w < h) ? w : h) / 2;
+    i64 Result = RoundFloatToi64(Radius / PixelSize);
+    Result     = (Result < Half) ? Result : Half;
+    Result     = (Result < SCN_SHAPE_MAX_TILE - Extent) ? Result : SCN_SHAPE_MAX_TILE - Extent;
+    return (Result > 0) ? (i32)Result : 0;
+}
+
+// NOTE(ingar): The pixels that DrawRoundedRect covers with opaque color when Alpha is 256, which is all of the rect but
+// its corners: one span across it between the corners and one down it between them
+isa_internal void
+RoundedRectCore(scn_offscreen_buffer Buffer, rect Rect, float Radius, pixel_span *Across, pixel_span *Down)
+{
+    pixel_span Shape  = RectToSpan(Buffer, Rect);
+    i64        Corner = ShapeRadius(Shape, Radius, Buffer.PixelSize, 0);
+    *Across           = { Shape.StartX + Corner, Shape.StartY, Shape.EndX - Corner, Shape.EndY };
+    *Down             = { Shape.StartX, Shape.StartY + Corner, Shape.EndX, Shape.EndY - Corner };
+}
+
+// NOTE(ingar): Everything is in window pixels. The rings are drawn from the outside in, each over the edge of the
+// last, and the rest is filled with Color. Only the corners of a ring are drawn twice, since the inside of each is
+// left out of its fill. The radius of each ring is the one outside it less its width in pixels of the buffer, so that
+// its corners lie inside those of the ring outside it and no pixel is left out of both.
+isa_internal void
+DrawRoundedRect(scn_offscreen_buffer Buffer, rect Clip, shape_mask_cache *Cache, rect Rect, float Radius,
+                u32_argb Color, u32 Alpha, shape_ring *Rings, u32 RingCount)
+{
+    rect       PixelClip = BufferClip(Buffer, Clip);
+    pixel_span ClipSpan  = { (i64)PixelClip.Min.x, (i64)PixelClip.Min.y, (i64)PixelClip.Max.x, (i64)PixelClip.Max.y };
+    pixel_span Shape     = RectToSpan(Buffer, Rect);
+    i64        Corner    = ShapeRadius(Shape, Radius, Buffer.PixelSize, 0);
+
+    for(u32 i = 0; i <= RingCount; ++i)
+    {
+        pixel_span Drawn = IntersectSpans(Shape, ClipSpan);
+        if(!SpanHasArea(Drawn))
+        {
+            return;
+        }
+
+        if(i == RingCount)
+        {
+            pixel_span Nothing = {};
+            DrawShape(Buffer, ClipSpan, Shape, GetShapeMask(Cache, (i32)Corner, 1), Color, Alpha, Nothing);
+            return;
+        }
+
+        /* A ring is left out when the clip is all inside the opaque part of what is drawn over it */
+        i64        Width  = RoundFloatToi64(Rings[i].Width / Buffer.PixelSize);
+        Width             = (Width > 0) ? Width : 1;
+        pixel_span Inside = GrowSpan(Shape, -Width);
+        i64        Inner  = (Corner > Width) ? Corner - Width : 0;
+        pixel_span Across = { Inside.StartX + Inner, Inside.StartY, Inside.EndX - Inner, Inside.EndY };
+        pixel_span Down   = { Inside.StartX, Inside.StartY + Inner, Inside.EndX, Inside.EndY - Inner };
+        if(!SpanContains(Across, Drawn) && !SpanContains(Down, Drawn))
+        {
+            DrawShape(Buffer, ClipSpan, Shape, GetShapeMask(Cache, (i32)Corner, 1), Rings[i].Color, Alpha, Inside);
+        }
+
+        Shape  = Inside;
+        Corner = Inner;
+    }
+}
+
+// NOTE(ingar): Rect is the shape that casts the shadow, in window pixels. Hidden is the part of the window that is
+// drawn over right after, where the shadow is left out.
+isa_internal void
+DrawShadow(scn_offscreen_buffer Buffer, rect Clip, shape_mask_cache *Cache, rect Rect, float Radius, float Blur,
+           v2 Offset, u32_argb Color, u32 Alpha, rect Hidden)
+{
+    rect       PixelClip = BufferClip(Buffer, Clip);
+    pixel_span ClipSpan  = { (i64)PixelClip.Min.x, (i64)PixelClip.Min.y, (i64)PixelClip.Max.x, (i64)PixelClip.Max.y };
+    pixel_span Shape     = RectToSpan(Buffer, OffsetRect(Rect, Offset));
+    if(!SpanHasArea(Shape))
+    {
+        return;
+    }
+
+    /* A blur wider than the shape would make the corners overlap */
+    i64 Smaller    = ((Shape.EndX - Shape.StartX) < (Shape.EndY - Shape.StartY)) ? (Shape.EndX - Shape.StartX)
+                                                                                 : (Shape.EndY - Shape.StartY);
+    i64 BlurPixels = RoundFloatToi64(Blur / Buffer.PixelSize);
+    BlurPixels     = Clamp(BlurPixels, (i64)1, (Smaller < SCN_SHAPE_MAX_TILE) ? Smaller : (i64)SCN_SHAPE_MAX_TILE);
+
+    pixel_span HiddenSpan = RectToSpan(Buffer, Hidden);
+    pixel_span Drawn      = IntersectSpans(GrowSpan(Shape, BlurPixels / 2), ClipSpan);
+    if(SpanContains(HiddenSpan, Drawn))
+    {
+        return;
+    }
+
+    i32         Corner = ShapeRadius(Shape, Radius, Buffer.PixelSize, (i32)(BlurPixels / 2));
+    shape_mask *Mask   = GetShapeMask(Cache, Corner, (i32)BlurPixels);
+    DrawShape(Buffer, ClipSpan, Shape, Mask, Color, Alpha, HiddenSpan);
+}
+
+#endif // SCN_SHAPE_H_
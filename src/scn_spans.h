@@ -0,0 +1,372 @@
+/*
+ * Copyright 2024 (c) by Ingar Solveigson Asheim. All Rights Reserved.
+ */
+
+#ifndef SCN_SPANS_H_
+#define SCN_SPANS_H_
+
+#include "isa.h"
+#include "scn.h"
+#include "scn_pixels.h"
+
+#include <cstdlib>
+
+/* NOTE(ingar): Span buffer
+ *
+ * Drawing every note under a region from the bottom up writes each pixel once per note over it, which adds up on a
+ * deep stack. Instead the region is cut into bands of rows at every row where a note, or the part of it that it fills
+ * with opaque color, starts or ends. Within a band nothing changes from row to row, so which parts of each note show
+ * is worked out once per band, from the top note down: a note shows where no opaque part of a note above it covers
+ * it, and what it covers is added to the covered spans for the notes below. The background is a layer under all the
+ * notes that covers the whole region. The layers whose extent crosses a band are kept in an active list, in z order,
+ * as the bands go down.
+ *
+ * Each part that shows is a piece, which is drawn with its own clip, so that a pixel under the opaque part of a note is
+ * only written by that note. A piece grows down into the next band when its layer shows in the same columns there,
+ * so a note is cut into about as many pieces as there are notes over it rather than one per band. Pieces of a layer
+ * never overlap, so drawing them by layer from the bottom up draws every pixel in z order. Shadows, rounded corners
+ * and anything translucent blend over what is under them as before.
+ *
+ * Everything is in pixels of the buffer, so that no two pieces share a row or column when the region is drawn at a
+ * lower resolution. If there are more pieces than there is room for, the region is drawn the plain way.
+ */
+
+#define SCN_SPAN_PIECES_PER_LAYER 16
+
+struct span_layer
+{
+    u64        Note;    // Index of the note, not used by the background
+    pixel_span Extent;  // The pixels the layer can change, within the clip
+    pixel_span Core[2]; // The pixels it fills with opaque color, as two spans that may overlap
+
+    u64 OpenFirst; // The pieces of the last band the layer showed in, which the next band can grow
+    u64 OpenCount;
+    i64 OpenEndY;
+};
+
+struct span_start
+{
+    i64 y;
+    u64 Layer;
+};
+
+struct span_interval
+{
+    i64 StartX, EndX;
+};
+
+struct span_piece
+{
+    u64        Layer;
+    pixel_span Span;
+};
+
+struct span_buffer
+{
+    u64 MaxLayers;
+    u64 MaxPieces;
+
+    pixel_span  Clip;
+    u64         LayerCount;
+    span_layer *Layers; // The background, then the notes in z order from the bottom up
+
+    i64        *Edges; // Rows where a band starts, and the end of the last one
+    span_start *Starts;
+    u64        *Active;
+
+    span_interval *Covered; // Sorted and apart, swapped with Merged when a span is added
+    span_interval *Merged;
+    u64            CoveredCount;
+
+    u64         PieceCount;
+    span_piece *Pieces;
+};
+
+isa_internal span_buffer *
+CreateSpanBuffer(isa_arena *Arena, u64 MaxNotes)
+{
+    span_buffer *Spans = IsaPushStructZero(Arena, span_buffer);
+    Spans->MaxLayers   = MaxNotes + 1;
+    Spans->MaxPieces   = Spans->MaxLayers * SCN_SPAN_PIECES_PER_LAYER;
+    Spans->Layers      = IsaPushArray(Arena, span_layer, Spans->MaxLayers);
+    Spans->Edges       = IsaPushArray(Arena, i64, Spans->MaxLayers * 6);
+    Spans->Starts      = IsaPushArray(Arena, span_start, Spans->MaxLayers);
+    Spans->Active      = IsaPushArray(Arena, u64, Spans->MaxLayers);
+    Spans->Covered     = IsaPushArray(Arena, span_interval, Spans->MaxLayers * 2);
+    Spans->Merged      = IsaPushArray(Arena, span_interval, Spans->MaxLayers * 2);
+    Spans->Pieces      = IsaPushArray(Arena, span_piece, Spans->MaxPieces);
+    return Spans;
+}
+
+// NOTE(ingar): The spans of a layer are clipped, and a layer that does not reach into the clip is left out
+isa_internal void
+AddSpanLayer(span_buffer *Spans, u64 Note, pixel_span Extent, pixel_span Core0, pixel_span Core1)
+{
+    IsaAssert(Spans->LayerCount < Spans->MaxLayers, "More layers than notes");
+
+    span_layer *Layer = Spans->Layers + Spans->LayerCount;
+    Layer->Note       = Note;
+    Layer->Extent     = IntersectSpans(Extent, Spans->Clip);
+    Layer->Core[0]    = IntersectSpans(Core0, Layer->Extent);
+    Layer->Core[1]    = IntersectSpans(Core1, Layer->Extent);
+    Layer->OpenCount  = 0;
+    Layer->OpenEndY   = Layer->Extent.StartY - 1;
+    if(SpanHasArea(Layer->Extent))
+    {
+        ++Spans->LayerCount;
+    }
+}
+
+// NOTE(ingar): Starts over with only the background, then the notes are added from the bottom up
+isa_internal void
+BeginSpanLayers(span_buffer *Spans, pixel_span Clip)
+{
+    pixel_span Nothing = {};
+    Spans->Clip        = Clip;
+    Spans->LayerCount  = 0;
+    AddSpanLayer(Spans, 0, Clip, Nothing, Nothing);
+}
+
+isa_internal int
+CompareEdges(const void *A, const void *B)
+{
+    i64 a = *(const i64 *)A;
+    i64 b = *(const i64 *)B;
+    return (a < b) ? -1 : (a > b);
+}
+
+isa_internal int
+CompareSpanStarts(const void *A, const void *B)
+{
+    i64 a = ((const span_start *)A)->y;
+    i64 b = ((const span_start *)B)->y;
+    return (a < b) ? -1 : (a > b);
+}
+
+isa_internal int
+CompareSpanPieces(const void *A, const void *B)
+{
+    u64 a = ((const span_piece *)A)->Layer;
+    u64 b = ((const span_piece *)B)->Layer;
+    return (a < b) ? -1 : (a > b);
+}
+
+isa_internal void
+AddCoveredSpan(span_buffer *Spans, i64 StartX, i64 EndX)
+{
+    if(StartX >= EndX)
+    {
+        return;
+    }
+
+    u64  Count  = 0;
+    bool Placed = false;
+    for(u64 i = 0; i < Spans->CoveredCount; ++i)
+    {
+        span_interval Covered = Spans->Covered[i];
+        if(Covered.EndX < StartX)
+        {
+            Spans->Merged[Count++] = Covered;
+        }
+        else if(Covered.StartX > EndX)
+        {
+            if(!Placed)
+            {
+                Spans->Merged[Count++] = { StartX, EndX };
+                Placed                 = true;
+            }
+            Spans->Merged[Count++] = Covered;
+        }
+        else
+        {
+            /* Overlapping or touching, so the two become one */
+            StartX = (Covered.StartX < StartX) ? Covered.StartX : StartX;
+            EndX   = (Covered.EndX > EndX) ? Covered.EndX : EndX;
+        }
+    }
+    if(!Placed)
+    {
+        Spans->Merged[Count++] = { StartX, EndX };
+    }
+
+    span_interval *Swap = Spans->Covered;
+    Spans->Covered      = Spans->Merged;
+    Spans->Merged       = Swap;
+    Spans->CoveredCount = Count;
+}
+
+inline bool
+AddSpanPiece(span_buffer *Spans, u64 Layer, i64 StartX, i64 StartY, i64 EndX, i64 EndY)
+{
+    if(Spans->PieceCount == Spans->MaxPieces)
+    {
+        return false;
+    }
+
+    Spans->Pieces[Spans->PieceCount++] = { Layer, { StartX, StartY, EndX, EndY } };
+    return true;
+}
+
+// NOTE(ingar): Adds a piece for every part of the extent of the layer that is not covered in the rows [StartY, EndY),
+// or grows the pieces of the band above if they are the same. Returns false if the pieces do not fit.
+isa_internal bool
+AddVisiblePieces(span_buffer *Spans, u64 Layer, i64 StartY, i64 EndY)
+{
+    span_layer *Data  = Spans->Layers + Layer;
+    u64         First = Spans->PieceCount;
+    i64         x     = Data->Extent.StartX;
+    i64         EndX  = Data->Extent.EndX;
+    for(u64 i = 0; i < Spans->CoveredCount && x < EndX; ++i)
+    {
+        span_interval Covered = Spans->Covered[i];
+        if(Covered.EndX <= x)
+        {
+            continue;
+        }
+        if(Covered.StartX >= EndX)
+        {
+            break;
+        }
+
+        if(Covered.StartX > x && !AddSpanPiece(Spans, Layer, x, StartY, Covered.StartX, EndY))
+        {
+            return false;
+        }
+        x = Covered.EndX;
+    }
+    if(x < EndX && !AddSpanPiece(Spans, Layer, x, StartY, EndX, EndY))
+    {
+        return false;
+    }
+
+    u64  Count = Spans->PieceCount - First;
+    bool Same  = (Data->OpenEndY == StartY) && (Data->OpenCount == Count);
+    for(u64 i = 0; i < Count && Same; ++i)
+    {
+        pixel_span Open = Spans->Pieces[Data->OpenFirst + i].Span;
+        pixel_span New  = Spans->Pieces[First + i].Span;
+        Same            = (Open.StartX == New.StartX) && (Open.EndX == New.EndX);
+    }
+
+    if(Same)
+    {
+        for(u64 i = 0; i < Count; ++i)
+        {
+            Spans->Pieces[Data->OpenFirst + i].Span.EndY = EndY;
+        }
+        Spans->PieceCount = First;
+    }
+    else
+    {
+        Data->OpenFirst = First;
+        Data->OpenCount = Count;
+    }
+    Data->OpenEndY = EndY;
+
+    return true;
+}
+
+inline void
+AddSpanEdges(i64 *Edges, u64 *Count, pixel_span Span)
+{
+    if(SpanHasArea(Span))
+    {
+        Edges[(*Count)++] = Span.StartY;
+        Edges[(*Count)++] = Span.EndY;
+    }
+}
+
+// NOTE(ingar): Fills Pieces with the parts of the layers that show, sorted from the bottom layer up. Returns false if
+// there are too many.
+isa_internal bool
+FindVisiblePieces(span_buffer *Spans)
+{
+    /* The rows where the bands start, and the layers by the row they start at */
+    u64 EdgeCount = 0;
+    for(u64 i = 0; i < Spans->LayerCount; ++i)
+    {
+        span_layer *Layer = Spans->Layers + i;
+        AddSpanEdges(Spans->Edges, &EdgeCount, Layer->Extent);
+        AddSpanEdges(Spans->Edges, &EdgeCount, Layer->Core[0]);
+        AddSpanEdges(Spans->Edges, &EdgeCount, Layer->Core[1]);
+        Spans->Starts[i] = { Layer->Extent.StartY, i };
+    }
+
+    qsort(Spans->Edges, EdgeCount, sizeof(i64), CompareEdges);
+    qsort(Spans->Starts, Spans->LayerCount, sizeof(span_start), CompareSpanStarts);
+
+    u64 Unique = 0;
+    for(u64 i = 0; i < EdgeCount; ++i)
+    {
+        if(Unique == 0 || Spans->Edges[i] != Spans->Edges[Unique - 1])
+        {
+            Spans->Edges[Unique++] = Spans->Edges[i];
+        }
+    }
+
+    Spans->PieceCount = 0;
+    u64 NextStart     = 0;
+    u64 ActiveCount   = 0;
+    for(u64 Edge = 0; Edge + 1 < Unique; ++Edge)
+    {
+        i64 StartY = Spans->Edges[Edge];
+        i64 EndY   = Spans->Edges[Edge + 1];
+
+        /* The active list stays in z order: layers that have ended are taken out, and those that start are put in
+         * place */
+        u64 Kept = 0;
+        for(u64 i = 0; i < ActiveCount; ++i)
+        {
+            u64 Layer = Spans->Active[i];
+            if(Spans->Layers[Layer].Extent.EndY > StartY)
+            {
+                Spans->Active[Kept++] = Layer;
+            }
+        }
+        ActiveCount = Kept;
+
+        for(; NextStart < Spans->LayerCount && Spans->Starts[NextStart].y <= StartY; ++NextStart)
+        {
+            u64 Layer = Spans->Starts[NextStart].Layer;
+            u64 At    = ActiveCount++;
+            for(; At > 0 && Spans->Active[At - 1] > Layer; --At)
+            {
+                Spans->Active[At] = Spans->Active[At - 1];
+            }
+            Spans->Active[At] = Layer;
+        }
+
+        /* From the top down, until the band is covered from one side of the clip to the other */
+        pixel_span Clip     = Spans->Clip;
+        Spans->CoveredCount = 0;
+        for(u64 i = ActiveCount; i > 0; --i)
+        {
+            span_interval *Covered = Spans->Covered;
+            if(Spans->CoveredCount == 1 && Covered->StartX <= Clip.StartX && Covered->EndX >= Clip.EndX)
+            {
+                break;
+            }
+
+            u64         Layer = Spans->Active[i - 1];
+            span_layer *Data  = Spans->Layers + Layer;
+            if(!AddVisiblePieces(Spans, Layer, StartY, EndY))
+            {
+                return false;
+            }
+
+            for(u32 c = 0; c < 2; ++c)
+            {
+                pixel_span Core = Data->Core[c];
+                if(Core.StartX < Core.EndX && Core.StartY <= StartY && Core.EndY >= EndY)
+                {
+                    AddCoveredSpan(Spans, Core.StartX, Core.EndX);
+                }
+            }
+        }
+    }
+
+    qsort(Spans->Pieces, Spans->PieceCount, sizeof(span_piece), CompareSpanPieces);
+    return true;
+}
+
+#endif // SCN_SPANS_H_
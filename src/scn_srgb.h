@@ -0,0 +1,106 @@
+/*
+ * Copyright 2024 (c) by Ingar Solveigson Asheim. All Rights Reserved.
+ */
+
+#ifndef SCN_SRGB_H_
+#define SCN_SRGB_H_
+
+#include "isa.h"
+
+/* NOTE(ingar): sRGB and linear light
+ *
+ * Colors are stored as sRGB bytes, which are not proportional to light, so mixing two of them directly makes the mix
+ * too dark. Blends convert to linear light, mix there and convert back. Both conversions are tables that are made at
+ * compile time: one from the 256 sRGB bytes to 12 bit linear values, and one from every 12 bit linear value back to
+ * the nearest sRGB byte. 12 bits is enough for every byte to come back as itself, so a blend with full alpha does not
+ * change the color.
+ *
+ * The tables are made with Newton's method instead of powf, since that is not constexpr.
+ */
+
+#define SCN_LINEAR_BITS 12
+#define SCN_LINEAR_MAX  ((1 << SCN_LINEAR_BITS) - 1)
+
+struct srgb_tables
+{
+    u16 ToLinear[256];                // sRGB byte to linear, 0 to SCN_LINEAR_MAX
+    u8  ToSrgb[SCN_LINEAR_MAX + 1];   // Linear to the nearest sRGB byte
+};
+
+// NOTE(ingar): The Root-th root of Value, for Value in [0, 1]. Newton's method converges from above when it starts
+// at 1.
+constexpr double
+ConstexprRoot(double Value, u32 Root)
+{
+    double Result = 1.0;
+    for(u32 Step = 0; Step < 64; ++Step)
+    {
+        double Power = 1.0;
+        for(u32 i = 0; i < Root - 1; ++i)
+        {
+            Power *= Result;
+        }
+
+        double Next = Result - (((Power * Result) - Value) / (Root * Power));
+        if(Next >= Result)
+        {
+            break;
+        }
+        Result = Next;
+    }
+
+    return Result;
+}
+
+// NOTE(ingar): x^2.4 is the fifth root of x^12
+constexpr double
+SrgbToLinearExact(double Srgb)
+{
+    if(Srgb <= 0.04045)
+    {
+        return Srgb / 12.92;
+    }
+
+    double Base   = (Srgb + 0.055) / 1.055;
+    double Square = Base * Base;
+    double Twelve = Square * Square * Square;
+    return ConstexprRoot(Twelve * Twelve, 5);
+}
+
+constexpr srgb_tables
+MakeSrgbTables(void)
+{
+    srgb_tables Tables     = {};
+    double      Exact[256] = {};
+    for(u32 i = 0; i < 256; ++i)
+    {
+        Exact[i]           = SrgbToLinearExact((double)i / 255.0);
+        Tables.ToLinear[i] = (u16)((Exact[i] * SCN_LINEAR_MAX) + 0.5);
+    }
+
+    /* Both are increasing, so the nearest byte only moves forward */
+    u32 Nearest = 0;
+    for(u32 i = 0; i <= SCN_LINEAR_MAX; ++i)
+    {
+        double Linear = (double)i / SCN_LINEAR_MAX;
+        while(Nearest < 255 && (Exact[Nearest + 1] - Linear) < (Linear - Exact[Nearest]))
+        {
+            ++Nearest;
+        }
+        Tables.ToSrgb[i] = (u8)Nearest;
+    }
+
+    return Tables;
+}
+
+constexpr srgb_tables SrgbTables = MakeSrgbTables();
+
+// NOTE(ingar): Alpha is out of 256
+inline u8
+BlendSrgb(u8 Dest, u8 Src, u32 Alpha)
+{
+    u32 Linear = ((SrgbTables.ToLinear[Src] * Alpha) + (SrgbTables.ToLinear[Dest] * (256 - Alpha))) >> 8;
+    return SrgbTables.ToSrgb[Linear];
+}
+
+#endif // SCN_SRGB_H_
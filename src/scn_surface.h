@@ -0,0 +1,310 @@
+/*
+ * Copyright 2024 (c) by Ingar Solveigson Asheim. All Rights Reserved.
+ */
+
+#ifndef SCN_SURFACE_H_
+#define SCN_SURFACE_H_
+
+#include "isa.h"
+#include "scn.h"
+#include "scn_intrinsics.h"
+#include "scn_pixels.h"
+
+/* NOTE(ingar): Text surfaces
+ *
+ * Notes are drawn again far more often than their text changes, whenever the drag preview, the rubber band or another
+ * note passes over them, so the text of each note is drawn once into a surface of coverage, one byte per pixel of the
+ * window, and blended into the buffer with the color of the text from there. A surface is made again when the text,
+ * the font, the size of the area it is drawn in or where that falls within a block of SCN_SURFACE_ALIGN pixels
+ * changes. Moving a note by whole blocks keeps it.
+ *
+ * When the buffer is drawn at 1/2^k of the window, level k of a mip chain is blended instead, so that each pixel of
+ * the buffer reads one byte of coverage and no more. Each level is a 2x2 box filter of the one above, made the first
+ * time it is needed and kept until the surface is made again. Surfaces start on a block, and are a whole number of
+ * blocks each way, so every level lines up with the pixels of the buffer at its resolution.
+ *
+ * Room for the whole chain is taken when a surface is made, bump allocated like the text layouts, and when the memory
+ * runs out every surface is dropped.
+ */
+
+#define SCN_SURFACE_MEM_SIZE   IsaMegaByte(32)
+#define SCN_SURFACE_LEVELS     4                               // Level 0 and three halvings
+#define SCN_SURFACE_ALIGN      (1 << (SCN_SURFACE_LEVELS - 1)) // In pixels of the window
+#define SCN_SURFACE_MAX_PIXELS IsaMegaByte(4)                  // Of level 0, larger text is drawn directly
+#define SCN_SURFACE_RUN        16                              // Pixels without coverage that are skipped at once
+
+// NOTE(ingar): Everything that changes what is drawn into a surface. Positions are relative to the area.
+struct text_surface_key
+{
+    u64   Text;
+    u32   FontGeneration;
+    float Width, Height;   // Of the area
+    float BlockX, BlockY;  // Where the area starts within its block
+    float Left, Top;       // Of the text
+    float Scale;
+};
+
+struct text_surface
+{
+    bool             Valid;
+    text_surface_key Key;
+    u32              LevelCount; // That have been made
+    i64              w, h;       // Of level 0, in whole blocks
+    u8              *Levels[SCN_SURFACE_LEVELS];
+};
+
+// NOTE(ingar): One surface per note, indexed like the notes
+struct text_surface_cache
+{
+    u64           Count;
+    text_surface *Surfaces;
+
+    u8 *Mem;
+    u64 MemSize;
+    u64 MemUsed;
+};
+
+isa_internal void
+DropTextSurfaces(text_surface_cache *Cache)
+{
+    memset(Cache->Surfaces, 0, Cache->Count * sizeof(text_surface));
+    Cache->MemUsed = 0;
+}
+
+isa_internal text_surface_cache *
+CreateTextSurfaceCache(isa_arena *Arena, u64 Count)
+{
+    text_surface_cache *Cache = IsaPushStructZero(Arena, text_surface_cache);
+    Cache->Count              = Count;
+    Cache->Surfaces           = IsaPushArray(Arena, text_surface, Count);
+    Cache->MemSize            = SCN_SURFACE_MEM_SIZE;
+    Cache->Mem                = IsaPushArray(Arena, u8, Cache->MemSize);
+
+    DropTextSurfaces(Cache);
+    return Cache;
+}
+
+inline bool
+SameSurfaceKey(text_surface_key a, text_surface_key b)
+{
+    return a.Text == b.Text && a.FontGeneration == b.FontGeneration && a.Width == b.Width && a.Height == b.Height
+           && a.BlockX == b.BlockX && a.BlockY == b.BlockY && a.Left == b.Left && a.Top == b.Top && a.Scale == b.Scale;
+}
+
+// NOTE(ingar): The surface with the key, or null if it has to be made
+inline text_surface *
+FindTextSurface(text_surface_cache *Cache, u64 Index, text_surface_key Key)
+{
+    if(Index >= Cache->Count)
+    {
+        return nullptr;
+    }
+
+    text_surface *Surface = Cache->Surfaces + Index;
+    return (Surface->Valid && SameSurfaceKey(Surface->Key, Key)) ? Surface : nullptr;
+}
+
+// NOTE(ingar): Takes room for a surface of w by h pixels and its levels, with level 0 cleared for the text to be drawn
+// into. Returns null if it is too large.
+isa_internal text_surface *
+RenewTextSurface(text_surface_cache *Cache, u64 Index, text_surface_key Key, i64 w, i64 h)
+{
+    IsaAssert((w % SCN_SURFACE_ALIGN) == 0 && (h % SCN_SURFACE_ALIGN) == 0, "Surfaces are whole blocks");
+
+    u64 Size = 0;
+    for(u32 Level = 0; Level < SCN_SURFACE_LEVELS; ++Level)
+    {
+        Size += (u64)(w >> Level) * (u64)(h >> Level);
+    }
+    if(Index >= Cache->Count || (u64)(w * h) > SCN_SURFACE_MAX_PIXELS || Size > Cache->MemSize)
+    {
+        return nullptr;
+    }
+
+    if(Cache->MemUsed + Size > Cache->MemSize)
+    {
+        DropTextSurfaces(Cache);
+    }
+
+    text_surface *Surface = Cache->Surfaces + Index;
+    Surface->Valid        = true;
+    Surface->Key          = Key;
+    Surface->LevelCount   = 1;
+    Surface->w            = w;
+    Surface->h            = h;
+
+    u8 *Storage = Cache->Mem + Cache->MemUsed;
+    for(u32 Level = 0; Level < SCN_SURFACE_LEVELS; ++Level)
+    {
+        Surface->Levels[Level]  = Storage;
+        Storage                += (w >> Level) * (h >> Level);
+    }
+    Cache->MemUsed += Size;
+
+    memset(Surface->Levels[0], 0, (u64)(w * h));
+    return Surface;
+}
+
+// NOTE(ingar): A view of a level as an A8 buffer, to draw into or read from
+inline scn_offscreen_buffer
+SurfaceLevelBuffer(text_surface *Surface, u32 Level)
+{
+    scn_offscreen_buffer Buffer;
+    Buffer.w             = Surface->w >> Level;
+    Buffer.h             = Surface->h >> Level;
+    Buffer.BytesPerPixel = 1;
+    Buffer.Format        = ScnPixelFormat_A8;
+    Buffer.PixelSize     = (float)(1 << Level);
+    Buffer.Mem           = Surface->Levels[Level];
+    return Buffer;
+}
+
+// NOTE(ingar): Each byte of Dest is the rounded mean of a 2x2 block of Src, 16 bytes of Src at a time. Each 16 bit
+// lane holds two neighbouring bytes, which are added by taking the low and high byte apart.
+isa_internal void
+DownsampleBox2x2(u8 *Src, i64 SrcW, u8 *Dest, i64 DestW, i64 DestH)
+{
+    __m128i Low   = _mm_set1_epi16(0x00FF);
+    __m128i Round = _mm_set1_epi16(2);
+    for(i64 y = 0; y < DestH; ++y)
+    {
+        u8 *Row0 = Src + ((2 * y) * SrcW);
+        u8 *Row1 = Row0 + SrcW;
+        u8 *Out  = Dest + (y * DestW);
+
+        i64 x = 0;
+        for(; x + 8 <= DestW; x += 8)
+        {
+            __m128i a   = _mm_loadu_si128((__m128i *)(Row0 + (2 * x)));
+            __m128i b   = _mm_loadu_si128((__m128i *)(Row1 + (2 * x)));
+            __m128i Sum = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a, Low), _mm_srli_epi16(a, 8)),
+                                        _mm_add_epi16(_mm_and_si128(b, Low), _mm_srli_epi16(b, 8)));
+            Sum         = _mm_srli_epi16(_mm_add_epi16(Sum, Round), 2);
+            _mm_storel_epi64((__m128i *)(Out + x), _mm_packus_epi16(Sum, Sum));
+        }
+        for(; x < DestW; ++x)
+        {
+            u32 Sum = Row0[2 * x] + Row0[(2 * x) + 1] + Row1[2 * x] + Row1[(2 * x) + 1];
+            Out[x]  = (u8)((Sum + 2) >> 2);
+        }
+    }
+}
+
+// NOTE(ingar): Makes the levels up to and including Level that have not been made yet
+isa_internal void
+BuildSurfaceLevels(text_surface *Surface, u32 Level)
+{
+    IsaAssert(Level < SCN_SURFACE_LEVELS, "No such level");
+    for(; Surface->LevelCount <= Level; ++Surface->LevelCount)
+    {
+        u32 Above = Surface->LevelCount - 1;
+        DownsampleBox2x2(Surface->Levels[Above], Surface->w >> Above, Surface->Levels[Above + 1],
+                         Surface->w >> (Above + 1), Surface->h >> (Above + 1));
+    }
+}
+
+// NOTE(ingar): The level whose pixels are the pixels of the buffer, or -1 if there is none
+inline i32
+SurfaceLevelFor(scn_offscreen_buffer Buffer)
+{
+    for(i32 Level = 0; Level < SCN_SURFACE_LEVELS; ++Level)
+    {
+        if(Buffer.PixelSize == (float)(1 << Level))
+        {
+            return Level;
+        }
+    }
+
+    return -1;
+}
+
+// NOTE(ingar): Whether the next SCN_SURFACE_RUN bytes of coverage, or the Left that remain if fewer, are all zero
+inline bool
+CoverageRunEmpty(u8 *Mask, i64 Left)
+{
+    if(Left >= SCN_SURFACE_RUN)
+    {
+        __m128i Bytes = _mm_loadu_si128((__m128i *)Mask);
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(Bytes, _mm_setzero_si128())) == 0xFFFF;
+    }
+
+    for(i64 i = 0; i < Left; ++i)
+    {
+        if(Mask[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename format>
+isa_internal void
+BlendTextSurfaceIn(scn_offscreen_buffer Buffer, pixel_span Clip, scn_offscreen_buffer Level, i64 OriginX,
+                   i64 OriginY, u32_argb Color)
+{
+    typedef typename format::type pixel;
+
+    pixel_span Drawn = IntersectSpans(Clip, { OriginX, OriginY, OriginX + Level.w, OriginY + Level.h });
+    i64        Count = Drawn.EndX - Drawn.StartX;
+    for(i64 y = Drawn.StartY; y < Drawn.EndY; ++y)
+    {
+        u8    *Mask   = PixelAt(Level, Drawn.StartX - OriginX, y - OriginY);
+        pixel *Pixels = (pixel *)PixelAt(Buffer, Drawn.StartX, y);
+
+        /* Most of a surface is the space between lines and words, which is skipped 16 pixels at a time */
+        i64 x = 0;
+        while(x < Count)
+        {
+            for(; x < Count && CoverageRunEmpty(Mask + x, Count - x); x += SCN_SURFACE_RUN)
+            {
+            }
+
+            i64 End = x;
+            for(; End < Count && !CoverageRunEmpty(Mask + End, Count - End); End += SCN_SURFACE_RUN)
+            {
+            }
+
+            End = (End < Count) ? End : Count;
+            if(End > x)
+            {
+                BlendMaskSpan<format>(Pixels + x, Mask + x, 1, End - x, Color, 256);
+            }
+            x = End;
+        }
+    }
+}
+
+// NOTE(ingar): Clip is in window pixels. The surface starts at (BlockX, BlockY) in the window, which are on a block.
+isa_internal void
+BlendTextSurface(scn_offscreen_buffer Buffer, rect Clip, text_surface *Surface, u32 Level, i64 BlockX, i64 BlockY,
+                 u32_argb Color)
+{
+    BuildSurfaceLevels(Surface, Level);
+
+    rect                 Pixels   = BufferClip(Buffer, Clip);
+    pixel_span           ClipSpan = { (i64)Pixels.Min.x, (i64)Pixels.Min.y, (i64)Pixels.Max.x, (i64)Pixels.Max.y };
+    scn_offscreen_buffer Source   = SurfaceLevelBuffer(Surface, Level);
+    i64                  OriginX  = BlockX >> Level;
+    i64                  OriginY  = BlockY >> Level;
+    switch(Buffer.Format)
+    {
+        case ScnPixelFormat_Bgra8:
+            {
+                BlendTextSurfaceIn<pixel_bgra8>(Buffer, ClipSpan, Source, OriginX, OriginY, Color);
+            }
+            break;
+        case ScnPixelFormat_Rgb565:
+            {
+                BlendTextSurfaceIn<pixel_rgb565>(Buffer, ClipSpan, Source, OriginX, OriginY, Color);
+            }
+            break;
+        case ScnPixelFormat_A8:
+            {
+                BlendTextSurfaceIn<pixel_a8>(Buffer, ClipSpan, Source, OriginX, OriginY, Color);
+            }
+            break;
+    }
+}
+
+#endif // SCN_SURFACE_H_
@@ -0,0 +1,775 @@
+/*
+ * Copyright 2024 (c) by Ingar Solveigson Asheim. All Rights Reserved.
+ */
+
+#ifndef SCN_TEXT_H_
+#define SCN_TEXT_H_
+
+#include "isa.h"
+#include "scn_font.h"
+
+#include <cfloat>
+#include <immintrin.h>
+
+/* NOTE(ingar): Text layout
+ *
+ * UTF-8 text is broken into lines that fit a box width, wrapping at spaces and at '\n', and every glyph gets a pen
+ * position on its line. The layout is done at the reference height of the font with the box width given in reference
+ * pixels, so the same layout can be drawn at any scale. Advances and kerning come from the flattened tables in
+ * scn_font, so laying out text is a few array loads per character.
+ *
+ * Layouts are cached per note in session memory and only redone when the text, the box width or the font changes.
+ * After an edit only the lines from the one before the edit up to the first line that starts the same as before are
+ * laid out again, and the rest of the old layout is moved into place.
+ */
+
+#define SCN_TEXT_NO_WRAP           FLT_MAX
+#define SCN_TEXT_REPLACEMENT_CHAR  0xFFFD
+#define SCN_TEXT_LAYOUT_MEM_SIZE   IsaMegaByte(16)
+#define SCN_TEXT_LAYOUT_MIN_GLYPHS 64
+
+// NOTE(ingar): The text is read through a view of up to two pieces, so that gap buffers can be laid out without
+// closing the gap. The text must be valid UTF-8, and codepoints never span the two pieces.
+struct text_view
+{
+    const u8 *A;
+    u64       ALen;
+    const u8 *B;
+    u64       BLen;
+};
+
+struct text_glyph
+{
+    u32   Codepoint;
+    u32   Glyph;      // Index in the font
+    u32   ByteOffset; // Of the codepoint, from the start of the line, so that lines can be moved without touching it
+    float x;          // Pen position relative to the start of the line
+};
+
+struct text_line
+{
+    u32   FirstGlyph;
+    u32   GlyphCount;
+    u32   ByteStart, ByteEnd; // ByteEnd is one past the last byte of the line, excluding the '\n' that ended it
+    float Width;              // Trailing spaces are not counted
+};
+
+struct text_layout
+{
+    u32         LineCount, MaxLines;
+    u32         GlyphCount, MaxGlyphs;
+    text_line  *Lines;
+    text_glyph *Glyphs;
+
+    float Width; // Of the widest line
+    float LineAdvance;
+
+    // NOTE(ingar): What the layout was made from. The key identifies the text and is chosen by the caller
+    bool  Valid;
+    u64   Key;
+    u64   TextLen;
+    float MaxWidth;
+    u32   FontGeneration;
+};
+
+// NOTE(ingar): Lines that changed in a relayout, for redrawing. Lines from NewEnd on are the same as the ones from
+// OldEnd on before the edit, and are only moved if the two differ.
+struct text_relayout
+{
+    bool Full; // The whole layout was redone, the old lines can't be compared
+    u32  FirstLine;
+    u32  OldEnd, NewEnd;
+};
+
+// NOTE(ingar): One layout per note, indexed like the notes. Glyphs and lines are bump allocated from Mem, and when it
+// runs out every cached layout is dropped and the memory is reused.
+struct text_layout_cache
+{
+    u64          Count;
+    text_layout *Layouts;
+    text_layout  Scratch; // Lines that are laid out again after an edit go here first
+
+    u8 *Mem;
+    u64 MemSize;
+    u64 MemUsed;
+};
+
+/* UTF-8
+ *
+ * Text is validated once where it enters scn (text input is encoded here, boards are checked when read), so the
+ * layout path can decode without checking. Validation goes 16 bytes at a time: runs of ASCII only check that no
+ * sequence was left open, and other blocks are classified with three table lookups on the nibbles of each byte and
+ * the byte before it, the scheme from Keiser and Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte".
+ */
+
+#define UTF8_TOO_SHORT   (1 << 0) // Lead byte not followed by enough continuation bytes
+#define UTF8_TOO_LONG    (1 << 1) // Continuation byte after ASCII
+#define UTF8_OVERLONG_3  (1 << 2)
+#define UTF8_TOO_LARGE   (1 << 3) // Above U+10FFFF
+#define UTF8_SURROGATE   (1 << 4)
+#define UTF8_OVERLONG_2  (1 << 5)
+#define UTF8_TOO_LARGE_2 (1 << 6) // Above U+10FFFF, found from the second byte
+#define UTF8_OVERLONG_4  (1 << 6)
+#define UTF8_TWO_CONTS   (1 << 7) // Two continuation bytes in a row, only an error if no lead byte expects them
+#define UTF8_CARRY       (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+inline __m128i
+Utf8HighNibbles(__m128i Bytes)
+{
+    return _mm_and_si128(_mm_srli_epi16(Bytes, 4), _mm_set1_epi8(0x0F));
+}
+
+// NOTE(ingar): Error bits for the 16 bytes in Block, given the block before it
+inline __m128i
+Utf8BlockErrors(__m128i Block, __m128i PrevBlock)
+{
+    const __m128i Byte1High
+        = _mm_setr_epi8(UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+                        UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+                        UTF8_TOO_SHORT | UTF8_OVERLONG_2, UTF8_TOO_SHORT,
+                        UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+                        UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_2 | UTF8_OVERLONG_4);
+
+    const char    Above = UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_2;
+    const __m128i Byte1Low
+        = _mm_setr_epi8(UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4, UTF8_CARRY | UTF8_OVERLONG_2,
+                        UTF8_CARRY, UTF8_CARRY, UTF8_CARRY | UTF8_TOO_LARGE, Above, Above, Above, Above, Above, Above,
+                        Above, Above, Above | UTF8_SURROGATE, Above, Above);
+
+    const char    Cont80 = UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_2
+                        | UTF8_OVERLONG_4;
+    const char    Cont90 = UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE;
+    const char    ContA0 = UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE;
+    const __m128i Byte2High = _mm_setr_epi8(UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+                                            UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, Cont80,
+                                            Cont90, ContA0, ContA0, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+                                            UTF8_TOO_SHORT);
+
+    __m128i Prev1 = _mm_alignr_epi8(Block, PrevBlock, 15);
+    __m128i Special
+        = _mm_and_si128(_mm_and_si128(_mm_shuffle_epi8(Byte1High, Utf8HighNibbles(Prev1)),
+                                      _mm_shuffle_epi8(Byte1Low, _mm_and_si128(Prev1, _mm_set1_epi8(0x0F)))),
+                        _mm_shuffle_epi8(Byte2High, Utf8HighNibbles(Block)));
+
+    /* The third and fourth bytes of a sequence must be continuations, which the lookups above can't see */
+    __m128i Prev2  = _mm_alignr_epi8(Block, PrevBlock, 14);
+    __m128i Prev3  = _mm_alignr_epi8(Block, PrevBlock, 13);
+    __m128i Third  = _mm_subs_epu8(Prev2, _mm_set1_epi8((char)(0xE0 - 0x80)));
+    __m128i Fourth = _mm_subs_epu8(Prev3, _mm_set1_epi8((char)(0xF0 - 0x80)));
+    __m128i Must23 = _mm_and_si128(_mm_or_si128(Third, Fourth), _mm_set1_epi8((char)0x80));
+
+    return _mm_xor_si128(Must23, Special);
+}
+
+// NOTE(ingar): Non-zero where the last bytes of the block start a sequence that must continue in the next one
+inline __m128i
+Utf8Incomplete(__m128i Block)
+{
+    const __m128i Max = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, (char)(0xF0 - 1),
+                                      (char)(0xE0 - 1), (char)(0xC0 - 1));
+    return _mm_subs_epu8(Block, Max);
+}
+
+isa_internal bool
+ValidateUtf8(const u8 *Text, u64 Len)
+{
+    __m128i Errors     = _mm_setzero_si128();
+    __m128i PrevBlock  = _mm_setzero_si128();
+    __m128i Incomplete = _mm_setzero_si128();
+
+    u64 At = 0;
+    for(; (At + 16) <= Len; At += 16)
+    {
+        __m128i Block = _mm_loadu_si128((const __m128i *)(Text + At));
+        if(!_mm_movemask_epi8(Block))
+        {
+            Errors = _mm_or_si128(Errors, Incomplete);
+        }
+        else
+        {
+            Errors     = _mm_or_si128(Errors, Utf8BlockErrors(Block, PrevBlock));
+            Incomplete = Utf8Incomplete(Block);
+        }
+        PrevBlock = Block;
+    }
+
+    /* The tail is padded with zeros, which also catches a sequence that is cut off by the end of the text */
+    alignas(16) u8 Tail[16] = {};
+    memcpy(Tail, Text + At, Len - At);
+    __m128i Block = _mm_load_si128((const __m128i *)Tail);
+    Errors        = _mm_or_si128(Errors, Utf8BlockErrors(Block, PrevBlock));
+    Errors        = _mm_or_si128(Errors, Utf8Incomplete(Block));
+
+    return _mm_testz_si128(Errors, Errors);
+}
+
+// NOTE(ingar): Returns the number of bytes written to Out, which must have room for 4. Codepoints that can't be
+// encoded are written as the replacement character.
+inline u32
+EncodeUtf8(u32 Codepoint, u8 *Out)
+{
+    if(Codepoint > 0x10FFFF || (Codepoint >= 0xD800 && Codepoint <= 0xDFFF))
+    {
+        Codepoint = SCN_TEXT_REPLACEMENT_CHAR;
+    }
+
+    if(Codepoint < 0x80)
+    {
+        Out[0] = (u8)Codepoint;
+        return 1;
+    }
+    if(Codepoint < 0x800)
+    {
+        Out[0] = (u8)(0xC0 | (Codepoint >> 6));
+        Out[1] = (u8)(0x80 | (Codepoint & 0x3F));
+        return 2;
+    }
+    if(Codepoint < 0x10000)
+    {
+        Out[0] = (u8)(0xE0 | (Codepoint >> 12));
+        Out[1] = (u8)(0x80 | ((Codepoint >> 6) & 0x3F));
+        Out[2] = (u8)(0x80 | (Codepoint & 0x3F));
+        return 3;
+    }
+
+    Out[0] = (u8)(0xF0 | (Codepoint >> 18));
+    Out[1] = (u8)(0x80 | ((Codepoint >> 12) & 0x3F));
+    Out[2] = (u8)(0x80 | ((Codepoint >> 6) & 0x3F));
+    Out[3] = (u8)(0x80 | (Codepoint & 0x3F));
+    return 4;
+}
+
+// NOTE(ingar): Returns the number of bytes the codepoint takes up. The text must be valid UTF-8 (see ValidateUtf8),
+// so the lead byte gives the size and nothing is checked.
+inline u32
+DecodeUtf8(const u8 *At, u32 *Codepoint)
+{
+    u8 Lead = At[0];
+    if(Lead < 0x80)
+    {
+        *Codepoint = Lead;
+        return 1;
+    }
+    if(Lead < 0xE0)
+    {
+        *Codepoint = ((u32)(Lead & 0x1F) << 6) | (At[1] & 0x3F);
+        return 2;
+    }
+    if(Lead < 0xF0)
+    {
+        *Codepoint = ((u32)(Lead & 0x0F) << 12) | ((u32)(At[1] & 0x3F) << 6) | (At[2] & 0x3F);
+        return 3;
+    }
+
+    *Codepoint = ((u32)(Lead & 0x07) << 18) | ((u32)(At[1] & 0x3F) << 12) | ((u32)(At[2] & 0x3F) << 6) | (At[3] & 0x3F);
+    return 4;
+}
+
+inline text_view
+TextView(const u8 *Text, u64 Len)
+{
+    text_view View = { Text, Len, nullptr, 0 };
+    return View;
+}
+
+inline u64
+TextViewLen(text_view View)
+{
+    return View.ALen + View.BLen;
+}
+
+inline u8
+TextViewByte(text_view View, u64 At)
+{
+    return (At < View.ALen) ? View.A[At] : View.B[At - View.ALen];
+}
+
+// NOTE(ingar): Copies the bytes from Start up to End out of the view
+inline void
+CopyTextView(text_view View, u64 Start, u64 End, u8 *Out)
+{
+    if(Start < End && Start < View.ALen)
+    {
+        u64 Len = ((End < View.ALen) ? End : View.ALen) - Start;
+        memcpy(Out, View.A + Start, Len);
+        Out   += Len;
+        Start += Len;
+    }
+    if(Start < End)
+    {
+        memcpy(Out, View.B + (Start - View.ALen), End - Start);
+    }
+}
+
+inline u32
+DecodeTextView(text_view View, u64 At, u32 *Codepoint)
+{
+    if(At < View.ALen)
+    {
+        return DecodeUtf8(View.A + At, Codepoint);
+    }
+
+    return DecodeUtf8(View.B + (At - View.ALen), Codepoint);
+}
+
+inline u64
+HashText(const u8 *Text, u64 Len)
+{
+    u64 Hash = 0xcbf29ce484222325ULL;
+    for(u64 i = 0; i < Len; ++i)
+    {
+        Hash ^= Text[i];
+        Hash *= 0x100000001b3ULL;
+    }
+
+    return Hash;
+}
+
+isa_internal void
+FinishTextLine(text_layout *Layout, scn_font *Font, u32 EndGlyph, u32 ByteEnd)
+{
+    text_line *Line  = Layout->Lines + Layout->LineCount++;
+    Line->GlyphCount = EndGlyph - Line->FirstGlyph;
+    Line->ByteEnd    = ByteEnd;
+    Line->Width      = 0.0f;
+
+    for(u32 i = EndGlyph; i > Line->FirstGlyph; --i)
+    {
+        text_glyph *Glyph = Layout->Glyphs + (i - 1);
+        if(Glyph->Codepoint != ' ')
+        {
+            Line->Width = Glyph->x + GlyphAdvance(Font, Glyph->Glyph);
+            break;
+        }
+    }
+
+    Layout->Width = (Line->Width > Layout->Width) ? Line->Width : Layout->Width;
+}
+
+isa_internal void
+BeginTextLine(text_layout *Layout, u32 FirstGlyph, u32 ByteStart)
+{
+    text_line *Line  = Layout->Lines + Layout->LineCount;
+    Line->FirstGlyph = FirstGlyph;
+    Line->ByteStart  = ByteStart;
+}
+
+// NOTE(ingar): Used when laying out again after an edit. Layout stops at the first line past the edit that starts
+// where a line of the old layout started, since laying out from a line start only depends on the text after it.
+struct text_sync
+{
+    text_layout *Old;
+    u64          MinByte; // End of the inserted bytes
+    i64          Delta;   // Bytes inserted minus bytes removed
+    u32          OldLine; // Next line of the old layout to compare with
+    bool         Synced;
+};
+
+isa_internal bool
+TextLineSynced(text_sync *Sync, u64 ByteStart)
+{
+    if(!Sync || ByteStart < Sync->MinByte)
+    {
+        return false;
+    }
+
+    text_layout *Old = Sync->Old;
+    while(Sync->OldLine < Old->LineCount && ((i64)Old->Lines[Sync->OldLine].ByteStart + Sync->Delta) < (i64)ByteStart)
+    {
+        ++Sync->OldLine;
+    }
+
+    Sync->Synced = Sync->OldLine < Old->LineCount
+                   && ((i64)Old->Lines[Sync->OldLine].ByteStart + Sync->Delta) == (i64)ByteStart;
+    return Sync->Synced;
+}
+
+isa_internal void
+ResetTextLayout(text_layout *Layout, scn_font *Font)
+{
+    Layout->LineCount   = 0;
+    Layout->GlyphCount  = 0;
+    Layout->Width       = 0.0f;
+    Layout->LineAdvance = Font->Ascent - Font->Descent + Font->LineGap;
+}
+
+// NOTE(ingar): Appends the lines from StartByte, which must be the start of a line, to the end of the text or until
+// Sync, if given, finds a line that is unchanged. The layout must have room for a glyph per remaining byte and one
+// line more than that, which is the most the text can produce.
+isa_internal void
+LayoutTextFrom(text_layout *Layout, scn_font *Font, text_view View, float MaxWidth, u64 StartByte, text_sync *Sync)
+{
+    u64 Len = TextViewLen(View);
+    IsaAssert(Layout->MaxGlyphs >= Layout->GlyphCount + (Len - StartByte)
+                  && Layout->MaxLines >= Layout->LineCount + (Len - StartByte) + 1,
+              "Layout storage too small");
+
+    BeginTextLine(Layout, Layout->GlyphCount, (u32)StartByte);
+
+    float PenX       = 0.0f;
+    u32   Prev       = 0; // Codepoint and glyph of the previous character on the line, for kerning
+    u32   PrevGlyph  = 0;
+    i64   BreakGlyph = -1; // First glyph after the last space on the current line
+
+    u64 At = StartByte;
+    while(At < Len)
+    {
+        u32 Codepoint;
+        u32 Size = DecodeTextView(View, At, &Codepoint);
+
+        if(Codepoint == '\n')
+        {
+            FinishTextLine(Layout, Font, Layout->GlyphCount, (u32)At);
+            BeginTextLine(Layout, Layout->GlyphCount, (u32)(At + Size));
+            if(TextLineSynced(Sync, At + Size))
+            {
+                return;
+            }
+
+            PenX       = 0.0f;
+            Prev       = 0;
+            BreakGlyph = -1;
+            At += Size;
+            continue;
+        }
+
+        text_line *Line       = Layout->Lines + Layout->LineCount;
+        u32        GlyphIndex = FindGlyph(Font, Codepoint);
+        float      Advance    = GlyphAdvance(Font, GlyphIndex);
+        float      GlyphX     = Prev ? PenX + KernAdvance(Font, Prev, PrevGlyph, Codepoint, GlyphIndex) : PenX;
+
+        /* Spaces are allowed to hang past the edge, everything else wraps */
+        if(Codepoint != ' ' && (GlyphX + Advance) > MaxWidth)
+        {
+            if(BreakGlyph > (i64)Line->FirstGlyph)
+            {
+                /* Move the word after the last space down to a new line. The word may not have started yet */
+                bool  WordStarted = BreakGlyph < (i64)Layout->GlyphCount;
+                u32   BreakOffset = WordStarted ? Layout->Glyphs[BreakGlyph].ByteOffset : (u32)(At - Line->ByteStart);
+                u32   BreakByte   = Line->ByteStart + BreakOffset;
+                float Shift       = WordStarted ? Layout->Glyphs[BreakGlyph].x : GlyphX;
+
+                FinishTextLine(Layout, Font, (u32)BreakGlyph, BreakByte);
+                BeginTextLine(Layout, (u32)BreakGlyph, BreakByte);
+                if(TextLineSynced(Sync, BreakByte))
+                {
+                    Layout->GlyphCount = (u32)BreakGlyph;
+                    return;
+                }
+
+                for(u32 i = (u32)BreakGlyph; i < Layout->GlyphCount; ++i)
+                {
+                    Layout->Glyphs[i].x -= Shift;
+                    Layout->Glyphs[i].ByteOffset -= BreakOffset;
+                }
+
+                GlyphX -= Shift;
+                Line       = Layout->Lines + Layout->LineCount;
+                BreakGlyph = -1;
+            }
+
+            if((GlyphX + Advance) > MaxWidth && Layout->GlyphCount > Line->FirstGlyph)
+            {
+                /* A word that is wider than the box is broken wherever it overflows */
+                FinishTextLine(Layout, Font, Layout->GlyphCount, (u32)At);
+                BeginTextLine(Layout, Layout->GlyphCount, (u32)At);
+                if(TextLineSynced(Sync, At))
+                {
+                    return;
+                }
+
+                Line   = Layout->Lines + Layout->LineCount;
+                GlyphX = 0.0f;
+            }
+        }
+
+        text_glyph *Glyph = Layout->Glyphs + Layout->GlyphCount++;
+        Glyph->Codepoint  = Codepoint;
+        Glyph->Glyph      = GlyphIndex;
+        Glyph->ByteOffset = (u32)(At - Line->ByteStart);
+        Glyph->x          = GlyphX;
+
+        PenX      = GlyphX + Advance;
+        Prev      = Codepoint;
+        PrevGlyph = GlyphIndex;
+        if(Codepoint == ' ')
+        {
+            BreakGlyph = Layout->GlyphCount;
+        }
+
+        At += Size;
+    }
+
+    FinishTextLine(Layout, Font, Layout->GlyphCount, (u32)Len);
+}
+
+isa_internal void
+LayoutText(text_layout *Layout, scn_font *Font, text_view View, float MaxWidth)
+{
+    ResetTextLayout(Layout, Font);
+    LayoutTextFrom(Layout, Font, View, MaxWidth, 0, nullptr);
+}
+
+// NOTE(ingar): Index of the line that Byte is on. A byte offset where a wrapped line ends is on the next line.
+isa_internal u32
+FindTextLine(text_layout *Layout, u64 Byte)
+{
+    u32 Low  = 0;
+    u32 High = Layout->LineCount;
+    while((High - Low) > 1)
+    {
+        u32 Mid = Low + ((High - Low) / 2);
+        if(Layout->Lines[Mid].ByteStart <= Byte)
+        {
+            Low = Mid;
+        }
+        else
+        {
+            High = Mid;
+        }
+    }
+
+    return Low;
+}
+
+// NOTE(ingar): True for lines that continue a word that was too wide to fit on a line of its own
+inline bool
+TextLineStartsMidWord(text_layout *Layout, u32 LineIndex)
+{
+    if(!LineIndex)
+    {
+        return false;
+    }
+
+    text_line *Prev = Layout->Lines + (LineIndex - 1);
+    if(Prev->ByteEnd != Layout->Lines[LineIndex].ByteStart || !Prev->GlyphCount)
+    {
+        return false;
+    }
+
+    return Layout->Glyphs[Prev->FirstGlyph + Prev->GlyphCount - 1].Codepoint != ' ';
+}
+
+// NOTE(ingar): Pen position of the caret at Byte, on the line it is on
+isa_internal float
+TextCaretX(text_layout *Layout, scn_font *Font, u32 LineIndex, u64 Byte)
+{
+    text_line *Line = Layout->Lines + LineIndex;
+    for(u32 i = 0; i < Line->GlyphCount; ++i)
+    {
+        text_glyph *Glyph = Layout->Glyphs + Line->FirstGlyph + i;
+        if((Line->ByteStart + Glyph->ByteOffset) >= Byte)
+        {
+            return Glyph->x;
+        }
+    }
+
+    if(Line->GlyphCount)
+    {
+        text_glyph *Last = Layout->Glyphs + Line->FirstGlyph + Line->GlyphCount - 1;
+        return Last->x + GlyphAdvance(Font, Last->Glyph);
+    }
+
+    return 0.0f;
+}
+
+// NOTE(ingar): Byte offset of the caret position on the line that is closest to x
+isa_internal u64
+TextHitTestLine(text_layout *Layout, scn_font *Font, u32 LineIndex, float x)
+{
+    text_line *Line = Layout->Lines + LineIndex;
+    for(u32 i = 0; i < Line->GlyphCount; ++i)
+    {
+        text_glyph *Glyph = Layout->Glyphs + Line->FirstGlyph + i;
+        if(x < Glyph->x + (0.5f * GlyphAdvance(Font, Glyph->Glyph)))
+        {
+            return Line->ByteStart + Glyph->ByteOffset;
+        }
+    }
+
+    /* The end of a wrapped line is the start of the next one, so stop before its last character instead */
+    bool Wrapped = (LineIndex + 1) < Layout->LineCount && Layout->Lines[LineIndex + 1].ByteStart == Line->ByteEnd;
+    if(Wrapped && Line->GlyphCount)
+    {
+        return Line->ByteStart + Layout->Glyphs[Line->FirstGlyph + Line->GlyphCount - 1].ByteOffset;
+    }
+
+    return Line->ByteEnd;
+}
+
+isa_internal void
+DropCachedLayouts(text_layout_cache *Cache)
+{
+    memset(Cache->Layouts, 0, Cache->Count * sizeof(text_layout));
+    memset(&Cache->Scratch, 0, sizeof(text_layout));
+    Cache->MemUsed = 0;
+}
+
+isa_internal bool
+ReserveLayoutStorage(text_layout_cache *Cache, text_layout *Layout, u64 Len)
+{
+    if(Layout->MaxGlyphs >= Len && Layout->MaxLines >= Len + 1)
+    {
+        return true;
+    }
+
+    u64 MaxGlyphs = (Len > SCN_TEXT_LAYOUT_MIN_GLYPHS) ? Len : SCN_TEXT_LAYOUT_MIN_GLYPHS;
+    MaxGlyphs     = (MaxGlyphs > (2 * (u64)Layout->MaxGlyphs)) ? MaxGlyphs : (2 * (u64)Layout->MaxGlyphs);
+    u64 Size      = (MaxGlyphs * sizeof(text_glyph)) + ((MaxGlyphs + 1) * sizeof(text_line));
+    if(Size > Cache->MemSize)
+    {
+        IsaLogError("Text of %llu bytes is too long to lay out", Len);
+        return false;
+    }
+
+    if(Cache->MemUsed + Size > Cache->MemSize)
+    {
+        DropCachedLayouts(Cache);
+    }
+
+    u8 *Storage = Cache->Mem + Cache->MemUsed;
+    Cache->MemUsed += Size;
+
+    Layout->Glyphs    = (text_glyph *)Storage;
+    Layout->Lines     = (text_line *)(Storage + (MaxGlyphs * sizeof(text_glyph)));
+    Layout->MaxGlyphs = (u32)MaxGlyphs;
+    Layout->MaxLines  = (u32)(MaxGlyphs + 1);
+
+    return true;
+}
+
+// NOTE(ingar): Returns null if the text can't be laid out. The result is valid until the next call.
+isa_internal text_layout *
+GetCachedLayout(text_layout_cache *Cache, scn_font *Font, u64 Index, text_view View, u64 Key, float MaxWidth)
+{
+    if(Index >= Cache->Count)
+    {
+        return nullptr;
+    }
+
+    text_layout *Layout = Cache->Layouts + Index;
+    u64          Len    = TextViewLen(View);
+    if(Layout->Valid && Layout->Key == Key && Layout->TextLen == Len && Layout->MaxWidth == MaxWidth
+       && Layout->FontGeneration == Font->Generation)
+    {
+        return Layout;
+    }
+
+    if(!ReserveLayoutStorage(Cache, Layout, Len))
+    {
+        return nullptr;
+    }
+
+    LayoutText(Layout, Font, View, MaxWidth);
+
+    Layout->Valid          = true;
+    Layout->Key            = Key;
+    Layout->TextLen        = Len;
+    Layout->MaxWidth       = MaxWidth;
+    Layout->FontGeneration = Font->Generation;
+
+    return Layout;
+}
+
+// NOTE(ingar): Brings the cached layout of the text with OldKey up to date after Removed bytes at EditStart were
+// replaced by Inserted bytes. Falls back to laying out everything if the cached layout is not of the old text.
+isa_internal text_relayout
+RelayoutAfterEdit(text_layout_cache *Cache, scn_font *Font, u64 Index, text_view View, u64 OldKey, u64 NewKey,
+                  float MaxWidth, u64 EditStart, u64 Removed, u64 Inserted)
+{
+    text_relayout Result = { true, 0, 0, 0 };
+
+    u64 Len = TextViewLen(View);
+    if(Index >= Cache->Count || !ReserveLayoutStorage(Cache, &Cache->Scratch, Len))
+    {
+        return Result;
+    }
+
+    text_layout *Layout = Cache->Layouts + Index;
+    if(!Layout->Valid || Layout->Key != OldKey || Layout->TextLen != (Len + Removed - Inserted)
+       || Layout->MaxWidth != MaxWidth || Layout->FontGeneration != Font->Generation || Layout->MaxGlyphs < Len
+       || Layout->MaxLines < Len + 1)
+    {
+        GetCachedLayout(Cache, Font, Index, View, NewKey, MaxWidth);
+        return Result;
+    }
+
+    /* Edits to the first word of a line can move it up onto the line before, and a word that was broken over
+     * several lines is only one word */
+    u32 FirstLine = FindTextLine(Layout, EditStart);
+    while(TextLineStartsMidWord(Layout, FirstLine))
+    {
+        --FirstLine;
+    }
+    FirstLine = FirstLine ? FirstLine - 1 : 0;
+
+    text_sync Sync = {};
+    Sync.Old       = Layout;
+    Sync.MinByte   = EditStart + Inserted;
+    Sync.Delta     = (i64)Inserted - (i64)Removed;
+    Sync.OldLine   = FirstLine + 1;
+
+    text_layout *Scratch = &Cache->Scratch;
+    ResetTextLayout(Scratch, Font);
+    LayoutTextFrom(Scratch, Font, View, MaxWidth, Layout->Lines[FirstLine].ByteStart, &Sync);
+
+    /* Replace the old lines up to the one that was synced with, and move the rest into place */
+    u32 OldEnd      = Sync.Synced ? Sync.OldLine : Layout->LineCount;
+    u32 GlyphStart  = Layout->Lines[FirstLine].FirstGlyph;
+    u32 OldGlyphEnd = (OldEnd < Layout->LineCount) ? Layout->Lines[OldEnd].FirstGlyph : Layout->GlyphCount;
+    u32 TailGlyphs  = Layout->GlyphCount - OldGlyphEnd;
+    u32 TailLines   = Layout->LineCount - OldEnd;
+    i64 GlyphDelta  = (i64)Scratch->GlyphCount - (i64)(OldGlyphEnd - GlyphStart);
+    u32 NewEnd      = FirstLine + Scratch->LineCount;
+
+    memmove(Layout->Glyphs + GlyphStart + Scratch->GlyphCount, Layout->Glyphs + OldGlyphEnd,
+            TailGlyphs * sizeof(text_glyph));
+    memcpy(Layout->Glyphs + GlyphStart, Scratch->Glyphs, Scratch->GlyphCount * sizeof(text_glyph));
+
+    memmove(Layout->Lines + NewEnd, Layout->Lines + OldEnd, TailLines * sizeof(text_line));
+    for(u32 i = 0; i < Scratch->LineCount; ++i)
+    {
+        text_line *Line = Layout->Lines + FirstLine + i;
+        *Line           = Scratch->Lines[i];
+        Line->FirstGlyph += GlyphStart;
+    }
+    for(u32 i = NewEnd; i < NewEnd + TailLines; ++i)
+    {
+        text_line *Line = Layout->Lines + i;
+        Line->FirstGlyph += (u32)GlyphDelta;
+        Line->ByteStart += (u32)Sync.Delta;
+        Line->ByteEnd += (u32)Sync.Delta;
+    }
+
+    Layout->GlyphCount = GlyphStart + Scratch->GlyphCount + TailGlyphs;
+    Layout->LineCount  = NewEnd + TailLines;
+    Layout->Width      = 0.0f;
+    for(u32 i = 0; i < Layout->LineCount; ++i)
+    {
+        Layout->Width = (Layout->Lines[i].Width > Layout->Width) ? Layout->Lines[i].Width : Layout->Width;
+    }
+
+    Layout->Key     = NewKey;
+    Layout->TextLen = Len;
+
+    Result.Full      = false;
+    Result.FirstLine = FirstLine;
+    Result.OldEnd    = OldEnd;
+    Result.NewEnd    = NewEnd;
+    return Result;
+}
+
+isa_internal text_layout_cache *
+CreateLayoutCache(isa_arena *Arena, u64 Count)
+{
+    text_layout_cache *Cache = IsaPushStructZero(Arena, text_layout_cache);
+    Cache->Count             = Count;
+    Cache->Layouts           = IsaPushArray(Arena, text_layout, Count);
+    Cache->MemSize           = SCN_TEXT_LAYOUT_MEM_SIZE;
+    Cache->Mem               = IsaPushArray(Arena, u8, Cache->MemSize);
+
+    DropCachedLayouts(Cache);
+    return Cache;
+}
+
+#endif // SCN_TEXT_H_
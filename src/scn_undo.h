@@ -0,0 +1,545 @@
+/*
+ * Copyright 2024 (c) by Ingar Solveigson Asheim. All Rights Reserved.
+ */
+
+#ifndef SCN_UNDO_H_
+#define SCN_UNDO_H_
+
+#include "isa.h"
+#include "scn.h"
+#include "scn_note_text.h"
+
+/* NOTE(ingar): Undo log
+ *
+ * Every change to the board pushes a record of what it takes to undo and redo it: the note that was created or
+ * deleted, the bytes that were typed or deleted, the rect a note was moved from and to. Applying a record costs as much
+ * as the change it describes, never a pass over the board.
+ *
+ * Records are packed into a ring in permanent memory, so the history survives reloads together with the board. When
+ * the ring is full the oldest records are dropped. Typing into or moving the same note in quick succession grows the
+ * newest record instead of pushing another, so one undo takes back a burst of typing or a whole drag.
+ *
+ * Clearing the board does not copy the notes. The note array is swapped for an empty one and the record keeps the old
+ * one until it is dropped. Memory that records keep alive outside the ring, note arrays and the text of notes that are
+ * not on the board, is counted in Retained, and the oldest records are dropped to keep it below MaxRetained.
+ *
+ * Changes to a selection of notes are one record with a copy of the selection bits, whatever the size of the
+ * selection.
+ */
+
+isa_internal undo_log *
+CreateUndoLog(isa_arena *Arena)
+{
+    undo_log *Log    = IsaPushStructZero(Arena, undo_log);
+    Log->Ring        = IsaPushArray(Arena, u8, SCN_UNDO_RING_SIZE);
+    Log->Last        = SCN_UNDO_NO_RECORD;
+    Log->MaxRetained = SCN_UNDO_MAX_RETAINED;
+
+    return Log;
+}
+
+inline undo_record *
+UndoRecordAt(undo_log *Log, u64 Pos)
+{
+    return (undo_record *)(Log->Ring + (Pos & (SCN_UNDO_RING_SIZE - 1)));
+}
+
+inline u8 *
+UndoRecordBytes(undo_record *Record)
+{
+    return (u8 *)(Record + 1);
+}
+
+inline u64 *
+UndoRecordSelection(undo_record *Record)
+{
+    return (u64 *)(Record + 1);
+}
+
+inline u64
+UndoRecordSize(u64 Bytes)
+{
+    return (sizeof(undo_record) + Bytes + 7) & ~(u64)7;
+}
+
+// NOTE(ingar): The newest record that is done, or null if it has been dropped or there is none
+inline undo_record *
+LastUndoRecord(undo_log *Log)
+{
+    bool Valid = (Log->Last != SCN_UNDO_NO_RECORD) && (Log->Last >= Log->Begin);
+    return Valid ? UndoRecordAt(Log, Log->Last) : nullptr;
+}
+
+/* Note arrays */
+
+// NOTE(ingar): An empty array to swap in for the notes when the board is cleared
+isa_internal note *
+TakeNoteArray(scn_state *State)
+{
+    undo_log *Log   = State->Undo;
+    note     *Array = Log->SpareNotes;
+    if(Array)
+    {
+        Log->SpareNotes = *(note **)Array;
+    }
+    else
+    {
+        Array = IsaPushArray(&State->PermArena, note, State->Notes->MaxCount);
+    }
+
+    return Array;
+}
+
+inline void
+ReturnNoteArray(undo_log *Log, note *Array)
+{
+    *(note **)Array = Log->SpareNotes;
+    Log->SpareNotes = Array;
+}
+
+/* Dropping records */
+
+// NOTE(ingar): Bytes outside the ring that the record keeps alive. Done is whether the change is on the board.
+isa_internal u64
+UndoRecordRetained(scn_state *State, undo_record *Record, bool Done)
+{
+    u64 Result = 0;
+    if(Record->Type == UndoRecord_DeleteNote && Done)
+    {
+        Result = Record->Note.Text.Capacity;
+    }
+    else if(Record->Type == UndoRecord_ClearNotes || Record->Type == UndoRecord_DeleteNotes)
+    {
+        Result = (State->Notes->MaxCount * sizeof(note)) + (Done ? Record->Batch.TextBytes : 0);
+    }
+
+    return Result;
+}
+
+isa_internal void
+ReleaseUndoRecord(scn_state *State, undo_record *Record, bool Done)
+{
+    undo_log *Log = State->Undo;
+    Log->Retained -= UndoRecordRetained(State, Record, Done);
+
+    if(Record->Type == UndoRecord_DeleteNote && Done)
+    {
+        FreeNoteText(&State->TextAllocator, &Record->Note.Text);
+    }
+    else if(Record->Type == UndoRecord_ClearNotes || Record->Type == UndoRecord_DeleteNotes)
+    {
+        for(u64 i = 0; i < Record->Batch.OtherCount; ++i)
+        {
+            FreeNoteText(&State->TextAllocator, &Record->Batch.Other[i].Text);
+        }
+        ReturnNoteArray(Log, Record->Batch.Other);
+    }
+}
+
+isa_internal void
+DropOldestUndoRecord(scn_state *State)
+{
+    undo_log    *Log    = State->Undo;
+    undo_record *Record = UndoRecordAt(Log, Log->Begin);
+    ReleaseUndoRecord(State, Record, Log->Begin < Log->Head);
+    Log->Begin += Record->Size;
+}
+
+// NOTE(ingar): A new change makes the records that were undone impossible to redo
+isa_internal void
+DropUndoneRecords(scn_state *State)
+{
+    undo_log *Log = State->Undo;
+    for(u64 Pos = Log->Head; Pos < Log->End;)
+    {
+        undo_record *Record = UndoRecordAt(Log, Pos);
+        ReleaseUndoRecord(State, Record, false);
+        Pos += Record->Size;
+    }
+
+    Log->End = Log->Head;
+}
+
+isa_internal void
+ResetUndoLog(scn_state *State)
+{
+    undo_log *Log = State->Undo;
+    DropUndoneRecords(State);
+    while(Log->Begin < Log->End)
+    {
+        DropOldestUndoRecord(State);
+    }
+
+    Log->Last = SCN_UNDO_NO_RECORD;
+    Log->Open = false;
+}
+
+// NOTE(ingar): Drops the oldest records that are done until the memory they keep alive is below the cap. This can drop
+// the newest record too, if it alone is over the cap.
+isa_internal void
+TrimUndoLog(scn_state *State)
+{
+    undo_log *Log = State->Undo;
+    while(Log->Retained > Log->MaxRetained && Log->Begin < Log->Head)
+    {
+        DropOldestUndoRecord(State);
+    }
+}
+
+/* Pushing records */
+
+isa_internal void
+MakeUndoRoom(scn_state *State, u64 Size)
+{
+    undo_log *Log = State->Undo;
+    while((Log->End + Size - Log->Begin) > SCN_UNDO_RING_SIZE)
+    {
+        DropOldestUndoRecord(State);
+    }
+}
+
+// NOTE(ingar): Returns a record with room for Bytes after the header and everything but the type and the links zeroed.
+// Returns null if the record is larger than the ring, in which case the whole history is dropped, since the records
+// before the change could no longer be applied to the board.
+isa_internal undo_record *
+PushUndoRecord(scn_state *State, undo_record_type Type, u64 Bytes)
+{
+    undo_log *Log = State->Undo;
+    DropUndoneRecords(State);
+
+    u64 Size = UndoRecordSize(Bytes);
+    if(Size > SCN_UNDO_RING_SIZE)
+    {
+        IsaLogError("Change of %llu bytes is too large to undo", Bytes);
+        ResetUndoLog(State);
+        return nullptr;
+    }
+
+    /* Records are never split across the end of the ring, the rest of it is padding instead */
+    u64 Offset = Log->End & (SCN_UNDO_RING_SIZE - 1);
+    if((Offset + Size) > SCN_UNDO_RING_SIZE)
+    {
+        u64 PadSize = SCN_UNDO_RING_SIZE - Offset;
+        MakeUndoRoom(State, PadSize);
+
+        undo_record *Pad = UndoRecordAt(Log, Log->End);
+        Pad->Type        = UndoRecord_Pad;
+        Pad->Size        = (u32)PadSize;
+        Log->End += PadSize;
+        Log->Head = Log->End;
+    }
+    MakeUndoRoom(State, Size);
+
+    undo_record *Record = UndoRecordAt(Log, Log->End);
+    memset(Record, 0, sizeof(undo_record));
+    Record->Type    = Type;
+    Record->Size    = (u32)Size;
+    Record->Prev    = Log->Last;
+    Record->StartUs = Log->NowUs;
+    Record->EndUs   = Log->NowUs;
+
+    Log->Last = Log->End;
+    Log->End += Size;
+    Log->Head = Log->End;
+    Log->Open = true;
+
+    return Record;
+}
+
+// NOTE(ingar): Returns the newest record if a change of the same type to the same note can be merged into it, or null
+// if the change needs a record of its own
+isa_internal undo_record *
+CoalescableUndoRecord(undo_log *Log, undo_record_type Type, u64 NoteIndex)
+{
+    undo_record *Record = LastUndoRecord(Log);
+    if(!Log->Open || Log->Head != Log->End || !Record || Record->Type != Type || Record->NoteIndex != NoteIndex)
+    {
+        return nullptr;
+    }
+
+    /* The clock may have started over since the record was made, in which case the differences wrap and are large */
+    if((Log->NowUs - Record->EndUs) >= SCN_UNDO_COALESCE_US || (Log->NowUs - Record->StartUs) >= SCN_UNDO_GROUP_US)
+    {
+        return nullptr;
+    }
+
+    return Record;
+}
+
+inline bool
+CanGrowUndoRecord(undo_log *Log, u64 NewSize)
+{
+    return ((Log->Last & (SCN_UNDO_RING_SIZE - 1)) + NewSize) <= SCN_UNDO_RING_SIZE
+           && (Log->Last + NewSize - Log->Begin) <= SCN_UNDO_RING_SIZE;
+}
+
+inline void
+GrowUndoRecord(undo_log *Log, undo_record *Record, u64 NewSize)
+{
+    Record->Size  = (u32)NewSize;
+    Record->EndUs = Log->NowUs;
+    Log->End      = Log->Last + NewSize;
+    Log->Head     = Log->End;
+}
+
+/* Recording changes */
+
+isa_internal void
+RecordCreateNote(scn_state *State, u64 NoteIndex)
+{
+    undo_record *Record = PushUndoRecord(State, UndoRecord_CreateNote, 0);
+    if(Record)
+    {
+        Record->NoteIndex = NoteIndex;
+        Record->Note      = State->Notes->N[NoteIndex];
+        Record->Note.Text = {};
+    }
+}
+
+// NOTE(ingar): Note is the deleted note as it was on the board. The record takes over its text.
+isa_internal void
+RecordDeleteNote(scn_state *State, u64 NoteIndex, note *Note)
+{
+    undo_record *Record = PushUndoRecord(State, UndoRecord_DeleteNote, 0);
+    if(!Record)
+    {
+        FreeNoteText(&State->TextAllocator, &Note->Text);
+        return;
+    }
+
+    Record->NoteIndex = NoteIndex;
+    Record->Note      = *Note;
+
+    State->Undo->Retained += UndoRecordRetained(State, Record, true);
+    TrimUndoLog(State);
+}
+
+// NOTE(ingar): Hands the array of notes that were taken off the board to the record, which may be null if it could not
+// be pushed
+isa_internal void
+KeepNoteBatch(scn_state *State, undo_record *Record, note *Other, u64 OtherCount)
+{
+    if(!Record)
+    {
+        for(u64 i = 0; i < OtherCount; ++i)
+        {
+            FreeNoteText(&State->TextAllocator, &Other[i].Text);
+        }
+        ReturnNoteArray(State->Undo, Other);
+        return;
+    }
+
+    Record->Batch.Other      = Other;
+    Record->Batch.OtherCount = OtherCount;
+    for(u64 i = 0; i < OtherCount; ++i)
+    {
+        Record->Batch.TextBytes += Other[i].Text.Capacity;
+    }
+
+    State->Undo->Retained += UndoRecordRetained(State, Record, true);
+    TrimUndoLog(State);
+}
+
+// NOTE(ingar): Other is the note array that was swapped out for an empty one. The record takes over it and the text of
+// its notes.
+isa_internal void
+RecordClearNotes(scn_state *State, note *Other, u64 OtherCount)
+{
+    KeepNoteBatch(State, PushUndoRecord(State, UndoRecord_ClearNotes, 0), Other, OtherCount);
+}
+
+// NOTE(ingar): Pushes a record with a copy of the selection bits and room for Bytes more after them
+isa_internal undo_record *
+PushSelectionRecord(scn_state *State, undo_record_type Type, u64 Bytes)
+{
+    note_collection *Notes    = State->Notes;
+    u64              BitsSize = SelectionWords(Notes) * sizeof(u64);
+
+    undo_record *Record = PushUndoRecord(State, Type, BitsSize + Bytes);
+    if(Record)
+    {
+        memcpy(UndoRecordSelection(Record), Notes->Selection, BitsSize);
+    }
+
+    return Record;
+}
+
+// NOTE(ingar): The selected notes were moved into Other, in order. Called before the selection is cleared.
+isa_internal void
+RecordDeleteNotes(scn_state *State, note *Other, u64 OtherCount)
+{
+    KeepNoteBatch(State, PushSelectionRecord(State, UndoRecord_DeleteNotes, 0), Other, OtherCount);
+}
+
+// NOTE(ingar): Called before the colors change, so that the old ones can be kept
+isa_internal void
+RecordRecolorNotes(scn_state *State, u32_argb Color)
+{
+    note_collection *Notes  = State->Notes;
+    undo_record     *Record = PushSelectionRecord(State, UndoRecord_RecolorNotes, Notes->SelectionCount * sizeof(u32));
+    if(!Record)
+    {
+        return;
+    }
+
+    Record->Recolor.Color = Color;
+
+    u32_argb *OldColors = (u32_argb *)(UndoRecordSelection(Record) + SelectionWords(Notes));
+    u64       Words     = SelectionWords(Notes);
+    for(u64 Word = 0; Word < Words; ++Word)
+    {
+        for(u64 Bits = Notes->Selection[Word]; Bits; Bits &= Bits - 1)
+        {
+            *OldColors++ = Notes->N[(Word * 64) + CountTrailingZerosu64(Bits)].Color;
+        }
+    }
+}
+
+// NOTE(ingar): Called before the selection is stacked above Base, so that the old z can be kept
+isa_internal void
+RecordRestackNotes(scn_state *State, u64 Base)
+{
+    note_collection *Notes  = State->Notes;
+    undo_record     *Record = PushSelectionRecord(State, UndoRecord_RestackNotes, Notes->SelectionCount * sizeof(u64));
+    if(!Record)
+    {
+        return;
+    }
+
+    Record->Restack.Base = Base;
+
+    u64 *OldZ  = UndoRecordSelection(Record) + SelectionWords(Notes);
+    u64  Words = SelectionWords(Notes);
+    for(u64 Word = 0; Word < Words; ++Word)
+    {
+        for(u64 Bits = Notes->Selection[Word]; Bits; Bits &= Bits - 1)
+        {
+            *OldZ++ = Notes->N[(Word * 64) + CountTrailingZerosu64(Bits)].z;
+        }
+    }
+}
+
+// NOTE(ingar): Moving the same selection again soon after adds to the distance in the newest record
+isa_internal void
+RecordMoveNotes(scn_state *State, v2 Delta)
+{
+    undo_log        *Log    = State->Undo;
+    note_collection *Notes  = State->Notes;
+    undo_record     *Record = CoalescableUndoRecord(Log, UndoRecord_MoveNotes, 0);
+    if(Record && memcmp(UndoRecordSelection(Record), Notes->Selection, SelectionWords(Notes) * sizeof(u64)) == 0)
+    {
+        Record->Nudge.Delta += Delta;
+        GrowUndoRecord(Log, Record, Record->Size);
+        return;
+    }
+
+    Record = PushSelectionRecord(State, UndoRecord_MoveNotes, 0);
+    if(Record)
+    {
+        Record->Nudge.Delta = Delta;
+    }
+}
+
+// NOTE(ingar): Len bytes were inserted at Pos in the text of the note. Typing after what the newest record inserted
+// extends it.
+isa_internal void
+RecordInsertText(scn_state *State, u64 NoteIndex, u32 Pos, const u8 *Bytes, u32 Len)
+{
+    undo_log    *Log    = State->Undo;
+    undo_record *Record = CoalescableUndoRecord(Log, UndoRecord_InsertText, NoteIndex);
+    if(Record && (Record->Text.Pos + Record->Text.Len) == Pos)
+    {
+        u64 NewSize = UndoRecordSize((u64)Record->Text.Len + Len);
+        if(CanGrowUndoRecord(Log, NewSize))
+        {
+            memcpy(UndoRecordBytes(Record) + Record->Text.Len, Bytes, Len);
+            Record->Text.Len += Len;
+            GrowUndoRecord(Log, Record, NewSize);
+            return;
+        }
+    }
+
+    Record = PushUndoRecord(State, UndoRecord_InsertText, Len);
+    if(Record)
+    {
+        Record->NoteIndex = NoteIndex;
+        Record->Text.Pos  = Pos;
+        Record->Text.Len  = Len;
+        memcpy(UndoRecordBytes(Record), Bytes, Len);
+    }
+}
+
+// NOTE(ingar): The Len bytes that were at Pos in the text of the note were deleted. Deleting backward from the start
+// of what the newest record deleted, or forward from the same place, extends it.
+isa_internal void
+RecordDeleteText(scn_state *State, u64 NoteIndex, u32 Pos, const u8 *Bytes, u32 Len)
+{
+    undo_log    *Log    = State->Undo;
+    undo_record *Record = CoalescableUndoRecord(Log, UndoRecord_DeleteText, NoteIndex);
+    if(Record && ((Pos + Len) == Record->Text.Pos || Pos == Record->Text.Pos))
+    {
+        u64 NewSize = UndoRecordSize((u64)Record->Text.Len + Len);
+        if(CanGrowUndoRecord(Log, NewSize))
+        {
+            u8 *Deleted = UndoRecordBytes(Record);
+            if(Pos == Record->Text.Pos)
+            {
+                memcpy(Deleted + Record->Text.Len, Bytes, Len);
+            }
+            else
+            {
+                memmove(Deleted + Len, Deleted, Record->Text.Len);
+                memcpy(Deleted, Bytes, Len);
+                Record->Text.Pos = Pos;
+            }
+            Record->Text.Len += Len;
+            GrowUndoRecord(Log, Record, NewSize);
+            return;
+        }
+    }
+
+    Record = PushUndoRecord(State, UndoRecord_DeleteText, Len);
+    if(Record)
+    {
+        Record->NoteIndex = NoteIndex;
+        Record->Text.Pos  = Pos;
+        Record->Text.Len  = Len;
+        memcpy(UndoRecordBytes(Record), Bytes, Len);
+    }
+}
+
+// NOTE(ingar): Moving the same note again soon after only updates where the newest record says it went
+isa_internal void
+RecordMoveNote(scn_state *State, u64 NoteIndex, rect From, rect To)
+{
+    undo_log    *Log    = State->Undo;
+    undo_record *Record = CoalescableUndoRecord(Log, UndoRecord_MoveNote, NoteIndex);
+    if(Record)
+    {
+        Record->Move.To = To;
+        GrowUndoRecord(Log, Record, Record->Size);
+        return;
+    }
+
+    Record = PushUndoRecord(State, UndoRecord_MoveNote, 0);
+    if(Record)
+    {
+        Record->NoteIndex = NoteIndex;
+        Record->Move.From = From;
+        Record->Move.To   = To;
+    }
+}
+
+isa_internal void
+RecordAttachImage(scn_state *State, u64 NoteIndex, u32 From, u32 To)
+{
+    undo_record *Record = PushUndoRecord(State, UndoRecord_AttachImage, 0);
+    if(Record)
+    {
+        Record->NoteIndex   = NoteIndex;
+        Record->Attach.From = From;
+        Record->Attach.To   = To;
+    }
+}
+
+#endif // SCN_UNDO_H_
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2024 (c) by Ingar Solveigson Asheim. All Rights Reserved.
+ */
+
+#ifndef SCN_UPSCALE_H_
+#define SCN_UPSCALE_H_
+
+#include "isa.h"
+#include "scn.h"
+#include "scn_intrinsics.h"
+#include "scn_pixels.h"
+
+/* NOTE(ingar): Upscaling
+ *
+ * When the notes are drawn below the resolution of the window, the frame is scaled up into the back buffer with a
+ * bilinear filter. The factor is a whole number, so the pixels of the back buffer fall at Factor places between the
+ * pixels of the source, and the weights repeat every Factor pixels. The weights are 7 bits, so that the difference of
+ * two channels times a weight fits in a 16 bit lane, and two pixels are filtered at a time.
+ */
+
+#define SCN_MAX_UPSCALE 8
+
+struct upscale_tap
+{
+    i64 i;      // The first of the two source pixels, the other is i + 1
+    i64 Weight; // Of the other, out of 128
+};
+
+// NOTE(ingar): The center of pixel Dest is at (Dest + 0.5) / Factor - 0.5 in the source
+inline upscale_tap
+UpscaleTap(i64 Dest, u32 Factor)
+{
+    i64 Num  = (2 * Dest) + 1 - Factor;
+    i64 Den  = 2 * (i64)Factor;
+    i64 i    = (Num >= 0) ? Num / Den : -((Den - 1 - Num) / Den);
+    i64 Frac = Num - (i * Den);
+    return { i, ((Frac * 128) + (Den / 2)) / Den };
+}
+
+// NOTE(ingar): Pixels past the edges of the source repeat the edge
+inline upscale_tap
+ClampTap(upscale_tap Tap, i64 SrcCount)
+{
+    if(Tap.i < 0)
+    {
+        return { 0, 0 };
+    }
+    if(Tap.i >= SrcCount - 1)
+    {
+        return { SrcCount - 2, 128 };
+    }
+    return Tap;
+}
+
+// NOTE(ingar): A + (B - A) * Weight / 128, rounded, in every 16 bit lane
+inline __m128i
+LerpLanes(__m128i A, __m128i B, __m128i Weight)
+{
+    __m128i Product = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(B, A), Weight), _mm_set1_epi16(64));
+    return _mm_add_epi16(A, _mm_srai_epi16(Product, 7));
+}
+
+// NOTE(ingar): The filtered pixels at a and b in the low 8 bytes
+inline __m128i
+FilterPixelPair(u32 *Row0, u32 *Row1, upscale_tap a, upscale_tap b, __m128i WeightY)
+{
+    __m128i Zero = _mm_setzero_si128();
+    __m128i Top  = _mm_unpacklo_epi64(_mm_loadl_epi64((__m128i *)(Row0 + a.i)),
+                                      _mm_loadl_epi64((__m128i *)(Row0 + b.i)));
+    __m128i Bot  = _mm_unpacklo_epi64(_mm_loadl_epi64((__m128i *)(Row1 + a.i)),
+                                      _mm_loadl_epi64((__m128i *)(Row1 + b.i)));
+
+    /* Down the columns first, which leaves the two pixels of a in one register and those of b in the other */
+    __m128i A = LerpLanes(_mm_unpacklo_epi8(Top, Zero), _mm_unpacklo_epi8(Bot, Zero), WeightY);
+    __m128i B = LerpLanes(_mm_unpackhi_epi8(Top, Zero), _mm_unpackhi_epi8(Bot, Zero), WeightY);
+
+    short   Wa      = (short)a.Weight;
+    short   Wb      = (short)b.Weight;
+    __m128i WeightX = _mm_set_epi16(Wb, Wb, Wb, Wb, Wa, Wa, Wa, Wa);
+    __m128i Result  = LerpLanes(_mm_unpacklo_epi64(A, B), _mm_unpackhi_epi64(A, B), WeightX);
+    return _mm_packus_epi16(Result, Result);
+}
+
+// NOTE(ingar): Fills Region of Dest, in its pixels, from Src, which is Factor times smaller. Both are BGRA8, and Src is
+// at least 2 pixels each way.
+isa_internal void
+UpscaleBilinear(scn_offscreen_buffer Src, scn_offscreen_buffer Dest, u32 Factor, rect Region)
+{
+    IsaAssert(Factor >= 1 && Factor <= SCN_MAX_UPSCALE, "Unsupported upscale factor");
+    IsaAssert(Src.w >= 2 && Src.h >= 2, "Source too small to filter");
+
+    i64 StartX = Clamp(FloorFloatToi64(Region.Min.x), (i64)0, Dest.w);
+    i64 StartY = Clamp(FloorFloatToi64(Region.Min.y), (i64)0, Dest.h);
+    i64 EndX   = Clamp(CeilFloatToi64(Region.Max.x), (i64)0, Dest.w);
+    i64 EndY   = Clamp(CeilFloatToi64(Region.Max.y), (i64)0, Dest.h);
+    if(EndX <= StartX || EndY <= StartY)
+    {
+        return;
+    }
+
+    /* The taps of the pixels Factor apart differ only in the source pixel, so they are worked out once per phase */
+    upscale_tap Phases[SCN_MAX_UPSCALE];
+    for(u32 p = 0; p < Factor; ++p)
+    {
+        Phases[p] = UpscaleTap(StartX + p, Factor);
+    }
+
+    for(i64 y = StartY; y < EndY; ++y)
+    {
+        upscale_tap TapY    = ClampTap(UpscaleTap(y, Factor), Src.h);
+        u32        *Row0    = (u32 *)PixelAt(Src, 0, TapY.i);
+        u32        *Row1    = (u32 *)PixelAt(Src, 0, TapY.i + 1);
+        u32        *Out     = (u32 *)PixelAt(Dest, 0, y);
+        __m128i     WeightY = _mm_set1_epi16((short)TapY.Weight);
+
+        u32 Phase = 0;
+        i64 Block = 0;
+        for(i64 x = StartX; x < EndX; x += 2)
+        {
+            upscale_tap a = Phases[Phase];
+            a.i += Block;
+            if(++Phase == Factor)
+            {
+                Phase = 0;
+                ++Block;
+            }
+
+            upscale_tap b = Phases[Phase];
+            b.i += Block;
+            if(++Phase == Factor)
+            {
+                Phase = 0;
+                ++Block;
+            }
+
+            __m128i Pair = FilterPixelPair(Row0, Row1, ClampTap(a, Src.w), ClampTap(b, Src.w), WeightY);
+            if(x + 1 < EndX)
+            {
+                _mm_storel_epi64((__m128i *)(Out + x), Pair);
+            }
+            else
+            {
+                Out[x] = (u32)_mm_cvtsi128_si32(Pair);
+            }
+        }
+    }
+}
+
+#endif // SCN_UPSCALE_H_
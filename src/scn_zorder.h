@@ -0,0 +1,123 @@
+/*
+ * Copyright 2024 (c) by Ingar Solveigson Asheim. All Rights Reserved.
+ */
+
+#ifndef SCN_ZORDER_H_
+#define SCN_ZORDER_H_
+
+#include "isa.h"
+#include "scn.h"
+#include "scn_intrinsics.h"
+#include "scn_undo.h"
+
+#include <cstdlib>
+
+/* NOTE(ingar): Stacking order
+ *
+ * The z of a note is a label, and notes are drawn from the lowest label to the highest. Labels start out SCN_Z_GAP
+ * apart around the middle of the range, so a note can be put on top of the others by giving it a label above Top,
+ * under them with one below Bottom, or between two neighbours with one in the gap, without touching any other note.
+ * Deleting a note leaves a gap and renumbers nothing.
+ *
+ * When there is no room left at the end a note goes to, every note is given a new label in its current order. That
+ * takes a sort of the board, but only happens after about 2^47 notes have been put on top or under. Undo records keep
+ * labels, so relabelling drops the history.
+ *
+ * Whatever has to be drawn or written in order is sorted by label when it is needed, which is cheap for the notes in a
+ * damaged region and happens once for a whole board.
+ */
+
+#define SCN_Z_GAP    (1ULL << 16)
+#define SCN_Z_MIDDLE (1ULL << 63)
+
+isa_internal int
+CompareZEntries(const void *A, const void *B)
+{
+    u64 a = ((const z_entry *)A)->z;
+    u64 b = ((const z_entry *)B)->z;
+    return (a < b) ? -1 : (a > b);
+}
+
+// NOTE(ingar): Fills Entries with the notes in Bits, or every note if Bits is null, from the lowest to the highest.
+// Returns how many there are.
+isa_internal u64
+SortNotesByZ(note_collection *Notes, u64 *Bits, z_entry *Entries)
+{
+    u64 Count = 0;
+    if(Bits)
+    {
+        u64 Words = SelectionWords(Notes);
+        for(u64 Word = 0; Word < Words; ++Word)
+        {
+            for(u64 Set = Bits[Word]; Set; Set &= Set - 1)
+            {
+                u64 i            = (Word * 64) + CountTrailingZerosu64(Set);
+                Entries[Count++] = { Notes->N[i].z, i };
+            }
+        }
+    }
+    else
+    {
+        for(u64 i = 0; i < Notes->Count; ++i)
+        {
+            Entries[Count++] = { Notes->N[i].z, i };
+        }
+    }
+
+    qsort(Entries, Count, sizeof(z_entry), CompareZEntries);
+    return Count;
+}
+
+isa_internal void
+ResetZOrder(z_order *Order, note_collection *Notes)
+{
+    Order->Top    = SCN_Z_MIDDLE;
+    Order->Bottom = SCN_Z_MIDDLE;
+    for(u64 i = 0; i < Notes->Count; ++i)
+    {
+        u64 z         = Notes->N[i].z;
+        Order->Top    = (z > Order->Top) ? z : Order->Top;
+        Order->Bottom = (z < Order->Bottom) ? z : Order->Bottom;
+    }
+}
+
+// NOTE(ingar): Gives the notes labels SCN_Z_GAP apart in the order of Sorted, around the middle of the range
+isa_internal void
+LabelNotesInOrder(z_order *Order, note_collection *Notes, z_entry *Sorted, u64 Count)
+{
+    Order->Bottom = SCN_Z_MIDDLE - ((Count / 2) * SCN_Z_GAP);
+    Order->Top    = Order->Bottom;
+    for(u64 i = 0; i < Count; ++i)
+    {
+        Order->Top                 = Order->Bottom + (i * SCN_Z_GAP);
+        Notes->N[Sorted[i].Note].z = Order->Top;
+    }
+}
+
+// NOTE(ingar): Returns the label that Count notes put on top of the others (or under them) should follow, so that the
+// j-th of them gets Base + (j + 1) * SCN_Z_GAP, and moves Top or Bottom past them. Relabels the board and drops the
+// undo history if there is no room.
+isa_internal u64
+ReserveZ(scn_state *State, u64 Count, bool Under)
+{
+    z_order *Order = &State->ZOrder;
+    u64      Span  = Count * SCN_Z_GAP;
+    if((Under && Order->Bottom <= Span + SCN_Z_GAP) || (!Under && Order->Top >= UINT64_MAX - Span))
+    {
+        u64 Sorted = SortNotesByZ(State->Notes, nullptr, Order->Entries);
+        LabelNotesInOrder(Order, State->Notes, Order->Entries, Sorted);
+        ResetUndoLog(State);
+    }
+
+    if(Under)
+    {
+        Order->Bottom -= Span;
+        return Order->Bottom - SCN_Z_GAP;
+    }
+
+    u64 Base = Order->Top;
+    Order->Top += Span;
+    return Base;
+}
+
+#endif // SCN_ZORDER_H_
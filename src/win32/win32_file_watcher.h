@@ -0,0 +1,271 @@
+/*
+ * Copyright 2024 (c) by Ingar Solveigson Asheim. All Rights Reserved.
+ */
+#ifndef WIN32_FILE_WATCHER_H_
+#define WIN32_FILE_WATCHER_H_
+
+#include "../isa.h"
+#include "win32_utils.h"
+
+#include <windows.h>
+
+// NOTE(ingar): Watches individual files through change notifications on their directories. A change only marks the
+// file as pending; it is reported once no further changes have arrived for the debounce period and the file can be
+// opened without sharing violations, i.e. when the compiler/linker (or whatever wrote it) has let go of it.
+#define WIN32_MAX_WATCHED_DIRS  4
+#define WIN32_MAX_WATCHED_FILES 8
+#define WIN32_WATCH_DEBOUNCE_US 100000
+
+struct win32_watched_dir
+{
+    HANDLE     Handle;
+    OVERLAPPED Overlapped;
+    TCHAR      Path[MAX_PATH]; // TODO(ingar): MAX_PATH is deprecated
+
+    // NOTE(ingar): FILE_NOTIFY_INFORMATION records have to be DWORD aligned
+    DWORD Buffer[1024];
+};
+
+struct win32_watched_file
+{
+    u64          Id; // Caller defined
+    u64          DirIndex;
+    TCHAR        Path[MAX_PATH];
+    const TCHAR *Name; // Points into Path, past the last separator
+
+    u64 ReadyAtUs; // 0 when no change is pending
+};
+
+struct win32_file_watcher
+{
+    u64                DirCount;
+    win32_watched_dir  Dirs[WIN32_MAX_WATCHED_DIRS];
+    HANDLE             Events[WIN32_MAX_WATCHED_DIRS]; // Same order as Dirs, to be waited on by the message loop
+
+    u64                FileCount;
+    win32_watched_file Files[WIN32_MAX_WATCHED_FILES];
+};
+
+isa_internal bool
+Win32NamesMatchNoCase(const WCHAR *A, u64 ALen, const TCHAR *B)
+{
+    u64 i = 0;
+    for(; i < ALen && B[i]; ++i)
+    {
+        WCHAR a = A[i];
+        WCHAR b = B[i];
+        a       = (a >= 'A' && a <= 'Z') ? (WCHAR)(a + ('a' - 'A')) : a;
+        b       = (b >= 'A' && b <= 'Z') ? (WCHAR)(b + ('a' - 'A')) : b;
+        if(a != b)
+        {
+            return false;
+        }
+    }
+
+    return (i == ALen) && !B[i];
+}
+
+isa_internal bool
+Win32IssueDirRead(win32_watched_dir *Dir)
+{
+    DWORD Filter = FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE;
+    BOOL  Issued = ReadDirectoryChangesW(Dir->Handle, Dir->Buffer, sizeof(Dir->Buffer), FALSE, Filter, NULL,
+                                         &Dir->Overlapped, NULL);
+    if(!Issued)
+    {
+        PrintLastError(TEXT("ReadDirectoryChangesW"));
+        return false;
+    }
+
+    return true;
+}
+
+isa_internal i64
+Win32FindOrOpenWatchedDir(win32_file_watcher *Watcher, const TCHAR *DirPath, u64 DirPathLen)
+{
+    for(u64 i = 0; i < Watcher->DirCount; ++i)
+    {
+        if(Win32NamesMatchNoCase(DirPath, DirPathLen, Watcher->Dirs[i].Path))
+        {
+            return (i64)i;
+        }
+    }
+
+    if(Watcher->DirCount >= WIN32_MAX_WATCHED_DIRS || DirPathLen >= MAX_PATH)
+    {
+        DebugPrint("Too many watched directories or directory path too long\n");
+        return -1;
+    }
+
+    win32_watched_dir *Dir = Watcher->Dirs + Watcher->DirCount;
+    memset(Dir, 0, sizeof(*Dir));
+    memcpy(Dir->Path, DirPath, DirPathLen * sizeof(TCHAR));
+
+    Dir->Handle = CreateFile(Dir->Path, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                             NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    if(Dir->Handle == INVALID_HANDLE_VALUE)
+    {
+        PrintLastError(TEXT("CreateFile"));
+        return -1;
+    }
+
+    Dir->Overlapped.hEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if(!Dir->Overlapped.hEvent || !Win32IssueDirRead(Dir))
+    {
+        CloseHandle(Dir->Handle);
+        return -1;
+    }
+
+    Watcher->Events[Watcher->DirCount] = Dir->Overlapped.hEvent;
+    return (i64)Watcher->DirCount++;
+}
+
+isa_internal bool
+Win32WatchFile(win32_file_watcher *Watcher, const TCHAR *Path, u64 Id)
+{
+    if(Watcher->FileCount >= WIN32_MAX_WATCHED_FILES)
+    {
+        DebugPrint("Too many watched files\n");
+        return false;
+    }
+
+    i64 LastSeparator = -1;
+    u64 PathLen       = 0;
+    for(; Path[PathLen]; ++PathLen)
+    {
+        if(Path[PathLen] == '\\' || Path[PathLen] == '/')
+        {
+            LastSeparator = (i64)PathLen;
+        }
+    }
+
+    if(LastSeparator < 0 || PathLen >= MAX_PATH)
+    {
+        DebugPrint("Watched files must be given by a full path\n");
+        return false;
+    }
+
+    i64 DirIndex = Win32FindOrOpenWatchedDir(Watcher, Path, (u64)LastSeparator);
+    if(DirIndex < 0)
+    {
+        return false;
+    }
+
+    win32_watched_file *File = Watcher->Files + Watcher->FileCount++;
+    memset(File, 0, sizeof(*File));
+    memcpy(File->Path, Path, PathLen * sizeof(TCHAR));
+    File->Id       = Id;
+    File->DirIndex = (u64)DirIndex;
+    File->Name     = File->Path + LastSeparator + 1;
+
+    return true;
+}
+
+// NOTE(ingar): Called when the event of the directory at DirIndex is signaled
+isa_internal void
+Win32HandleDirChange(win32_file_watcher *Watcher, u64 DirIndex, u64 NowUs)
+{
+    win32_watched_dir *Dir = Watcher->Dirs + DirIndex;
+
+    DWORD BytesWritten = 0;
+    if(!GetOverlappedResult(Dir->Handle, &Dir->Overlapped, &BytesWritten, FALSE))
+    {
+        PrintLastError(TEXT("GetOverlappedResult"));
+        return;
+    }
+
+    u64 ReadyAtUs = NowUs + WIN32_WATCH_DEBOUNCE_US;
+    if(BytesWritten == 0)
+    {
+        /* The notification buffer overflowed, so anything in the directory may have changed */
+        for(u64 i = 0; i < Watcher->FileCount; ++i)
+        {
+            if(Watcher->Files[i].DirIndex == DirIndex)
+            {
+                Watcher->Files[i].ReadyAtUs = ReadyAtUs;
+            }
+        }
+    }
+    else
+    {
+        u8 *At = (u8 *)Dir->Buffer;
+        for(;;)
+        {
+            FILE_NOTIFY_INFORMATION *Info    = (FILE_NOTIFY_INFORMATION *)At;
+            u64                      NameLen = Info->FileNameLength / sizeof(WCHAR);
+
+            for(u64 i = 0; i < Watcher->FileCount; ++i)
+            {
+                win32_watched_file *File = Watcher->Files + i;
+                if(File->DirIndex == DirIndex && Win32NamesMatchNoCase(Info->FileName, NameLen, File->Name))
+                {
+                    File->ReadyAtUs = ReadyAtUs;
+                }
+            }
+
+            if(!Info->NextEntryOffset)
+            {
+                break;
+            }
+            At += Info->NextEntryOffset;
+        }
+    }
+
+    Win32IssueDirRead(Dir);
+}
+
+// NOTE(ingar): Returns the id of one file whose debounce period has passed and that is no longer being written, or
+// false if there is none. Call until it returns false.
+isa_internal bool
+Win32PopReadyFile(win32_file_watcher *Watcher, u64 NowUs, u64 *Id)
+{
+    for(u64 i = 0; i < Watcher->FileCount; ++i)
+    {
+        win32_watched_file *File = Watcher->Files + i;
+        if(!File->ReadyAtUs || File->ReadyAtUs > NowUs)
+        {
+            continue;
+        }
+
+        HANDLE Handle = CreateFile(File->Path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                   FILE_ATTRIBUTE_NORMAL, NULL);
+        if(Handle == INVALID_HANDLE_VALUE)
+        {
+            if(GetLastError() == ERROR_SHARING_VIOLATION)
+            {
+                File->ReadyAtUs = NowUs + WIN32_WATCH_DEBOUNCE_US;
+            }
+            else
+            {
+                /* Deleted or renamed away. A new notification re-arms the file when it comes back */
+                File->ReadyAtUs = 0;
+            }
+            continue;
+        }
+
+        CloseHandle(Handle);
+
+        File->ReadyAtUs = 0;
+        *Id             = File->Id;
+        return true;
+    }
+
+    return false;
+}
+
+isa_internal u64
+Win32NextWatchDeadline(win32_file_watcher *Watcher, u64 Deadline)
+{
+    for(u64 i = 0; i < Watcher->FileCount; ++i)
+    {
+        u64 ReadyAtUs = Watcher->Files[i].ReadyAtUs;
+        if(ReadyAtUs && ReadyAtUs < Deadline)
+        {
+            Deadline = ReadyAtUs;
+        }
+    }
+
+    return Deadline;
+}
+
+#endif // WIN32_FILE_WATCHER_H_
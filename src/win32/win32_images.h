@@ -0,0 +1,229 @@
+/*
+ * Copyright 2024 (c) by Ingar Solveigson Asheim. All Rights Reserved.
+ */
+#ifndef WIN32_IMAGES_H_
+#define WIN32_IMAGES_H_
+
+#include "../isa.h"
+#include "../scn.h"
+#include "win32_utils.h"
+
+#include <windows.h>
+#include <wincodec.h>
+
+// NOTE(ingar): Decodes the images scn asks for with WIC, on a thread of its own so that reading a large file never
+// holds up a frame. Requests are taken from Mem->ImageRequests in order, the pixels are scaled down to the size scn
+// asked for and written straight into the tiles of the request in Mem->ImageMem, and the result is posted to the
+// window, which passes it on to scn as an input event.
+#define WIN32_IMAGE_MEM_SIZE IsaMegaByte(64)
+
+struct win32_image_decoder
+{
+    scn_mem *Mem;
+    HWND     Window;
+    UINT     DoneMessage; // Posted to Window with the job in WParam and the size of the image in LParam
+
+    HANDLE Thread;
+    HANDLE Wake;           // Auto-reset, set when scn has made new requests
+    u64    LastWriteIndex; // Of the request ring, the last time the thread was woken
+};
+
+// NOTE(ingar): Rows of the image are converted a row of tiles at a time into Strip and copied out to the tiles from
+// there, since WIC scales and converts a whole row at a time anyway. Returns false if the file could not be decoded.
+isa_internal bool
+Win32DecodeImage(IWICImagingFactory *Factory, scn_mem *Mem, scn_image_request *Request, u8 *Strip, u32 *w, u32 *h)
+{
+    WCHAR Path[SCN_PATH_MAX];
+    if(!MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, Request->Path, -1, Path, SCN_PATH_MAX))
+    {
+        return false;
+    }
+
+    IWICBitmapDecoder     *Decoder   = NULL;
+    IWICBitmapFrameDecode *Frame     = NULL;
+    IWICBitmapScaler      *Scaler    = NULL;
+    IWICFormatConverter   *Converter = NULL;
+    UINT                   FileW     = 0;
+    UINT                   FileH     = 0;
+    u32                    FitW      = 0;
+    u32                    FitH      = 0;
+
+    HRESULT Result = Factory->CreateDecoderFromFilename(Path, NULL, GENERIC_READ, WICDecodeMetadataCacheOnDemand,
+                                                        &Decoder);
+    if(SUCCEEDED(Result))
+    {
+        Result = Decoder->GetFrame(0, &Frame);
+    }
+    if(SUCCEEDED(Result))
+    {
+        Result = Frame->GetSize(&FileW, &FileH);
+    }
+    if(SUCCEEDED(Result) && FileW && FileH)
+    {
+        /* The largest size that fits in the box with the same aspect, and never larger than the file */
+        FitW = FileW;
+        FitH = FileH;
+        if(FitW > Request->MaxW)
+        {
+            FitH = (u32)(((u64)FitH * Request->MaxW) / FitW);
+            FitW = Request->MaxW;
+        }
+        if(FitH > Request->MaxH)
+        {
+            FitW = (u32)(((u64)FitW * Request->MaxH) / FitH);
+            FitH = Request->MaxH;
+        }
+        FitW = FitW ? FitW : 1;
+        FitH = FitH ? FitH : 1;
+
+        Result = Factory->CreateBitmapScaler(&Scaler);
+    }
+    else if(SUCCEEDED(Result))
+    {
+        Result = E_FAIL;
+    }
+    if(SUCCEEDED(Result))
+    {
+        Result = Scaler->Initialize(Frame, FitW, FitH, WICBitmapInterpolationModeFant);
+    }
+    if(SUCCEEDED(Result))
+    {
+        Result = Factory->CreateFormatConverter(&Converter);
+    }
+    if(SUCCEEDED(Result))
+    {
+        /* Byte order B, G, R, A is u32_argb on a little-endian machine */
+        Result = Converter->Initialize(Scaler, GUID_WICPixelFormat32bppBGRA, WICBitmapDitherTypeNone, NULL, 0.0,
+                                       WICBitmapPaletteTypeCustom);
+    }
+
+    u32 Across     = (Request->MaxW + SCN_IMAGE_TILE - 1) / SCN_IMAGE_TILE;
+    u64 TileCount  = Mem->ImageMemSize / SCN_IMAGE_TILE_BYTES;
+    u32 StripPitch = FitW * sizeof(u32);
+    for(u32 Y = 0; SUCCEEDED(Result) && Y < FitH; Y += SCN_IMAGE_TILE)
+    {
+        u32     Rows  = ((FitH - Y) < SCN_IMAGE_TILE) ? (FitH - Y) : SCN_IMAGE_TILE;
+        WICRect Rect  = { 0, (INT)Y, (INT)FitW, (INT)Rows };
+        Result        = Converter->CopyPixels(&Rect, StripPitch, StripPitch * Rows, Strip);
+        for(u32 X = 0; SUCCEEDED(Result) && X < FitW; X += SCN_IMAGE_TILE)
+        {
+            u32 Tile = Request->Tiles[((Y / SCN_IMAGE_TILE) * Across) + (X / SCN_IMAGE_TILE)];
+            if(Tile >= TileCount)
+            {
+                Result = E_FAIL;
+                break;
+            }
+
+            u32 Columns = ((FitW - X) < SCN_IMAGE_TILE) ? (FitW - X) : SCN_IMAGE_TILE;
+            u8 *Dest    = (u8 *)Mem->ImageMem + ((u64)Tile * SCN_IMAGE_TILE_BYTES);
+            for(u32 Row = 0; Row < Rows; ++Row)
+            {
+                memcpy(Dest + (Row * SCN_IMAGE_TILE * sizeof(u32)), Strip + (Row * StripPitch) + (X * sizeof(u32)),
+                       Columns * sizeof(u32));
+            }
+        }
+    }
+
+    if(Converter)
+    {
+        Converter->Release();
+    }
+    if(Scaler)
+    {
+        Scaler->Release();
+    }
+    if(Frame)
+    {
+        Frame->Release();
+    }
+    if(Decoder)
+    {
+        Decoder->Release();
+    }
+
+    *w = FitW;
+    *h = FitH;
+    return SUCCEEDED(Result);
+}
+
+// NOTE(ingar): Every request gets an answer, with a size of 0 if it failed, so that scn does not wait for it forever
+isa_internal DWORD WINAPI
+Win32ImageDecoderThread(LPVOID Param)
+{
+    win32_image_decoder *Decoder = (win32_image_decoder *)Param;
+    scn_mem             *Mem     = Decoder->Mem;
+
+    IWICImagingFactory *Factory = NULL;
+    HRESULT             Result  = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+    if(SUCCEEDED(Result))
+    {
+        Result = CoCreateInstance(CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&Factory));
+    }
+    if(FAILED(Result))
+    {
+        DebugPrint("Could not create the WIC factory, images will not be shown\n");
+        Factory = NULL;
+    }
+
+    u8 *Strip = (u8 *)VirtualAlloc(NULL, SCN_IMAGE_MAX_SIDE * SCN_IMAGE_TILE * sizeof(u32), MEM_RESERVE | MEM_COMMIT,
+                                   PAGE_READWRITE);
+
+    for(;;)
+    {
+        WaitForSingleObject(Decoder->Wake, INFINITE);
+        while(ScnRingAvailable(&Mem->ImageRequests))
+        {
+            scn_image_request *Request = ScnRingPeek(&Mem->ImageRequests, 0);
+
+            u32 w = 0;
+            u32 h = 0;
+            if(!(Factory && Strip && Win32DecodeImage(Factory, Mem, Request, Strip, &w, &h)))
+            {
+                w = 0;
+                h = 0;
+            }
+
+            u64 Job = Request->Job;
+            ScnRingRelease(&Mem->ImageRequests, 1);
+            PostMessage(Decoder->Window, Decoder->DoneMessage, (WPARAM)Job, MAKELPARAM(w, h));
+        }
+    }
+}
+
+isa_internal bool
+Win32StartImageDecoder(win32_image_decoder *Decoder, scn_mem *Mem, HWND Window, UINT DoneMessage)
+{
+    Decoder->Mem         = Mem;
+    Decoder->Window      = Window;
+    Decoder->DoneMessage = DoneMessage;
+
+    Decoder->Wake = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if(!Decoder->Wake)
+    {
+        PrintLastError(TEXT("CreateEvent"));
+        return false;
+    }
+
+    Decoder->Thread = CreateThread(NULL, 0, Win32ImageDecoderThread, Decoder, 0, NULL);
+    if(!Decoder->Thread)
+    {
+        PrintLastError(TEXT("CreateThread"));
+        return false;
+    }
+
+    return true;
+}
+
+// NOTE(ingar): Called after scn has been updated, which is when it makes its requests
+isa_internal void
+Win32WakeImageDecoder(win32_image_decoder *Decoder)
+{
+    u64 WriteIndex = Decoder->Mem->ImageRequests.WriteIndex;
+    if(Decoder->Thread && WriteIndex != Decoder->LastWriteIndex)
+    {
+        Decoder->LastWriteIndex = WriteIndex;
+        SetEvent(Decoder->Wake);
+    }
+}
+
+#endif // WIN32_IMAGES_H_
@@ -16,6 +16,9 @@ ISA_LOG_REGISTER(WinMain);
 #include "../consts.h"
 #include "../scn.h" // TODO(ingar): Split into scn and scn_platform?
 #include "win32_utils.h"
+#include "win32_file_watcher.h"
+#include "win32_snapshot.h"
+#include "win32_images.h"
 
 // #define STB_TRUETYPE_IMPLEMENTATION
 // #include "stb_truetype.h"
@@ -39,14 +42,22 @@ isa_global struct scn
     TCHAR DllName[MAX_PATH]; // TODO(ingar): MAX_PATH is deprecated
     TCHAR TempDllName[MAX_PATH];
 
-    HMODULE  Dll;
-    FILETIME LastWriteTime;
+    TCHAR ImageName[MAX_PATH];
+    TCHAR TempImageName[MAX_PATH];
+    TCHAR BoardName[MAX_PATH];
 
-    bool                 CodeLoaded;
-    update_back_buffer  *UpdateBackBuffer;
-    respond_to_mouse    *RespondToMouse;
-    respond_to_keyboard *RespondToKeyboard;
-    seed_rand_pcg       *SeedRandPcg; // TODO(ingar): This is overkill
+    void             *PermanentBaseAddress;
+    win32_board_image BoardImage;
+
+    HMODULE Dll;
+
+    bool                CodeLoaded;
+    update_back_buffer *UpdateBackBuffer;
+    save_board         *SaveBoard;
+    load_board         *LoadBoard;
+    seed_rand_pcg      *SeedRandPcg; // TODO(ingar): This is overkill
+
+    u64 PerfCountFrequency;
 
 } Scn;
 
@@ -55,11 +66,17 @@ isa_global struct win32
     NOTIFYICONDATA NotifyIconData;
     HICON          AppIcon;
 
+    win32_file_watcher  FileWatcher;
+    win32_image_decoder ImageDecoder;
+
+    WCHAR HighSurrogate; // First half of a character outside the BMP, until WM_CHAR brings the second
+
 } Win32;
 
 enum : UINT
 {
     WM_TRAY_ICON = (WM_USER + 1),
+    WM_IMAGE_DECODED,
     ID_TRAY_EXIT,
     ID_TRAY_SHOW,
     ID_TRAY_APP_ICON,
@@ -67,7 +84,6 @@ enum : UINT
     WIN32_COMMANDS_FINAL,
 };
 
-// NOTE(ingar): The window buffer's memory is at the start of Scn.Mem
 isa_global struct window_buffer
 {
     BITMAPINFO DIBInfo;
@@ -81,6 +97,9 @@ isa_global struct window_buffer
 
 } WindowBuffer;
 
+// NOTE(ingar): Upper bound on how often scn is updated while input is streaming in
+#define WIN32_MIN_FRAME_TIME_US 16000
+
 struct win32_window_dims
 {
     LONG Width, Height;
@@ -156,20 +175,6 @@ AppendToEXEFilePathTchar(const TCHAR *Filename, TCHAR *Out, size_t OutLen)
     return true;
 }
 
-inline FILETIME
-Win32GetLastWriteTime(const TCHAR *Filename)
-{
-    FILETIME LastWriteTime = {};
-
-    WIN32_FILE_ATTRIBUTE_DATA Data;
-    if(GetFileAttributesEx(Filename, GetFileExInfoStandard, &Data))
-    {
-        LastWriteTime = Data.ftLastWriteTime;
-    }
-
-    return LastWriteTime;
-}
-
 isa_internal void
 Win32UnloadScnCode(void)
 {
@@ -179,11 +184,11 @@ Win32UnloadScnCode(void)
         Scn.Dll = NULL;
     }
 
-    Scn.CodeLoaded        = false;
-    Scn.UpdateBackBuffer  = NULL;
-    Scn.RespondToMouse    = NULL;
-    Scn.RespondToKeyboard = NULL;
-    Scn.SeedRandPcg       = NULL;
+    Scn.CodeLoaded       = false;
+    Scn.UpdateBackBuffer = NULL;
+    Scn.SaveBoard        = NULL;
+    Scn.LoadBoard        = NULL;
+    Scn.SeedRandPcg      = NULL;
 }
 
 isa_internal bool
@@ -205,46 +210,231 @@ Win32LoadScnCode(void) // TODO(ingar): Pass file path as argument?
         return false; // {0};
     }
 
-    update_back_buffer  *UpdateBackbuffer  = (update_back_buffer *)GetProcAddress(Dll, "UpdateBackBuffer");
-    respond_to_mouse    *RespondToMouse    = (respond_to_mouse *)GetProcAddress(Dll, "RespondToMouse");
-    respond_to_keyboard *RespondToKeyboard = (respond_to_keyboard *)GetProcAddress(Dll, "RespondToKeyboard");
-    seed_rand_pcg       *SeedRandPcg       = (seed_rand_pcg *)GetProcAddress(Dll, "SeedRandPcg");
+    update_back_buffer *UpdateBackbuffer = (update_back_buffer *)GetProcAddress(Dll, "UpdateBackBuffer");
+    save_board         *SaveBoard        = (save_board *)GetProcAddress(Dll, "SaveBoard");
+    load_board         *LoadBoard        = (load_board *)GetProcAddress(Dll, "LoadBoard");
+    seed_rand_pcg      *SeedRandPcg      = (seed_rand_pcg *)GetProcAddress(Dll, "SeedRandPcg");
 
-    if(!UpdateBackbuffer || !RespondToMouse || !RespondToKeyboard || !SeedRandPcg)
+    if(!UpdateBackbuffer || !SaveBoard || !LoadBoard || !SeedRandPcg)
     {
         PrintLastError(TEXT("GetProcAddress"));
         return false; //{0};
     }
 
-    Scn.Dll               = Dll;
-    Scn.UpdateBackBuffer  = UpdateBackbuffer;
-    Scn.RespondToMouse    = RespondToMouse;
-    Scn.RespondToKeyboard = RespondToKeyboard;
-    Scn.SeedRandPcg       = SeedRandPcg;
-    Scn.CodeLoaded        = true;
+    Scn.Dll              = Dll;
+    Scn.UpdateBackBuffer = UpdateBackbuffer;
+    Scn.SaveBoard        = SaveBoard;
+    Scn.LoadBoard        = LoadBoard;
+    Scn.SeedRandPcg      = SeedRandPcg;
+    Scn.CodeLoaded       = true;
 
     return true;
 }
 
-VOID CALLBACK
-Win32UpdateScnCodeTimer(HWND Window, UINT Message, UINT_PTR TimerId, DWORD Time)
+isa_internal u64
+Win32GetTimeUs(void)
 {
-    FILETIME LastFileTime = Win32GetLastWriteTime(Scn.DllName);
+    LARGE_INTEGER Counter;
+    QueryPerformanceCounter(&Counter);
+
+    u64 Ticks  = (u64)Counter.QuadPart;
+    u64 Result = ((Ticks / Scn.PerfCountFrequency) * 1000000)
+               + (((Ticks % Scn.PerfCountFrequency) * 1000000) / Scn.PerfCountFrequency);
+    return Result;
+}
 
-    if(CompareFileTime(&LastFileTime, &Scn.LastWriteTime))
+// NOTE(ingar): Events are consumed by scn once per frame when the back buffer is updated
+isa_internal bool
+Win32PushInputEvent(scn_input_event *Event)
+{
+    Event->TimeUs = Win32GetTimeUs();
+    if(!ScnInputRingPush(&Scn.Mem.Input, Event))
     {
-        DebugPrint("Write time is newere!\n");
+        DebugPrint("Input ring is full, dropping event\n");
+        return false;
+    }
 
-        bool Success = Win32LoadScnCode();
-        if(Success)
+    return true;
+}
+
+// NOTE(ingar): The paths do not fit in an input event, so they go through the drop ring, one for each event. scn is
+// updated on this thread, so the path can be committed after the event has made it into the input ring. Files after
+// the first are placed in a row to the right of it, so that each gets a note of its own when dropped next to the
+// notes.
+isa_internal void
+Win32PushDroppedFiles(HDROP Drop)
+{
+    POINT Point = {};
+    DragQueryPoint(Drop, &Point);
+
+    UINT Count = DragQueryFileW(Drop, 0xFFFFFFFF, NULL, 0);
+    for(UINT i = 0; i < Count; ++i)
+    {
+        scn_dropped_file *File = ScnRingReserve(&Scn.Mem.Drops);
+        if(!File)
+        {
+            DebugPrint("Drop ring is full, dropping file\n");
+            break;
+        }
+
+        WCHAR Path[SCN_PATH_MAX];
+        if(!DragQueryFileW(Drop, i, Path, SCN_PATH_MAX)
+           || !WideCharToMultiByte(CP_UTF8, 0, Path, -1, File->Path, SCN_PATH_MAX, NULL, NULL))
         {
-            DebugPrint("Successfully updated Scn code in timer\n");
-            Scn.LastWriteTime = LastFileTime;
+            continue;
+        }
+
+        scn_input_event Event = {};
+        Event.Type            = ScnInputEvent_FileDropped;
+        Event.FileDropped.x   = Point.x + ((i64)i * (i64)(SCN_IMAGE_NOTE_WIDTH + SCN_NOTE_TEXT_PADDING));
+        Event.FileDropped.y   = Point.y;
+        if(Win32PushInputEvent(&Event))
+        {
+            ScnRingCommit(&Scn.Mem.Drops);
+        }
+    }
+
+    DragFinish(Drop);
+}
+
+// NOTE(ingar): WM_CHAR carries UTF-16 code units for Unicode windows, so characters outside the BMP arrive as two
+// messages. Control characters are left to the key events.
+isa_internal void
+Win32PushCharEvent(HWND Window, WPARAM WParams)
+{
+    u32 Codepoint = 0;
+    if(IsWindowUnicode(Window))
+    {
+        WCHAR Unit = (WCHAR)WParams;
+        if(Unit >= 0xD800 && Unit <= 0xDBFF)
+        {
+            Win32.HighSurrogate = Unit;
+            return;
+        }
+
+        if(Unit >= 0xDC00 && Unit <= 0xDFFF)
+        {
+            if(!Win32.HighSurrogate)
+            {
+                return;
+            }
+
+            Codepoint           = 0x10000 + (((u32)Win32.HighSurrogate - 0xD800) << 10) + ((u32)Unit - 0xDC00);
+            Win32.HighSurrogate = 0;
+        }
+        else
+        {
+            Codepoint           = Unit;
+            Win32.HighSurrogate = 0;
         }
     }
     else
     {
-        //        OmsDebugPrint("Last write time not greater than previous write time\n");
+        CHAR  Byte = (CHAR)WParams;
+        WCHAR Unit = 0;
+        if(!MultiByteToWideChar(CP_ACP, 0, &Byte, 1, &Unit, 1))
+        {
+            return;
+        }
+        Codepoint = Unit;
+    }
+
+    if(Codepoint < 0x20 || Codepoint == 0x7F)
+    {
+        return;
+    }
+
+    scn_input_event Event = {};
+    Event.Type            = ScnInputEvent_Char;
+    Event.Char.Codepoint  = Codepoint;
+    Win32PushInputEvent(&Event);
+}
+
+// NOTE(ingar): Used when the snapshot image could not be restored, or scn could not migrate the state in it
+isa_internal void
+Win32LoadPortableBoard(void)
+{
+    u64   Size = 0;
+    void *Data = Win32ReadEntireFile(Scn.BoardName, &Size);
+    if(Data)
+    {
+        if(!Scn.LoadBoard(&Scn.Mem, Data, Size))
+        {
+            DebugPrint("Could not load the portable board\n");
+        }
+        VirtualFree(Data, 0, MEM_RELEASE);
+    }
+}
+
+isa_internal void
+Win32SavePortableBoard(void)
+{
+    u64   Size = Scn.SaveBoard(&Scn.Mem, NULL, 0);
+    void *Data = VirtualAlloc(NULL, Size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if(Data)
+    {
+        Scn.SaveBoard(&Scn.Mem, Data, Size);
+        Win32WriteEntireFile(Scn.BoardName, NULL, 0, Data, Size);
+        VirtualFree(Data, 0, MEM_RELEASE);
+    }
+}
+
+// NOTE(ingar): Writes both the portable board and the snapshot image. Must be the last thing that touches
+// Scn.Mem.Permanent, since the image is unmapped while it is saved.
+isa_internal void
+Win32SaveBoard(void)
+{
+    Win32SavePortableBoard();
+    Win32SaveBoardImage(Scn.ImageName, Scn.TempImageName, Scn.PermanentBaseAddress, &Scn.Mem, &Scn.BoardImage);
+}
+
+// NOTE(ingar): The code id is placed after the scn assets so that asset ids can be passed on to scn as they are
+enum : u64
+{
+    WIN32_WATCH_ID_SCN_CODE = ScnAsset_Count,
+};
+
+isa_internal void
+Win32WatchFiles(void)
+{
+    Win32WatchFile(&Win32.FileWatcher, Scn.DllName, WIN32_WATCH_ID_SCN_CODE);
+    Win32WatchFile(&Win32.FileWatcher, SCN_FONT_PATH_TEXT, ScnAsset_Font);
+
+    TCHAR PalettePath[MAX_PATH];
+    if(AppendToEXEFilePathTchar(SCN_PALETTE_NAME_TEXT, PalettePath, MAX_PATH))
+    {
+        Win32WatchFile(&Win32.FileWatcher, PalettePath, ScnAsset_Palette);
+    }
+}
+
+isa_internal void
+Win32ReloadChangedFiles(u64 NowUs)
+{
+    u64 Id;
+    while(Win32PopReadyFile(&Win32.FileWatcher, NowUs, &Id))
+    {
+        if(Id == WIN32_WATCH_ID_SCN_CODE)
+        {
+            /* Written by the code that wrote the state, so that the board can be read back if the new code can not
+             * migrate it */
+            if(Scn.CodeLoaded)
+            {
+                Win32SavePortableBoard();
+            }
+
+            if(Win32LoadScnCode())
+            {
+                DebugPrint("Successfully reloaded Scn code\n");
+                Scn.Mem.RedrawRequested = true;
+            }
+        }
+        else
+        {
+            scn_input_event Event    = {};
+            Event.Type               = ScnInputEvent_AssetChanged;
+            Event.AssetChanged.Asset = (scn_asset)Id;
+            Win32PushInputEvent(&Event);
+        }
     }
 }
 
@@ -299,14 +489,40 @@ Win32ResizeDibSection(LONG Width, LONG Height)
     WindowBuffer.DIBInfo.bmiHeader.biBitCount    = 32;
     WindowBuffer.DIBInfo.bmiHeader.biCompression = BI_RGB;
 
-    // TODO(ingar): Should this memory be used for this?
-    WindowBuffer.Mem = Scn.Mem.Session;
+    // NOTE(ingar): The buffer used to live at the start of the session memory, which is where scn's session arena
+    // starts as well
+    if(WindowBuffer.Mem)
+    {
+        VirtualFree(WindowBuffer.Mem, 0, MEM_RELEASE);
+        WindowBuffer.Mem = NULL;
+    }
+
+    // NOTE(ingar): scn draws into this when it draws below the resolution of the window and scales the result up into
+    // the back buffer, so it never needs more than the back buffer does
+    if(Scn.Mem.Render)
+    {
+        VirtualFree(Scn.Mem.Render, 0, MEM_RELEASE);
+        Scn.Mem.Render        = NULL;
+        Scn.Mem.RenderMemSize = 0;
+    }
+
+    SIZE_T BufferSize = (SIZE_T)Width * (SIZE_T)Height * (SIZE_T)WindowBuffer.BytesPerPixel;
+    if(BufferSize)
+    {
+        WindowBuffer.Mem = VirtualAlloc(NULL, BufferSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        Scn.Mem.Render   = VirtualAlloc(NULL, BufferSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if(Scn.Mem.Render)
+        {
+            Scn.Mem.RenderMemSize = BufferSize;
+        }
+    }
 }
 
 // TODO(ingar): I'm a bit confused as to why the window dimensions are passed in. They seem to be the same as the
 // WindowBuffer dimensions, so them being parameter might be artifacts from Casey's implementation.
-isa_internal void
-Win32UpdateWindow(HDC DeviceContext, LONG Width, LONG Height)
+// NOTE(ingar): The back buffer is only presented if scn redrew it, unless the window contents were lost (WM_PAINT)
+isa_internal scn_update_result
+Win32UpdateWindow(HDC DeviceContext, LONG Width, LONG Height, bool ForcePresent)
 {
     // NOTE(ingar): A back buffer is a subset of offscreen buffers that is specifically
     // meant to hold the next frame to be displayed, which is appropriate in this circumstance
@@ -317,21 +533,27 @@ Win32UpdateWindow(HDC DeviceContext, LONG Width, LONG Height)
 
     BackBuffer.Mem           = WindowBuffer.Mem;
     BackBuffer.BytesPerPixel = WindowBuffer.BytesPerPixel;
+    BackBuffer.Format        = ScnPixelFormat_Bgra8;
+    BackBuffer.PixelSize     = 1.0f;
 
-    Scn.UpdateBackBuffer(&Scn.Mem, BackBuffer);
+    scn_update_result Result = Scn.UpdateBackBuffer(&Scn.Mem, BackBuffer, Win32GetTimeUs());
+    if(Scn.Mem.BoardLost)
+    {
+        /* scn started over with an empty state, and the board is drawn again once it has been loaded into it */
+        Scn.Mem.BoardLost = false;
+        Win32LoadPortableBoard();
+        Result = Scn.UpdateBackBuffer(&Scn.Mem, BackBuffer, Win32GetTimeUs());
+    }
 
-    StretchDIBits(DeviceContext, 0, 0, Width, Height, 0, 0, WindowBuffer.Width, WindowBuffer.Height, WindowBuffer.Mem,
-                  &WindowBuffer.DIBInfo, DIB_RGB_COLORS, SRCCOPY);
-}
+    Win32WakeImageDecoder(&Win32.ImageDecoder);
 
-VOID CALLBACK
-Win32RedrawWindowTimer(HWND Window, UINT Message, UINT_PTR TimerId, DWORD Time)
-{
-    //    OmsDebugPrint("Entered redraw timer\n");
-    HDC               DeviceContext    = GetDC(Window);
-    win32_window_dims WindowDimensions = Win32GetWindowDimensions(Window);
-    Win32UpdateWindow(DeviceContext, WindowDimensions.Width, WindowDimensions.Height);
-    ReleaseDC(Window, DeviceContext);
+    if(Result.Redrawn || ForcePresent)
+    {
+        StretchDIBits(DeviceContext, 0, 0, Width, Height, 0, 0, WindowBuffer.Width, WindowBuffer.Height,
+                      WindowBuffer.Mem, &WindowBuffer.DIBInfo, DIB_RGB_COLORS, SRCCOPY);
+    }
+
+    return Result;
 }
 
 isa_internal enum scn_mouse_event_type
@@ -447,6 +669,23 @@ MapVirtualKeyToScnEvent(WPARAM wParam)
             return ScnKeyboardEvent_Tab;
         case VK_RETURN:
             return ScnKeyboardEvent_Enter;
+        case VK_ESCAPE:
+            return ScnKeyboardEvent_Escape;
+        case VK_DELETE:
+            return ScnKeyboardEvent_Delete;
+
+        case VK_LEFT:
+            return ScnKeyboardEvent_Left;
+        case VK_RIGHT:
+            return ScnKeyboardEvent_Right;
+        case VK_UP:
+            return ScnKeyboardEvent_Up;
+        case VK_DOWN:
+            return ScnKeyboardEvent_Down;
+        case VK_HOME:
+            return ScnKeyboardEvent_Home;
+        case VK_END:
+            return ScnKeyboardEvent_End;
 
         default:
             return ScnKeyboardEvent_Unhandled;
@@ -487,13 +726,31 @@ Win32MainWindowCallback(HWND Window, UINT SystemMessage, WPARAM WParams, LPARAM
         case WM_RBUTTONUP:
         case WM_MOUSEMOVE:
             {
-                scn_mouse_event Event;
-                Event.Type = WmToMouseEventType(SystemMessage);
-                Event.x    = LOWORD(LParams);
-                Event.y    = HIWORD(LParams);
-                Scn.RespondToMouse(&Scn.Mem, Event);
+                scn_input_event Event = {};
+                Event.Type            = ScnInputEvent_Mouse;
+                Event.Mouse.Type      = WmToMouseEventType(SystemMessage);
+                Event.Mouse.x         = LOWORD(LParams);
+                Event.Mouse.y         = HIWORD(LParams);
+                Win32PushInputEvent(&Event);
             }
             break;
+        case WM_DROPFILES:
+            {
+                Win32PushDroppedFiles((HDROP)WParams);
+            }
+            break;
+
+        case WM_IMAGE_DECODED:
+            {
+                scn_input_event Event  = {};
+                Event.Type             = ScnInputEvent_ImageDecoded;
+                Event.ImageDecoded.Job = (u64)WParams;
+                Event.ImageDecoded.w   = LOWORD(LParams);
+                Event.ImageDecoded.h   = HIWORD(LParams);
+                Win32PushInputEvent(&Event);
+            }
+            break;
+
         case WM_COMMAND:
             {
                 switch(LOWORD(WParams))
@@ -564,7 +821,7 @@ Win32MainWindowCallback(HWND Window, UINT SystemMessage, WPARAM WParams, LPARAM
                 HDC         PaintContext = BeginPaint(Window, &Paint);
 
                 win32_window_dims Dimensions = Win32GetWindowDimensions(Window);
-                Win32UpdateWindow(PaintContext, Dimensions.Width, Dimensions.Height);
+                Win32UpdateWindow(PaintContext, Dimensions.Width, Dimensions.Height, true);
                 EndPaint(Window, &Paint);
             }
             break;
@@ -572,9 +829,18 @@ Win32MainWindowCallback(HWND Window, UINT SystemMessage, WPARAM WParams, LPARAM
         case WM_HOTKEY:
         case WM_KEYDOWN:
             {
-                scn_keyboard_event_type Type  = MapVirtualKeyToScnEvent(WParams);
-                scn_keyboard_event      Event = { Type };
-                Scn.RespondToKeyboard(&Scn.Mem, Event);
+                scn_input_event Event  = {};
+                Event.Type             = ScnInputEvent_Keyboard;
+                Event.Keyboard.Type    = MapVirtualKeyToScnEvent(WParams);
+                Event.Keyboard.Shift   = (GetKeyState(VK_SHIFT) & 0x8000) != 0;
+                Event.Keyboard.Control = (GetKeyState(VK_CONTROL) & 0x8000) != 0;
+                Win32PushInputEvent(&Event);
+            }
+            break;
+
+        case WM_CHAR:
+            {
+                Win32PushCharEvent(Window, WParams);
             }
             break;
 
@@ -631,7 +897,7 @@ WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR CommandLineString, int
     int WindowHeight = 1000;
 
     HWND Window = {};
-    Window      = CreateWindowEx(0, WindowClass.lpszClassName, TEXT("StickCNote"),
+    Window      = CreateWindowEx(WS_EX_ACCEPTFILES, WindowClass.lpszClassName, TEXT("StickCNote"),
                                  WS_OVERLAPPEDWINDOW | WS_VISIBLE, // Comment out WS_VISIBLE to start in minimized mode
                                  CW_USEDEFAULT, CW_USEDEFAULT, WindowWidth, WindowHeight, 0, 0, Instance, 0);
 
@@ -645,6 +911,9 @@ WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR CommandLineString, int
 
     AppendToEXEFilePathTchar(APP_DLL_NAME_TEXT, Scn.DllName, MAX_PATH);
     AppendToEXEFilePathTchar(APP_DLL_TEMP_NAME_TEXT, Scn.TempDllName, MAX_PATH);
+    AppendToEXEFilePathTchar(SCN_IMAGE_NAME_TEXT, Scn.ImageName, MAX_PATH);
+    AppendToEXEFilePathTchar(SCN_IMAGE_TEMP_NAME_TEXT, Scn.TempImageName, MAX_PATH);
+    AppendToEXEFilePathTchar(SCN_BOARD_NAME_TEXT, Scn.BoardName, MAX_PATH);
 
 #ifndef NAPP_DEBUG
     LPVOID BaseAddressPermanentMem = (LPVOID)IsaTeraByte(1);
@@ -654,9 +923,15 @@ WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR CommandLineString, int
     LPVOID BaseAddressWorkMem      = 0;
 #endif
 
+    Scn.PermanentBaseAddress = BaseAddressPermanentMem;
     Scn.Mem.PermanentMemSize = IsaMegaByte(64);
-    Scn.Mem.Permanent
-        = VirtualAlloc(BaseAddressPermanentMem, Scn.Mem.PermanentMemSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+
+    bool RestoredImage = Win32MapBoardImage(Scn.ImageName, BaseAddressPermanentMem, &Scn.Mem, &Scn.BoardImage);
+    if(!RestoredImage)
+    {
+        Scn.Mem.Permanent = VirtualAlloc(BaseAddressPermanentMem, Scn.Mem.PermanentMemSize, MEM_RESERVE | MEM_COMMIT,
+                                         PAGE_READWRITE);
+    }
 
     Scn.Mem.SessionMemSize = IsaMegaByte(128);
     Scn.Mem.Session
@@ -668,51 +943,97 @@ WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR CommandLineString, int
         return FALSE;
     }
 
-    bool Succeded = Win32LoadScnCode();
-    if(!Succeded)
+    // NOTE(ingar): Decoded images are cached in this, and notes are drawn without their images if it is missing
+    Scn.Mem.ImageMemSize = WIN32_IMAGE_MEM_SIZE;
+    Scn.Mem.ImageMem     = VirtualAlloc(NULL, Scn.Mem.ImageMemSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if(!Scn.Mem.ImageMem)
     {
-        return FALSE;
+        PrintLastError(TEXT("VirtualAlloc"));
+        Scn.Mem.ImageMemSize = 0;
     }
+    Win32StartImageDecoder(&Win32.ImageDecoder, &Scn.Mem, Window, WM_IMAGE_DECODED);
+
+    LARGE_INTEGER PerfCountFrequency;
+    QueryPerformanceFrequency(&PerfCountFrequency);
+    Scn.PerfCountFrequency = PerfCountFrequency.QuadPart;
 
-    UINT_PTR ScnCodeTimerId = SetTimer(Window, 1, 50, &Win32UpdateScnCodeTimer);
-    if(!ScnCodeTimerId)
+    bool Succeded = Win32LoadScnCode();
+    if(!Succeded)
     {
-        PrintLastError(TEXT("SetTimer"));
         return FALSE;
     }
 
-    UINT_PTR RedrawWindowTimer = SetTimer(Window, 2, 16, &Win32RedrawWindowTimer);
-    if(!RedrawWindowTimer)
+    if(!RestoredImage)
     {
-        PrintLastError(TEXT("SetTimer"));
-        return FALSE;
+        Win32LoadPortableBoard();
     }
 
-    // NOTE(Ingar): We need to call this here because the WM_SIZE message is posted before the above
-    // memory allocation which meaans GlobalBackbuffer's memory's address is 0
-    win32_window_dims WindowDimensions = Win32GetWindowDimensions(Window);
-    Win32ResizeDibSection(WindowDimensions.Width, WindowDimensions.Height);
+    Win32WatchFiles();
 
     LARGE_INTEGER PerformanceCounter;
     QueryPerformanceCounter(&PerformanceCounter);
     Scn.SeedRandPcg(PerformanceCounter.LowPart);
 
-    MSG  Message    = {};
-    BOOL MessageRet = 1;
+    // NOTE(ingar): The window class has CS_OWNDC, so the DC is private to the window and can be kept for its lifetime
+    HDC DeviceContext = GetDC(Window);
+
+    MSG Message      = {};
+    u64 NextWakeUpUs = SCN_NO_DEADLINE;
+    u64 LastUpdateUs = 0;
 
-    while((MessageRet = GetMessage(&Message, NULL, 0, 0)) != 0)
+    // NOTE(ingar): The thread sleeps until a message arrives, a watched file changes or scn's deadline passes, so an
+    // idle window does no work.
+    // Updates are rate limited so that a burst of input is handled as one frame instead of one frame per message.
+    for(;;)
     {
-        if(MessageRet == -1)
+        win32_file_watcher *Watcher  = &Win32.FileWatcher;
+        u64                 WakeUpUs = Win32NextWatchDeadline(Watcher, NextWakeUpUs);
+
+        DWORD Timeout = INFINITE;
+        if(WakeUpUs != SCN_NO_DEADLINE)
         {
-            PrintLastError(TEXT("GetMessage"));
-            return (int)Message.wParam;
+            u64 Now = Win32GetTimeUs();
+            Timeout = (WakeUpUs > Now) ? (DWORD)((WakeUpUs - Now + 999) / 1000) : 0;
         }
-        else
+
+        DWORD WaitResult = MsgWaitForMultipleObjectsEx((DWORD)Watcher->DirCount, Watcher->Events, Timeout,
+                                                       QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+        if(WaitResult == WAIT_FAILED)
+        {
+            PrintLastError(TEXT("MsgWaitForMultipleObjectsEx"));
+            return FALSE;
+        }
+
+        if(WaitResult >= WAIT_OBJECT_0 && WaitResult < (WAIT_OBJECT_0 + Watcher->DirCount))
+        {
+            Win32HandleDirChange(Watcher, WaitResult - WAIT_OBJECT_0, Win32GetTimeUs());
+        }
+        Win32ReloadChangedFiles(Win32GetTimeUs());
+
+        while(PeekMessage(&Message, NULL, 0, 0, PM_REMOVE))
         {
+            if(Message.message == WM_QUIT)
+            {
+                Win32SaveBoard();
+                return (int)Message.wParam;
+            }
+
             TranslateMessage(&Message);
             DispatchMessage(&Message);
         }
-    }
 
-    return (int)Message.wParam;
+        u64 Now = Win32GetTimeUs();
+        if((Now - LastUpdateUs) < WIN32_MIN_FRAME_TIME_US)
+        {
+            u64 FrameDeadline = LastUpdateUs + WIN32_MIN_FRAME_TIME_US;
+            NextWakeUpUs      = (FrameDeadline < NextWakeUpUs) ? FrameDeadline : NextWakeUpUs;
+            continue;
+        }
+
+        win32_window_dims Dimensions = Win32GetWindowDimensions(Window);
+        scn_update_result Result     = Win32UpdateWindow(DeviceContext, Dimensions.Width, Dimensions.Height, false);
+
+        LastUpdateUs = Now;
+        NextWakeUpUs = Result.NextWakeUpUs;
+    }
 }
@@ -0,0 +1,282 @@
+/*
+ * Copyright 2024 (c) by Ingar Solveigson Asheim. All Rights Reserved.
+ */
+#ifndef WIN32_SNAPSHOT_H_
+#define WIN32_SNAPSHOT_H_
+
+#include "../isa.h"
+#include "../scn.h"
+#include "win32_utils.h"
+
+#include <windows.h>
+
+/* NOTE(ingar): Snapshot images of the permanent memory
+ *
+ * The permanent memory is always placed at the same base address, so the pointers inside it stay valid across runs.
+ * At exit the used part of it is written to disk as is, and at startup it is mapped copy-on-write back at the same
+ * address, so the board is there without being rebuilt. The data starts one allocation granule into the file so that
+ * the view can be mapped directly from the file offset, and it is padded to a whole number of granules so that the
+ * rest of the permanent memory can be allocated right after the view.
+ */
+
+#define WIN32_IMAGE_MAGIC       0x474d494e4353ULL // "SCNIMG"
+#define WIN32_IMAGE_VERSION     1
+#define WIN32_IMAGE_HEADER_SIZE IsaKiloByte(64)
+
+struct win32_image_header
+{
+    u64 Magic;
+    u32 Version;
+
+    u32 StateVersion;
+    u64 StateSchemaHash;
+
+    u64 BaseAddress;
+    u64 PermanentMemSize;
+    u64 ImageSize;
+    u64 Checksum;
+};
+
+// NOTE(ingar): Handles that have to stay open for as long as the image is mapped
+struct win32_board_image
+{
+    HANDLE File;
+    HANDLE Mapping;
+    void  *View;
+};
+
+isa_internal u64
+Win32ChecksumImage(void *Data, u64 Size)
+{
+    u64 *Words = (u64 *)Data;
+    u64  Count = Size / sizeof(u64);
+
+    u64 Hash = 0x9E3779B97F4A7C15ULL ^ Size;
+    for(u64 i = 0; i < Count; ++i)
+    {
+        Hash ^= Words[i];
+        Hash *= 0xFF51AFD7ED558CCDULL;
+        Hash ^= Hash >> 32;
+    }
+
+    return Hash;
+}
+
+isa_internal u64
+Win32AllocationGranularity(void)
+{
+    SYSTEM_INFO Info;
+    GetSystemInfo(&Info);
+    return Info.dwAllocationGranularity;
+}
+
+isa_internal void
+Win32ReleaseBoardImage(win32_board_image *Image)
+{
+    if(Image->View)
+    {
+        UnmapViewOfFile(Image->View);
+    }
+    if(Image->Mapping)
+    {
+        CloseHandle(Image->Mapping);
+    }
+    if(Image->File && Image->File != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(Image->File);
+    }
+
+    memset(Image, 0, sizeof(*Image));
+}
+
+// NOTE(ingar): On success Mem->Permanent points to the restored state, with the rest of the permanent memory
+// allocated after it. Fails if there is no image, it is corrupt, or it cannot be placed at BaseAddress.
+isa_internal bool
+Win32MapBoardImage(const TCHAR *Path, void *BaseAddress, scn_mem *Mem, win32_board_image *Image)
+{
+    u64 Granularity = Win32AllocationGranularity();
+    if(!BaseAddress || (WIN32_IMAGE_HEADER_SIZE % Granularity) != 0)
+    {
+        return false;
+    }
+
+    Image->File = CreateFile(Path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(Image->File == INVALID_HANDLE_VALUE)
+    {
+        Image->File = NULL;
+        return false;
+    }
+
+    win32_image_header Header    = {};
+    DWORD              BytesRead = 0;
+    if(!ReadFile(Image->File, &Header, sizeof(Header), &BytesRead, NULL) || BytesRead != sizeof(Header))
+    {
+        Win32ReleaseBoardImage(Image);
+        return false;
+    }
+
+    if(Header.Magic != WIN32_IMAGE_MAGIC || Header.Version != WIN32_IMAGE_VERSION
+       || Header.BaseAddress != (u64)BaseAddress || Header.PermanentMemSize != Mem->PermanentMemSize
+       || Header.ImageSize == 0 || Header.ImageSize > Header.PermanentMemSize || (Header.ImageSize % Granularity) != 0)
+    {
+        DebugPrint("Board image does not match this build\n");
+        Win32ReleaseBoardImage(Image);
+        return false;
+    }
+
+    Image->Mapping = CreateFileMapping(Image->File, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if(!Image->Mapping)
+    {
+        PrintLastError(TEXT("CreateFileMapping"));
+        Win32ReleaseBoardImage(Image);
+        return false;
+    }
+
+    Image->View = MapViewOfFileEx(Image->Mapping, FILE_MAP_COPY, 0, (DWORD)WIN32_IMAGE_HEADER_SIZE,
+                                  (SIZE_T)Header.ImageSize, BaseAddress);
+    if(!Image->View)
+    {
+        PrintLastError(TEXT("MapViewOfFileEx"));
+        Win32ReleaseBoardImage(Image);
+        return false;
+    }
+
+    if(Win32ChecksumImage(Image->View, Header.ImageSize) != Header.Checksum)
+    {
+        DebugPrint("Board image checksum mismatch\n");
+        Win32ReleaseBoardImage(Image);
+        return false;
+    }
+
+    u64 RestSize = Mem->PermanentMemSize - Header.ImageSize;
+    if(RestSize)
+    {
+        void *Rest = VirtualAlloc((u8 *)BaseAddress + Header.ImageSize, RestSize, MEM_RESERVE | MEM_COMMIT,
+                                  PAGE_READWRITE);
+        if(!Rest)
+        {
+            PrintLastError(TEXT("VirtualAlloc"));
+            Win32ReleaseBoardImage(Image);
+            return false;
+        }
+    }
+
+    Mem->Permanent       = BaseAddress;
+    Mem->PermanentUsed   = Header.ImageSize;
+    Mem->StateVersion    = Header.StateVersion;
+    Mem->StateSchemaHash = Header.StateSchemaHash;
+    Mem->Initialized     = true;
+
+    return true;
+}
+
+isa_internal bool
+Win32WriteEntireFile(const TCHAR *Path, const void *Header, DWORD HeaderSize, const void *Data, u64 DataSize)
+{
+    HANDLE File = CreateFile(Path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(File == INVALID_HANDLE_VALUE)
+    {
+        PrintLastError(TEXT("CreateFile"));
+        return false;
+    }
+
+    bool  Success = true;
+    DWORD Written = 0;
+    if(HeaderSize)
+    {
+        Success = WriteFile(File, Header, HeaderSize, &Written, NULL) && Written == HeaderSize;
+    }
+
+    const u8 *At        = (const u8 *)Data;
+    u64       Remaining = DataSize;
+    while(Success && Remaining)
+    {
+        DWORD Chunk = (Remaining > IsaMegaByte(64)) ? (DWORD)IsaMegaByte(64) : (DWORD)Remaining;
+        Success     = WriteFile(File, At, Chunk, &Written, NULL) && Written == Chunk;
+        At += Chunk;
+        Remaining -= Chunk;
+    }
+
+    if(!Success)
+    {
+        PrintLastError(TEXT("WriteFile"));
+    }
+
+    CloseHandle(File);
+    return Success;
+}
+
+// NOTE(ingar): The caller frees the result with VirtualFree
+isa_internal void *
+Win32ReadEntireFile(const TCHAR *Path, u64 *Size)
+{
+    HANDLE File = CreateFile(Path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(File == INVALID_HANDLE_VALUE)
+    {
+        return NULL;
+    }
+
+    LARGE_INTEGER FileSize;
+    void         *Data = NULL;
+    if(GetFileSizeEx(File, &FileSize) && FileSize.QuadPart > 0 && FileSize.QuadPart < (LONGLONG)IsaGigaByte(1))
+    {
+        Data = VirtualAlloc(NULL, (SIZE_T)FileSize.QuadPart, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+
+        DWORD BytesRead = 0;
+        if(Data && !(ReadFile(File, Data, (DWORD)FileSize.QuadPart, &BytesRead, NULL)
+                     && BytesRead == (DWORD)FileSize.QuadPart))
+        {
+            VirtualFree(Data, 0, MEM_RELEASE);
+            Data = NULL;
+        }
+        *Size = (u64)FileSize.QuadPart;
+    }
+
+    CloseHandle(File);
+    return Data;
+}
+
+// NOTE(ingar): The image is written to a temporary file first since the current one may still be mapped. Any mapped
+// image is released before the temporary file replaces it, so Mem->Permanent must not be used after this returns.
+isa_internal bool
+Win32SaveBoardImage(const TCHAR *Path, const TCHAR *TempPath, void *BaseAddress, scn_mem *Mem,
+                    win32_board_image *Image)
+{
+    if(!BaseAddress || Mem->Permanent != BaseAddress || !Mem->Initialized)
+    {
+        return false;
+    }
+
+    u64 Granularity = Win32AllocationGranularity();
+    u64 ImageSize   = ((Mem->PermanentUsed + Granularity - 1) / Granularity) * Granularity;
+    ImageSize       = (ImageSize > Mem->PermanentMemSize) ? Mem->PermanentMemSize : ImageSize;
+
+    static u8           HeaderPage[WIN32_IMAGE_HEADER_SIZE];
+    win32_image_header *Header = (win32_image_header *)HeaderPage;
+    Header->Magic              = WIN32_IMAGE_MAGIC;
+    Header->Version            = WIN32_IMAGE_VERSION;
+    Header->StateVersion       = Mem->StateVersion;
+    Header->StateSchemaHash    = Mem->StateSchemaHash;
+    Header->BaseAddress        = (u64)BaseAddress;
+    Header->PermanentMemSize   = Mem->PermanentMemSize;
+    Header->ImageSize          = ImageSize;
+    Header->Checksum           = Win32ChecksumImage(Mem->Permanent, ImageSize);
+
+    bool Written = Win32WriteEntireFile(TempPath, HeaderPage, sizeof(HeaderPage), Mem->Permanent, ImageSize);
+    Win32ReleaseBoardImage(Image);
+
+    if(!Written)
+    {
+        return false;
+    }
+
+    if(!MoveFileEx(TempPath, Path, MOVEFILE_REPLACE_EXISTING))
+    {
+        PrintLastError(TEXT("MoveFileEx"));
+        return false;
+    }
+
+    return true;
+}
+
+#endif // WIN32_SNAPSHOT_H_